@@ -0,0 +1,86 @@
+/* Micro benchmark for the one's complement word sum used by the TCP/UDP
+ * checksum calculation, comparing the scalar and SIMD implementations
+ * across packet sizes.
+ *
+ * Build from a configured source tree:
+ *
+ *   gcc -O2 -DHAVE_CONFIG_H -I../src -o checksum checksum.c \
+ *       ../src/util-checksum-simd.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "util-checksum-simd.h"
+
+#define ROUNDS_BYTES (1024UL * 1024UL * 1024UL) /* sum ~1GB per size */
+
+static const uint32_t sizes[] = { 64, 128, 256, 512, 1024, 1460, 4096, 9000, 65534 };
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int main() {
+    uint8_t *buf = malloc(65536 + 2);
+    uint32_t i, s;
+    int impl;
+
+    if (buf == NULL)
+        exit(1);
+
+    srandom(0);
+    for (i = 0; i < 65536 + 2; i++)
+        buf[i] = (uint8_t)random();
+
+    printf("%8s", "size");
+    for (impl = 0; impl < CHECKSUM_IMPL_MAX; impl++)
+        printf(" %14s", ChecksumSimdImplName(impl));
+    printf("   (ns/packet)\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t size = sizes[s];
+        unsigned long rounds = ROUNDS_BYTES / size;
+        uint32_t expected = ChecksumSimdGetFunc(CHECKSUM_IMPL_SCALAR)(
+                (uint16_t *)buf, size);
+
+        printf("%8u", size);
+        for (impl = 0; impl < CHECKSUM_IMPL_MAX; impl++) {
+            ChecksumSumWordsFunc Func = ChecksumSimdGetFunc(impl);
+            if (Func == NULL) {
+                printf(" %14s", "n/a");
+                continue;
+            }
+
+            /* use an odd word offset so the loads are unaligned, as they
+             * are for the payload of a real packet */
+            const uint16_t *pkt = (const uint16_t *)(buf + 2);
+            volatile uint32_t sink = 0;
+            unsigned long r;
+
+            double start = now();
+            for (r = 0; r < rounds; r++)
+                sink += Func(pkt, size);
+            double elapsed = now() - start;
+
+            if (Func((const uint16_t *)buf, size) != expected) {
+                printf("\n%s: result mismatch for size %u\n",
+                        ChecksumSimdImplName(impl), size);
+                exit(1);
+            }
+            (void)sink;
+
+            printf(" %14.1f", elapsed * 1000000000.0 / rounds);
+        }
+        printf("\n");
+    }
+
+    free(buf);
+    exit(0);
+}
@@ -472,6 +472,12 @@ static OutputCtx *AlertDebugLogInitCtx(ConfNode *conf)
     if (SCConfLogOpenGeneric(conf, file_ctx, DEFAULT_LOG_FILENAME) < 0) {
         goto error;
     }
+    /* records are written to the fp directly */
+    if (file_ctx->compress != NULL) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "alert debug log doesn't "
+                "support compression");
+        goto error;
+    }
     OutputRegisterFileRotationFlag(&file_ctx->rotation_flag);
 
     OutputCtx *output_ctx = SCMalloc(sizeof(OutputCtx));
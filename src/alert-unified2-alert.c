@@ -69,6 +69,8 @@
 #include "util-optimize.h"
 
 #include "util-memrchr.h"
+#include "util-buffer.h"
+#include "util-logopenfile-async.h"
 
 #ifndef IPPROTO_SCTP
 #define IPPROTO_SCTP 132
@@ -79,6 +81,10 @@
 /**< Default log file limit in MB. */
 #define DEFAULT_LIMIT 32 * 1024 * 1024
 
+/** Size of the per thread record batch in async mode. Needs to hold
+ *  at least one record (Unified2AlertThread::datalen). */
+#define UNIFIED2_BATCH_SIZE (128 * 1024)
+
 /**< Minimum log file limit in MB. */
 #define MIN_LIMIT 1 * 1024 * 1024
 
@@ -227,6 +233,13 @@ typedef struct Unified2AlertThread_ {
     uint8_t xff_flags; /**< XFF flags for the current alert */
     uint32_t xff_ip[4]; /**< The XFF reported IP address for the current alert */
     uint32_t event_id;
+    /** async mode: records of the current packet, handed to the
+     *  writer thread in one go. NULL if records are written directly. */
+    MemBuffer *batch;
+    uint32_t batch_alerts; /**< alerts that have all their records in batch */
+    uint8_t alert_dropped; /**< records of the current alert were dropped */
+    uint64_t alerts; /**< alerts written by this thread */
+    uint64_t alerts_dropped; /**< alerts dropped by the async writer */
 } Unified2AlertThread;
 
 #define UNIFIED2_PACKET_SIZE        (sizeof(Unified2Packet) - 4)
@@ -281,6 +294,30 @@ int Unified2AlertCloseFile(ThreadVars *t, Unified2AlertThread *aun)
     return 0;
 }
 
+/**
+ *  \brief Rotate callback for the async writer thread
+ *
+ *  Called between two write batches, so no lock is needed.
+ *
+ *  \retval 0 on succces
+ *  \retval -1 on failure
+ */
+static int Unified2AlertRotateFileCtx(LogFileCtx *file_ctx)
+{
+    if (file_ctx->fp != NULL) {
+        fclose(file_ctx->fp);
+        file_ctx->fp = NULL;
+    }
+    file_ctx->size_current = 0;
+
+    if (Unified2AlertOpenFileCtx(file_ctx, file_ctx->prefix) < 0) {
+        SCLogError(SC_ERR_UNIFIED2_ALERT_GENERIC,
+                   "Error: Unified2AlertOpenFileCtx, open new log file failed");
+        return -1;
+    }
+    return 0;
+}
+
 /**
  *  \brief Function to rotate unified2 file
  *
@@ -306,6 +343,90 @@ int Unified2AlertRotateFile(ThreadVars *t, Unified2AlertThread *aun)
     return 0;
 }
 
+/**
+ * \brief Hand the batched records to the async writer
+ *
+ * The records of a packet are passed as one buffer, so they end up
+ * next to each other in the same file. The writer drops the buffer if
+ * its ring is full, the alerts in it are then counted as dropped.
+ *
+ * \retval 0 records queued
+ * \retval -1 records dropped
+ */
+static int Unified2BatchFlush(Unified2AlertThread *aun)
+{
+    if (MEMBUFFER_OFFSET(aun->batch) == 0)
+        return 0;
+
+    LogFileCtx *file_ctx = aun->unified2alert_ctx->file_ctx;
+    int r = file_ctx->Write((const char *)MEMBUFFER_BUFFER(aun->batch),
+            MEMBUFFER_OFFSET(aun->batch), file_ctx);
+    if (r > 0)
+        aun->alerts += aun->batch_alerts;
+    else
+        aun->alerts_dropped += aun->batch_alerts;
+    aun->batch_alerts = 0;
+    MemBufferReset(aun->batch);
+
+    return (r > 0) ? 0 : -1;
+}
+
+/**
+ * \brief Account an alert once all its records are written
+ *
+ * In async mode it's counted when its batch is accepted by the writer.
+ */
+static void Unified2AlertWritten(Unified2AlertThread *aun)
+{
+    if (aun->batch == NULL) {
+        aun->alerts++;
+    } else if (aun->alert_dropped) {
+        /* a batch holding its first records was dropped */
+        aun->alerts_dropped++;
+        aun->alert_dropped = 0;
+    } else {
+        aun->batch_alerts++;
+    }
+}
+
+/**
+ * \brief Take the file lock and rotate the file if the record doesn't fit
+ *
+ * No-op in async mode, where the writer thread owns the file.
+ *
+ * \retval 0 on succces
+ * \retval -1 on failure, lock is released
+ */
+static int Unified2AlertLock(ThreadVars *t, Unified2AlertThread *aun, int length)
+{
+    LogFileCtx *file_ctx = aun->unified2alert_ctx->file_ctx;
+    if (aun->batch != NULL)
+        return 0;
+
+    SCMutexLock(&file_ctx->fp_mutex);
+    if ((file_ctx->size_current + length) > file_ctx->size_limit) {
+        if (Unified2AlertRotateFile(t, aun) < 0) {
+            SCMutexUnlock(&file_ctx->fp_mutex);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Release the file lock, flushing the file if requested
+ */
+static void Unified2AlertUnlock(Unified2AlertThread *aun, int flush)
+{
+    LogFileCtx *file_ctx = aun->unified2alert_ctx->file_ctx;
+    if (aun->batch != NULL)
+        return;
+
+    if (flush)
+        fflush(file_ctx->fp);
+    SCMutexUnlock(&file_ctx->fp_mutex);
+}
+
 /**
  * \brief Wrapper for fwrite
  *
@@ -318,6 +439,18 @@ static int Unified2Write(Unified2AlertThread *aun)
 {
     int ret;
 
+    if (aun->batch != NULL) {
+        /* async mode: collect the records, the writer thread tracks the
+         * file size */
+        if (MEMBUFFER_OFFSET(aun->batch) + (uint32_t)aun->length > aun->batch->size) {
+            if (Unified2BatchFlush(aun) < 0)
+                aun->alert_dropped = 1;
+        }
+        memcpy(aun->batch->buffer + aun->batch->offset, aun->data, aun->length);
+        aun->batch->offset += aun->length;
+        return 1;
+    }
+
     ret = fwrite(aun->data, aun->length, 1, aun->unified2alert_ctx->file_ctx->fp);
     if (ret != 1) {
         SCLogError(SC_ERR_FWRITE, "Error: fwrite failed: %s", strerror(errno));
@@ -467,6 +600,12 @@ int Unified2Logger(ThreadVars *t, void *data, const Packet *p)
         return TM_ECODE_OK;
     }
 
+    /* also pass on the records written before an error */
+    if (aun->batch != NULL) {
+        (void) Unified2BatchFlush(aun);
+        aun->alert_dropped = 0;
+    }
+
     if (ret != 0) {
         return TM_ECODE_FAILED;
     }
@@ -1026,19 +1165,14 @@ static int Unified2IPv6TypeAlert(ThreadVars *t, const Packet *p, void *data)
         phdr->classification_id = htonl(pa->s->class);
         phdr->priority_id = htonl(pa->s->prio);
 
-        SCMutexLock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
-        if ((aun->unified2alert_ctx->file_ctx->size_current + length) >
-              aun->unified2alert_ctx->file_ctx->size_limit) {
-            if (Unified2AlertRotateFile(t,aun) < 0) {
-                aun->unified2alert_ctx->file_ctx->alerts += i;
-                SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
-                return -1;
-            }
+        if (Unified2AlertLock(t, aun, length) < 0) {
+            aun->alerts += i;
+            return -1;
         }
 
         if (Unified2Write(aun) != 1) {
-            aun->unified2alert_ctx->file_ctx->alerts += i;
-            SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+            aun->alerts += i;
+            Unified2AlertUnlock(aun, 0);
             return -1;
         }
 
@@ -1052,13 +1186,12 @@ static int Unified2IPv6TypeAlert(ThreadVars *t, const Packet *p, void *data)
         ret = Unified2PacketTypeAlert(aun, p, phdr->event_id, stream);
         if (ret != 1) {
             SCLogError(SC_ERR_FWRITE, "Error: fwrite failed: %s", strerror(errno));
-            aun->unified2alert_ctx->file_ctx->alerts += i;
-            SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+            aun->alerts += i;
+            Unified2AlertUnlock(aun, 0);
             return -1;
         }
-        fflush(aun->unified2alert_ctx->file_ctx->fp);
-        aun->unified2alert_ctx->file_ctx->alerts++;
-        SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+        Unified2AlertWritten(aun);
+        Unified2AlertUnlock(aun, 1);
     }
 
     return 0;
@@ -1203,20 +1336,14 @@ static int Unified2IPv4TypeAlert (ThreadVars *tv, const Packet *p, void *data)
         phdr->priority_id = htonl(pa->s->prio);
 
         /* check and enforce the filesize limit */
-        SCMutexLock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
-
-        if ((aun->unified2alert_ctx->file_ctx->size_current + length) >
-              aun->unified2alert_ctx->file_ctx->size_limit) {
-            if (Unified2AlertRotateFile(tv,aun) < 0) {
-                aun->unified2alert_ctx->file_ctx->alerts += i;
-                SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
-                return -1;
-            }
+        if (Unified2AlertLock(tv, aun, length) < 0) {
+            aun->alerts += i;
+            return -1;
         }
 
         if (Unified2Write(aun) != 1) {
-            aun->unified2alert_ctx->file_ctx->alerts += i;
-            SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+            aun->alerts += i;
+            Unified2AlertUnlock(aun, 0);
             return -1;
         }
 
@@ -1225,20 +1352,20 @@ static int Unified2IPv4TypeAlert (ThreadVars *tv, const Packet *p, void *data)
         aun->offset = 0;
 
         /* Write the alert (it doesn't lock inside, since we
-         * already locked here for rotation check)
+         * already locked here for rotation check, or batches it
+         * in async mode)
          */
         int stream = (gphdr.protocol == IPPROTO_TCP) ?
             (pa->flags & (PACKET_ALERT_FLAG_STATE_MATCH|PACKET_ALERT_FLAG_STREAM_MATCH) ? 1 : 0) : 0;
         ret = Unified2PacketTypeAlert(aun, p, event_id, stream);
         if (ret != 1) {
-            aun->unified2alert_ctx->file_ctx->alerts += i;
-            SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+            aun->alerts += i;
+            Unified2AlertUnlock(aun, 0);
             return -1;
         }
 
-        fflush(aun->unified2alert_ctx->file_ctx->fp);
-        aun->unified2alert_ctx->file_ctx->alerts++;
-        SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+        Unified2AlertWritten(aun);
+        Unified2AlertUnlock(aun, 1);
     }
 
     return 0;
@@ -1278,6 +1405,16 @@ TmEcode Unified2AlertThreadInit(ThreadVars *t, void *initdata, void **data)
     aun->datalen = sizeof(Unified2AlertFileHeader) + sizeof(Unified2Packet) +
                     IPV4_MAXPACKET_LEN + sizeof(Unified2ExtraDataHdr) + sizeof(Unified2ExtraData);
 
+    if (aun->unified2alert_ctx->file_ctx->async != NULL) {
+        BUG_ON(aun->datalen > UNIFIED2_BATCH_SIZE);
+        aun->batch = MemBufferCreateNew(UNIFIED2_BATCH_SIZE);
+        if (aun->batch == NULL) {
+            SCFree(aun->data);
+            SCFree(aun);
+            return TM_ECODE_FAILED;
+        }
+    }
+
     *data = (void *)aun;
 
     return TM_ECODE_OK;
@@ -1299,15 +1436,16 @@ TmEcode Unified2AlertThreadDeinit(ThreadVars *t, void *data)
         goto error;
     }
 
-    if (!(aun->unified2alert_ctx->file_ctx->flags & LOGFILE_ALERTS_PRINTED)) {
-        SCLogInfo("Alert unified2 module wrote %"PRIu64" alerts",
-                aun->unified2alert_ctx->file_ctx->alerts);
-
-        /* Do not print it for each thread */
-        aun->unified2alert_ctx->file_ctx->flags |= LOGFILE_ALERTS_PRINTED;
+    /* printed in Unified2AlertDeInitCtx once all threads are done */
+    SCMutexLock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
+    aun->unified2alert_ctx->file_ctx->alerts += aun->alerts;
+    aun->unified2alert_ctx->file_ctx->alerts_dropped += aun->alerts_dropped;
+    SCMutexUnlock(&aun->unified2alert_ctx->file_ctx->fp_mutex);
 
+    if (aun->batch != NULL) {
+        MemBufferFree(aun->batch);
+        aun->batch = NULL;
     }
-
     if (aun->data != NULL) {
         SCFree(aun->data);
         aun->data = NULL;
@@ -1391,6 +1529,13 @@ OutputCtx *Unified2AlertInitCtx(ConfNode *conf)
     if (ret < 0)
         goto error;
 
+    /* async: threads batch their records and a writer thread writes
+     * and rotates the file */
+    if (LogFileAsyncSetup(conf, file_ctx) < 0)
+        exit(EXIT_FAILURE);
+    if (file_ctx->async != NULL)
+        file_ctx->Rotate = Unified2AlertRotateFileCtx;
+
     output_ctx = SCCalloc(1, sizeof(OutputCtx));
     if (unlikely(output_ctx == NULL))
         goto error;
@@ -1460,6 +1605,12 @@ static void Unified2AlertDeInitCtx(OutputCtx *output_ctx)
         if (unified2alert_ctx != NULL) {
             LogFileCtx *logfile_ctx = unified2alert_ctx->file_ctx;
             if (logfile_ctx != NULL) {
+                if (!(logfile_ctx->flags & LOGFILE_ALERTS_PRINTED)) {
+                    SCLogInfo("Alert unified2 module wrote %"PRIu64" alerts, "
+                            "dropped %"PRIu64, logfile_ctx->alerts,
+                            logfile_ctx->alerts_dropped);
+                    logfile_ctx->flags |= LOGFILE_ALERTS_PRINTED;
+                }
                 LogFileFreeCtx(logfile_ctx);
             }
             SCFree(unified2alert_ctx);
@@ -2045,6 +2196,82 @@ error:
         SCFree(filename);
     return r;
 }
+
+static int Unified2TestWriteAccept = 1;
+
+static int Unified2TestWrite(const char *buffer, int buffer_len, LogFileCtx *file_ctx)
+{
+    return Unified2TestWriteAccept;
+}
+
+/**
+ *  \test In async mode alerts are counted once their batch is accepted,
+ *        alerts of a batch the writer drops are counted as dropped.
+ */
+static int Unified2TestBatch01(void)
+{
+    int r = 0;
+    Unified2AlertThread aun;
+    Unified2AlertFileCtx uaf;
+    LogFileCtx lf;
+    uint8_t record[64];
+
+    memset(&aun, 0, sizeof(aun));
+    memset(&uaf, 0, sizeof(uaf));
+    memset(&lf, 0, sizeof(lf));
+    memset(record, 0x11, sizeof(record));
+
+    lf.Write = Unified2TestWrite;
+    uaf.file_ctx = &lf;
+    aun.unified2alert_ctx = &uaf;
+    aun.data = record;
+    aun.length = sizeof(record);
+    aun.batch = MemBufferCreateNew(sizeof(record) * 2);
+    if (aun.batch == NULL)
+        return 0;
+
+    /* two alerts, accepted */
+    Unified2TestWriteAccept = 1;
+    Unified2Write(&aun);
+    Unified2AlertWritten(&aun);
+    Unified2Write(&aun);
+    Unified2AlertWritten(&aun);
+    if (aun.alerts != 0) {
+        printf("alerts counted before the batch was handed over: ");
+        goto end;
+    }
+    Unified2BatchFlush(&aun);
+    if (aun.alerts != 2 || aun.alerts_dropped != 0) {
+        printf("expected 2/0 alerts, got %"PRIu64"/%"PRIu64": ",
+                aun.alerts, aun.alerts_dropped);
+        goto end;
+    }
+
+    /* an alert with records in a dropped batch and one in a dropped
+     * batch of its own */
+    Unified2TestWriteAccept = 0;
+    Unified2Write(&aun);
+    Unified2Write(&aun);
+    Unified2Write(&aun); /* flushes the full batch */
+    Unified2AlertWritten(&aun);
+    Unified2Write(&aun);
+    Unified2AlertWritten(&aun);
+    if (Unified2BatchFlush(&aun) != -1) {
+        printf("dropped batch not reported: ");
+        goto end;
+    }
+    if (aun.alerts != 2 || aun.alerts_dropped != 2) {
+        printf("expected 2/2 alerts, got %"PRIu64"/%"PRIu64": ",
+                aun.alerts, aun.alerts_dropped);
+        goto end;
+    }
+
+    r = 1;
+end:
+    MemBufferFree(aun.batch);
+    return r;
+}
+
 #endif
 
 /**
@@ -2060,5 +2287,6 @@ void Unified2RegisterTests(void)
     UtRegisterTest("Unified2Test04 -- PPP test", Unified2Test04, 1);
     UtRegisterTest("Unified2Test05 -- Inline test", Unified2Test05, 1);
     UtRegisterTest("Unified2TestRotate01 -- Rotate File", Unified2TestRotate01, 1);
+    UtRegisterTest("Unified2TestBatch01 -- Async batch accounting", Unified2TestBatch01, 1);
 #endif /* UNITTESTS */
 }
@@ -170,8 +170,13 @@ typedef struct DCERPCRequest_ {
     uint8_t *stub_data_buffer;
     /* length of the above buffer */
     uint32_t stub_data_buffer_len;
+    /* allocated size of the above buffer */
+    uint32_t stub_data_buffer_size;
     /* used by the dce preproc to indicate fresh entry in the stub data buffer */
     uint8_t stub_data_fresh;
+    /* stub data of the current PDU went over the max stub size, the rest
+     * of it is dropped */
+    uint8_t stub_data_too_large;
     uint8_t first_request_seen;
 } DCERPCRequest;
 
@@ -180,8 +185,13 @@ typedef struct DCERPCResponse_ {
     uint8_t *stub_data_buffer;
     /* length of the above buffer */
     uint32_t stub_data_buffer_len;
+    /* allocated size of the above buffer */
+    uint32_t stub_data_buffer_size;
     /* used by the dce preproc to indicate fresh entry in the stub data buffer */
     uint8_t stub_data_fresh;
+    /* stub data of the current PDU went over the max stub size, the rest
+     * of it is dropped */
+    uint8_t stub_data_too_large;
 } DCERPCResponse;
 
 typedef struct DCERPC_ {
@@ -196,6 +206,9 @@ typedef struct DCERPC_ {
     /* indicates if the dcerpc pdu state is in the middle of processing
      * a fragmented pdu */
     uint8_t pdu_fragged;
+    /* set when a stub data buffer hit the max stub size, the event is
+     * raised on the flow by DCERPCSetEvents */
+    uint8_t stub_data_too_large_event;
 } DCERPC;
 
 typedef struct DCERPCUDP_ {
@@ -238,7 +251,23 @@ typedef struct DCERPCUDP_ {
 #define USER_DATA_NOT_READABLE          6 /* not used */
 #define NO_PSAP_AVAILABLE               7 /* not used */
 
+/** initial allocation of a stub data buffer, it's doubled as fragments
+ *  are appended */
+#define DCERPC_STUB_DATA_INIT_SIZE      1024
+/** default max size of the stub data of a PDU, see "max-stub-size" */
+#define DCERPC_STUB_DATA_MAX_SIZE       (1024 * 1024)
+
+enum {
+    DCERPC_DECODER_EVENT_STUB_DATA_TOO_LARGE,
+};
+
 int32_t DCERPCParser(DCERPC *, uint8_t *, uint32_t);
+int DCERPCStubDataAppend(uint8_t **buffer, uint32_t *buffer_len,
+                         uint32_t *buffer_size, const uint8_t *data,
+                         uint32_t data_len);
+void DCERPCSetEvents(Flow *f, DCERPC *dcerpc);
+int DCERPCStateGetEventInfo(const char *event_name,
+                            int *event_id, AppLayerEventType *event_type);
 void hexdump(const void *buf, size_t len);
 void printUUID(char *type, DCERPCUuidEntry *uuid);
 
@@ -53,21 +53,26 @@ static uint32_t FragmentDataParser(Flow *f, void *dcerpcudp_state,
 	DCERPCUDPState *sstate = (DCERPCUDPState *) dcerpcudp_state;
     uint8_t **stub_data_buffer = NULL;
     uint32_t *stub_data_buffer_len = NULL;
+    uint32_t *stub_data_buffer_size = NULL;
     uint8_t *stub_data_fresh = NULL;
+    uint8_t *stub_data_too_large = NULL;
     uint16_t stub_len = 0;
-    void *ptmp;
 
     /* request PDU.  Retrieve the request stub buffer */
     if (sstate->dcerpc.dcerpchdrudp.type == REQUEST) {
         stub_data_buffer = &sstate->dcerpc.dcerpcrequest.stub_data_buffer;
         stub_data_buffer_len = &sstate->dcerpc.dcerpcrequest.stub_data_buffer_len;
+        stub_data_buffer_size = &sstate->dcerpc.dcerpcrequest.stub_data_buffer_size;
         stub_data_fresh = &sstate->dcerpc.dcerpcrequest.stub_data_fresh;
+        stub_data_too_large = &sstate->dcerpc.dcerpcrequest.stub_data_too_large;
 
     /* response PDU.  Retrieve the response stub buffer */
     } else {
         stub_data_buffer = &sstate->dcerpc.dcerpcresponse.stub_data_buffer;
         stub_data_buffer_len = &sstate->dcerpc.dcerpcresponse.stub_data_buffer_len;
+        stub_data_buffer_size = &sstate->dcerpc.dcerpcresponse.stub_data_buffer_size;
         stub_data_fresh = &sstate->dcerpc.dcerpcresponse.stub_data_fresh;
+        stub_data_too_large = &sstate->dcerpc.dcerpcresponse.stub_data_too_large;
     }
 
     stub_len = (sstate->dcerpc.fraglenleft < input_len) ? sstate->dcerpc.fraglenleft : input_len;
@@ -81,23 +86,27 @@ static uint32_t FragmentDataParser(Flow *f, void *dcerpcudp_state,
      * frags from a fresh request/response */
     if (sstate->dcerpc.dcerpchdrudp.flags1 & PFC_FIRST_FRAG) {
         *stub_data_buffer_len = 0;
+        *stub_data_too_large = 0;
     }
 
-    ptmp = SCRealloc(*stub_data_buffer, *stub_data_buffer_len + stub_len);
-    if (ptmp == NULL) {
-        SCFree(*stub_data_buffer);
-        *stub_data_buffer = NULL;
-        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+    /* over the max stub size the rest of the PDU is consumed but not
+     * buffered */
+    if (*stub_data_too_large)
+        goto consumed;
+
+    int r = DCERPCStubDataAppend(stub_data_buffer, stub_data_buffer_len,
+                                 stub_data_buffer_size, input, stub_len);
+    if (r < 0) {
         goto end;
+    } else if (r == 1) {
+        *stub_data_too_large = 1;
+        AppLayerDecoderEventsSetEvent(f, DCERPC_DECODER_EVENT_STUB_DATA_TOO_LARGE);
+        goto consumed;
     }
 
-    *stub_data_buffer = ptmp;
-    memcpy(*stub_data_buffer + *stub_data_buffer_len, input, stub_len);
-
     *stub_data_fresh = 1;
-    /* length of the buffered stub */
-    *stub_data_buffer_len += stub_len;
 
+consumed:
    sstate->dcerpc.fraglenleft -= stub_len;
    sstate->dcerpc.bytesprocessed += stub_len;
 
@@ -792,11 +801,13 @@ static void DCERPCUDPStateFree(void *s)
         SCFree(sstate->dcerpc.dcerpcrequest.stub_data_buffer);
         sstate->dcerpc.dcerpcrequest.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcrequest.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcrequest.stub_data_buffer_size = 0;
     }
     if (sstate->dcerpc.dcerpcresponse.stub_data_buffer != NULL) {
         SCFree(sstate->dcerpc.dcerpcresponse.stub_data_buffer);
         sstate->dcerpc.dcerpcresponse.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcresponse.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcresponse.stub_data_buffer_size = 0;
     }
     SCFree(s);
 }
@@ -812,6 +823,19 @@ static int DCERPCUDPRegisterPatternsForProtocolDetection(void)
     return 0;
 }
 
+/**
+ * \brief Memory in use by a state: the state itself and the stub data
+ *        buffers.
+ */
+static uint32_t DCERPCUDPStateGetMemuse(void *state)
+{
+    DCERPCUDPState *dcerpc_state = (DCERPCUDPState *)state;
+
+    return sizeof(DCERPCUDPState) +
+        dcerpc_state->dcerpc.dcerpcrequest.stub_data_buffer_size +
+        dcerpc_state->dcerpc.dcerpcresponse.stub_data_buffer_size;
+}
+
 void RegisterDCERPCUDPParsers(void)
 {
     char *proto_name = "dcerpc";
@@ -834,6 +858,8 @@ void RegisterDCERPCUDPParsers(void)
         AppLayerParserRegisterStateFuncs(IPPROTO_UDP, ALPROTO_DCERPC, DCERPCUDPStateAlloc,
                                          DCERPCUDPStateFree);
         AppLayerParserRegisterParserAcceptableDataDirection(IPPROTO_UDP, ALPROTO_DCERPC, STREAM_TOSERVER);
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_UDP, ALPROTO_DCERPC, DCERPCUDPStateGetMemuse);
+        AppLayerParserRegisterGetEventInfo(IPPROTO_UDP, ALPROTO_DCERPC, DCERPCStateGetEventInfo);
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", "dcerpc");
@@ -64,6 +64,8 @@
 
 #include "util-spm.h"
 #include "util-unittest.h"
+#include "util-misc.h"
+#include "conf.h"
 
 #include "app-layer-dcerpc.h"
 
@@ -1189,26 +1191,96 @@ static uint32_t DCERPCParseREQUEST(DCERPC *dcerpc, uint8_t *input, uint32_t inpu
     SCReturnUInt((uint32_t)(p - input));
 }
 
+/** max size of the stub data of a PDU, fragments beyond it are dropped */
+static uint32_t dcerpc_max_stub_size = DCERPC_STUB_DATA_MAX_SIZE;
+
+SCEnumCharMap dcerpc_decoder_event_table[ ] = {
+    { "STUB_DATA_TOO_LARGE", DCERPC_DECODER_EVENT_STUB_DATA_TOO_LARGE },
+    { NULL,                  -1 },
+};
+
+/**
+ * \brief Append stub data to a stub data buffer.
+ *
+ *        The buffer is grown by doubling its size, so that a PDU split over
+ *        many fragments doesn't cost a realloc and a copy of all the data
+ *        buffered so far per fragment.  The allocation is kept when the
+ *        buffer is reset for the next PDU.  The buffer never grows beyond
+ *        the configured max stub size.
+ *
+ * \param buffer      Pointer to the stub data buffer.
+ * \param buffer_len  Pointer to the length of the data in the buffer.
+ * \param buffer_size Pointer to the allocated size of the buffer.
+ * \param data        Stub data to append.
+ * \param data_len    Length of the stub data.
+ *
+ * \retval 0 on success, -1 if the buffer couldn't be grown, in which case
+ *         it's freed, 1 if the data would take the buffer over the max
+ *         stub size, in which case nothing is appended.
+ */
+int DCERPCStubDataAppend(uint8_t **buffer, uint32_t *buffer_len,
+                         uint32_t *buffer_size, const uint8_t *data,
+                         uint32_t data_len)
+{
+    /* buffer_len never exceeds the max, this can't wrap */
+    if (data_len > dcerpc_max_stub_size - *buffer_len)
+        return 1;
+
+    if (*buffer_len + data_len > *buffer_size) {
+        uint32_t size = *buffer_size;
+        if (size < DCERPC_STUB_DATA_INIT_SIZE)
+            size = DCERPC_STUB_DATA_INIT_SIZE;
+        while (size < *buffer_len + data_len) {
+            if (size > dcerpc_max_stub_size / 2) {
+                size = dcerpc_max_stub_size;
+                break;
+            }
+            size *= 2;
+        }
+
+        void *ptmp = SCRealloc(*buffer, size);
+        if (ptmp == NULL) {
+            SCFree(*buffer);
+            *buffer = NULL;
+            *buffer_len = 0;
+            *buffer_size = 0;
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            return -1;
+        }
+        *buffer = ptmp;
+        *buffer_size = size;
+    }
+
+    memcpy(*buffer + *buffer_len, data, data_len);
+    *buffer_len += data_len;
+    return 0;
+}
+
 static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_len)
 {
     SCEnter();
     uint8_t **stub_data_buffer = NULL;
     uint32_t *stub_data_buffer_len = NULL;
+    uint32_t *stub_data_buffer_size = NULL;
     uint8_t *stub_data_fresh = NULL;
+    uint8_t *stub_data_too_large = NULL;
     uint16_t stub_len = 0;
-    void *ptmp;
 
     /* request PDU.  Retrieve the request stub buffer */
     if (dcerpc->dcerpchdr.type == REQUEST) {
         stub_data_buffer = &dcerpc->dcerpcrequest.stub_data_buffer;
         stub_data_buffer_len = &dcerpc->dcerpcrequest.stub_data_buffer_len;
+        stub_data_buffer_size = &dcerpc->dcerpcrequest.stub_data_buffer_size;
         stub_data_fresh = &dcerpc->dcerpcrequest.stub_data_fresh;
+        stub_data_too_large = &dcerpc->dcerpcrequest.stub_data_too_large;
 
     /* response PDU.  Retrieve the response stub buffer */
     } else {
         stub_data_buffer = &dcerpc->dcerpcresponse.stub_data_buffer;
         stub_data_buffer_len = &dcerpc->dcerpcresponse.stub_data_buffer_len;
+        stub_data_buffer_size = &dcerpc->dcerpcresponse.stub_data_buffer_size;
         stub_data_fresh = &dcerpc->dcerpcresponse.stub_data_fresh;
+        stub_data_too_large = &dcerpc->dcerpcresponse.stub_data_too_large;
     }
 
     stub_len = (dcerpc->padleft < input_len) ? dcerpc->padleft : input_len;
@@ -1230,6 +1302,7 @@ static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_le
     if ((dcerpc->dcerpchdr.pfc_flags & PFC_FIRST_FRAG) &&
         !dcerpc->pdu_fragged) {
         *stub_data_buffer_len = 0;
+        *stub_data_too_large = 0;
         /* just a hack to get thing working.  We shouldn't be setting
          * this var here.  The ideal thing would have been to use
          * an extra state var, to indicate that the stub parser has made a
@@ -1243,23 +1316,28 @@ static uint32_t StubDataParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_le
         dcerpc->pdu_fragged = 1;
     }
 
-    ptmp = SCRealloc(*stub_data_buffer, *stub_data_buffer_len + stub_len);
-    if (ptmp == NULL) {
-        SCFree(*stub_data_buffer);
-        *stub_data_buffer = NULL;
-        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+    /* the stub data went over the max stub size: the rest of the PDU is
+     * consumed but not buffered, a gap would make the buffer misleading */
+    if (*stub_data_too_large)
+        goto consumed;
+
+    int r = DCERPCStubDataAppend(stub_data_buffer, stub_data_buffer_len,
+                                 stub_data_buffer_size, input, stub_len);
+    if (r < 0) {
         goto end;
+    } else if (r == 1) {
+        SCLogDebug("stub data of the pdu over %"PRIu32" bytes, dropping "
+                   "the rest of it", dcerpc_max_stub_size);
+        *stub_data_too_large = 1;
+        dcerpc->stub_data_too_large_event = 1;
+        goto consumed;
     }
-    *stub_data_buffer = ptmp;
-
-    memcpy(*stub_data_buffer + *stub_data_buffer_len, input, stub_len);
 
     *stub_data_fresh = 1;
-    /* length of the buffered stub */
-    *stub_data_buffer_len += stub_len;
     /* To see the total reassembled stubdata */
     //hexdump(*stub_data_buffer, *stub_data_buffer_len);
 
+consumed:
     dcerpc->padleft -= stub_len;
     dcerpc->bytesprocessed += stub_len;
 
@@ -1906,6 +1984,34 @@ int32_t DCERPCParser(DCERPC *dcerpc, uint8_t *input, uint32_t input_len)
     SCReturnInt(parsed);
 }
 
+/**
+ * \brief Raise the decoder events DCERPCParser left in the dcerpc state
+ *        on the flow. DCERPC over SMB calls it too.
+ */
+void DCERPCSetEvents(Flow *f, DCERPC *dcerpc)
+{
+    if (dcerpc->stub_data_too_large_event) {
+        AppLayerDecoderEventsSetEvent(f, DCERPC_DECODER_EVENT_STUB_DATA_TOO_LARGE);
+        dcerpc->stub_data_too_large_event = 0;
+    }
+}
+
+int DCERPCStateGetEventInfo(const char *event_name,
+                            int *event_id, AppLayerEventType *event_type)
+{
+    *event_id = SCMapEnumNameToValue(event_name, dcerpc_decoder_event_table);
+    if (*event_id == -1) {
+        SCLogError(SC_ERR_INVALID_ENUM_MAP, "event \"%s\" not present in "
+                   "dcerpc's enum map table.",  event_name);
+        /* yes this is fatal */
+        return -1;
+    }
+
+    *event_type = APP_LAYER_EVENT_TYPE_GENERAL;
+
+    return 0;
+}
+
 static int DCERPCParse(Flow *f, void *dcerpc_state,
                        AppLayerParserState *pstate,
                        uint8_t *input, uint32_t input_len,
@@ -1921,6 +2027,7 @@ static int DCERPCParse(Flow *f, void *dcerpc_state,
     }
 
     retval = DCERPCParser(&sstate->dcerpc, input, input_len);
+    DCERPCSetEvents(f, &sstate->dcerpc);
     if (retval == -1) {
         SCReturnInt(0);
     }
@@ -1988,11 +2095,13 @@ static void DCERPCStateFree(void *s)
         SCFree(sstate->dcerpc.dcerpcrequest.stub_data_buffer);
         sstate->dcerpc.dcerpcrequest.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcrequest.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcrequest.stub_data_buffer_size = 0;
     }
     if (sstate->dcerpc.dcerpcresponse.stub_data_buffer != NULL) {
         SCFree(sstate->dcerpc.dcerpcresponse.stub_data_buffer);
         sstate->dcerpc.dcerpcresponse.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcresponse.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcresponse.stub_data_buffer_size = 0;
     }
 
     SCFree(s);
@@ -2014,10 +2123,45 @@ static int DCERPCRegisterPatternsForProtocolDetection(void)
     return 0;
 }
 
+/**
+ * \brief Memory in use by a state: the state itself and the stub data
+ *        buffers.
+ */
+static uint32_t DCERPCStateGetMemuse(void *state)
+{
+    DCERPCState *dcerpc_state = (DCERPCState *)state;
+
+    return sizeof(DCERPCState) +
+        dcerpc_state->dcerpc.dcerpcrequest.stub_data_buffer_size +
+        dcerpc_state->dcerpc.dcerpcresponse.stub_data_buffer_size;
+}
+
+/**
+ * \brief Read the max stub size. It's shared by DCERPC over tcp, udp
+ *        and SMB, so it's read even if the tcp parser is disabled.
+ */
+static void DCERPCParseConfig(void)
+{
+    char *conf_val;
+
+    if ((ConfGet("app-layer.protocols.dcerpc.max-stub-size", &conf_val)) == 1) {
+        uint32_t size = 0;
+        if (ParseSizeStringU32(conf_val, &size) < 0 || size == 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "Error parsing dcerpc.max-stub-size "
+                       "from conf file - %s.  Killing engine", conf_val);
+            exit(EXIT_FAILURE);
+        }
+        dcerpc_max_stub_size = size;
+    }
+    SCLogDebug("dcerpc max stub size %"PRIu32, dcerpc_max_stub_size);
+}
+
 void RegisterDCERPCParsers(void)
 {
     char *proto_name = "dcerpc";
 
+    DCERPCParseConfig();
+
     if (AppLayerProtoDetectConfProtoDetectionEnabled("tcp", proto_name)) {
         AppLayerProtoDetectRegisterProtocol(ALPROTO_DCERPC, proto_name);
         if (DCERPCRegisterPatternsForProtocolDetection() < 0)
@@ -2036,6 +2180,8 @@ void RegisterDCERPCParsers(void)
         AppLayerParserRegisterStateFuncs(IPPROTO_TCP, ALPROTO_DCERPC, DCERPCStateAlloc,
                                          DCERPCStateFree);
         AppLayerParserRegisterParserAcceptableDataDirection(IPPROTO_TCP, ALPROTO_DCERPC, STREAM_TOSERVER);
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_DCERPC, DCERPCStateGetMemuse);
+        AppLayerParserRegisterGetEventInfo(IPPROTO_TCP, ALPROTO_DCERPC, DCERPCStateGetEventInfo);
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", proto_name);
@@ -6380,6 +6526,176 @@ end:
     return result;
 }
 
+/**
+ * \test Stub data of a request split over several PDU fragments is
+ *       appended to a buffer that is grown by doubling and reused for the
+ *       next request.
+ */
+int DCERPCParserTest20(void)
+{
+    int result = 0;
+    Flow f;
+    int r = 0;
+    uint8_t request[24 + 600];
+    uint8_t pfc_flags[4] = { PFC_FIRST_FRAG, 0, PFC_LAST_FRAG,
+                             PFC_FIRST_FRAG | PFC_LAST_FRAG };
+    uint32_t exp_len[4] = { 600, 1200, 1800, 600 };
+    uint32_t exp_size[4] = { 1024, 2048, 2048, 2048 };
+    uint8_t *buffer = NULL;
+    int i;
+
+    memset(request, 0, sizeof(request));
+    request[0] = 0x05;
+    request[4] = 0x10;
+    request[8] = sizeof(request) & 0xff;
+    request[9] = sizeof(request) >> 8;
+    request[12] = 0x01;
+    request[22] = 0x02;
+    memset(request + 24, 'A', sizeof(request) - 24);
+
+    TcpSession ssn;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+
+    StreamTcpInitConfig(TRUE);
+
+    for (i = 0; i < 4; i++) {
+        request[3] = pfc_flags[i];
+
+        SCMutexLock(&f.m);
+        r = AppLayerParserParse(alp_tctx, &f, ALPROTO_DCERPC, STREAM_TOSERVER,
+                                request, sizeof(request));
+        if (r != 0) {
+            printf("dcerpc header check returned %" PRId32 ", expected 0: ", r);
+            SCMutexUnlock(&f.m);
+            goto end;
+        }
+        SCMutexUnlock(&f.m);
+
+        DCERPCState *dcerpc_state = f.alstate;
+        if (dcerpc_state == NULL) {
+            printf("no dcerpc state: ");
+            goto end;
+        }
+
+        DCERPCRequest *req = &dcerpc_state->dcerpc.dcerpcrequest;
+        if (req->stub_data_buffer == NULL ||
+            req->stub_data_buffer_len != exp_len[i] ||
+            req->stub_data_buffer_size != exp_size[i] ||
+            req->stub_data_fresh != 1) {
+            printf("pdu %d: len %"PRIu32" size %"PRIu32": ",
+                   i, req->stub_data_buffer_len, req->stub_data_buffer_size);
+            goto end;
+        }
+        /* no realloc once the buffer is large enough */
+        if (i >= 2 && req->stub_data_buffer != buffer) {
+            printf("pdu %d: buffer was reallocated: ", i);
+            goto end;
+        }
+        buffer = req->stub_data_buffer;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
+/**
+ * \test Stub data of a PDU that goes over the max stub size isn't buffered
+ *       beyond it, an event is set, and the next PDU is buffered again.
+ */
+int DCERPCParserTest21(void)
+{
+    int result = 0;
+    Flow f;
+    int r = 0;
+    uint8_t request[24 + 600];
+    uint8_t pfc_flags[5] = { PFC_FIRST_FRAG, 0, 0, PFC_LAST_FRAG,
+                             PFC_FIRST_FRAG | PFC_LAST_FRAG };
+    uint32_t exp_len[5] = { 600, 1200, 1200, 1200, 600 };
+    uint8_t exp_too_large[5] = { 0, 0, 1, 1, 0 };
+    uint32_t max_stub_size = dcerpc_max_stub_size;
+    int i;
+
+    memset(request, 0, sizeof(request));
+    request[0] = 0x05;
+    request[4] = 0x10;
+    request[8] = sizeof(request) & 0xff;
+    request[9] = sizeof(request) >> 8;
+    request[12] = 0x01;
+    request[22] = 0x02;
+    memset(request + 24, 'A', sizeof(request) - 24);
+
+    TcpSession ssn;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+
+    StreamTcpInitConfig(TRUE);
+
+    dcerpc_max_stub_size = 1500;
+
+    for (i = 0; i < 5; i++) {
+        request[3] = pfc_flags[i];
+
+        SCMutexLock(&f.m);
+        r = AppLayerParserParse(alp_tctx, &f, ALPROTO_DCERPC, STREAM_TOSERVER,
+                                request, sizeof(request));
+        if (r != 0) {
+            printf("dcerpc header check returned %" PRId32 ", expected 0: ", r);
+            SCMutexUnlock(&f.m);
+            goto end;
+        }
+        SCMutexUnlock(&f.m);
+
+        DCERPCState *dcerpc_state = f.alstate;
+        if (dcerpc_state == NULL) {
+            printf("no dcerpc state: ");
+            goto end;
+        }
+
+        DCERPCRequest *req = &dcerpc_state->dcerpc.dcerpcrequest;
+        if (req->stub_data_buffer_len != exp_len[i] ||
+            req->stub_data_buffer_size > dcerpc_max_stub_size ||
+            req->stub_data_too_large != exp_too_large[i]) {
+            printf("pdu %d: len %"PRIu32" size %"PRIu32" too large %u: ",
+                   i, req->stub_data_buffer_len, req->stub_data_buffer_size,
+                   req->stub_data_too_large);
+            goto end;
+        }
+    }
+
+    if (!AppLayerDecoderEventsIsEventSet(AppLayerParserGetDecoderEvents(f.alparser),
+                                         DCERPC_DECODER_EVENT_STUB_DATA_TOO_LARGE)) {
+        printf("no stub data too large event: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    dcerpc_max_stub_size = max_stub_size;
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DCERPCParserRegisterTests(void)
@@ -6404,6 +6720,8 @@ void DCERPCParserRegisterTests(void)
     UtRegisterTest("DCERPCParserTest17", DCERPCParserTest17, 1);
     UtRegisterTest("DCERPCParserTest18", DCERPCParserTest18, 1);
     UtRegisterTest("DCERPCParserTest19", DCERPCParserTest19, 1);
+    UtRegisterTest("DCERPCParserTest20", DCERPCParserTest20, 1);
+    UtRegisterTest("DCERPCParserTest21", DCERPCParserTest21, 1);
 #endif /* UNITTESTS */
 
     return;
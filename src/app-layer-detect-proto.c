@@ -61,6 +61,7 @@
 #include "util-spm.h"
 #include "util-cuda.h"
 #include "util-debug.h"
+#include "util-hash-lookup3.h"
 
 #include "runmodes.h"
 
@@ -101,6 +102,13 @@ typedef struct AppLayerProtoDetectProbingParser_ {
     uint8_t ipproto;
     AppLayerProtoDetectProbingParserPort *port;
 
+    /* Direct port lookup, built by AppLayerProtoDetectPPFlatten().
+     * port_map[port] is the index + 1 in port_array of the entry of the
+     * port, 0 if there is none and port_any applies. */
+    uint16_t *port_map;
+    AppLayerProtoDetectProbingParserPort **port_array;
+    AppLayerProtoDetectProbingParserPort *port_any;
+
     struct AppLayerProtoDetectProbingParser_ *next;
 } AppLayerProtoDetectProbingParser;
 
@@ -126,6 +134,26 @@ typedef struct AppLayerProtoDetectPMCtx_ {
     PatIntId max_pat_id;
 } AppLayerProtoDetectPMCtx;
 
+/** number of entries per set of the protocol detection cache */
+#define ALPD_CACHE_WAYS 4
+
+/**
+ * \brief Protocol last detected on a server endpoint.
+ *
+ * The protocol detection cache is a per thread set associative cache,
+ * keyed by the server address, port and ipproto of the flow. Each set
+ * holds ALPD_CACHE_WAYS entries and evicts the least recently used one.
+ */
+typedef struct AppLayerProtoDetectCacheEntry_ {
+    uint32_t addr[4];
+    uint16_t port;
+    uint8_t ipproto;
+    /** 4 or 6, 0 for an unused entry */
+    uint8_t ipver;
+    AppProto alproto;
+    uint32_t last_used;
+} AppLayerProtoDetectCacheEntry;
+
 typedef struct AppLayerProtoDetectCtxIpproto_ {
     /* 0 - toserver, 1 - toclient */
     AppLayerProtoDetectPMCtx ctx_pm[2];
@@ -141,11 +169,18 @@ typedef struct AppLayerProtoDetectCtx_ {
     AppLayerProtoDetectCtxIpproto ctx_ipp[FLOW_PROTO_DEFAULT];
 
     AppLayerProtoDetectProbingParser *ctx_pp;
+    /* ctx_pp indexed by ipproto, valid if pp_flat is set */
+    AppLayerProtoDetectProbingParser *ctx_pp_map[256];
+    int pp_flat;
 
     /* Indicates the protocols that have registered themselves
      * for protocol detection.  This table is independent of the
      * ipproto. */
     char *alproto_names[ALPROTO_MAX];
+
+    /* Number of entries in the per thread protocol detection cache,
+     * 0 if disabled. A multiple of ALPD_CACHE_WAYS. */
+    uint32_t cache_size;
 } AppLayerProtoDetectCtx;
 
 /**
@@ -155,6 +190,12 @@ struct AppLayerProtoDetectThreadCtx_ {
     PatternMatcherQueue pmq;
     /* The value 2 is for direction(0 - toserver, 1 - toclient). */
     MpmThreadCtx mpm_tctx[FLOW_PROTO_DEFAULT][2];
+
+    /* server endpoint protocol cache, NULL if disabled */
+    AppLayerProtoDetectCacheEntry *cache;
+    /* number of sets, power of 2 */
+    uint32_t cache_sets;
+    uint32_t cache_tick;
 };
 
 /* The global app layer proto detection context. */
@@ -189,6 +230,18 @@ static AppProto AppLayerProtoDetectPMMatchSignature(const AppLayerProtoDetectPMS
     SCLogDebug("s->co->offset (%"PRIu16") s->cd->depth (%"PRIu16")",
                s->cd->offset, s->cd->depth);
 
+    /* pattern at a fixed position: compare in place */
+    if (sbuflen == s->cd->content_len) {
+        if (s->cd->flags & DETECT_CONTENT_NOCASE) {
+            if (SCMemcmpLowercase(s->cd->content, sbuf, sbuflen) == 0)
+                proto = s->alproto;
+        } else {
+            if (SCMemcmp(s->cd->content, sbuf, sbuflen) == 0)
+                proto = s->alproto;
+        }
+        goto end;
+    }
+
     if (s->cd->flags & DETECT_CONTENT_NOCASE)
         found = BoyerMooreNocase(s->cd->content, s->cd->content_len, sbuf, sbuflen, s->cd->bm_ctx);
     else
@@ -284,6 +337,17 @@ static AppLayerProtoDetectProbingParserPort *AppLayerProtoDetectGetProbingParser
 {
     AppLayerProtoDetectProbingParserPort *pp_port = NULL;
 
+    if (pp == alpd_ctx.ctx_pp && alpd_ctx.pp_flat) {
+        pp = alpd_ctx.ctx_pp_map[ipproto];
+        if (pp == NULL)
+            goto end;
+        if (pp->port_map[port] != 0)
+            pp_port = pp->port_array[pp->port_map[port] - 1];
+        else
+            pp_port = pp->port_any;
+        goto end;
+    }
+
     while (pp != NULL) {
         if (pp->ipproto == ipproto)
             break;
@@ -443,6 +507,153 @@ static AppProto AppLayerProtoDetectPPGetProto(Flow *f,
     SCReturnUInt(alproto);
 }
 
+/***** Static Internal Calls: Protocol Cache *****/
+
+/** \internal
+ *  \brief Get the cache set of the server endpoint of a flow
+ *
+ *  The server is the destination of the flow, whatever the direction
+ *  of the data we're looking at.
+ */
+static AppLayerProtoDetectCacheEntry *AppLayerProtoDetectCacheGetSet(AppLayerProtoDetectThreadCtx *tctx,
+                                                                     const Flow *f,
+                                                                     uint8_t ipproto,
+                                                                     AppLayerProtoDetectCacheEntry *key)
+{
+    memset(key, 0, sizeof(*key));
+    if (FLOW_IS_IPV4(f)) {
+        key->addr[0] = f->dst.addr_data32[0];
+        key->ipver = 4;
+    } else {
+        key->addr[0] = f->dst.addr_data32[0];
+        key->addr[1] = f->dst.addr_data32[1];
+        key->addr[2] = f->dst.addr_data32[2];
+        key->addr[3] = f->dst.addr_data32[3];
+        key->ipver = 6;
+    }
+    key->port = f->dp;
+    key->ipproto = ipproto;
+
+    uint32_t hash = hashword(key->addr, 4, ((uint32_t)ipproto << 16) | f->dp);
+    return &tctx->cache[(hash & (tctx->cache_sets - 1)) * ALPD_CACHE_WAYS];
+}
+
+static inline int AppLayerProtoDetectCacheEntryMatch(const AppLayerProtoDetectCacheEntry *e,
+                                                     const AppLayerProtoDetectCacheEntry *key)
+{
+    return (e->ipver == key->ipver && e->port == key->port &&
+            e->ipproto == key->ipproto &&
+            memcmp(e->addr, key->addr, sizeof(e->addr)) == 0);
+}
+
+/** \internal
+ *  \brief Look up the protocol last detected on the server of a flow
+ *
+ *  \retval e the entry or NULL if the server isn't cached
+ */
+static AppLayerProtoDetectCacheEntry *AppLayerProtoDetectCacheLookup(AppLayerProtoDetectThreadCtx *tctx,
+                                                                     const Flow *f,
+                                                                     uint8_t ipproto)
+{
+    AppLayerProtoDetectCacheEntry key;
+    AppLayerProtoDetectCacheEntry *set =
+        AppLayerProtoDetectCacheGetSet(tctx, f, ipproto, &key);
+    int i;
+
+    for (i = 0; i < ALPD_CACHE_WAYS; i++) {
+        if (AppLayerProtoDetectCacheEntryMatch(&set[i], &key))
+            return &set[i];
+    }
+    return NULL;
+}
+
+/** \internal
+ *  \brief Store the protocol detected on the server of a flow, evicting
+ *          the least recently used entry of the set if needed.
+ */
+static void AppLayerProtoDetectCacheStore(AppLayerProtoDetectThreadCtx *tctx,
+                                          const Flow *f, uint8_t ipproto,
+                                          AppProto alproto)
+{
+    AppLayerProtoDetectCacheEntry key;
+    AppLayerProtoDetectCacheEntry *set =
+        AppLayerProtoDetectCacheGetSet(tctx, f, ipproto, &key);
+    AppLayerProtoDetectCacheEntry *e = &set[0];
+    int i;
+
+    for (i = 0; i < ALPD_CACHE_WAYS; i++) {
+        if (set[i].ipver == 0 || AppLayerProtoDetectCacheEntryMatch(&set[i], &key)) {
+            e = &set[i];
+            break;
+        }
+        if ((int32_t)(set[i].last_used - e->last_used) < 0)
+            e = &set[i];
+    }
+
+    *e = key;
+    e->alproto = alproto;
+    e->last_used = ++tctx->cache_tick;
+}
+
+/** \internal
+ *  \brief Check if the data is of the protocol cached for the server,
+ *          using only the probing parsers and patterns of that protocol.
+ *
+ *  \retval 1 confirmed
+ *  \retval 0 not confirmed, full detection needed
+ */
+static int AppLayerProtoDetectCacheConfirm(const Flow *f,
+                                           uint8_t *buf, uint32_t buflen,
+                                           uint8_t ipproto, uint8_t direction,
+                                           AppProto alproto)
+{
+    const AppLayerProtoDetectProbingParserPort *pp_port;
+    const AppLayerProtoDetectProbingParserElement *pe;
+    int i;
+
+    /* probing parsers registered for the ports of the flow */
+    for (i = 0; i < 2; i++) {
+        pp_port = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipproto,
+                                                       i == 0 ? f->dp : f->sp);
+        if (pp_port == NULL)
+            continue;
+
+        for (pe = (i == 0) ? pp_port->dp : pp_port->sp; pe != NULL; pe = pe->next) {
+            if (pe->alproto != alproto)
+                continue;
+            if (buflen < pe->min_depth ||
+                (pe->max_depth != 0 && buflen > pe->max_depth))
+                continue;
+            if (pe->ProbingParser(buf, buflen, NULL) == alproto)
+                return 1;
+        }
+    }
+
+    /* patterns of the protocol */
+    if (f->protomap < FLOW_PROTO_DEFAULT) {
+        const AppLayerProtoDetectPMCtx *pm_ctx =
+            &alpd_ctx.ctx_ipp[f->protomap].ctx_pm[(direction & STREAM_TOSERVER) ? 0 : 1];
+        uint16_t searchlen = (buflen > pm_ctx->max_len) ? pm_ctx->max_len : (uint16_t)buflen;
+        PatIntId id;
+
+        if (pm_ctx->map == NULL)
+            return 0;
+
+        for (id = 0; id < pm_ctx->max_pat_id; id++) {
+            const AppLayerProtoDetectPMSignature *s;
+            for (s = pm_ctx->map[id]; s != NULL; s = s->next) {
+                if (s->alproto != alproto)
+                    continue;
+                if (AppLayerProtoDetectPMMatchSignature(s, buf, searchlen,
+                                                        ipproto) == alproto)
+                    return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
 /***** Static Internal Calls: PP registration *****/
 
 static void AppLayerProtoDetectPPGetIpprotos(AppProto alproto,
@@ -566,6 +777,10 @@ static void AppLayerProtoDetectProbingParserFree(AppLayerProtoDetectProbingParse
         pt = pt_next;
     }
 
+    if (p->port_map != NULL)
+        SCFree(p->port_map);
+    if (p->port_array != NULL)
+        SCFree(p->port_array);
     SCFree(p);
 
     SCReturn;
@@ -1293,6 +1508,21 @@ AppProto AppLayerProtoDetectGetProto(AppLayerProtoDetectThreadCtx *tctx,
     AppProto pm_results[ALPROTO_MAX];
     uint16_t pm_matches;
 
+    /* try the protocol last seen on this server first */
+    if (tctx->cache != NULL) {
+        AppLayerProtoDetectCacheEntry *e =
+            AppLayerProtoDetectCacheLookup(tctx, f, ipproto);
+        if (e != NULL) {
+            if (AppLayerProtoDetectCacheConfirm(f, buf, buflen, ipproto,
+                                                direction, e->alproto)) {
+                e->last_used = ++tctx->cache_tick;
+                SCReturnCT(e->alproto, "AppProto");
+            }
+            /* the server changed protocol or the data is too short to
+             * tell, the full detection below updates the entry */
+        }
+    }
+
     if (!FLOW_IS_PM_DONE(f, direction)) {
         pm_matches = AppLayerProtoDetectPMGetProto(tctx, f,
                                                    buf, buflen,
@@ -1309,6 +1539,11 @@ AppProto AppLayerProtoDetectGetProto(AppLayerProtoDetectThreadCtx *tctx,
         alproto = AppLayerProtoDetectPPGetProto(f, buf, buflen, ipproto, direction);
 
  end:
+    if (tctx->cache != NULL &&
+        alproto != ALPROTO_UNKNOWN && alproto != ALPROTO_FAILED)
+    {
+        AppLayerProtoDetectCacheStore(tctx, f, ipproto, alproto);
+    }
     SCReturnCT(alproto, "AppProto");
 }
 
@@ -1333,6 +1568,106 @@ static void AppLayerProtoDetectFreeProbingParsers(AppLayerProtoDetectProbingPars
 
 /***** State Preparation *****/
 
+static void AppLayerProtoDetectPPFreeFlat(void)
+{
+    AppLayerProtoDetectProbingParser *pp;
+
+    for (pp = alpd_ctx.ctx_pp; pp != NULL; pp = pp->next) {
+        if (pp->port_map != NULL) {
+            SCFree(pp->port_map);
+            pp->port_map = NULL;
+        }
+        if (pp->port_array != NULL) {
+            SCFree(pp->port_array);
+            pp->port_array = NULL;
+        }
+        pp->port_any = NULL;
+    }
+    memset(alpd_ctx.ctx_pp_map, 0, sizeof(alpd_ctx.ctx_pp_map));
+    alpd_ctx.pp_flat = 0;
+}
+
+/** \internal
+ *  \brief Build the direct ipproto and port lookup tables of the probing
+ *          parsers, giving the same result as walking the lists.
+ */
+static int AppLayerProtoDetectPPFlatten(void)
+{
+    AppLayerProtoDetectProbingParser *pp;
+    AppLayerProtoDetectProbingParserPort *pp_port;
+
+    AppLayerProtoDetectPPFreeFlat();
+
+    for (pp = alpd_ctx.ctx_pp; pp != NULL; pp = pp->next) {
+        /* the first list for an ipproto is the one used */
+        if (alpd_ctx.ctx_pp_map[pp->ipproto] != NULL)
+            continue;
+
+        uint32_t cnt = 0;
+        for (pp_port = pp->port; pp_port != NULL; pp_port = pp_port->next)
+            cnt++;
+
+        pp->port_map = SCMalloc(65536 * sizeof(uint16_t));
+        if (unlikely(pp->port_map == NULL))
+            goto error;
+        memset(pp->port_map, 0, 65536 * sizeof(uint16_t));
+        if (cnt > 0) {
+            pp->port_array = SCMalloc(cnt * sizeof(AppLayerProtoDetectProbingParserPort *));
+            if (unlikely(pp->port_array == NULL))
+                goto error;
+        }
+
+        uint32_t idx = 0;
+        for (pp_port = pp->port; pp_port != NULL; pp_port = pp_port->next) {
+            /* port 0 matches all ports, entries after it are never used */
+            if (pp_port->port == 0) {
+                pp->port_any = pp_port;
+                break;
+            }
+            if (pp->port_map[pp_port->port] != 0 || idx >= 65535)
+                continue;
+            pp->port_array[idx++] = pp_port;
+            pp->port_map[pp_port->port] = (uint16_t)idx;
+        }
+
+        alpd_ctx.ctx_pp_map[pp->ipproto] = pp;
+    }
+
+    alpd_ctx.pp_flat = 1;
+    return 0;
+ error:
+    AppLayerProtoDetectPPFreeFlat();
+    return -1;
+}
+
+/** \internal
+ *  \brief Read the size of the protocol detection cache
+ *
+ *  Rounded down to a power of 2 number of sets.
+ */
+static void AppLayerProtoDetectCacheConfig(void)
+{
+    intmax_t size = 0;
+
+    alpd_ctx.cache_size = 0;
+    if (ConfGetInt("app-layer.protocol-detection-cache.size", &size) != 1 ||
+        size <= 0)
+        return;
+
+    if (size < ALPD_CACHE_WAYS)
+        size = ALPD_CACHE_WAYS;
+    if (size > (1 << 24))
+        size = 1 << 24;
+
+    uint32_t sets = 1;
+    while ((intmax_t)(sets * 2 * ALPD_CACHE_WAYS) <= size)
+        sets *= 2;
+
+    alpd_ctx.cache_size = sets * ALPD_CACHE_WAYS;
+    SCLogInfo("protocol detection cache: %"PRIu32" entries per thread",
+              alpd_ctx.cache_size);
+}
+
 int AppLayerProtoDetectPrepareState(void)
 {
     SCEnter();
@@ -1358,12 +1693,17 @@ int AppLayerProtoDetectPrepareState(void)
         }
     }
 
+    if (AppLayerProtoDetectPPFlatten() < 0)
+        goto error;
+
 #ifdef DEBUG
     if (SCLogDebugEnabled()) {
         AppLayerProtoDetectPrintProbingParsers(alpd_ctx.ctx_pp);
     }
 #endif
 
+    AppLayerProtoDetectCacheConfig();
+
     goto end;
  error:
     ret = -1;
@@ -1386,6 +1726,9 @@ void AppLayerProtoDetectPPRegister(uint8_t ipproto,
 {
     SCEnter();
 
+    /* the lookup tables are rebuilt by AppLayerProtoDetectPrepareState() */
+    AppLayerProtoDetectPPFreeFlat();
+
     DetectPort *head = NULL;
     DetectPortParse(&head, portstr);
     DetectPort *temp_dp = head;
@@ -1675,6 +2018,16 @@ AppLayerProtoDetectThreadCtx *AppLayerProtoDetectGetCtxThread(void)
     if (PmqSetup(&alpd_tctx->pmq, max_pat_id) < 0)
         goto error;
 
+    if (alpd_ctx.cache_size > 0) {
+        alpd_tctx->cache = SCMalloc(alpd_ctx.cache_size *
+                                    sizeof(AppLayerProtoDetectCacheEntry));
+        if (alpd_tctx->cache == NULL)
+            goto error;
+        memset(alpd_tctx->cache, 0, alpd_ctx.cache_size *
+                                    sizeof(AppLayerProtoDetectCacheEntry));
+        alpd_tctx->cache_sets = alpd_ctx.cache_size / ALPD_CACHE_WAYS;
+    }
+
     for (i = 0; i < FLOW_PROTO_DEFAULT; i++) {
         for (j = 0; j < 2; j++) {
             mpm_ctx = &alpd_ctx.ctx_ipp[i].ctx_pm[j].mpm_ctx;
@@ -1708,6 +2061,8 @@ void AppLayerProtoDetectDestroyCtxThread(AppLayerProtoDetectThreadCtx *alpd_tctx
         }
     }
     PmqFree(&alpd_tctx->pmq);
+    if (alpd_tctx->cache != NULL)
+        SCFree(alpd_tctx->cache);
     SCFree(alpd_tctx);
 
     SCReturn;
@@ -3739,6 +4094,153 @@ static int AppLayerProtoDetectTest20(void)
     return result;
 }
 
+/** \test protocol detection cache: a known server is detected from the
+ *        patterns of its cached protocol and a protocol change replaces
+ *        the entry */
+static int AppLayerProtoDetectTest21(void)
+{
+    AppLayerProtoDetectUnittestCtxBackup();
+    AppLayerProtoDetectSetup();
+
+    uint8_t http_buf[] = "GET / HTTP/1.1\r\n";
+    uint8_t ssh_buf[] = "SSH-2.0-OpenSSH\r\n";
+    int r = 0;
+    Flow f;
+    AppProto alproto;
+    AppLayerProtoDetectThreadCtx *alpd_tctx = NULL;
+    AppLayerProtoDetectCacheEntry *e;
+
+    memset(&f, 0x00, sizeof(f));
+    f.protomap = FlowGetProtoMapping(IPPROTO_TCP);
+    f.flags |= FLOW_IPV4;
+    f.dst.addr_data32[0] = 0x01020304;
+    f.dp = 8080;
+    f.sp = 40000;
+
+    AppLayerProtoDetectPMRegisterPatternCS(IPPROTO_TCP, ALPROTO_HTTP, "GET", 3, 0, STREAM_TOSERVER);
+    AppLayerProtoDetectPMRegisterPatternCS(IPPROTO_TCP, ALPROTO_SSH, "SSH-", 4, 0, STREAM_TOSERVER);
+
+    AppLayerProtoDetectPrepareState();
+    alpd_ctx.cache_size = 2 * ALPD_CACHE_WAYS;
+    alpd_tctx = AppLayerProtoDetectGetCtxThread();
+    if (alpd_tctx == NULL || alpd_tctx->cache == NULL) {
+        printf("no cache: ");
+        goto end;
+    }
+
+    alproto = AppLayerProtoDetectGetProto(alpd_tctx, &f, http_buf, sizeof(http_buf) - 1,
+                                          IPPROTO_TCP, STREAM_TOSERVER);
+    if (alproto != ALPROTO_HTTP) {
+        printf("alproto %u, expected http: ", alproto);
+        goto end;
+    }
+    e = AppLayerProtoDetectCacheLookup(alpd_tctx, &f, IPPROTO_TCP);
+    if (e == NULL || e->alproto != ALPROTO_HTTP) {
+        printf("server not cached: ");
+        goto end;
+    }
+
+    /* new flow to the same server, full detection can't run anymore so
+     * only the cache can detect it */
+    f.flags = FLOW_IPV4;
+    f.sp = 40001;
+    FLOW_SET_PM_DONE(&f, STREAM_TOSERVER);
+    FLOW_SET_PP_DONE(&f, STREAM_TOSERVER);
+    alproto = AppLayerProtoDetectGetProto(alpd_tctx, &f, http_buf, sizeof(http_buf) - 1,
+                                          IPPROTO_TCP, STREAM_TOSERVER);
+    if (alproto != ALPROTO_HTTP) {
+        printf("alproto %u, expected http from the cache: ", alproto);
+        goto end;
+    }
+
+    /* other port on the same address isn't cached */
+    f.dp = 8081;
+    if (AppLayerProtoDetectCacheLookup(alpd_tctx, &f, IPPROTO_TCP) != NULL) {
+        printf("port 8081 cached: ");
+        goto end;
+    }
+    f.dp = 8080;
+
+    /* the server now speaks ssh */
+    f.flags = FLOW_IPV4;
+    alproto = AppLayerProtoDetectGetProto(alpd_tctx, &f, ssh_buf, sizeof(ssh_buf) - 1,
+                                          IPPROTO_TCP, STREAM_TOSERVER);
+    if (alproto != ALPROTO_SSH) {
+        printf("alproto %u, expected ssh: ", alproto);
+        goto end;
+    }
+    e = AppLayerProtoDetectCacheLookup(alpd_tctx, &f, IPPROTO_TCP);
+    if (e == NULL || e->alproto != ALPROTO_SSH) {
+        printf("cache entry not updated: ");
+        goto end;
+    }
+
+    r = 1;
+
+ end:
+    if (alpd_tctx != NULL)
+        AppLayerProtoDetectDestroyCtxThread(alpd_tctx);
+    AppLayerProtoDetectDeSetup();
+    AppLayerProtoDetectUnittestCtxRestore();
+    return r;
+}
+/** \test the flattened probing parser port tables give the same
+ *        result as walking the lists */
+static int AppLayerProtoDetectTest22(void)
+{
+    AppLayerProtoDetectUnittestCtxBackup();
+    AppLayerProtoDetectSetup();
+
+    int r = 0;
+    uint32_t port;
+    int i;
+    uint8_t ipprotos[] = { IPPROTO_TCP, IPPROTO_UDP, IPPROTO_SCTP };
+    AppLayerProtoDetectProbingParserPort *walk[3];
+
+    AppLayerProtoDetectInsertNewProbingParser(&alpd_ctx.ctx_pp, IPPROTO_TCP, 80,
+            ALPROTO_HTTP, 5, 8, STREAM_TOSERVER, ProbingParserDummyForTesting);
+    AppLayerProtoDetectInsertNewProbingParser(&alpd_ctx.ctx_pp, IPPROTO_TCP, 0,
+            ALPROTO_SMB, 5, 8, STREAM_TOSERVER, ProbingParserDummyForTesting);
+    AppLayerProtoDetectInsertNewProbingParser(&alpd_ctx.ctx_pp, IPPROTO_TCP, 443,
+            ALPROTO_TLS, 5, 8, STREAM_TOSERVER, ProbingParserDummyForTesting);
+    AppLayerProtoDetectInsertNewProbingParser(&alpd_ctx.ctx_pp, IPPROTO_UDP, 53,
+            ALPROTO_DNS, 5, 8, STREAM_TOSERVER, ProbingParserDummyForTesting);
+
+    AppLayerProtoDetectPrepareState();
+    if (!alpd_ctx.pp_flat) {
+        printf("port tables not built: ");
+        goto end;
+    }
+
+    for (port = 0; port <= 65535; port++) {
+        alpd_ctx.pp_flat = 1;
+        for (i = 0; i < 3; i++)
+            walk[i] = AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipprotos[i], (uint16_t)port);
+        alpd_ctx.pp_flat = 0;
+        for (i = 0; i < 3; i++) {
+            if (AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, ipprotos[i], (uint16_t)port) != walk[i]) {
+                printf("ipproto %u port %u: tables and lists differ: ", ipprotos[i], port);
+                goto end;
+            }
+        }
+    }
+    alpd_ctx.pp_flat = 1;
+
+    if (AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, IPPROTO_TCP, 443)->port != 443 ||
+        AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, IPPROTO_TCP, 8080)->port != 0 ||
+        AppLayerProtoDetectGetProbingParsers(alpd_ctx.ctx_pp, IPPROTO_UDP, 54) != NULL)
+    {
+        printf("wrong port entry: ");
+        goto end;
+    }
+
+    r = 1;
+
+ end:
+    AppLayerProtoDetectDeSetup();
+    AppLayerProtoDetectUnittestCtxRestore();
+    return r;
+}
 
 void AppLayerProtoDetectUnittestsRegister(void)
 {
@@ -3764,6 +4266,8 @@ void AppLayerProtoDetectUnittestsRegister(void)
     UtRegisterTest("AppLayerProtoDetectTest18", AppLayerProtoDetectTest18, 1);
     UtRegisterTest("AppLayerProtoDetectTest19", AppLayerProtoDetectTest19, 1);
     UtRegisterTest("AppLayerProtoDetectTest20", AppLayerProtoDetectTest20, 1);
+    UtRegisterTest("AppLayerProtoDetectTest21", AppLayerProtoDetectTest21, 1);
+    UtRegisterTest("AppLayerProtoDetectTest22", AppLayerProtoDetectTest22, 1);
 
     SCReturn;
 }
@@ -30,11 +30,13 @@
 #endif
 #include "util-memcmp.h"
 #include "util-atomic.h"
+#include "util-hash-lookup3.h"
 
 typedef struct DNSConfig_ {
     uint32_t request_flood;
     uint32_t state_memcap;  /**< memcap in bytes per state */
     uint64_t global_memcap; /**< memcap in bytes globally for parser */
+    uint8_t store;          /**< DNS_STORE_* flags */
 } DNSConfig;
 static DNSConfig dns_config;
 
@@ -48,6 +50,31 @@ void DNSConfigSetRequestFlood(uint32_t value)
     dns_config.request_flood = value;
 }
 
+/** \brief enable storing parts of the messages in the tx
+ *
+ *  Called by the keywords and loggers that need the names or the answer
+ *  data. Flags are only added, so each user can set what it needs.
+ *
+ *  \param flags DNS_STORE_* flags
+ */
+void DNSConfigSetStore(uint8_t flags)
+{
+    dns_config.store |= flags;
+}
+
+uint8_t DNSConfigGetStore(void)
+{
+    return dns_config.store;
+}
+
+#ifdef UNITTESTS
+/** \brief set the store flags to exactly flags, for the unittests */
+void DNSConfigResetStore(uint8_t flags)
+{
+    dns_config.store = flags;
+}
+#endif
+
 void DNSConfigSetStateMemcap(uint32_t value)
 {
     dns_config.state_memcap = value;
@@ -226,20 +253,30 @@ void DNSSetEvent(DNSState *s, uint8_t e)
     }
 }
 
+/** size of the first arena chunk of a tx: room for the tx, a query and
+ *  a few answers */
+#define DNS_TX_ARENA_SIZE 512
+
 /** \internal
  *  \brief Allocate a DNS TX
  *  \retval tx or NULL */
 static DNSTransaction *DNSTransactionAlloc(DNSState *state, const uint16_t tx_id)
 {
-    if (DNSCheckMemcap(sizeof(DNSTransaction), state) < 0)
+    if (DNSCheckMemcap(DNS_TX_ARENA_SIZE, state) < 0)
         return NULL;
 
-    DNSTransaction *tx = SCMalloc(sizeof(DNSTransaction));
-    if (unlikely(tx == NULL))
+    AppLayerParserArena *arena = AppLayerParserArenaAlloc(DNS_TX_ARENA_SIZE);
+    if (unlikely(arena == NULL))
+        return NULL;
+    DNSTransaction *tx = AppLayerParserArenaMalloc(arena, sizeof(DNSTransaction));
+    if (unlikely(tx == NULL)) {
+        AppLayerParserArenaFree(arena);
         return NULL;
-    DNSIncrMemcap(sizeof(DNSTransaction), state);
+    }
+    DNSIncrMemcap(AppLayerParserArenaMemuse(arena), state);
 
     memset(tx, 0x00, sizeof(DNSTransaction));
+    tx->arena = arena;
 
     TAILQ_INIT(&tx->query_list);
     TAILQ_INIT(&tx->answer_list);
@@ -249,6 +286,22 @@ static DNSTransaction *DNSTransactionAlloc(DNSState *state, const uint16_t tx_id
     return tx;
 }
 
+/** \internal
+ *  \brief Allocate from the arena of a tx, accounting for its growth
+ *  \retval ptr or NULL */
+static void *DNSTransactionMalloc(DNSState *state, DNSTransaction *tx, uint32_t size)
+{
+    if (DNSCheckMemcap(size, state) < 0)
+        return NULL;
+
+    uint32_t memuse = AppLayerParserArenaMemuse(tx->arena);
+    void *ptr = AppLayerParserArenaMalloc(tx->arena, size);
+    if (unlikely(ptr == NULL))
+        return NULL;
+    DNSIncrMemcap(AppLayerParserArenaMemuse(tx->arena) - memuse, state);
+    return ptr;
+}
+
 /** \internal
  *  \brief Free a DNS TX
  *  \param tx DNS TX to free */
@@ -256,29 +309,11 @@ static void DNSTransactionFree(DNSTransaction *tx, DNSState *state)
 {
     SCEnter();
 
-    DNSQueryEntry *q = NULL;
-    while ((q = TAILQ_FIRST(&tx->query_list))) {
-        TAILQ_REMOVE(&tx->query_list, q, next);
-        DNSDecrMemcap((sizeof(DNSQueryEntry) + q->len), state);
-        SCFree(q);
-    }
-
-    DNSAnswerEntry *a = NULL;
-    while ((a = TAILQ_FIRST(&tx->answer_list))) {
-        TAILQ_REMOVE(&tx->answer_list, a, next);
-        DNSDecrMemcap((sizeof(DNSAnswerEntry) + a->fqdn_len + a->data_len), state);
-        SCFree(a);
-    }
-    while ((a = TAILQ_FIRST(&tx->authority_list))) {
-        TAILQ_REMOVE(&tx->authority_list, a, next);
-        DNSDecrMemcap((sizeof(DNSAnswerEntry) + a->fqdn_len + a->data_len), state);
-        SCFree(a);
-    }
-
     AppLayerDecoderEventsFreeEvents(&tx->decoder_events);
 
-    DNSDecrMemcap(sizeof(DNSTransaction), state);
-    SCFree(tx);
+    /* the tx itself and its query and answer entries are in the arena */
+    DNSDecrMemcap(AppLayerParserArenaMemuse(tx->arena), state);
+    AppLayerParserArenaFree(tx->arena);
     SCReturn;
 }
 
@@ -445,33 +480,43 @@ bad_data:
  *  \brief check the query list to see if we already have this exact query
  *  \retval bool true or false
  */
+/** \internal
+ *  \brief Check if a query is already in the tx. Names that aren't stored
+ *         are compared by length and hash.
+ */
 static int QueryIsDuplicate(DNSTransaction *tx, const uint8_t *fqdn, const uint16_t fqdn_len,
-        const uint16_t type, const uint16_t class)
+        const uint32_t name_hash, const uint16_t type, const uint16_t class)
 {
     DNSQueryEntry *q = NULL;
 
     TAILQ_FOREACH(q, &tx->query_list, next) {
         uint8_t *qfqdn = (uint8_t *)q + sizeof(DNSQueryEntry);
 
-        if (q->len == fqdn_len && q->type == type &&
-            q->class == class &&
-            SCMemcmp(qfqdn, fqdn, fqdn_len) == 0) {
+        if (q->name_len == fqdn_len && q->name_hash == name_hash &&
+            q->type == type && q->class == class &&
+            (q->len == 0 || SCMemcmp(qfqdn, fqdn, fqdn_len) == 0)) {
             return TRUE;
         }
     }
     return FALSE;
 }
 
-void DNSStoreQueryInState(DNSState *dns_state, const uint8_t *fqdn, const uint16_t fqdn_len,
+void DNSStoreQueryInState(DNSState *dns_state, const uint8_t *fqdn, uint16_t fqdn_len,
         const uint16_t type, const uint16_t class, const uint16_t tx_id)
 {
     /* flood protection */
     if (dns_state->givenup)
         return;
 
+    /* no keyword or logger uses the name: only keep its length and hash,
+     * the duplicate check needs them */
+    const uint32_t name_hash = hashlittle(fqdn, fqdn_len, 0);
+    const uint16_t store_len = (dns_config.store & DNS_STORE_QUERIES) ? fqdn_len : 0;
+
     /* find the tx and see if this is an exact duplicate */
     DNSTransaction *tx = DNSTransactionFindByTxId(dns_state, tx_id);
-    if ((tx != NULL) && (QueryIsDuplicate(tx, fqdn, fqdn_len, type, class) == TRUE)) {
+    if ((tx != NULL) &&
+        (QueryIsDuplicate(tx, fqdn, fqdn_len, name_hash, type, class) == TRUE)) {
         SCLogDebug("query is duplicate");
         return;
     }
@@ -503,17 +548,17 @@ void DNSStoreQueryInState(DNSState *dns_state, const uint8_t *fqdn, const uint16
         SCLogDebug("new tx %u with internal id %u", tx->tx_id, tx->tx_num);
     }
 
-    if (DNSCheckMemcap((sizeof(DNSQueryEntry) + fqdn_len), dns_state) < 0)
-        return;
-    DNSQueryEntry *q = SCMalloc(sizeof(DNSQueryEntry) + fqdn_len);
+    DNSQueryEntry *q = DNSTransactionMalloc(dns_state, tx,
+            sizeof(DNSQueryEntry) + store_len);
     if (unlikely(q == NULL))
         return;
-    DNSIncrMemcap((sizeof(DNSQueryEntry) + fqdn_len), dns_state);
 
     q->type = type;
     q->class = class;
-    q->len = fqdn_len;
-    memcpy((uint8_t *)q + sizeof(DNSQueryEntry), fqdn, fqdn_len);
+    q->len = store_len;
+    q->name_len = fqdn_len;
+    q->name_hash = name_hash;
+    memcpy((uint8_t *)q + sizeof(DNSQueryEntry), fqdn, store_len);
 
     TAILQ_INSERT_TAIL(&tx->query_list, q, next);
 
@@ -521,9 +566,15 @@ void DNSStoreQueryInState(DNSState *dns_state, const uint8_t *fqdn, const uint16
 }
 
 void DNSStoreAnswerInState(DNSState *dns_state, const int rtype, const uint8_t *fqdn,
-        const uint16_t fqdn_len, const uint16_t type, const uint16_t class, const uint16_t ttl,
-        const uint8_t *data, const uint16_t data_len, const uint16_t tx_id)
+        uint16_t fqdn_len, const uint16_t type, const uint16_t class, const uint16_t ttl,
+        const uint8_t *data, uint16_t data_len, const uint16_t tx_id)
 {
+    /* no keyword or logger uses the names and data, only keep the record */
+    if (!(dns_config.store & DNS_STORE_ANSWERS)) {
+        fqdn_len = 0;
+        data_len = 0;
+    }
+
     DNSTransaction *tx = DNSTransactionFindByTxId(dns_state, tx_id);
     if (tx == NULL) {
         tx = DNSTransactionAlloc(dns_state, tx_id);
@@ -534,12 +585,10 @@ void DNSStoreAnswerInState(DNSState *dns_state, const int rtype, const uint8_t *
         tx->tx_num = dns_state->transaction_max;
     }
 
-    if (DNSCheckMemcap((sizeof(DNSAnswerEntry) + fqdn_len + data_len), dns_state) < 0)
-        return;
-    DNSAnswerEntry *q = SCMalloc(sizeof(DNSAnswerEntry) + fqdn_len + data_len);
+    DNSAnswerEntry *q = DNSTransactionMalloc(dns_state, tx,
+            sizeof(DNSAnswerEntry) + fqdn_len + data_len);
     if (unlikely(q == NULL))
         return;
-    DNSIncrMemcap((sizeof(DNSAnswerEntry) + fqdn_len + data_len), dns_state);
 
     q->type = type;
     q->class = class;
@@ -585,7 +634,7 @@ void DNSStoreAnswerInState(DNSState *dns_state, const int rtype, const uint8_t *
  *  \param input input buffer (complete dns record)
  *  \param input_len lenght of input buffer
  *  \param offset offset into @input where dns name starts
- *  \param fqdn buffer to store result
+ *  \param fqdn buffer to store result, NULL to only validate the name
  *  \param fqdn_size size of @fqdn buffer
  *  \retval 0 on error/no buffer
  *  \retval size size of fqdn
@@ -605,7 +654,8 @@ static uint16_t DNSResponseGetNameByOffset(const uint8_t * const input, const ui
     SCLogDebug("qry length %u", length);
 
     if (length == 0) {
-        memcpy(fqdn, "<root>", 6);
+        if (fqdn != NULL)
+            memcpy(fqdn, "<root>", 6);
         SCReturnUInt(6U);
     }
 
@@ -641,9 +691,11 @@ static uint16_t DNSResponseGetNameByOffset(const uint8_t * const input, const ui
         //PrintRawDataFp(stdout, qdata, length);
 
         if ((size_t)(fqdn_offset + length + 1) < fqdn_size) {
-            memcpy(fqdn + fqdn_offset, qdata, length);
-            fqdn_offset += length;
-            fqdn[fqdn_offset++] = '.';
+            if (fqdn != NULL) {
+                memcpy(fqdn + fqdn_offset, qdata, length);
+                fqdn[fqdn_offset + length] = '.';
+            }
+            fqdn_offset += length + 1;
         }
         qdata += length;
 
@@ -717,13 +769,16 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
         goto insufficient_data;
     }
 
+    /* names are only decoded if the keywords or loggers need them, otherwise
+     * they are just validated */
+    const int store = (dns_config.store & DNS_STORE_ANSWERS);
     uint8_t fqdn[DNS_MAX_SIZE];
     uint16_t fqdn_len = 0;
 
     /* see if name is compressed */
     if (!(data[0] & 0xc0)) {
         if ((fqdn_len = DNSResponseGetNameByOffset(input, input_len,
-                        data - input, fqdn, sizeof(fqdn))) == 0)
+                        data - input, store ? fqdn : NULL, sizeof(fqdn))) == 0)
         {
 #if DEBUG
             PrintRawDataFp(stdout, (uint8_t *)input, input_len);
@@ -741,7 +796,7 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
         uint16_t offset = (data[0] & 0x3f) << 8 | data[1];
 
         if ((fqdn_len = DNSResponseGetNameByOffset(input, input_len,
-                        offset, fqdn, sizeof(fqdn))) == 0)
+                        offset, store ? fqdn : NULL, sizeof(fqdn))) == 0)
         {
 #if DEBUG
             PrintRawDataFp(stdout, (uint8_t *)input, input_len);
@@ -796,7 +851,7 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
                 uint16_t cname_len = 0;
 
                 if ((cname_len = DNSResponseGetNameByOffset(input, input_len,
-                                data - input, cname, sizeof(cname))) == 0)
+                                data - input, store ? cname : NULL, sizeof(cname))) == 0)
                 {
 #if DEBUG
                     PrintRawDataFp(stdout, (uint8_t *)input, input_len);
@@ -830,7 +885,7 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
             uint16_t mxname_len = 0;
 
             if ((mxname_len = DNSResponseGetNameByOffset(input, input_len,
-                            data - input + 2, mxname, sizeof(mxname))) == 0) {
+                            data - input + 2, store ? mxname : NULL, sizeof(mxname))) == 0) {
 #if DEBUG
                 PrintRawDataFp(stdout, (uint8_t *)input, input_len);
                 BUG_ON(1);
@@ -861,7 +916,7 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
             uint16_t pname_len = 0;
 
             if ((pname_len = DNSResponseGetNameByOffset(input, input_len,
-                            data - input, pname, sizeof(pname))) == 0)
+                            data - input, store ? pname : NULL, sizeof(pname))) == 0)
             {
 #if DEBUG
                 PrintRawDataFp(stdout, (uint8_t *)input, input_len);
@@ -876,11 +931,11 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
                     goto insufficient_data;
                 }
 
-                uint8_t pmail[DNS_MAX_SIZE];
+                /* pmail isn't stored, only validate it */
                 uint16_t pmail_len = 0;
                 SCLogDebug("getting pmail");
                 if ((pmail_len = DNSResponseGetNameByOffset(input, input_len,
-                                sdata - input, pmail, sizeof(pmail))) == 0)
+                                sdata - input, NULL, DNS_MAX_SIZE)) == 0)
                 {
 #if DEBUG
                     PrintRawDataFp(stdout, (uint8_t *)input, input_len);
@@ -889,7 +944,6 @@ const uint8_t *DNSReponseParse(DNSState *dns_state, const DNSHeader * const dns_
                     goto insufficient_data;
                 }
                 SCLogDebug("pmail_len %u", pmail_len);
-                //PrintRawDataFp(stdout, (uint8_t *)pmail, pmail_len);
 
                 const uint8_t *tdata = SkipDomain(input, input_len, sdata);
                 if (tdata == NULL) {
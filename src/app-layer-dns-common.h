@@ -105,13 +105,19 @@ typedef enum {
 /** \brief DNS Query storage. Stored in TX list.
  *
  *  Layout is:
- *  [list ptr][2 byte type][2 byte class][2 byte len][...data...]
+ *  [list ptr][2 byte type][2 byte class][2 byte len][2 byte name_len]
+ *  [4 byte name_hash][...data...]
+ *
+ *  The name is only stored if DNS_STORE_QUERIES is set, otherwise len is 0.
+ *  Its length and hash are always kept to find duplicate queries.
  */
 typedef struct DNSQueryEntry_ {
     TAILQ_ENTRY(DNSQueryEntry_) next;
     uint16_t type;
     uint16_t class;
     uint16_t len;
+    uint16_t name_len;
+    uint32_t name_hash;
 } DNSQueryEntry;
 
 /** \brief DNS Answer storage. Stored in TX list.
@@ -119,6 +125,9 @@ typedef struct DNSQueryEntry_ {
  *  Layout is:
  *  [list ptr][2 byte type][2 byte class][2 byte ttl] \
  *      [2 byte fqdn len][2 byte data len][...fqdn...][...data...]
+ *
+ *  The fqdn and data are only stored if DNS_STORE_ANSWERS is set, otherwise
+ *  both lengths are 0.
  */
 typedef struct DNSAnswerEntry_ {
     TAILQ_ENTRY(DNSAnswerEntry_) next;
@@ -148,6 +157,9 @@ typedef struct DNSTransaction_ {
 
     AppLayerDecoderEvents *decoder_events;          /**< per tx events */
 
+    AppLayerParserArena *arena;                     /**< holds the tx and its
+                                                         query and answer entries */
+
     TAILQ_ENTRY(DNSTransaction_) next;
 } DNSTransaction;
 
@@ -172,7 +184,17 @@ typedef struct DNSState_ {
 #define DNS_CONFIG_DEFAULT_STATE_MEMCAP 512*1024
 #define DNS_CONFIG_DEFAULT_GLOBAL_MEMCAP 16*1024*1024
 
+/* parts of the messages to store in the tx, set by the dns keywords and
+ * loggers that use them */
+#define DNS_STORE_QUERIES   0x01    /**< query names */
+#define DNS_STORE_ANSWERS   0x02    /**< answer and authority names and data */
+
 void DNSConfigInit(void);
+void DNSConfigSetStore(uint8_t flags);
+uint8_t DNSConfigGetStore(void);
+#ifdef UNITTESTS
+void DNSConfigResetStore(uint8_t flags);
+#endif
 void DNSConfigSetRequestFlood(uint32_t value);
 void DNSConfigSetStateMemcap(uint32_t value);
 void DNSConfigSetGlobalMemcap(uint64_t value);
@@ -191,6 +191,7 @@ static int DNSRequestParseData(Flow *f, DNSState *dns_state, const uint8_t *inpu
 
     //SCLogInfo("ID %04x", ntohs(dns_header->tx_id));
 
+
     uint16_t q;
     const uint8_t *data = input + sizeof(DNSHeader);
 
@@ -224,8 +225,8 @@ static int DNSRequestParseData(Flow *f, DNSState *dns_state, const uint8_t *inpu
 
                 if ((size_t)(fqdn_offset + length + 1) < sizeof(fqdn)) {
                     memcpy(fqdn + fqdn_offset, data, length);
-                    fqdn_offset += length;
-                    fqdn[fqdn_offset++] = '.';
+                    fqdn[fqdn_offset + length] = '.';
+                    fqdn_offset += length + 1;
                 } else {
                     /** \todo set event? */
                     goto insufficient_data;
@@ -378,7 +379,6 @@ static int DNSReponseParseData(Flow *f, DNSState *dns_state, const uint8_t *inpu
     uint16_t q;
     const uint8_t *data = input + sizeof(DNSHeader);
     for (q = 0; q < ntohs(dns_header->questions); q++) {
-        uint8_t fqdn[DNS_MAX_SIZE];
         uint16_t fqdn_offset = 0;
 
         if (input + input_len < data + 1) {
@@ -398,10 +398,8 @@ static int DNSReponseParseData(Flow *f, DNSState *dns_state, const uint8_t *inpu
                 }
                 //PrintRawDataFp(stdout, data, length);
 
-                if ((size_t)(fqdn_offset + length + 1) < sizeof(fqdn)) {
-                    memcpy(fqdn + fqdn_offset, data, length);
-                    fqdn_offset += length;
-                    fqdn[fqdn_offset++] = '.';
+                if ((size_t)(fqdn_offset + length + 1) < DNS_MAX_SIZE) {
+                    fqdn_offset += length + 1;
                 }
             }
 
@@ -77,6 +77,7 @@ static int DNSUDPRequestParse(Flow *f, void *dstate,
     if (DNSValidateRequestHeader(dns_state, dns_header) < 0)
         goto bad_data;
 
+
     uint16_t q;
     const uint8_t *data = input + sizeof(DNSHeader);
     for (q = 0; q < ntohs(dns_header->questions); q++) {
@@ -110,8 +111,8 @@ static int DNSUDPRequestParse(Flow *f, void *dstate,
 
             if ((size_t)(fqdn_offset + length + 1) < sizeof(fqdn)) {
                 memcpy(fqdn + fqdn_offset, data, length);
-                fqdn_offset += length;
-                fqdn[fqdn_offset++] = '.';
+                fqdn[fqdn_offset + length] = '.';
+                fqdn_offset += length + 1;
             } else {
                 /** \todo set event? */
                 goto insufficient_data;
@@ -198,7 +199,6 @@ static int DNSUDPResponseParse(Flow *f, void *dstate,
     uint16_t q;
     const uint8_t *data = input + sizeof(DNSHeader);
     for (q = 0; q < ntohs(dns_header->questions); q++) {
-        uint8_t fqdn[DNS_MAX_SIZE];
         uint16_t fqdn_offset = 0;
 
         if (input + input_len < data + 1) {
@@ -220,10 +220,8 @@ static int DNSUDPResponseParse(Flow *f, void *dstate,
             }
             //PrintRawDataFp(stdout, data, length);
 
-            if ((size_t)(fqdn_offset + length + 1) < sizeof(fqdn)) {
-                memcpy(fqdn + fqdn_offset, data, length);
-                fqdn_offset += length;
-                fqdn[fqdn_offset++] = '.';
+            if ((size_t)(fqdn_offset + length + 1) < DNS_MAX_SIZE) {
+                fqdn_offset += length + 1;
             }
 
             data += length;
@@ -608,6 +606,124 @@ end:
     return (result);
 }
 
+/** \test names and data are stored in the tx, through compression pointers,
+ *        when the keywords or loggers use them */
+static int DNSUDPParserTest06 (void)
+{
+    int result = 0;
+    uint8_t req[] = {
+        0x6F,0xB4,0x01,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x57,0x57,0x77,
+        0x0B,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x03,0x55,0x55,0x55,
+        0x02,0x79,0x79,0x00,0x00,0x01,0x00,0x01
+    };
+    uint8_t buf[] = {
+        0x6F,0xB4,0x84,0x80,0x00,0x01,0x00,0x02,0x00,0x00,0x00,0x00,0x03,0x57,0x57,0x77,
+        0x0B,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x56,0x03,0x55,0x55,0x55,
+        0x02,0x79,0x79,0x00,0x00,0x01,0x00,0x01,0xC0,0x0C,0x00,0x05,0x00,0x01,0x00,0x00,
+        0x0E,0x10,0x00,0x02,0xC0,0x10,0xC0,0x34,0x00,0x01,0x00,0x01,0x00,0x00,0x0E,0x10,
+        0x00,0x04,0xC3,0xEA,0x04,0x19
+    };
+    uint8_t addr[] = { 0xC3,0xEA,0x04,0x19 };
+    Flow *f = NULL;
+
+    DNSConfigSetStore(DNS_STORE_QUERIES|DNS_STORE_ANSWERS);
+
+    f = UTHBuildFlow(AF_INET, "1.2.3.4", "1.2.3.5", 1024, 53);
+    if (f == NULL)
+        goto end;
+    f->proto = IPPROTO_UDP;
+    f->alproto = ALPROTO_DNS;
+    f->alstate = DNSStateAlloc();
+
+    if (DNSUDPRequestParse(f, f->alstate, NULL, req, sizeof(req), NULL) != 1)
+        goto end;
+    if (DNSUDPResponseParse(f, f->alstate, NULL, buf, sizeof(buf), NULL) != 1)
+        goto end;
+
+    DNSTransaction *tx = DNSTransactionFindByTxId(f->alstate, 0x6FB4);
+    if (tx == NULL)
+        goto end;
+
+    DNSQueryEntry *q = TAILQ_FIRST(&tx->query_list);
+    if (q == NULL || q->len != 22 ||
+        memcmp((uint8_t *)q + sizeof(DNSQueryEntry), "WWw.VVVVVVVVVVV.UUU.yy", 22) != 0)
+        goto end;
+
+    DNSAnswerEntry *a = TAILQ_FIRST(&tx->answer_list);
+    if (a == NULL || a->type != DNS_RECORD_TYPE_CNAME || a->fqdn_len != 22 ||
+        a->data_len != 18)
+        goto end;
+    uint8_t *ptr = (uint8_t *)a + sizeof(DNSAnswerEntry);
+    if (memcmp(ptr, "WWw.VVVVVVVVVVV.UUU.yy", 22) != 0 ||
+        memcmp(ptr + a->fqdn_len, "VVVVVVVVVVV.UUU.yy", 18) != 0)
+        goto end;
+
+    a = TAILQ_NEXT(a, next);
+    if (a == NULL || a->type != DNS_RECORD_TYPE_A || a->fqdn_len != 18 ||
+        a->data_len != 4)
+        goto end;
+    ptr = (uint8_t *)a + sizeof(DNSAnswerEntry);
+    if (memcmp(ptr, "VVVVVVVVVVV.UUU.yy", 18) != 0 ||
+        memcmp(ptr + a->fqdn_len, addr, 4) != 0)
+        goto end;
+
+    result = 1;
+end:
+    UTHFreeFlow(f);
+    return (result);
+}
+
+/** \test different query names in the same tx aren't duplicates when the
+ *        names aren't stored */
+static int DNSUDPParserTest07 (void)
+{
+    int result = 0;
+    uint8_t req1[] = {
+        0x12,0x34,0x01,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x02,0x61,0x61,0x01,0x62,0x00,0x00,0x01,0x00,0x01
+    };
+    uint8_t req2[] = {
+        0x12,0x34,0x01,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,
+        0x02,0x63,0x63,0x01,0x62,0x00,0x00,0x01,0x00,0x01
+    };
+    Flow *f = NULL;
+    uint8_t store = DNSConfigGetStore();
+    int cnt = 0;
+
+    DNSConfigResetStore(0);
+
+    f = UTHBuildFlow(AF_INET, "1.2.3.4", "1.2.3.5", 1024, 53);
+    if (f == NULL)
+        goto end;
+    f->proto = IPPROTO_UDP;
+    f->alproto = ALPROTO_DNS;
+    f->alstate = DNSStateAlloc();
+
+    /* the second name differs, the third request repeats the first */
+    if (DNSUDPRequestParse(f, f->alstate, NULL, req1, sizeof(req1), NULL) != 1 ||
+        DNSUDPRequestParse(f, f->alstate, NULL, req2, sizeof(req2), NULL) != 1 ||
+        DNSUDPRequestParse(f, f->alstate, NULL, req1, sizeof(req1), NULL) != 1)
+        goto end;
+
+    DNSTransaction *tx = DNSTransactionFindByTxId(f->alstate, 0x1234);
+    if (tx == NULL)
+        goto end;
+
+    DNSQueryEntry *q = NULL;
+    TAILQ_FOREACH(q, &tx->query_list, next) {
+        if (q->len != 0 || q->name_len != 4)
+            goto end;
+        cnt++;
+    }
+    if (cnt != 2)
+        goto end;
+
+    result = 1;
+end:
+    DNSConfigResetStore(store);
+    UTHFreeFlow(f);
+    return (result);
+}
 
 void DNSUDPParserRegisterTests(void)
 {
@@ -616,5 +732,7 @@ void DNSUDPParserRegisterTests(void)
 	UtRegisterTest("DNSUDPParserTest03", DNSUDPParserTest03, 1);
 	UtRegisterTest("DNSUDPParserTest04", DNSUDPParserTest04, 1);
 	UtRegisterTest("DNSUDPParserTest05", DNSUDPParserTest05, 1);
+	UtRegisterTest("DNSUDPParserTest06", DNSUDPParserTest06, 1);
+	UtRegisterTest("DNSUDPParserTest07", DNSUDPParserTest07, 1);
 }
 #endif
@@ -327,6 +327,18 @@ static int FTPRegisterPatternsForProtocolDetection(void)
     return 0;
 }
 
+/**
+ * \brief Memory in use by a state: the state itself, the buffers of
+ *        fragmented lines and the PORT line.
+ */
+static uint32_t FTPStateGetMemuse(void *state)
+{
+    FtpState *ftp_state = (FtpState *)state;
+
+    return sizeof(FtpState) + ftp_state->line_state[0].db_len +
+        ftp_state->line_state[1].db_len + ftp_state->port_line_size;
+}
+
 void RegisterFTPParsers(void)
 {
     char *proto_name = "ftp";
@@ -345,6 +357,7 @@ void RegisterFTPParsers(void)
                                      FTPParseResponse);
         AppLayerParserRegisterStateFuncs(IPPROTO_TCP, ALPROTO_FTP, FTPStateAlloc, FTPStateFree);
         AppLayerParserRegisterParserAcceptableDataDirection(IPPROTO_TCP, ALPROTO_FTP, STREAM_TOSERVER | STREAM_TOCLIENT);
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_FTP, FTPStateGetMemuse);
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", proto_name);
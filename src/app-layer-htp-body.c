@@ -66,7 +66,11 @@
 /**
  * \brief Append a chunk of body to the HtpBody struct
  *
- * \param body pointer to the HtpBody holding the list
+ * The data is added to the body's store, a single buffer per body, so
+ * the body can be inspected without copying it. Space of pruned data is
+ * reclaimed by moving the remaining data to the start of the buffer.
+ *
+ * \param body pointer to the HtpBody holding the data
  * \param data pointer to the data of the chunk
  * \param len length of the chunk pointed by data
  *
@@ -77,68 +81,89 @@ int HtpBodyAppendChunk(HtpTxUserData *htud, HtpBody *body, uint8_t *data, uint32
 {
     SCEnter();
 
-    HtpBodyChunk *bd = NULL;
-
     if (len == 0 || data == NULL) {
         SCReturnInt(0);
     }
 
-    if (body->first == NULL) {
-        /* New chunk */
-        bd = (HtpBodyChunk *)HTPMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
-
-        bd->len = len;
-        bd->stream_offset = 0;
-        bd->next = NULL;
-
-        bd->data = HTPMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
+    if (body->store_head + body->store_len + len > body->store_size) {
+        /* reclaim the pruned space if that is worth moving the data */
+        if (body->store_head > 0 && body->store_head >= body->store_len) {
+            memmove(body->store, body->store + body->store_head, body->store_len);
+            body->store_head = 0;
         }
-        memcpy(bd->data, data, len);
-
-        body->first = body->last = bd;
 
-        body->content_len_so_far = len;
-    } else {
-        bd = (HtpBodyChunk *)HTPMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
-
-        bd->len = len;
-        bd->stream_offset = body->content_len_so_far;
-        bd->next = NULL;
-
-        bd->data = HTPMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
+        uint32_t needed = body->store_head + body->store_len + len;
+        if (needed > body->store_size) {
+            /* grow by doubling so appending stays cheap for bodies
+             * that come in many small chunks */
+            uint32_t size = body->store_size ? body->store_size : needed;
+            while (size < needed && size <= UINT32_MAX / 2)
+                size *= 2;
+            if (size < needed)
+                size = needed;
+
+            uint8_t *ptmp = HTPRealloc(body->store, body->store_size, size);
+            if (ptmp == NULL) {
+                SCReturnInt(-1);
+            }
+            body->store = ptmp;
+            body->store_size = size;
         }
-        memcpy(bd->data, data, len);
-
-        body->last->next = bd;
-        body->last = bd;
+    }
 
-        body->content_len_so_far += len;
+    if (body->store_len == 0) {
+        body->store_offset = body->content_len_so_far;
     }
-    SCLogDebug("Body %p; data %p, len %"PRIu32, body, bd->data, (uint32_t)bd->len);
+    memcpy(body->store + body->store_head + body->store_len, data, len);
+    body->store_len += len;
+    body->content_len_so_far += len;
+
+    SCLogDebug("Body %p; store %p, size %"PRIu32", len %"PRIu32, body,
+            body->store, body->store_size, body->store_len);
 
     SCReturnInt(0);
+}
 
-error:
-    if (bd != NULL) {
-        if (bd->data != NULL) {
-            HTPFree(bd->data, bd->len);
-        }
-        HTPFree(bd, sizeof(HtpBodyChunk));
-    }
-    SCReturnInt(-1);
+/**
+ * \brief Get the body data starting at a stream offset
+ *
+ * Returns a pointer into the body store, valid until the next append or
+ * prune. If data before offset was already pruned, the data starts at
+ * the oldest data still held.
+ *
+ * \param body pointer to the HtpBody holding the data
+ * \param offset stream offset in the body to start at
+ * \param data_offset pointer to pass back the stream offset the data
+ *        starts at
+ * \param data_len pointer to pass back the length of the data
+ *
+ * \retval ptr pointer to the data
+ * \retval NULL no data at or after offset
+ */
+uint8_t *HtpBodyGetData(HtpBody *body, uint64_t offset,
+        uint64_t *data_offset, uint32_t *data_len)
+{
+    *data_offset = 0;
+    *data_len = 0;
+
+    if (body->store_len == 0)
+        return NULL;
+
+    uint64_t end = body->store_offset + body->store_len;
+    if (offset >= end)
+        return NULL;
+    if (offset < body->store_offset)
+        offset = body->store_offset;
+
+    uint32_t skip = (uint32_t)(offset - body->store_offset);
+    *data_offset = offset;
+    *data_len = body->store_len - skip;
+    return body->store + body->store_head + skip;
 }
 
 /**
- * \brief Print the information and chunks of a Body
- * \param body pointer to the HtpBody holding the list
+ * \brief Print the information and data of a Body
+ * \param body pointer to the HtpBody
  * \retval none
  */
 void HtpBodyPrint(HtpBody *body)
@@ -146,54 +171,45 @@ void HtpBodyPrint(HtpBody *body)
     if (SCLogDebugEnabled()||1) {
         SCEnter();
 
-        if (body->first == NULL)
+        if (body->store_len == 0)
             return;
 
-        HtpBodyChunk *cur = NULL;
-        SCLogDebug("--- Start body chunks at %p ---", body);
-        printf("--- Start body chunks at %p ---\n", body);
-        for (cur = body->first; cur != NULL; cur = cur->next) {
-            SCLogDebug("Body %p; data %p, len %"PRIu32, body, cur->data, (uint32_t)cur->len);
-            printf("Body %p; data %p, len %"PRIu32"\n", body, cur->data, (uint32_t)cur->len);
-            PrintRawDataFp(stdout, (uint8_t*)cur->data, cur->len);
-        }
-        SCLogDebug("--- End body chunks at %p ---", body);
+        SCLogDebug("--- Start body at %p ---", body);
+        printf("--- Start body at %p ---\n", body);
+        SCLogDebug("Body %p; offset %"PRIu64", len %"PRIu32, body, body->store_offset, body->store_len);
+        printf("Body %p; offset %"PRIu64", len %"PRIu32"\n", body, body->store_offset, body->store_len);
+        PrintRawDataFp(stdout, body->store + body->store_head, body->store_len);
+        SCLogDebug("--- End body at %p ---", body);
     }
 }
 
 /**
  * \brief Free the information held in the request body
- * \param body pointer to the HtpBody holding the list
+ * \param body pointer to the HtpBody
  * \retval none
  */
 void HtpBodyFree(HtpBody *body)
 {
     SCEnter();
 
-    if (body->first == NULL)
+    if (body->store == NULL)
         return;
 
-    SCLogDebug("Removing chunks of Body %p; data %p, len %"PRIu32, body,
-            body->last->data, (uint32_t)body->last->len);
-
-    HtpBodyChunk *cur = NULL;
-    HtpBodyChunk *prev = NULL;
+    SCLogDebug("Removing store of Body %p; size %"PRIu32, body, body->store_size);
 
-    prev = body->first;
-    while (prev != NULL) {
-        cur = prev->next;
-        if (prev->data != NULL)
-            HTPFree(prev->data, prev->len);
-        HTPFree(prev, sizeof(HtpBodyChunk));
-        prev = cur;
-    }
-    body->first = body->last = NULL;
+    HTPFree(body->store, body->store_size);
+    body->store = NULL;
+    body->store_size = 0;
+    body->store_head = 0;
+    body->store_len = 0;
 }
 
 /**
- * \brief Free request body chunks that are already fully parsed.
+ * \brief Drop body data that is already fully inspected.
+ *
+ * The space is reclaimed on the next append.
  *
- * \param htud pointer to the HtpTxUserData holding the body
+ * \param body pointer to the HtpBody
  *
  * \retval none
  */
@@ -201,7 +217,7 @@ void HtpBodyPrune(HtpBody *body)
 {
     SCEnter();
 
-    if (body == NULL || body->first == NULL) {
+    if (body == NULL || body->store_len == 0) {
         SCReturn;
     }
 
@@ -209,32 +225,24 @@ void HtpBodyPrune(HtpBody *body)
         SCReturn;
     }
 
-    SCLogDebug("Pruning chunks of Body %p; data %p, len %"PRIu32, body,
-            body->last->data, (uint32_t)body->last->len);
-
-    HtpBodyChunk *cur = body->first;
-    while (cur != NULL) {
-        HtpBodyChunk *next = cur->next;
-
-        SCLogDebug("cur->stream_offset %"PRIu64" + cur->len %u = %"PRIu64", "
-                "body->body_parsed %"PRIu64, cur->stream_offset, cur->len,
-                cur->stream_offset + cur->len, body->body_parsed);
+    SCLogDebug("Pruning Body %p; offset %"PRIu64", len %"PRIu32", "
+            "body->body_inspected %"PRIu64, body, body->store_offset,
+            body->store_len, body->body_inspected);
 
-        if (cur->stream_offset >= body->body_inspected) {
-            break;
-        }
-
-        body->first = next;
-        if (body->last == cur) {
-            body->last = next;
-        }
-
-        if (cur->data != NULL) {
-            HTPFree(cur->data, cur->len);
-        }
-        HTPFree(cur, sizeof(HtpBodyChunk));
+    if (body->body_inspected <= body->store_offset) {
+        SCReturn;
+    }
 
-        cur = next;
+    uint64_t end = body->store_offset + body->store_len;
+    if (body->body_inspected >= end) {
+        body->store_head = 0;
+        body->store_len = 0;
+        body->store_offset = end;
+    } else {
+        uint32_t skip = (uint32_t)(body->body_inspected - body->store_offset);
+        body->store_head += skip;
+        body->store_len -= skip;
+        body->store_offset = body->body_inspected;
     }
 
     SCReturn;
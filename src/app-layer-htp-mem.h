@@ -17,6 +17,8 @@
 
 #include "stream-tcp-reassemble.h"
 
+extern uint64_t htp_config_memcap;
+
 void HTPParseMemcap();
 void *HTPMalloc(size_t size);
 void *HTPRealloc(void *ptr, size_t orig_size, size_t size);
@@ -314,6 +314,10 @@ static void HtpTxUserDataFree(HtpTxUserData *htud)
             HTPFree(htud->request_headers_raw, htud->request_headers_raw_len);
         if (htud->response_headers_raw)
             HTPFree(htud->response_headers_raw, htud->response_headers_raw_len);
+        if (htud->request_headers_norm)
+            HTPFree(htud->request_headers_norm, htud->request_headers_norm_len);
+        if (htud->response_headers_norm)
+            HTPFree(htud->response_headers_norm, htud->response_headers_norm_len);
         AppLayerDecoderEventsFreeEvents(&htud->decoder_events);
         if (htud->boundary)
             HTPFree(htud->boundary, htud->boundary_len);
@@ -1185,7 +1189,10 @@ static void HtpRequestBodyMultipartParseHeader(HtpState *hstate,
 }
 
 /**
- *  \brief Create a single buffer from the HtpBodyChunks in our list
+ *  \brief Get the part of the request body that we didn't parse yet
+ *
+ *  The buffer points into the body store, so it must not be freed and is
+ *  only valid until the body is appended to or pruned.
  *
  *  \param htud transaction user data
  *  \param chunks_buffers pointer to pass back the buffer to the caller
@@ -1194,58 +1201,10 @@ static void HtpRequestBodyMultipartParseHeader(HtpState *hstate,
 static void HtpRequestBodyReassemble(HtpTxUserData *htud,
         uint8_t **chunks_buffer, uint32_t *chunks_buffer_len)
 {
-    uint8_t *buf = NULL;
-    uint8_t *pbuf = NULL;
-    uint32_t buf_len = 0;
-    HtpBodyChunk *cur = htud->request_body.first;
-
-    for ( ; cur != NULL; cur = cur->next) {
-        SCLogDebug("chunk %p", cur);
-
-        /* skip body chunks entirely before what we parsed already */
-        if ((uint64_t )cur->stream_offset + cur->len <= htud->request_body.body_parsed) {
-            SCLogDebug("skipping chunk");
-            continue;
-        }
-
-        SCLogDebug("cur->stream_offset %"PRIu64", cur->len %"PRIu32", body_parsed %"PRIu64,
-            cur->stream_offset, cur->len, htud->request_body.body_parsed);
-
-        if (cur->stream_offset < htud->request_body.body_parsed &&
-                cur->stream_offset + cur->len >= htud->request_body.body_parsed) {
-            SCLogDebug("use part");
+    uint64_t offset = 0;
 
-            uint32_t toff = htud->request_body.body_parsed - cur->stream_offset;
-            uint32_t tlen = (cur->stream_offset + cur->len) - htud->request_body.body_parsed;
-            uint8_t *pbuf = NULL;
-
-            buf_len += tlen;
-            if ((pbuf = HTPRealloc(buf, buf_len - tlen, buf_len)) == NULL) {
-                HTPFree(buf, buf_len - tlen);
-                buf = NULL;
-                buf_len = 0;
-                break;
-            }
-            buf = pbuf;
-            memcpy(buf + buf_len - tlen, cur->data + toff, tlen);
-
-        } else {
-            SCLogDebug("use entire chunk");
-
-            buf_len += cur->len;
-            if ((pbuf = HTPRealloc(buf, buf_len - cur->len, buf_len)) == NULL) {
-                HTPFree(buf, buf_len - cur->len);
-                buf = NULL;
-                buf_len = 0;
-                break;
-            }
-            buf = pbuf;
-            memcpy(buf + buf_len - cur->len, cur->data, cur->len);
-        }
-    }
-
-    *chunks_buffer = buf;
-    *chunks_buffer_len = buf_len;
+    *chunks_buffer = HtpBodyGetData(&htud->request_body,
+            htud->request_body.body_parsed, &offset, chunks_buffer_len);
 }
 
 int HtpRequestBodyHandleMultipart(HtpState *hstate, HtpTxUserData *htud,
@@ -1822,10 +1781,6 @@ int HTPCallbackRequestBodyData(htp_tx_data_t *d)
 #endif
 
             HtpRequestBodyHandleMultipart(hstate, tx_ud, d->tx, chunks_buffer, chunks_buffer_len);
-
-            if (chunks_buffer != NULL) {
-                HTPFree(chunks_buffer, chunks_buffer_len);
-            }
         } else if (tx_ud->request_body_type == HTP_BODY_REQUEST_POST) {
             HtpRequestBodyHandlePOST(hstate, tx_ud, d->tx, (uint8_t *)d->data, (uint32_t)d->len);
         } else if (tx_ud->request_body_type == HTP_BODY_REQUEST_PUT) {
@@ -2118,6 +2073,7 @@ static int HTPCallbackRequestHeaderData(htp_tx_data_t *tx_data)
     memcpy(tx_ud->request_headers_raw + tx_ud->request_headers_raw_len,
            tx_data->data, tx_data->len);
     tx_ud->request_headers_raw_len += tx_data->len;
+    tx_ud->request_headers_gen++;
 
     if (tx_data->tx && tx_data->tx->flags) {
         HtpState *hstate = htp_connp_get_user_data(tx_data->tx->connp);
@@ -2156,6 +2112,7 @@ static int HTPCallbackResponseHeaderData(htp_tx_data_t *tx_data)
     memcpy(tx_ud->response_headers_raw + tx_ud->response_headers_raw_len,
            tx_data->data, tx_data->len);
     tx_ud->response_headers_raw_len += tx_data->len;
+    tx_ud->response_headers_gen++;
 
     return HTP_OK;
 }
@@ -5620,6 +5577,77 @@ static int HTPBodyReassemblyTest01(void)
 
     result = 1;
 end:
+    HtpBodyFree(&htud.request_body);
+    return result;
+}
+
+/** \test body store: data is appended to a single buffer, pruned data is
+ *        no longer returned and its space is reused */
+static int HTPBodyStoreTest01(void)
+{
+    int result = 0;
+    HtpTxUserData htud;
+    memset(&htud, 0x00, sizeof(htud));
+    HtpBody *body = &htud.request_body;
+    uint64_t offset = 0;
+    uint32_t len = 0;
+    uint8_t *data = NULL;
+
+    if (HtpBodyAppendChunk(&htud, body, (uint8_t *)"abcd", 4) != 0)
+        goto end;
+    if (HtpBodyAppendChunk(&htud, body, (uint8_t *)"efgh", 4) != 0)
+        goto end;
+
+    data = HtpBodyGetData(body, 0, &offset, &len);
+    if (data == NULL || offset != 0 || len != 8 || memcmp(data, "abcdefgh", 8) != 0) {
+        printf("expected \"abcdefgh\" at 0: ");
+        goto end;
+    }
+    data = HtpBodyGetData(body, 6, &offset, &len);
+    if (data == NULL || offset != 6 || len != 2 || memcmp(data, "gh", 2) != 0) {
+        printf("expected \"gh\" at 6: ");
+        goto end;
+    }
+    if (HtpBodyGetData(body, 8, &offset, &len) != NULL) {
+        printf("no data expected past the end: ");
+        goto end;
+    }
+
+    /* prune what was inspected */
+    body->body_parsed = 8;
+    body->body_inspected = 6;
+    HtpBodyPrune(body);
+
+    data = HtpBodyGetData(body, 0, &offset, &len);
+    if (data == NULL || offset != 6 || len != 2 || memcmp(data, "gh", 2) != 0) {
+        printf("expected \"gh\" at 6 after prune: ");
+        goto end;
+    }
+
+    /* appending more than fits reclaims the pruned space */
+    uint32_t size = body->store_size;
+    uint8_t chunk[8] = "ijklmnop";
+    if (HtpBodyAppendChunk(&htud, body, chunk, sizeof(chunk)) != 0)
+        goto end;
+    if (body->store_head != 0 || body->content_len_so_far != 16) {
+        printf("head %u content_len_so_far %"PRIu64": ",
+                body->store_head, body->content_len_so_far);
+        goto end;
+    }
+    if (body->store_size < size) {
+        printf("store shrunk: ");
+        goto end;
+    }
+
+    data = HtpBodyGetData(body, 6, &offset, &len);
+    if (data == NULL || offset != 6 || len != 10 || memcmp(data, "ghijklmnop", 10) != 0) {
+        printf("expected \"ghijklmnop\" at 6: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    HtpBodyFree(body);
     return result;
 }
 
@@ -6019,6 +6047,7 @@ void HTPParserRegisterTests(void)
     UtRegisterTest("HTPParserDecodingTest09", HTPParserDecodingTest09, 1);
 
     UtRegisterTest("HTPBodyReassemblyTest01", HTPBodyReassemblyTest01, 1);
+    UtRegisterTest("HTPBodyStoreTest01", HTPBodyStoreTest01, 1);
 
     UtRegisterTest("HTPSegvTest01", HTPSegvTest01, 1);
 
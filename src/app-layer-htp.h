@@ -155,19 +155,16 @@ typedef struct HTPCfgRec_ {
     int                 randomize_range;
 } HTPCfgRec;
 
-/** Struct used to hold chunks of a body on a request */
-struct HtpBodyChunk_ {
-    uint8_t *data;              /**< Pointer to the data of the chunk */
-    struct HtpBodyChunk_ *next; /**< Pointer to the next chunk */
-    uint64_t stream_offset;
-    uint32_t len;               /**< Length of the chunk */
-} __attribute__((__packed__));
-typedef struct HtpBodyChunk_ HtpBodyChunk;
-
-/** Struct used to hold all the chunks of a body on a request */
+/** Struct used to hold the body of a request or response. The body data
+ *  is kept in a single buffer, the store, so that it can be inspected
+ *  without copying it. */
 typedef struct HtpBody_ {
-    HtpBodyChunk *first; /**< Pointer to the first chunk */
-    HtpBodyChunk *last;  /**< Pointer to the last chunk */
+    uint8_t *store;         /**< Buffer holding the body data */
+    uint32_t store_size;    /**< Size of the buffer */
+    uint32_t store_head;    /**< Start of the data in the buffer, data
+                             *   before it was pruned */
+    uint32_t store_len;     /**< Length of the data in the buffer */
+    uint64_t store_offset;  /**< Body offset of the data at store_head */
 
     /* Holds the length of the htp request body */
     uint64_t content_len;
@@ -211,6 +208,22 @@ typedef struct HtpTxUserData_ {
     uint32_t request_headers_raw_len;
     uint32_t response_headers_raw_len;
 
+    /** incremented by the parser each time header or trailer data is
+     *  received, so cached header buffers can be invalidated */
+    uint32_t request_headers_gen;
+    uint32_t response_headers_gen;
+
+    /** normalized headers for http_header inspection, built by the
+     *  detection engine on first use. The generation is the headers
+     *  generation the buffer was built from plus one, 0 if it wasn't
+     *  built. */
+    uint8_t *request_headers_norm;
+    uint8_t *response_headers_norm;
+    uint32_t request_headers_norm_len;
+    uint32_t response_headers_norm_len;
+    uint32_t request_headers_norm_gen;
+    uint32_t response_headers_norm_gen;
+
     AppLayerDecoderEvents *decoder_events;          /**< per tx events */
 
     /** Holds the boundary identificator string if any (used on
@@ -60,6 +60,8 @@
 
 #include "conf.h"
 #include "util-spm.h"
+#include "util-misc.h"
+#include "util-atomic.h"
 
 #include "util-debug.h"
 #include "decode-events.h"
@@ -104,6 +106,7 @@ typedef struct AppLayerParserProtoCtx_
     int (*StateGetProgressCompletionStatus)(uint8_t direction);
     int (*StateGetEventInfo)(const char *event_name,
                              int *event_id, AppLayerEventType *event_type);
+    uint32_t (*StateGetMemuse)(void *alstate);
 
     /* Indicates the direction the parser is ready to see the data
      * the first time for a flow.  Values accepted -
@@ -134,12 +137,37 @@ struct AppLayerParserState_ {
 
     /* Used to store decoder events. */
     AppLayerDecoderEvents *decoder_events;
+
+    /* Memory in use by the app layer state, as accounted in the memuse
+     * of the protocol. */
+    uint32_t memuse;
 };
 
+/**
+ * \brief Memcaps and memory accounting of a protocol's parser. Only used
+ *        by the protocols that register a StateGetMemuse function.
+ */
+typedef struct AppLayerParserMemcap_ {
+    /** per state memcap in bytes, 0 for no limit */
+    uint32_t state_memcap;
+    /** memcap in bytes for all states, 0 for no limit */
+    uint64_t global_memcap;
+    uint8_t configured;
+
+    /** bytes in use by all states */
+    SC_ATOMIC_DECLARE(uint64_t, memuse);
+    /** number of states that went over the state memcap */
+    SC_ATOMIC_DECLARE(uint64_t, memcap_state);
+    /** number of states that went over the global memcap */
+    SC_ATOMIC_DECLARE(uint64_t, memcap_global);
+} AppLayerParserMemcap;
+
 /* Static global version of the parser context.
  * Post 2.0 let's look at changing this to move it out to app-layer.c. */
 static AppLayerParserCtx alp_ctx;
 
+static AppLayerParserMemcap alp_memcaps[ALPROTO_MAX];
+
 AppLayerParserState *AppLayerParserStateAlloc(void)
 {
     SCEnter();
@@ -469,6 +497,70 @@ void AppLayerParserRegisterGetEventInfo(uint8_t ipproto, AppProto alproto,
 
 /***** Get and transaction functions *****/
 
+/** \brief read the state-memcap and global-memcap of a protocol */
+static void AppLayerParserMemcapConfig(AppProto alproto)
+{
+    AppLayerParserMemcap *mc = &alp_memcaps[alproto];
+    const char *alproto_name = AppProtoToString(alproto);
+    char param[100];
+    ConfNode *node;
+
+    if (mc->configured)
+        return;
+    mc->configured = 1;
+
+    SC_ATOMIC_INIT(mc->memuse);
+    SC_ATOMIC_INIT(mc->memcap_state);
+    SC_ATOMIC_INIT(mc->memcap_global);
+
+    if (alproto_name == NULL)
+        return;
+
+    snprintf(param, sizeof(param), "app-layer.protocols.%s.state-memcap",
+             alproto_name);
+    node = ConfGetNode(param);
+    if (node != NULL) {
+        uint32_t value;
+        if (ParseSizeStringU32(node->val, &value) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "invalid value for %s: %s",
+                       param, node->val);
+        } else {
+            mc->state_memcap = value;
+        }
+    }
+
+    snprintf(param, sizeof(param), "app-layer.protocols.%s.global-memcap",
+             alproto_name);
+    node = ConfGetNode(param);
+    if (node != NULL) {
+        uint64_t value;
+        if (ParseSizeStringU64(node->val, &value) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "invalid value for %s: %s",
+                       param, node->val);
+        } else {
+            mc->global_memcap = value;
+        }
+    }
+
+    if (mc->state_memcap != 0 || mc->global_memcap != 0) {
+        SCLogInfo("%s parser memcaps: state-memcap %"PRIu32", "
+                  "global-memcap %"PRIu64, alproto_name,
+                  mc->state_memcap, mc->global_memcap);
+    }
+}
+
+void AppLayerParserRegisterGetStateMemuse(uint8_t ipproto, AppProto alproto,
+                               uint32_t (*StateGetMemuse)(void *alstate))
+{
+    SCEnter();
+
+    alp_ctx.ctxs[FlowGetProtoMapping(ipproto)][alproto].StateGetMemuse =
+        StateGetMemuse;
+    AppLayerParserMemcapConfig(alproto);
+
+    SCReturn;
+}
+
 void *AppLayerParserGetProtocolParserLocalStorage(uint8_t ipproto, AppProto alproto)
 {
     SCEnter();
@@ -783,6 +875,51 @@ uint64_t AppLayerParserGetTransactionActive(uint8_t ipproto, AppProto alproto,
 
 /***** General *****/
 
+/**
+ * \brief Account the memory in use by a state and stop parsing the
+ *        flow if it's over the state or the global memcap.
+ *
+ *        The flow isn't dropped: the parser isn't called anymore and the
+ *        state is truncated and set to EOF, so the transactions parsed so
+ *        far are still inspected and logged, while the rest of the flow is
+ *        left to the stream and packet inspection.
+ */
+static void AppLayerParserMemcapUpdate(AppLayerParserProtoCtx *p, Flow *f,
+                                       AppProto alproto,
+                                       AppLayerParserState *pstate,
+                                       void *alstate)
+{
+    AppLayerParserMemcap *mc = &alp_memcaps[alproto];
+    uint32_t memuse = p->StateGetMemuse(alstate);
+    int grown = (memuse > pstate->memuse);
+
+    if (memuse > pstate->memuse)
+        SC_ATOMIC_ADD(mc->memuse, memuse - pstate->memuse);
+    else if (memuse < pstate->memuse)
+        (void)SC_ATOMIC_SUB(mc->memuse, pstate->memuse - memuse);
+    pstate->memuse = memuse;
+
+    if (pstate->flags & APP_LAYER_PARSER_MEMCAP)
+        return;
+
+    if (mc->state_memcap != 0 && memuse > mc->state_memcap) {
+        SCLogDebug("%s state memcap reached: %"PRIu32,
+                   AppProtoToString(alproto), memuse);
+        SC_ATOMIC_ADD(mc->memcap_state, 1);
+    } else if (mc->global_memcap != 0 && grown &&
+               SC_ATOMIC_GET(mc->memuse) > mc->global_memcap) {
+        SCLogDebug("%s global memcap reached", AppProtoToString(alproto));
+        SC_ATOMIC_ADD(mc->memcap_global, 1);
+    } else {
+        return;
+    }
+
+    AppLayerParserStateSetFlag(pstate, APP_LAYER_PARSER_MEMCAP);
+    AppLayerParserStreamTruncated(f->proto, alproto, alstate, STREAM_TOSERVER);
+    AppLayerParserStreamTruncated(f->proto, alproto, alstate, STREAM_TOCLIENT);
+    AppLayerParserSetEOF(pstate);
+}
+
 int AppLayerParserParse(AppLayerParserThreadCtx *alp_tctx, Flow *f, AppProto alproto,
                         uint8_t flags, uint8_t *input, uint32_t input_len)
 {
@@ -834,8 +971,9 @@ int AppLayerParserParse(AppLayerParserThreadCtx *alp_tctx, Flow *f, AppProto alp
                    alstate, AppLayerGetProtoName(f->alproto));
     }
 
-    /* invoke the recursive parser, but only on data. We may get empty msgs on EOF */
-    if (input_len > 0) {
+    /* invoke the recursive parser, but only on data. We may get empty msgs on EOF.
+     * Once the state went over a memcap the data is ignored. */
+    if (input_len > 0 && !(pstate->flags & APP_LAYER_PARSER_MEMCAP)) {
         /* invoke the parser */
         if (p->Parser[(flags & STREAM_TOSERVER) ? 0 : 1](f, alstate, pstate,
                 input, input_len,
@@ -881,6 +1019,9 @@ int AppLayerParserParse(AppLayerParserThreadCtx *alp_tctx, Flow *f, AppProto alp
     /* next, see if we can get rid of transactions now */
     AppLayerParserTransactionsCleanup(f);
 
+    if (p->StateGetMemuse != NULL)
+        AppLayerParserMemcapUpdate(p, f, alproto, pstate, alstate);
+
     /* stream truncated, inform app layer */
     if (flags & STREAM_DEPTH)
         AppLayerParserStreamTruncated(f->proto, alproto, alstate, flags);
@@ -987,6 +1128,24 @@ int AppLayerParserProtocolHasLogger(uint8_t ipproto, AppProto alproto)
     SCReturnInt(r);
 }
 
+int AppLayerParserProtocolHasMemcap(AppProto alproto)
+{
+    SCEnter();
+    int r = alp_memcaps[alproto].configured;
+    SCReturnInt(r);
+}
+
+void AppLayerParserMemcapGetCounters(AppProto alproto, uint64_t *memuse,
+                                     uint64_t *memcap_state,
+                                     uint64_t *memcap_global)
+{
+    AppLayerParserMemcap *mc = &alp_memcaps[alproto];
+
+    *memuse = SC_ATOMIC_GET(mc->memuse);
+    *memcap_state = SC_ATOMIC_GET(mc->memcap_state);
+    *memcap_global = SC_ATOMIC_GET(mc->memcap_global);
+}
+
 void AppLayerParserTriggerRawStreamReassembly(Flow *f)
 {
     SCEnter();
@@ -1010,8 +1169,11 @@ void AppLayerParserStateCleanup(uint8_t ipproto, AppProto alproto, void *alstate
         ctx->StateFree(alstate);
 
     /* free the app layer parser api state */
-    if (pstate != NULL)
+    if (pstate != NULL) {
+        if (pstate->memuse > 0)
+            (void)SC_ATOMIC_SUB(alp_memcaps[alproto].memuse, pstate->memuse);
         AppLayerParserStateFree(pstate);
+    }
 
     SCReturn;
 }
@@ -1092,6 +1254,118 @@ void AppLayerParserStreamTruncated(uint8_t ipproto, AppProto alproto, void *alst
     SCReturn;
 }
 
+/***** Transaction arena *****/
+
+/** allocations are aligned to this */
+#define ARENA_ALIGN         8
+#define ARENA_ALIGNED(x)    (((x) + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1))
+/** chunks grow by doubling up to this size */
+#define ARENA_CHUNK_MAX     (64 * 1024)
+
+typedef struct AppLayerParserArenaChunk_ {
+    struct AppLayerParserArenaChunk_ *next;
+    uint32_t size;              /**< usable bytes */
+    uint32_t used;
+    /* data follows */
+} AppLayerParserArenaChunk;
+
+#define ARENA_CHUNK_DATA(c) ((uint8_t *)(c) + ARENA_ALIGNED(sizeof(AppLayerParserArenaChunk)))
+
+struct AppLayerParserArena_ {
+    /** chunk allocations are made from, older chunks follow */
+    AppLayerParserArenaChunk *head;
+    /** bytes allocated for the arena and its chunks */
+    uint32_t memuse;
+    /** first chunk, allocated with the arena */
+    AppLayerParserArenaChunk first;
+};
+
+/**
+ * \brief Create an arena
+ *
+ * \param size size of the first chunk, allocated together with the arena
+ *
+ * \retval arena or NULL on memory error
+ */
+AppLayerParserArena *AppLayerParserArenaAlloc(uint32_t size)
+{
+    size = ARENA_ALIGNED(size);
+    /* the data of the first chunk directly follows it */
+    uint32_t alloc = offsetof(AppLayerParserArena, first) +
+        ARENA_ALIGNED(sizeof(AppLayerParserArenaChunk)) + size;
+
+    AppLayerParserArena *arena = SCMalloc(alloc);
+    if (unlikely(arena == NULL))
+        return NULL;
+
+    arena->first.next = NULL;
+    arena->first.size = size;
+    arena->first.used = 0;
+    arena->head = &arena->first;
+    arena->memuse = alloc;
+    return arena;
+}
+
+/**
+ * \brief Allocate from an arena
+ *
+ * The memory is not zeroed. It lives until the arena is freed.
+ *
+ * \retval ptr or NULL on memory error
+ */
+void *AppLayerParserArenaMalloc(AppLayerParserArena *arena, uint32_t size)
+{
+    AppLayerParserArenaChunk *c = arena->head;
+
+    size = ARENA_ALIGNED(size);
+    if (size > c->size - c->used) {
+        uint32_t csize = c->size * 2;
+        if (csize > ARENA_CHUNK_MAX)
+            csize = ARENA_CHUNK_MAX;
+        if (csize < size)
+            csize = size;
+
+        uint32_t alloc = ARENA_ALIGNED(sizeof(AppLayerParserArenaChunk)) + csize;
+        c = SCMalloc(alloc);
+        if (unlikely(c == NULL))
+            return NULL;
+        c->size = csize;
+        c->used = 0;
+        c->next = arena->head;
+        arena->head = c;
+        arena->memuse += alloc;
+    }
+
+    void *ptr = ARENA_CHUNK_DATA(c) + c->used;
+    c->used += size;
+    return ptr;
+}
+
+/**
+ * \brief Bytes held by an arena, for memcap accounting
+ */
+uint32_t AppLayerParserArenaMemuse(const AppLayerParserArena *arena)
+{
+    return arena->memuse;
+}
+
+/**
+ * \brief Free an arena and everything allocated from it
+ */
+void AppLayerParserArenaFree(AppLayerParserArena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    AppLayerParserArenaChunk *c = arena->head;
+    while (c != &arena->first) {
+        AppLayerParserArenaChunk *next = c->next;
+        SCFree(c);
+        c = next;
+    }
+    SCFree(arena);
+}
+
 #ifdef DEBUG
 void AppLayerParserStatePrintDetails(AppLayerParserState *pstate)
 {
@@ -1123,6 +1397,7 @@ static AppLayerParserCtx alp_ctx_backup_unittest;
 
 typedef struct TestState_ {
     uint8_t test;
+    uint32_t memuse;
 } TestState;
 
 /**
@@ -1137,6 +1412,25 @@ static int TestProtocolParser(Flow *f, void *test_state, AppLayerParserState *ps
     SCReturnInt(-1);
 }
 
+/**
+ *  \brief  Test parser function that accounts all the data it's passed as
+ *          memory used by the state.
+ */
+static int TestProtocolMemuseParser(Flow *f, void *test_state,
+                                    AppLayerParserState *pstate,
+                                    uint8_t *input, uint32_t input_len,
+                                    void *local_data)
+{
+    SCEnter();
+    ((TestState *)test_state)->memuse += input_len;
+    SCReturnInt(0);
+}
+
+static uint32_t TestProtocolStateGetMemuse(void *test_state)
+{
+    return ((TestState *)test_state)->memuse;
+}
+
 /** \brief Function to allocates the Test protocol state memory
  */
 static void *TestProtocolStateAlloc(void)
@@ -1286,6 +1580,164 @@ static int AppLayerParserTest02(void)
 }
 
 
+/**
+ * \test Test the transaction arena: alignment, growth past the first
+ *       chunk and large allocations.
+ */
+static int AppLayerParserTest03(void)
+{
+    int result = 0;
+    int i;
+    AppLayerParserArena *arena = AppLayerParserArenaAlloc(64);
+    if (arena == NULL)
+        goto end;
+
+    uint32_t memuse = AppLayerParserArenaMemuse(arena);
+
+    uint8_t *prev = NULL;
+    for (i = 0; i < 8; i++) {
+        uint8_t *ptr = AppLayerParserArenaMalloc(arena, 5);
+        if (ptr == NULL || ((uintptr_t)ptr % ARENA_ALIGN) != 0) {
+            printf("bad allocation %d: ", i);
+            goto end;
+        }
+        memset(ptr, i, 5);
+        if (prev != NULL && prev[0] != i - 1) {
+            printf("allocation %d overwritten: ", i - 1);
+            goto end;
+        }
+        prev = ptr;
+    }
+    /* 8 allocations of 8 bytes fill the first chunk */
+    if (AppLayerParserArenaMemuse(arena) != memuse) {
+        printf("first chunk not used: ");
+        goto end;
+    }
+
+    uint8_t *ptr = AppLayerParserArenaMalloc(arena, 1);
+    if (ptr == NULL || AppLayerParserArenaMemuse(arena) <= memuse) {
+        printf("arena didn't grow: ");
+        goto end;
+    }
+
+    ptr = AppLayerParserArenaMalloc(arena, 2 * ARENA_CHUNK_MAX);
+    if (ptr == NULL) {
+        printf("large allocation failed: ");
+        goto end;
+    }
+    memset(ptr, 0xff, 2 * ARENA_CHUNK_MAX);
+    if (prev[0] != 7) {
+        printf("first chunk overwritten: ");
+        goto end;
+    }
+
+    result = 1;
+ end:
+    AppLayerParserArenaFree(arena);
+    return result;
+}
+
+/**
+ * \test A state going over the state memcap is counted, its parser isn't
+ *       called anymore but the flow isn't flagged as failed, and its memory
+ *       is unaccounted when the state is freed.
+ */
+static int AppLayerParserTest04(void)
+{
+    AppLayerParserBackupParserTable();
+
+    int result = 0;
+    Flow *f = NULL;
+    uint8_t testbuf[60];
+    TcpSession ssn;
+    uint64_t memuse, memcap_state, memcap_global;
+    uint64_t memuse0, memcap_state0, memcap_global0;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&ssn, 0, sizeof(ssn));
+    memset(testbuf, 'a', sizeof(testbuf));
+
+    AppLayerParserRegisterParser(IPPROTO_TCP, ALPROTO_TEST, STREAM_TOSERVER,
+                      TestProtocolMemuseParser);
+    AppLayerParserRegisterStateFuncs(IPPROTO_TCP, ALPROTO_TEST,
+                          TestProtocolStateAlloc, TestProtocolStateFree);
+    AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_TEST,
+                          TestProtocolStateGetMemuse);
+    alp_memcaps[ALPROTO_TEST].state_memcap = 100;
+
+    if (!AppLayerParserProtocolHasMemcap(ALPROTO_TEST)) {
+        printf("no memcap: ");
+        goto end;
+    }
+    AppLayerParserMemcapGetCounters(ALPROTO_TEST, &memuse0, &memcap_state0,
+                                    &memcap_global0);
+
+    f = UTHBuildFlow(AF_INET, "1.2.3.4", "4.3.2.1", 20, 40);
+    if (f == NULL)
+        goto end;
+    f->protoctx = &ssn;
+    f->alproto = ALPROTO_TEST;
+    f->proto = IPPROTO_TCP;
+
+    StreamTcpInitConfig(TRUE);
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        SCMutexLock(&f->m);
+        int r = AppLayerParserParse(alp_tctx, f, ALPROTO_TEST, STREAM_TOSERVER,
+                                    testbuf, sizeof(testbuf));
+        SCMutexUnlock(&f->m);
+        if (r != 0) {
+            printf("returned %" PRId32 ", expected 0: ", r);
+            goto end;
+        }
+
+        AppLayerParserMemcapGetCounters(ALPROTO_TEST, &memuse, &memcap_state,
+                                        &memcap_global);
+        /* the third chunk is ignored */
+        uint32_t state_memuse = (i == 0) ? 60 : 120;
+        if (((TestState *)f->alstate)->memuse != state_memuse ||
+            memuse - memuse0 != state_memuse) {
+            printf("chunk %d: memuse %"PRIu64": ", i, memuse - memuse0);
+            goto end;
+        }
+        if (AppLayerParserStateIssetFlag(f->alparser, APP_LAYER_PARSER_MEMCAP) !=
+            (i == 0 ? 0 : APP_LAYER_PARSER_MEMCAP) ||
+            memcap_state - memcap_state0 != (i == 0 ? 0 : 1) ||
+            memcap_global != memcap_global0) {
+            printf("chunk %d: memcap not applied: ", i);
+            goto end;
+        }
+    }
+
+    if (f->flags & FLOW_NO_APPLAYER_INSPECTION) {
+        printf("flow shouldn't be flagged: ");
+        goto end;
+    }
+
+    AppLayerParserStateCleanup(f->proto, ALPROTO_TEST, f->alstate, f->alparser);
+    f->alstate = NULL;
+    f->alparser = NULL;
+
+    AppLayerParserMemcapGetCounters(ALPROTO_TEST, &memuse, &memcap_state,
+                                    &memcap_global);
+    if (memuse != memuse0) {
+        printf("memuse not released: ");
+        goto end;
+    }
+
+    result = 1;
+ end:
+    memset(&alp_memcaps[ALPROTO_TEST], 0, sizeof(alp_memcaps[ALPROTO_TEST]));
+    AppLayerParserRestoreParserTable();
+    StreamTcpFreeConfig(TRUE);
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+
+    UTHFreeFlow(f);
+    return result;
+}
+
 void AppLayerParserRegisterUnittests(void)
 {
     SCEnter();
@@ -1305,6 +1757,8 @@ void AppLayerParserRegisterUnittests(void)
 
     UtRegisterTest("AppLayerParserTest01", AppLayerParserTest01, 1);
     UtRegisterTest("AppLayerParserTest02", AppLayerParserTest02, 1);
+    UtRegisterTest("AppLayerParserTest03", AppLayerParserTest03, 1);
+    UtRegisterTest("AppLayerParserTest04", AppLayerParserTest04, 1);
 
     SCReturn;
 }
@@ -32,6 +32,8 @@
 #define APP_LAYER_PARSER_NO_INSPECTION          0x02
 #define APP_LAYER_PARSER_NO_REASSEMBLY          0x04
 #define APP_LAYER_PARSER_NO_INSPECTION_PAYLOAD  0x08
+/** the state went over a memcap, the parser isn't called anymore */
+#define APP_LAYER_PARSER_MEMCAP                 0x10
 
 
 /***** transaction handling *****/
@@ -141,6 +143,12 @@ void AppLayerParserRegisterGetStateProgressCompletionStatus(uint8_t ipproto,
 void AppLayerParserRegisterGetEventInfo(uint8_t ipproto, AppProto alproto,
     int (*StateGetEventInfo)(const char *event_name, int *event_id,
                              AppLayerEventType *event_type));
+/**
+ * \brief Register the function returning the memory in use by a state, which
+ *        enables the state-memcap and global-memcap of the protocol.
+ */
+void AppLayerParserRegisterGetStateMemuse(uint8_t ipproto, AppProto alproto,
+                               uint32_t (*StateGetMemuse)(void *alstate));
 
 /***** Get and transaction functions *****/
 
@@ -187,6 +195,10 @@ int AppLayerParserProtocolIsTxEventAware(uint8_t ipproto, AppProto alproto);
 int AppLayerParserProtocolSupportsTxs(uint8_t ipproto, AppProto alproto);
 int AppLayerParserProtocolHasLogger(uint8_t ipproto, AppProto alproto);
 void AppLayerParserTriggerRawStreamReassembly(Flow *f);
+int AppLayerParserProtocolHasMemcap(AppProto alproto);
+void AppLayerParserMemcapGetCounters(AppProto alproto, uint64_t *memuse,
+                                     uint64_t *memcap_state,
+                                     uint64_t *memcap_global);
 
 /***** Cleanup *****/
 
@@ -212,6 +224,19 @@ void AppLayerParserStateFree(AppLayerParserState *pstate);
 void AppLayerParserStatePrintDetails(AppLayerParserState *pstate);
 #endif
 
+/***** Transaction arena *****/
+
+/** \brief Bump allocator for the data of a transaction. There is no per
+ *         allocation free: everything is released at once by
+ *         AppLayerParserArenaFree(), normally from the transaction free
+ *         callback run by AppLayerParserTransactionsCleanup(). */
+typedef struct AppLayerParserArena_ AppLayerParserArena;
+
+AppLayerParserArena *AppLayerParserArenaAlloc(uint32_t size);
+void *AppLayerParserArenaMalloc(AppLayerParserArena *arena, uint32_t size);
+uint32_t AppLayerParserArenaMemuse(const AppLayerParserArena *arena);
+void AppLayerParserArenaFree(AppLayerParserArena *arena);
+
 /***** Unittests *****/
 
 #ifdef UNITTESTS
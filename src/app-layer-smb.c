@@ -1376,14 +1376,18 @@ static int SMBParseRequest(Flow *f, void *smb_state, AppLayerParserState *pstate
                            uint8_t *input, uint32_t input_len,
                            void *local_data)
 {
-    return SMBParse(f, smb_state, pstate, input, input_len, local_data, 0);
+    int r = SMBParse(f, smb_state, pstate, input, input_len, local_data, 0);
+    DCERPCSetEvents(f, &((SMBState *)smb_state)->dcerpc);
+    return r;
 }
 
 static int SMBParseResponse(Flow *f, void *smb_state, AppLayerParserState *pstate,
                             uint8_t *input, uint32_t input_len,
                             void *local_data)
 {
-    return SMBParse(f, smb_state, pstate, input, input_len, local_data, 1);
+    int r = SMBParse(f, smb_state, pstate, input, input_len, local_data, 1);
+    DCERPCSetEvents(f, &((SMBState *)smb_state)->dcerpc);
+    return r;
 }
 
 
@@ -1451,11 +1455,13 @@ static void SMBStateFree(void *s)
         SCFree(sstate->dcerpc.dcerpcrequest.stub_data_buffer);
         sstate->dcerpc.dcerpcrequest.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcrequest.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcrequest.stub_data_buffer_size = 0;
     }
     if (sstate->dcerpc.dcerpcresponse.stub_data_buffer != NULL) {
         SCFree(sstate->dcerpc.dcerpcresponse.stub_data_buffer);
         sstate->dcerpc.dcerpcresponse.stub_data_buffer = NULL;
         sstate->dcerpc.dcerpcresponse.stub_data_buffer_len = 0;
+        sstate->dcerpc.dcerpcresponse.stub_data_buffer_size = 0;
     }
 
     SCFree(s);
@@ -1522,6 +1528,19 @@ static int SMBRegisterPatternsForProtocolDetection(void)
     return 0;
 }
 
+/**
+ * \brief Memory in use by a state: the state itself and the stub data
+ *        buffers of the dcerpc over smb.
+ */
+static uint32_t SMBStateGetMemuse(void *state)
+{
+    SMBState *smb_state = (SMBState *)state;
+
+    return sizeof(SMBState) +
+        smb_state->dcerpc.dcerpcrequest.stub_data_buffer_size +
+        smb_state->dcerpc.dcerpcresponse.stub_data_buffer_size;
+}
+
 void RegisterSMBParsers(void)
 {
     char *proto_name = "smb";
@@ -1556,6 +1575,8 @@ void RegisterSMBParsers(void)
         AppLayerParserRegisterParser(IPPROTO_TCP, ALPROTO_SMB, STREAM_TOSERVER, SMBParseRequest);
         AppLayerParserRegisterParser(IPPROTO_TCP, ALPROTO_SMB, STREAM_TOCLIENT, SMBParseResponse);
         AppLayerParserRegisterStateFuncs(IPPROTO_TCP, ALPROTO_SMB, SMBStateAlloc, SMBStateFree);
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_SMB, SMBStateGetMemuse);
+        AppLayerParserRegisterGetEventInfo(IPPROTO_TCP, ALPROTO_SMB, DCERPCStateGetEventInfo);
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", proto_name);
@@ -45,6 +45,8 @@
 #include "util-byte.h"
 #include "util-unittest-helper.h"
 #include "util-memcmp.h"
+#include "util-file.h"
+#include "util-decode-mime.h"
 #include "flow-util.h"
 
 #include "detect-engine.h"
@@ -121,6 +123,13 @@ SCEnumCharMap smtp_decoder_event_table[ ] = {
 static MpmCtx *smtp_mpm_ctx = NULL;
 MpmThreadCtx *smtp_mpm_thread_ctx;
 
+typedef struct SMTPConfig_ {
+    /** decode the MIME parts of the messages and extract attachments */
+    int decode_mime;
+} SMTPConfig;
+
+static SMTPConfig smtp_config = { 0 };
+
 /* smtp reply codes.  If an entry is made here, please make a simultaneous
  * entry in smtp_reply_map */
 enum {
@@ -459,6 +468,98 @@ static int SMTPInsertCommandIntoCommandBuffer(uint8_t command, SMTPState *state,
     return 0;
 }
 
+static int SMTPMimeFileOpen(const uint8_t *name, uint16_t name_len, void *data)
+{
+    SMTPState *state = (SMTPState *)data;
+    uint8_t flags = 0;
+
+    if (state->files_ts == NULL) {
+        state->files_ts = FileContainerAlloc();
+        if (state->files_ts == NULL)
+            return -1;
+    }
+
+    if (state->f->flags & FLOW_FILE_NO_MAGIC_TS) {
+        SCLogDebug("no magic for this flow in toserver direction, so none for this file");
+        flags |= FILE_NOMAGIC;
+    }
+    if (state->f->flags & FLOW_FILE_NO_MD5_TS) {
+        SCLogDebug("no md5 for this flow in toserver direction, so none for this file");
+        flags |= FILE_NOMD5;
+    }
+    if (state->f->flags & FLOW_FILE_NO_STORE_TS) {
+        flags |= FILE_NOSTORE;
+    }
+
+    if (FileOpenFile(state->files_ts, (uint8_t *)name, name_len,
+                NULL, 0, flags) == NULL)
+        return -1;
+
+    FilePrune(state->files_ts);
+    return 0;
+}
+
+static int SMTPMimeFileData(const uint8_t *chunk, uint32_t len, void *data)
+{
+    SMTPState *state = (SMTPState *)data;
+
+    int r = FileAppendData(state->files_ts, (uint8_t *)chunk, len);
+    FilePrune(state->files_ts);
+    return r;
+}
+
+static int SMTPMimeFileClose(int truncated, void *data)
+{
+    SMTPState *state = (SMTPState *)data;
+
+    int r = FileCloseFile(state->files_ts, NULL, 0,
+            truncated ? FILE_TRUNCATED : 0);
+    FilePrune(state->files_ts);
+    return r;
+}
+
+static const MimeDecCallbacks smtp_mime_callbacks = {
+    SMTPMimeFileOpen, SMTPMimeFileData, SMTPMimeFileClose
+};
+
+/**
+ * \internal
+ * \brief Pass the current line of a message to the mime decoder, the
+ *        decoder is set up by the first line of the message.
+ */
+static void SMTPMimeParseLine(SMTPState *state)
+{
+    if (state->mime_state == NULL) {
+        state->mime_state = MimeDecInitParser(&smtp_mime_callbacks, state);
+        if (state->mime_state == NULL)
+            return;
+    }
+
+    const uint8_t *line = state->current_line;
+    uint32_t len = state->current_line_len;
+
+    /* undo the dot stuffing of DATA, rfc 5321 4.5.2 */
+    if (state->current_command == SMTP_COMMAND_DATA && len > 0 && line[0] == '.') {
+        line++;
+        len--;
+    }
+
+    MimeDecParseLine(state->mime_state, line, len);
+}
+
+/**
+ * \internal
+ * \brief End of the message, closes the open attachment, if any.
+ */
+static void SMTPMimeComplete(SMTPState *state)
+{
+    if (state->mime_state != NULL) {
+        MimeDecParseComplete(state->mime_state);
+        MimeDecDeInitParser(state->mime_state);
+        state->mime_state = NULL;
+    }
+}
+
 static int SMTPProcessCommandBDAT(SMTPState *state, Flow *f,
                                   AppLayerParserState *pstate)
 {
@@ -468,12 +569,20 @@ static int SMTPProcessCommandBDAT(SMTPState *state, Flow *f,
                               state->current_line_delimiter_len);
     if (state->bdat_chunk_idx > state->bdat_chunk_len) {
         state->parser_state &= ~SMTP_PARSER_STATE_COMMAND_DATA_MODE;
+        SMTPMimeComplete(state);
         /* decoder event */
         AppLayerDecoderEventsSetEvent(f,
                                       SMTP_DECODER_EVENT_BDAT_CHUNK_LEN_EXCEEDED);
         SCReturnInt(-1);
-    } else if (state->bdat_chunk_idx == state->bdat_chunk_len) {
+    }
+
+    if (smtp_config.decode_mime)
+        SMTPMimeParseLine(state);
+
+    if (state->bdat_chunk_idx == state->bdat_chunk_len) {
         state->parser_state &= ~SMTP_PARSER_STATE_COMMAND_DATA_MODE;
+        if (state->bdat_last)
+            SMTPMimeComplete(state);
     }
 
     SCReturnInt(0);
@@ -496,6 +605,9 @@ static int SMTPProcessCommandDATA(SMTPState *state, Flow *f,
          * the command buffer to be used by the reply handler to match
          * the reply received */
         SMTPInsertCommandIntoCommandBuffer(SMTP_COMMAND_DATA_MODE, state, f);
+        SMTPMimeComplete(state);
+    } else if (smtp_config.decode_mime) {
+        SMTPMimeParseLine(state);
     }
 
     return 0;
@@ -642,6 +754,17 @@ static int SMTPParseCommandBDAT(SMTPState *state)
         return -1;
     }
 
+    /* the last chunk of a message is flagged by "LAST" */
+    state->bdat_last = 0;
+    while (endptr < state->current_line + state->current_line_len &&
+           *endptr == ' ') {
+        endptr++;
+    }
+    if (state->current_line + state->current_line_len - endptr >= 4 &&
+        SCMemcmpLowercase("last", endptr, 4) == 0) {
+        state->bdat_last = 1;
+    }
+
     return 0;
 }
 
@@ -715,6 +838,7 @@ static int SMTPParse(int direction, Flow *f, SMTPState *state,
     state->input_len = input_len;
     state->direction = direction;
     state->thread_local_data = local_data;
+    state->f = f;
 
     /* toserver */
     if (direction == 0) {
@@ -820,6 +944,10 @@ static void SMTPStateFree(void *p)
     if (smtp_state->tc_current_line_db) {
         SCFree(smtp_state->tc_db);
     }
+    if (smtp_state->mime_state != NULL) {
+        MimeDecDeInitParser(smtp_state->mime_state);
+    }
+    FileContainerFree(smtp_state->files_ts);
 
     SCFree(smtp_state);
 
@@ -854,6 +982,48 @@ static void SMTPSetMpmState(void)
     mpm_table[SMTP_MPM].Prepare(smtp_mpm_ctx);
 }
 
+static FileContainer *SMTPStateGetFiles(void *state, uint8_t direction)
+{
+    if (state == NULL)
+        return NULL;
+
+    SMTPState *smtp_state = (SMTPState *)state;
+
+    /* attachments are only extracted from the client's messages */
+    if (direction & STREAM_TOCLIENT) {
+        SCReturnPtr(NULL, "FileContainer");
+    } else {
+        SCReturnPtr(smtp_state->files_ts, "FileContainer");
+    }
+}
+
+/**
+ * \brief Close the open files of a state that isn't parsed anymore, e.g.
+ *        at a stream gap or when it went over a memcap.
+ */
+static void SMTPStateTruncate(void *state, uint8_t direction)
+{
+    FileContainer *fc = SMTPStateGetFiles(state, direction);
+    if (fc != NULL) {
+        FileTruncateAllOpenFiles(fc);
+    }
+}
+
+static void SMTPConfigure(void)
+{
+    SCEnter();
+
+    ConfNode *config = ConfGetNode("app-layer.protocols.smtp.mime");
+    if (config != NULL) {
+        int val;
+        if (ConfGetChildValueBool(config, "decode-mime", &val))
+            smtp_config.decode_mime = val;
+    }
+    SCLogDebug("mime decoding %s", smtp_config.decode_mime ? "on" : "off");
+
+    SCReturn;
+}
+
 int SMTPStateGetEventInfo(const char *event_name,
                           int *event_id, AppLayerEventType *event_type)
 {
@@ -870,6 +1040,25 @@ int SMTPStateGetEventInfo(const char *event_name,
     return 0;
 }
 
+/**
+ * \brief Memory in use by a state: the state itself, the line buffers,
+ *        the command buffer and the mime decoder.
+ */
+static uint32_t SMTPStateGetMemuse(void *state)
+{
+    SMTPState *smtp_state = (SMTPState *)state;
+    uint32_t memuse = sizeof(SMTPState);
+
+    memuse += smtp_state->ts_db_len + smtp_state->tc_db_len;
+    memuse += smtp_state->cmds_buffer_len;
+    if (smtp_state->mime_state != NULL)
+        memuse += sizeof(MimeDecParseState);
+    /* file chunks are held until they are logged, stored or pruned */
+    memuse += FileContainerGetMemuse(smtp_state->files_ts);
+
+    return memuse;
+}
+
 static int SMTPRegisterPatternsForProtocolDetection(void)
 {
     if (AppLayerProtoDetectPMRegisterPatternCS(IPPROTO_TCP, ALPROTO_SMTP,
@@ -920,6 +1109,13 @@ void RegisterSMTPParsers(void)
 
         AppLayerParserRegisterLocalStorageFunc(IPPROTO_TCP, ALPROTO_SMTP, SMTPLocalStorageAlloc,
                                                SMTPLocalStorageFree);
+
+        AppLayerParserRegisterGetFilesFunc(IPPROTO_TCP, ALPROTO_SMTP, SMTPStateGetFiles);
+        AppLayerParserRegisterTruncateFunc(IPPROTO_TCP, ALPROTO_SMTP, SMTPStateTruncate);
+
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_SMTP, SMTPStateGetMemuse);
+
+        SMTPConfigure();
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", proto_name);
@@ -3614,6 +3810,139 @@ end:
     return result;
 }
 
+
+/**
+ * \test Attachments of a mail sent with DATA are decoded and passed to
+ *       the file api.
+ */
+int SMTPParserTest14(void)
+{
+    int result = 0;
+    Flow f;
+    TcpSession ssn;
+    SMTPState *smtp_state = NULL;
+    int r = 0;
+    int decode_mime = smtp_config.decode_mime;
+
+    uint8_t welcome_reply[] = "220 mx.example.com ESMTP\r\n";
+    uint8_t request1[] = "EHLO example.com\r\n";
+    uint8_t reply1[] = "250 mx.example.com\r\n";
+    uint8_t request2[] = "MAIL FROM:<a@example.com>\r\n"
+                         "RCPT TO:<b@example.com>\r\n"
+                         "DATA\r\n";
+    uint8_t reply2[] = "250 OK\r\n250 OK\r\n354 go ahead\r\n";
+    uint8_t request3[] = "Subject: test\r\n"
+                         "Content-Type: multipart/mixed; boundary=\"b1\"\r\n"
+                         "\r\n"
+                         "--b1\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "\r\n"
+                         "body\r\n"
+                         "--b1\r\n"
+                         "Content-Type: application/octet-stream\r\n"
+                         "Content-Transfer-Encoding: base64\r\n"
+                         "Content-Disposition: attachment; filename=\"a.txt\"\r\n"
+                         "\r\n"
+                         "SGVsbG8sIFdvcmxkIQ0KVGhpcyB\r\n"
+                         "pcyBhIHRlc3QgYXR0YWNobWVudC4NCg==\r\n"
+                         "--b1\r\n";
+    /* the second attachment is split over two segments */
+    uint8_t request4[] = "Content-Disposition: attachment; filename=b.txt\r\n"
+                         "\r\n"
+                         "..dot\r\n"
+                         "--b1--\r\n"
+                         ".\r\n";
+
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+
+    StreamTcpInitConfig(TRUE);
+    smtp_config.decode_mime = 1;
+
+    struct {
+        uint8_t flags;
+        uint8_t *buf;
+        uint32_t len;
+    } steps[] = {
+        { STREAM_TOCLIENT, welcome_reply, sizeof(welcome_reply) - 1 },
+        { STREAM_TOSERVER, request1, sizeof(request1) - 1 },
+        { STREAM_TOCLIENT, reply1, sizeof(reply1) - 1 },
+        { STREAM_TOSERVER, request2, sizeof(request2) - 1 },
+        { STREAM_TOCLIENT, reply2, sizeof(reply2) - 1 },
+        { STREAM_TOSERVER, request3, sizeof(request3) - 1 },
+        { STREAM_TOSERVER, request4, 60 },
+        { STREAM_TOSERVER, request4 + 60, sizeof(request4) - 1 - 60 },
+    };
+    uint32_t i;
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        SCMutexLock(&f.m);
+        r = AppLayerParserParse(alp_tctx, &f, ALPROTO_SMTP, steps[i].flags,
+                                steps[i].buf, steps[i].len);
+        SCMutexUnlock(&f.m);
+        if (r != 0) {
+            printf("smtp check returned %" PRId32 " at step %u, expected 0: ", r, i);
+            goto end;
+        }
+    }
+
+    smtp_state = f.alstate;
+    if (smtp_state == NULL) {
+        printf("no smtp state: ");
+        goto end;
+    }
+    if (smtp_state->parser_state & SMTP_PARSER_STATE_COMMAND_DATA_MODE ||
+        smtp_state->mime_state != NULL) {
+        printf("message not completed: ");
+        goto end;
+    }
+
+    FileContainer *files = smtp_state->files_ts;
+    if (files == NULL || files->head == NULL || files->head->next == NULL ||
+        files->head->next->next != NULL) {
+        printf("expected 2 files: ");
+        goto end;
+    }
+
+    File *file = files->head;
+    if (file->name_len != 5 || memcmp(file->name, "a.txt", 5) != 0 ||
+        file->state != FILE_STATE_CLOSED || file->size != 44) {
+        printf("first file wrong (size %"PRIu64"): ", file->size);
+        goto end;
+    }
+    if (file->chunks_head == NULL ||
+        memcmp(file->chunks_head->data, "Hello, World!\r\n", 15) != 0) {
+        printf("first file content wrong: ");
+        goto end;
+    }
+
+    file = file->next;
+    if (file->name_len != 5 || memcmp(file->name, "b.txt", 5) != 0 ||
+        file->state != FILE_STATE_CLOSED || file->size != 4) {
+        printf("second file wrong (size %"PRIu64"): ", file->size);
+        goto end;
+    }
+    if (file->chunks_head == NULL ||
+        memcmp(file->chunks_head->data, ".dot", 4) != 0) {
+        printf("dot stuffing not undone: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    smtp_config.decode_mime = decode_mime;
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SMTPParserRegisterTests(void)
@@ -3632,6 +3961,7 @@ void SMTPParserRegisterTests(void)
     UtRegisterTest("SMTPParserTest11", SMTPParserTest11, 1);
     UtRegisterTest("SMTPParserTest12", SMTPParserTest12, 1);
     UtRegisterTest("SMTPParserTest13", SMTPParserTest13, 1);
+    UtRegisterTest("SMTPParserTest14", SMTPParserTest14, 1);
 #endif /* UNITTESTS */
 
     return;
@@ -25,6 +25,8 @@
 #define __APP_LAYER_SMTP_H__
 
 #include "decode-events.h"
+#include "util-file.h"
+#include "util-decode-mime.h"
 
 enum {
     SMTP_DECODER_EVENT_INVALID_REPLY,
@@ -76,6 +78,15 @@ typedef struct SMTPState_ {
     uint32_t bdat_chunk_len;
     /** bdat chunk idx */
     uint32_t bdat_chunk_idx;
+    /** current bdat chunk is the last one of the message */
+    uint8_t bdat_last;
+
+    /** flow of the state, for the file flags */
+    Flow *f;
+    /** mime decoder of the message currently in DATA/BDAT, NULL if none */
+    MimeDecParseState *mime_state;
+    /** attachments of the messages */
+    FileContainer *files_ts;
 
     /* the request commands are store here and the reply handler uses these
      * stored command in the buffer to match the reply(ies) with the command */
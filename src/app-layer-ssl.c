@@ -53,6 +53,7 @@
 #include "flow-private.h"
 
 #include "util-byte.h"
+#include "util-crypt.h"
 
 SCEnumCharMap tls_decoder_event_table[ ] = {
     /* TLS protocol messages */
@@ -1181,6 +1182,41 @@ int SSLStateGetEventInfo(const char *event_name,
     return 0;
 }
 
+/**
+ * \brief Memory held by one direction: the fragmented record buffer and
+ *        the decoded certificate fields.
+ */
+static uint32_t SSLStateConnpGetMemuse(SSLStateConnp *connp)
+{
+    uint32_t memuse = connp->trec_len;
+    SSLCertsChain *cert;
+
+    if (connp->cert0_subject != NULL)
+        memuse += strlen(connp->cert0_subject) + 1;
+    if (connp->cert0_issuerdn != NULL)
+        memuse += strlen(connp->cert0_issuerdn) + 1;
+    if (connp->cert0_fingerprint != NULL)
+        memuse += strlen(connp->cert0_fingerprint) + 1;
+
+    /* the certificate data points into the record buffer */
+    TAILQ_FOREACH(cert, &connp->certs, next) {
+        memuse += sizeof(SSLCertsChain);
+    }
+    return memuse;
+}
+
+/**
+ * \brief Memory in use by a state: the state itself and the buffers of
+ *        fragmented records.
+ */
+static uint32_t SSLStateGetMemuse(void *state)
+{
+    SSLState *ssl_state = (SSLState *)state;
+
+    return sizeof(SSLState) + SSLStateConnpGetMemuse(&ssl_state->client_connp) +
+        SSLStateConnpGetMemuse(&ssl_state->server_connp);
+}
+
 static int SSLRegisterPatternsForProtocolDetection(void)
 {
     if (AppLayerProtoDetectPMRegisterPatternCS(IPPROTO_TCP, ALPROTO_TLS,
@@ -1369,6 +1405,7 @@ void RegisterSSLParsers(void)
 
         AppLayerParserRegisterStateFuncs(IPPROTO_TCP, ALPROTO_TLS, SSLStateAlloc, SSLStateFree);
         AppLayerParserRegisterParserAcceptableDataDirection(IPPROTO_TCP, ALPROTO_TLS, STREAM_TOSERVER);
+        AppLayerParserRegisterGetStateMemuse(IPPROTO_TCP, ALPROTO_TLS, SSLStateGetMemuse);
 
         /* Get the value of no reassembly option from the config file */
         if (ConfGetNode("app-layer.protocols.tls.no-reassemble") == NULL) {
@@ -1378,6 +1415,15 @@ void RegisterSSLParsers(void)
             if (ConfGetBool("app-layer.protocols.tls.no-reassemble", &ssl_config.no_reassemble) != 1)
                 ssl_config.no_reassemble = 1;
         }
+
+        /* Get the number of entries of the certificate cache */
+        intmax_t cert_cache_size = 0;
+        if (ConfGetInt("app-layer.protocols.tls.certificate-cache.size",
+                       &cert_cache_size) != 1 || cert_cache_size < 0)
+            cert_cache_size = TLS_CERT_CACHE_DEFAULT_SIZE;
+        if (cert_cache_size > UINT32_MAX)
+            cert_cache_size = UINT32_MAX;
+        TLSCertCacheSetup((uint32_t)cert_cache_size);
     } else {
         SCLogInfo("Parsed disabled for %s protocol. Protocol detection"
                   "still on.", proto_name);
@@ -4166,6 +4212,190 @@ end:
     return result;
 }
 
+
+/**
+ * \test A certificate seen before is taken from the certificate cache,
+ *       not decoded again.
+ */
+static int SSLParserTest26(void)
+{
+    int result = 0;
+    /* certificate message of SSLParserTest23 */
+    uint8_t certs_buf[] = {
+        0x00, 0x03, 0x3d, 0x00, 0x03, 0x3a, 0x30, 0x82,
+        0x03, 0x36, 0x30, 0x82, 0x02, 0x9f, 0xa0, 0x03,
+        0x02, 0x01, 0x02, 0x02, 0x01, 0x01, 0x30, 0x0d,
+        0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d,
+        0x01, 0x01, 0x04, 0x05, 0x00, 0x30, 0x81, 0xa9,
+        0x31, 0x0b, 0x30, 0x09, 0x06, 0x03, 0x55, 0x04,
+        0x06, 0x13, 0x02, 0x58, 0x59, 0x31, 0x15, 0x30,
+        0x13, 0x06, 0x03, 0x55, 0x04, 0x08, 0x13, 0x0c,
+        0x53, 0x6e, 0x61, 0x6b, 0x65, 0x20, 0x44, 0x65,
+        0x73, 0x65, 0x72, 0x74, 0x31, 0x13, 0x30, 0x11,
+        0x06, 0x03, 0x55, 0x04, 0x07, 0x13, 0x0a, 0x53,
+        0x6e, 0x61, 0x6b, 0x65, 0x20, 0x54, 0x6f, 0x77,
+        0x6e, 0x31, 0x17, 0x30, 0x15, 0x06, 0x03, 0x55,
+        0x04, 0x0a, 0x13, 0x0e, 0x53, 0x6e, 0x61, 0x6b,
+        0x65, 0x20, 0x4f, 0x69, 0x6c, 0x2c, 0x20, 0x4c,
+        0x74, 0x64, 0x31, 0x1e, 0x30, 0x1c, 0x06, 0x03,
+        0x55, 0x04, 0x0b, 0x13, 0x15, 0x43, 0x65, 0x72,
+        0x74, 0x69, 0x66, 0x69, 0x63, 0x61, 0x74, 0x65,
+        0x20, 0x41, 0x75, 0x74, 0x68, 0x6f, 0x72, 0x69,
+        0x74, 0x79, 0x31, 0x15, 0x30, 0x13, 0x06, 0x03,
+        0x55, 0x04, 0x03, 0x13, 0x0c, 0x53, 0x6e, 0x61,
+        0x6b, 0x65, 0x20, 0x4f, 0x69, 0x6c, 0x20, 0x43,
+        0x41, 0x31, 0x1e, 0x30, 0x1c, 0x06, 0x09, 0x2a,
+        0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x09, 0x01,
+        0x16, 0x0f, 0x63, 0x61, 0x40, 0x73, 0x6e, 0x61,
+        0x6b, 0x65, 0x6f, 0x69, 0x6c, 0x2e, 0x64, 0x6f,
+        0x6d, 0x30, 0x1e, 0x17, 0x0d, 0x30, 0x33, 0x30,
+        0x33, 0x30, 0x35, 0x31, 0x36, 0x34, 0x37, 0x34,
+        0x35, 0x5a, 0x17, 0x0d, 0x30, 0x38, 0x30, 0x33,
+        0x30, 0x33, 0x31, 0x36, 0x34, 0x37, 0x34, 0x35,
+        0x5a, 0x30, 0x81, 0xa7, 0x31, 0x0b, 0x30, 0x09,
+        0x06, 0x03, 0x55, 0x04, 0x06, 0x13, 0x02, 0x58,
+        0x59, 0x31, 0x15, 0x30, 0x13, 0x06, 0x03, 0x55,
+        0x04, 0x08, 0x13, 0x0c, 0x53, 0x6e, 0x61, 0x6b,
+        0x65, 0x20, 0x44, 0x65, 0x73, 0x65, 0x72, 0x74,
+        0x31, 0x13, 0x30, 0x11, 0x06, 0x03, 0x55, 0x04,
+        0x07, 0x13, 0x0a, 0x53, 0x6e, 0x61, 0x6b, 0x65,
+        0x20, 0x54, 0x6f, 0x77, 0x6e, 0x31, 0x17, 0x30,
+        0x15, 0x06, 0x03, 0x55, 0x04, 0x0a, 0x13, 0x0e,
+        0x53, 0x6e, 0x61, 0x6b, 0x65, 0x20, 0x4f, 0x69,
+        0x6c, 0x2c, 0x20, 0x4c, 0x74, 0x64, 0x31, 0x17,
+        0x30, 0x15, 0x06, 0x03, 0x55, 0x04, 0x0b, 0x13,
+        0x0e, 0x57, 0x65, 0x62, 0x73, 0x65, 0x72, 0x76,
+        0x65, 0x72, 0x20, 0x54, 0x65, 0x61, 0x6d, 0x31,
+        0x19, 0x30, 0x17, 0x06, 0x03, 0x55, 0x04, 0x03,
+        0x13, 0x10, 0x77, 0x77, 0x77, 0x2e, 0x73, 0x6e,
+        0x61, 0x6b, 0x65, 0x6f, 0x69, 0x6c, 0x2e, 0x64,
+        0x6f, 0x6d, 0x31, 0x1f, 0x30, 0x1d, 0x06, 0x09,
+        0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x09,
+        0x01, 0x16, 0x10, 0x77, 0x77, 0x77, 0x40, 0x73,
+        0x6e, 0x61, 0x6b, 0x65, 0x6f, 0x69, 0x6c, 0x2e,
+        0x64, 0x6f, 0x6d, 0x30, 0x81, 0x9f, 0x30, 0x0d,
+        0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d,
+        0x01, 0x01, 0x01, 0x05, 0x00, 0x03, 0x81, 0x8d,
+        0x00, 0x30, 0x81, 0x89, 0x02, 0x81, 0x81, 0x00,
+        0xa4, 0x6e, 0x53, 0x14, 0x0a, 0xde, 0x2c, 0xe3,
+        0x60, 0x55, 0x9a, 0xf2, 0x42, 0xa6, 0xaf, 0x47,
+        0x12, 0x2f, 0x17, 0xce, 0xfa, 0xba, 0xdc, 0x4e,
+        0x63, 0x56, 0x34, 0xb9, 0xba, 0x73, 0x4b, 0x78,
+        0x44, 0x3d, 0xc6, 0x6c, 0x69, 0xa4, 0x25, 0xb3,
+        0x61, 0x02, 0x9d, 0x09, 0x04, 0x3f, 0x72, 0x3d,
+        0xd8, 0x27, 0xd3, 0xb0, 0x5a, 0x45, 0x77, 0xb7,
+        0x36, 0xe4, 0x26, 0x23, 0xcc, 0x12, 0xb8, 0xae,
+        0xde, 0xa7, 0xb6, 0x3a, 0x82, 0x3c, 0x7c, 0x24,
+        0x59, 0x0a, 0xf8, 0x96, 0x43, 0x8b, 0xa3, 0x29,
+        0x36, 0x3f, 0x91, 0x7f, 0x5d, 0xc7, 0x23, 0x94,
+        0x29, 0x7f, 0x0a, 0xce, 0x0a, 0xbd, 0x8d, 0x9b,
+        0x2f, 0x19, 0x17, 0xaa, 0xd5, 0x8e, 0xec, 0x66,
+        0xa2, 0x37, 0xeb, 0x3f, 0x57, 0x53, 0x3c, 0xf2,
+        0xaa, 0xbb, 0x79, 0x19, 0x4b, 0x90, 0x7e, 0xa7,
+        0xa3, 0x99, 0xfe, 0x84, 0x4c, 0x89, 0xf0, 0x3d,
+        0x02, 0x03, 0x01, 0x00, 0x01, 0xa3, 0x6e, 0x30,
+        0x6c, 0x30, 0x1b, 0x06, 0x03, 0x55, 0x1d, 0x11,
+        0x04, 0x14, 0x30, 0x12, 0x81, 0x10, 0x77, 0x77,
+        0x77, 0x40, 0x73, 0x6e, 0x61, 0x6b, 0x65, 0x6f,
+        0x69, 0x6c, 0x2e, 0x64, 0x6f, 0x6d, 0x30, 0x3a,
+        0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x86, 0xf8,
+        0x42, 0x01, 0x0d, 0x04, 0x2d, 0x16, 0x2b, 0x6d,
+        0x6f, 0x64, 0x5f, 0x73, 0x73, 0x6c, 0x20, 0x67,
+        0x65, 0x6e, 0x65, 0x72, 0x61, 0x74, 0x65, 0x64,
+        0x20, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x20,
+        0x73, 0x65, 0x72, 0x76, 0x65, 0x72, 0x20, 0x63,
+        0x65, 0x72, 0x74, 0x69, 0x66, 0x69, 0x63, 0x61,
+        0x74, 0x65, 0x30, 0x11, 0x06, 0x09, 0x60, 0x86,
+        0x48, 0x01, 0x86, 0xf8, 0x42, 0x01, 0x01, 0x04,
+        0x04, 0x03, 0x02, 0x06, 0x40, 0x30, 0x0d, 0x06,
+        0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01,
+        0x01, 0x04, 0x05, 0x00, 0x03, 0x81, 0x81, 0x00,
+        0xae, 0x79, 0x79, 0x22, 0x90, 0x75, 0xfd, 0xa6,
+        0xd5, 0xc4, 0xb8, 0xc4, 0x99, 0x4e, 0x1c, 0x05,
+        0x7c, 0x91, 0x59, 0xbe, 0x89, 0x0d, 0x3d, 0xc6,
+        0x8c, 0xa3, 0xcf, 0xf6, 0xba, 0x23, 0xdf, 0xb8,
+        0xae, 0x44, 0x68, 0x8a, 0x8f, 0xb9, 0x8b, 0xcb,
+        0x12, 0xda, 0xe6, 0xa2, 0xca, 0xa5, 0xa6, 0x55,
+        0xd9, 0xd2, 0xa1, 0xad, 0xba, 0x9b, 0x2c, 0x44,
+        0x95, 0x1d, 0x4a, 0x90, 0x59, 0x7f, 0x83, 0xae,
+        0x81, 0x5e, 0x3f, 0x92, 0xe0, 0x14, 0x41, 0x82,
+        0x4e, 0x7f, 0x53, 0xfd, 0x10, 0x23, 0xeb, 0x8a,
+        0xeb, 0xe9, 0x92, 0xea, 0x61, 0xf2, 0x8e, 0x19,
+        0xa1, 0xd3, 0x49, 0xc0, 0x84, 0x34, 0x1e, 0x2e,
+        0x6e, 0xf6, 0x98, 0xe2, 0x87, 0x53, 0xd6, 0x55,
+        0xd9, 0x1a, 0x8a, 0x92, 0x5c, 0xad, 0xdc, 0x1e,
+        0x1c, 0x30, 0xa7, 0x65, 0x9d, 0xc2, 0x4f, 0x60,
+        0xd2, 0x6f, 0xdb, 0xe0, 0x9f, 0x9e, 0xbc, 0x41
+    };
+    uint32_t certs_buf_len = sizeof(certs_buf);
+    /* skip the certificates length and the certificate length */
+    uint8_t *cert = certs_buf + 6;
+    uint32_t cert_len = certs_buf_len - 6;
+    TLSCertInfo info;
+    int r;
+    uint32_t cache_size = TLSCertCacheGetSize();
+
+    SSLState *ssl_state1 = SSLStateAlloc();
+    SSLState *ssl_state2 = SSLStateAlloc();
+    if (ssl_state1 == NULL || ssl_state2 == NULL)
+        goto end;
+
+    if (TLSCertCacheSetup(4) != 0)
+        goto end;
+
+    r = DecodeTLSHandshakeServerCertificate(ssl_state1, certs_buf, certs_buf_len);
+    if (r != (int)certs_buf_len || ssl_state1->server_connp.cert0_subject == NULL ||
+        ssl_state1->server_connp.cert0_fingerprint == NULL) {
+        printf("first decoding failed (%d): ", r);
+        goto end;
+    }
+
+    memset(&info, 0, sizeof(info));
+    unsigned char *hash = ComputeSHA1(cert, cert_len);
+    if (hash == NULL)
+        goto end;
+    memcpy(info.sha1, hash, TLS_CERT_SHA1_LEN);
+    SCFree(hash);
+    info.cert_len = cert_len;
+
+    if (!TLSCertCacheLookup(&info)) {
+        printf("certificate not cached: ");
+        goto end;
+    }
+    if (!(info.flags & TLS_CERT_SUBJECT) ||
+        strcmp(info.subject, ssl_state1->server_connp.cert0_subject) != 0) {
+        printf("cached subject \"%s\" differs: ", info.subject);
+        goto end;
+    }
+
+    /* alter the cached subject, the next handshake must use it */
+    strlcpy(info.subject, "CN=cached", sizeof(info.subject));
+    TLSCertCacheStore(&info);
+
+    r = DecodeTLSHandshakeServerCertificate(ssl_state2, certs_buf, certs_buf_len);
+    if (r != (int)certs_buf_len || ssl_state2->server_connp.cert0_subject == NULL ||
+        strcmp(ssl_state2->server_connp.cert0_subject, "CN=cached") != 0) {
+        printf("second decoding didn't use the cache: ");
+        goto end;
+    }
+    if (ssl_state2->server_connp.cert0_fingerprint == NULL ||
+        strcmp(ssl_state2->server_connp.cert0_fingerprint,
+               ssl_state1->server_connp.cert0_fingerprint) != 0) {
+        printf("fingerprint differs: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (ssl_state1 != NULL)
+        SSLStateFree(ssl_state1);
+    if (ssl_state2 != NULL)
+        SSLStateFree(ssl_state2);
+    /* restore the configured cache */
+    TLSCertCacheSetup(cache_size);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SSLParserRegisterTests(void)
@@ -4198,6 +4428,7 @@ void SSLParserRegisterTests(void)
     UtRegisterTest("SSLParserTest23", SSLParserTest23, 1);
     UtRegisterTest("SSLParserTest24", SSLParserTest24, 1);
     UtRegisterTest("SSLParserTest25", SSLParserTest25, 1);
+    UtRegisterTest("SSLParserTest26", SSLParserTest26, 1);
 
     UtRegisterTest("SSLParserMultimsgTest01", SSLParserMultimsgTest01, 1);
     UtRegisterTest("SSLParserMultimsgTest02", SSLParserMultimsgTest02, 1);
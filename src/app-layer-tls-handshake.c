@@ -51,9 +51,35 @@
 #include "util-decode-der-get.h"
 
 #include "util-crypt.h"
+#include "threads.h"
 
 #define SSLV3_RECORD_LEN 5
 
+/** number of entries per set of the certificate cache */
+#define TLS_CERT_CACHE_WAYS 4
+
+typedef struct TLSCertCacheEntry_ {
+    TLSCertInfo info;
+    uint32_t last_used;
+} TLSCertCacheEntry;
+
+typedef struct TLSCertCacheSet_ {
+    SCSpinlock lock;
+    uint32_t tick;
+    TLSCertCacheEntry entries[TLS_CERT_CACHE_WAYS];
+} TLSCertCacheSet;
+
+/**
+ * The certificate cache keeps the decoded fields of the certificates
+ * seen last, keyed by their sha1 fingerprint, so a certificate that is
+ * seen again isn't DER decoded again. It's shared by all threads: a
+ * set associative table, TLS_CERT_CACHE_WAYS entries per set, with a
+ * lock and least recently used eviction per set.
+ */
+static TLSCertCacheSet *tls_cert_cache = NULL;
+/** number of sets, power of 2, 0 if the cache is disabled */
+static uint32_t tls_cert_cache_sets = 0;
+
 static void TLSCertificateErrCodeToWarning(SSLState *ssl_state, uint32_t errcode)
 {
     if (errcode == 0)
@@ -85,16 +111,212 @@ static void TLSCertificateErrCodeToWarning(SSLState *ssl_state, uint32_t errcode
     };
 }
 
+/**
+ * \brief Set up the certificate cache, replacing the current one
+ *
+ * \param size number of entries, rounded down to a power of 2 number
+ *             of sets. 0 disables the cache.
+ *
+ * \retval 0 ok
+ * \retval -1 error, the cache is disabled
+ */
+int TLSCertCacheSetup(uint32_t size)
+{
+    TLSCertCacheFree();
+
+    if (size == 0)
+        return 0;
+    if (size < TLS_CERT_CACHE_WAYS)
+        size = TLS_CERT_CACHE_WAYS;
+    if (size > (1 << 20))
+        size = 1 << 20;
+
+    uint32_t sets = 1;
+    while (sets * 2 * TLS_CERT_CACHE_WAYS <= size)
+        sets *= 2;
+
+    tls_cert_cache = SCMalloc(sets * sizeof(TLSCertCacheSet));
+    if (tls_cert_cache == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "can't allocate the tls certificate "
+                   "cache of %"PRIu32" entries", sets * TLS_CERT_CACHE_WAYS);
+        return -1;
+    }
+    memset(tls_cert_cache, 0, sets * sizeof(TLSCertCacheSet));
+
+    uint32_t u;
+    for (u = 0; u < sets; u++) {
+        SCSpinInit(&tls_cert_cache[u].lock, 0);
+    }
+    tls_cert_cache_sets = sets;
+
+    SCLogDebug("tls certificate cache: %"PRIu32" entries",
+               sets * TLS_CERT_CACHE_WAYS);
+    return 0;
+}
+
+void TLSCertCacheFree(void)
+{
+    uint32_t u;
+
+    if (tls_cert_cache == NULL)
+        return;
+
+    for (u = 0; u < tls_cert_cache_sets; u++) {
+        SCSpinDestroy(&tls_cert_cache[u].lock);
+    }
+    SCFree(tls_cert_cache);
+    tls_cert_cache = NULL;
+    tls_cert_cache_sets = 0;
+}
+
+/** \brief get the number of entries of the certificate cache, 0 if disabled */
+uint32_t TLSCertCacheGetSize(void)
+{
+    return tls_cert_cache_sets * TLS_CERT_CACHE_WAYS;
+}
+
+static inline TLSCertCacheSet *TLSCertCacheGetSet(const TLSCertInfo *info)
+{
+    /* the sha1 is as good a hash as any */
+    uint32_t hash = (uint32_t)info->sha1[0] << 24 | info->sha1[1] << 16 |
+                    info->sha1[2] << 8 | info->sha1[3];
+    return &tls_cert_cache[hash & (tls_cert_cache_sets - 1)];
+}
+
+static inline int TLSCertCacheEntryMatch(const TLSCertCacheEntry *e,
+                                         const TLSCertInfo *info)
+{
+    return (e->info.cert_len == info->cert_len &&
+            memcmp(e->info.sha1, info->sha1, TLS_CERT_SHA1_LEN) == 0);
+}
+
+/**
+ * \brief Look up a certificate in the cache
+ *
+ * \param info sha1 and cert_len set, the other fields are filled in
+ *             from the cache on a hit
+ *
+ * \retval 1 hit
+ * \retval 0 miss or cache disabled
+ */
+int TLSCertCacheLookup(TLSCertInfo *info)
+{
+    int i;
+    int found = 0;
+
+    if (tls_cert_cache == NULL)
+        return 0;
+
+    TLSCertCacheSet *set = TLSCertCacheGetSet(info);
+    SCSpinLock(&set->lock);
+    for (i = 0; i < TLS_CERT_CACHE_WAYS; i++) {
+        TLSCertCacheEntry *e = &set->entries[i];
+        if (TLSCertCacheEntryMatch(e, info)) {
+            *info = e->info;
+            e->last_used = ++set->tick;
+            found = 1;
+            break;
+        }
+    }
+    SCSpinUnlock(&set->lock);
+    return found;
+}
+
+/**
+ * \brief Store a decoded certificate, evicting the least recently used
+ *        entry of its set if needed.
+ */
+void TLSCertCacheStore(const TLSCertInfo *info)
+{
+    int i;
+
+    if (tls_cert_cache == NULL)
+        return;
+
+    TLSCertCacheSet *set = TLSCertCacheGetSet(info);
+    SCSpinLock(&set->lock);
+    TLSCertCacheEntry *e = &set->entries[0];
+    for (i = 0; i < TLS_CERT_CACHE_WAYS; i++) {
+        /* cert_len 0 is an unused entry */
+        if (set->entries[i].info.cert_len == 0 ||
+            TLSCertCacheEntryMatch(&set->entries[i], info)) {
+            e = &set->entries[i];
+            break;
+        }
+        if ((int32_t)(set->entries[i].last_used - e->last_used) < 0)
+            e = &set->entries[i];
+    }
+    e->info = *info;
+    e->last_used = ++set->tick;
+    SCSpinUnlock(&set->lock);
+}
+
+/**
+ * \internal
+ * \brief DER decode the fields we need from a certificate
+ */
+static void TLSCertDecode(uint8_t *input, uint32_t input_len, TLSCertInfo *info)
+{
+    uint32_t errcode = 0;
+
+    Asn1Generic *cert = DecodeDer(input, input_len, &errcode);
+    if (cert == NULL) {
+        info->der_err = errcode;
+        return;
+    }
+    info->flags |= TLS_CERT_DECODED;
+
+    errcode = 0;
+    if (Asn1DerGetSubjectDN(cert, info->subject, sizeof(info->subject), &errcode) == 0)
+        info->flags |= TLS_CERT_SUBJECT;
+    else
+        info->subject_err = errcode;
+
+    errcode = 0;
+    if (Asn1DerGetIssuerDN(cert, info->issuerdn, sizeof(info->issuerdn), &errcode) == 0)
+        info->flags |= TLS_CERT_ISSUER;
+    else
+        info->issuer_err = errcode;
+
+    DerFree(cert);
+}
+
+/**
+ * \internal
+ * \brief Get the decoded fields of a certificate, from the cache if
+ *        the certificate was seen before.
+ */
+static void TLSCertGetInfo(uint8_t *input, uint32_t input_len, TLSCertInfo *info)
+{
+    info->cert_len = input_len;
+    info->flags = 0;
+    info->der_err = info->subject_err = info->issuer_err = 0;
+    info->subject[0] = '\0';
+    info->issuerdn[0] = '\0';
+
+    unsigned char *hash = ComputeSHA1((unsigned char *)input, (int)input_len);
+    if (hash != NULL) {
+        memcpy(info->sha1, hash, TLS_CERT_SHA1_LEN);
+        SCFree(hash);
+        info->flags |= TLS_CERT_SHA1;
+
+        if (TLSCertCacheLookup(info))
+            return;
+    }
+
+    TLSCertDecode(input, input_len, info);
+
+    if (info->flags & TLS_CERT_SHA1)
+        TLSCertCacheStore(info);
+}
+
 int DecodeTLSHandshakeServerCertificate(SSLState *ssl_state, uint8_t *input, uint32_t input_len)
 {
     uint32_t certificates_length, cur_cert_length;
     int i;
-    Asn1Generic *cert;
-    char buffer[256];
-    int rc;
+    TLSCertInfo info;
     int parsed;
     uint8_t *start_data;
-    uint32_t errcode = 0;
 
     if (input_len < 3)
         return 1;
@@ -118,28 +340,24 @@ int DecodeTLSHandshakeServerCertificate(SSLState *ssl_state, uint8_t *input, uin
             AppLayerDecoderEventsSetEvent(ssl_state->f, TLS_DECODER_EVENT_INVALID_CERTIFICATE);
             return -1;
         }
-        cert = DecodeDer(input, cur_cert_length, &errcode);
-        if (cert == NULL) {
-            TLSCertificateErrCodeToWarning(ssl_state, errcode);
-        }
-        if (cert != NULL) {
-            rc = Asn1DerGetSubjectDN(cert, buffer, sizeof(buffer), &errcode);
-            if (rc != 0) {
-                TLSCertificateErrCodeToWarning(ssl_state, errcode);
+        TLSCertGetInfo(input, cur_cert_length, &info);
+        if (!(info.flags & TLS_CERT_DECODED)) {
+            TLSCertificateErrCodeToWarning(ssl_state, info.der_err);
+        } else {
+            if (!(info.flags & TLS_CERT_SUBJECT)) {
+                TLSCertificateErrCodeToWarning(ssl_state, info.subject_err);
             } else {
                 SSLCertsChain *ncert;
-                //SCLogInfo("TLS Cert %d: %s\n", i, buffer);
+                //SCLogInfo("TLS Cert %d: %s\n", i, info.subject);
                 if (i == 0) {
                     if (ssl_state->server_connp.cert0_subject == NULL)
-                        ssl_state->server_connp.cert0_subject = SCStrdup(buffer);
+                        ssl_state->server_connp.cert0_subject = SCStrdup(info.subject);
                     if (ssl_state->server_connp.cert0_subject == NULL) {
-                        DerFree(cert);
                         return -1;
                     }
                 }
                 ncert = (SSLCertsChain *)SCMalloc(sizeof(SSLCertsChain));
                 if (ncert == NULL) {
-                    DerFree(cert);
                     return -1;
                 }
                 memset(ncert, 0, sizeof(*ncert));
@@ -147,39 +365,32 @@ int DecodeTLSHandshakeServerCertificate(SSLState *ssl_state, uint8_t *input, uin
                 ncert->cert_len = cur_cert_length;
                 TAILQ_INSERT_TAIL(&ssl_state->server_connp.certs, ncert, next);
             }
-            rc = Asn1DerGetIssuerDN(cert, buffer, sizeof(buffer), &errcode);
-            if (rc != 0) {
-                TLSCertificateErrCodeToWarning(ssl_state, errcode);
+            if (!(info.flags & TLS_CERT_ISSUER)) {
+                TLSCertificateErrCodeToWarning(ssl_state, info.issuer_err);
             } else {
-                //SCLogInfo("TLS IssuerDN %d: %s\n", i, buffer);
+                //SCLogInfo("TLS IssuerDN %d: %s\n", i, info.issuerdn);
                 if (i == 0) {
                     if (ssl_state->server_connp.cert0_issuerdn == NULL)
-                        ssl_state->server_connp.cert0_issuerdn = SCStrdup(buffer);
+                        ssl_state->server_connp.cert0_issuerdn = SCStrdup(info.issuerdn);
                     if (ssl_state->server_connp.cert0_issuerdn == NULL) {
-                        DerFree(cert);
                         return -1;
                     }
                 }
             }
-            DerFree(cert);
 
             if (i == 0 && ssl_state->server_connp.cert0_fingerprint == NULL) {
-                int msg_len = cur_cert_length;
-                int hash_len = 20;
+                int hash_len = TLS_CERT_SHA1_LEN;
                 int out_len = 60;
                 char out[out_len];
-                unsigned char *hash;
-                hash = ComputeSHA1((unsigned char *) input, (int) msg_len);
                 char *p = out;
                 int j = 0;
 
-                if (hash == NULL) {
+                if (!(info.flags & TLS_CERT_SHA1)) {
                     SCLogWarning(SC_ERR_MEM_ALLOC, "Can not allocate fingerprint string");
                 } else {
                     for (j = 0; j < hash_len; j++, p += 3) {
-                        snprintf(p, 4, j == hash_len - 1 ? "%02x" : "%02x:", hash[j]);
+                        snprintf(p, 4, j == hash_len - 1 ? "%02x" : "%02x:", info.sha1[j]);
                     }
-                    SCFree(hash);
                     ssl_state->server_connp.cert0_fingerprint = SCStrdup(out);
                     if (ssl_state->server_connp.cert0_fingerprint == NULL) {
                         SCLogWarning(SC_ERR_MEM_ALLOC, "Can not allocate fingerprint string");
@@ -35,6 +35,40 @@
 #ifndef __APP_LAYER_TLS_HANDSHAKE_H__
 #define __APP_LAYER_TLS_HANDSHAKE_H__
 
+#define TLS_CERT_SHA1_LEN           20
+#define TLS_CERT_NAME_LEN           256
+
+/** default number of entries of the certificate cache */
+#define TLS_CERT_CACHE_DEFAULT_SIZE 1024
+
+/* TLSCertInfo flags */
+#define TLS_CERT_SHA1               0x01 /**< sha1 is set */
+#define TLS_CERT_DECODED            0x02 /**< DER decoding succeeded */
+#define TLS_CERT_SUBJECT            0x04 /**< subject is set */
+#define TLS_CERT_ISSUER             0x08 /**< issuerdn is set */
+
+/** \brief Decoded fields of a certificate, as kept in the cache */
+typedef struct TLSCertInfo_ {
+    /** key: sha1 of the DER certificate and its length */
+    uint8_t sha1[TLS_CERT_SHA1_LEN];
+    uint32_t cert_len;
+
+    uint8_t flags;
+    /* ERR_DER_* codes of the failed decoding steps */
+    uint32_t der_err;
+    uint32_t subject_err;
+    uint32_t issuer_err;
+
+    char subject[TLS_CERT_NAME_LEN];
+    char issuerdn[TLS_CERT_NAME_LEN];
+} TLSCertInfo;
+
+int TLSCertCacheSetup(uint32_t size);
+void TLSCertCacheFree(void);
+uint32_t TLSCertCacheGetSize(void);
+int TLSCertCacheLookup(TLSCertInfo *info);
+void TLSCertCacheStore(const TLSCertInfo *info);
+
 int DecodeTLSHandshakeServerCertificate(SSLState *ssl_state, uint8_t *input, uint32_t input_len);
 
 #endif /* __APP_LAYER_TLS_HANDSHAKE_H__ */
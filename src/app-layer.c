@@ -59,6 +59,11 @@ struct AppLayerThreadCtx_ {
     uint16_t counter_dns_memcap_state;
     uint16_t counter_dns_memcap_global;
 
+    /* memcap counters of the parsers using the app-layer-parser memcaps */
+    uint16_t counter_memuse[ALPROTO_MAX];
+    uint16_t counter_memcap_state[ALPROTO_MAX];
+    uint16_t counter_memcap_global[ALPROTO_MAX];
+
 #ifdef PROFILING
     uint64_t ticks_start;
     uint64_t ticks_end;
@@ -86,6 +91,29 @@ static void DNSUpdateCounters(ThreadVars *tv, AppLayerThreadCtx *app_tctx)
                          tv->sc_perf_pca, memcap_global);
 }
 
+/** \brief update the memcap counters of a protocol using the parser
+ *         memcaps, see AppLayerParserRegisterGetStateMemuse() */
+static void AppLayerParserUpdateCounters(ThreadVars *tv,
+                                         AppLayerThreadCtx *app_tctx,
+                                         AppProto alproto)
+{
+    uint64_t memuse = 0, memcap_state = 0, memcap_global = 0;
+
+    /* not registered, e.g. in unittests */
+    if (app_tctx->counter_memuse[alproto] == 0)
+        return;
+
+    AppLayerParserMemcapGetCounters(alproto, &memuse, &memcap_state,
+                                    &memcap_global);
+
+    SCPerfCounterSetUI64(app_tctx->counter_memuse[alproto],
+                         tv->sc_perf_pca, memuse);
+    SCPerfCounterSetUI64(app_tctx->counter_memcap_state[alproto],
+                         tv->sc_perf_pca, memcap_state);
+    SCPerfCounterSetUI64(app_tctx->counter_memcap_global[alproto],
+                         tv->sc_perf_pca, memcap_global);
+}
+
 /***** L7 layer dispatchers *****/
 
 int AppLayerHandleTCPData(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
@@ -460,6 +488,9 @@ int AppLayerHandleTCPData(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
         HTPMemuseCounter(tv, ra_ctx);
     else if (*alproto == ALPROTO_DNS)
         DNSUpdateCounters(tv, app_tctx);
+    else if (*alproto != ALPROTO_UNKNOWN &&
+             AppLayerParserProtocolHasMemcap(*alproto))
+        AppLayerParserUpdateCounters(tv, app_tctx, *alproto);
     goto end;
  failure:
     r = -1;
@@ -546,6 +577,9 @@ int AppLayerHandleUdp(ThreadVars *tv, AppLayerThreadCtx *tctx, Packet *p, Flow *
 
     if (alproto == ALPROTO_DNS)
         DNSUpdateCounters(tv, tctx);
+    else if (alproto != ALPROTO_UNKNOWN &&
+             AppLayerParserProtocolHasMemcap(alproto))
+        AppLayerParserUpdateCounters(tv, tctx, alproto);
     SCReturnInt(r);
 }
 
@@ -630,6 +664,25 @@ AppLayerThreadCtx *AppLayerGetCtxThread(ThreadVars *tv)
                 SC_PERF_TYPE_UINT64, "NULL");
         app_tctx->counter_dns_memcap_global = SCPerfTVRegisterCounter("dns.memcap_global", tv,
                 SC_PERF_TYPE_UINT64, "NULL");
+
+        AppProto alproto;
+        for (alproto = 0; alproto < ALPROTO_MAX; alproto++) {
+            const char *alproto_name = AppProtoToString(alproto);
+            char name[64];
+
+            if (alproto_name == NULL || !AppLayerParserProtocolHasMemcap(alproto))
+                continue;
+
+            snprintf(name, sizeof(name), "%s.memuse", alproto_name);
+            app_tctx->counter_memuse[alproto] = SCPerfTVRegisterCounter(name, tv,
+                    SC_PERF_TYPE_UINT64, "NULL");
+            snprintf(name, sizeof(name), "%s.memcap_state", alproto_name);
+            app_tctx->counter_memcap_state[alproto] = SCPerfTVRegisterCounter(name, tv,
+                    SC_PERF_TYPE_UINT64, "NULL");
+            snprintf(name, sizeof(name), "%s.memcap_global", alproto_name);
+            app_tctx->counter_memcap_global[alproto] = SCPerfTVRegisterCounter(name, tv,
+                    SC_PERF_TYPE_UINT64, "NULL");
+        }
     }
 
     goto done;
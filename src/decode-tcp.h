@@ -25,6 +25,8 @@
 #ifndef __DECODE_TCP_H__
 #define __DECODE_TCP_H__
 
+#include "util-checksum-simd.h"
+
 #define TCP_HEADER_LEN                       20
 #define TCP_OPTLENMAX                        40
 #define TCP_OPTMAX                           20 /* every opt is at least 2 bytes
@@ -192,6 +194,13 @@ static inline uint16_t TCPCalculateChecksum(uint16_t *shdr, uint16_t *pkt,
     tlen -= 20;
     pkt += 10;
 
+    if (tlen >= CHECKSUM_SIMD_MIN_LEN) {
+        uint16_t blen = tlen & ~31;
+        csum += ChecksumSumWords(pkt, blen);
+        tlen -= blen;
+        pkt += blen / 2;
+    }
+
     while (tlen >= 32) {
         csum += pkt[0] + pkt[1] + pkt[2] + pkt[3] + pkt[4] + pkt[5] + pkt[6] +
             pkt[7] + pkt[8] + pkt[9] + pkt[10] + pkt[11] + pkt[12] + pkt[13] +
@@ -255,6 +264,13 @@ static inline uint16_t TCPV6CalculateChecksum(uint16_t *shdr, uint16_t *pkt,
     tlen -= 20;
     pkt += 10;
 
+    if (tlen >= CHECKSUM_SIMD_MIN_LEN) {
+        uint16_t blen = tlen & ~31;
+        csum += ChecksumSumWords(pkt, blen);
+        tlen -= blen;
+        pkt += blen / 2;
+    }
+
     while (tlen >= 32) {
         csum += pkt[0] + pkt[1] + pkt[2] + pkt[3] + pkt[4] + pkt[5] + pkt[6] +
             pkt[7] + pkt[8] + pkt[9] + pkt[10] + pkt[11] + pkt[12] + pkt[13] +
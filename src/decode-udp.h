@@ -24,6 +24,8 @@
 #ifndef __DECODE_UDP_H__
 #define __DECODE_UDP_H__
 
+#include "util-checksum-simd.h"
+
 #define UDP_HEADER_LEN         8
 
 /* XXX RAW* needs to be really 'raw', so no ntohs there */
@@ -82,6 +84,13 @@ static inline uint16_t UDPV4CalculateChecksum(uint16_t *shdr, uint16_t *pkt,
     tlen -= 8;
     pkt += 4;
 
+    if (tlen >= CHECKSUM_SIMD_MIN_LEN) {
+        uint16_t blen = tlen & ~31;
+        csum += ChecksumSumWords(pkt, blen);
+        tlen -= blen;
+        pkt += blen / 2;
+    }
+
     while (tlen >= 32) {
         csum += pkt[0] + pkt[1] + pkt[2] + pkt[3] + pkt[4] + pkt[5] + pkt[6] +
             pkt[7] + pkt[8] + pkt[9] + pkt[10] + pkt[11] + pkt[12] + pkt[13] +
@@ -148,6 +157,13 @@ static inline uint16_t UDPV6CalculateChecksum(uint16_t *shdr, uint16_t *pkt,
     tlen -= 8;
     pkt += 4;
 
+    if (tlen >= CHECKSUM_SIMD_MIN_LEN) {
+        uint16_t blen = tlen & ~31;
+        csum += ChecksumSumWords(pkt, blen);
+        tlen -= blen;
+        pkt += blen / 2;
+    }
+
     while (tlen >= 32) {
         csum += pkt[0] + pkt[1] + pkt[2] + pkt[3] + pkt[4] + pkt[5] + pkt[6] +
             pkt[7] + pkt[8] + pkt[9] + pkt[10] + pkt[11] + pkt[12] + pkt[13] +
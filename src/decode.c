@@ -59,6 +59,7 @@
 #include "util-error.h"
 #include "util-print.h"
 #include "tmqh-packetpool.h"
+#include "defrag.h"
 #include "util-profiling.h"
 #include "pkt-var.h"
 #include "util-mpm-ac.h"
@@ -171,6 +172,34 @@ Packet *PacketGetFromQueueOrAlloc(void)
     return p;
 }
 
+/**
+ *  \brief Make sure a Packet can hold datalen bytes of data
+ *
+ * If the data will not fit in the space allocated at Packet creation
+ * the external buffer is allocated now. Used before assembling data
+ * in pieces, so that data already copied doesn't have to be moved
+ * to the external buffer later on. Must be called on a Packet that
+ * doesn't hold any data yet.
+ *
+ *  \param Pointer to the Packet to modify
+ *  \param Length of the data that will be copied in
+ *
+ *  \retval 0 ok
+ *  \retval -1 data too big or allocation failure
+ */
+int PacketReserveData(Packet *p, int datalen)
+{
+    if (unlikely(datalen > MAX_PAYLOAD_SIZE))
+        return -1;
+
+    if (!p->ext_pkt && datalen > (int)default_packet_size) {
+        p->ext_pkt = SCMalloc(MAX_PAYLOAD_SIZE);
+        if (unlikely(p->ext_pkt == NULL))
+            return -1;
+    }
+    return 0;
+}
+
 /**
  *  \brief Copy data to Packet payload at given offset
  *
@@ -426,6 +455,9 @@ void DecodeRegisterPerfCounters(DecodeThreadVars *dtv, ThreadVars *tv)
     dtv->counter_defrag_max_hit =
         SCPerfTVRegisterCounter("defrag.max_frag_hits", tv,
             SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_defrag_tracker_drop =
+        SCPerfTVRegisterCounter("defrag.tracker_drops", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
 
     return;
 }
@@ -477,6 +509,8 @@ DecodeThreadVars *DecodeThreadVarsAlloc(ThreadVars *tv)
     }
     SCLogDebug("vlan tracking is %s", dtv->vlan_disabled == 0 ? "enabled" : "disabled");
 
+    dtv->defrag_frag_pool_id = DefragThreadFragPoolRegister();
+
     return dtv;
 }
 
@@ -489,6 +523,8 @@ void DecodeThreadVarsFree(ThreadVars *tv, DecodeThreadVars *dtv)
         if (dtv->output_flow_thread_data != NULL)
             OutputFlowLogThreadDeinit(tv, dtv->output_flow_thread_data);
 
+        DefragThreadFragPoolUnregister(dtv->defrag_frag_pool_id);
+
         SCFree(dtv);
     }
 }
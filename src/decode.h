@@ -609,6 +609,10 @@ typedef struct DecodeThreadVars_
     uint16_t counter_defrag_ipv6_reassembled;
     uint16_t counter_defrag_ipv6_timeouts;
     uint16_t counter_defrag_max_hit;
+    uint16_t counter_defrag_tracker_drop;
+
+    /** per thread fragment pool id */
+    int defrag_frag_pool_id;
 
 #ifdef __SC_CUDA_SUPPORT__
     CudaThreadVars cuda_vars;
@@ -830,6 +834,7 @@ Packet *PacketGetFromAlloc(void);
 void PacketDecodeFinalize(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p);
 void PacketFree(Packet *p);
 void PacketFreeOrRelease(Packet *p);
+int PacketReserveData(Packet *p, int datalen);
 int PacketCopyData(Packet *p, uint8_t *pktdata, int pktlen);
 int PacketSetData(Packet *p, uint8_t *pktdata, int pktlen);
 int PacketCopyDataOffset(Packet *p, int offset, uint8_t *data, int datalen);
@@ -571,18 +571,21 @@ DefragTracker *DefragGetTrackerFromHash (Packet *p)
                 hb->head = dt;
 
                 /* found our tracker, lock & return */
-                SCMutexLock(&dt->lock);
                 (void) DefragTrackerIncrUsecnt(dt);
                 DRLOCK_UNLOCK(hb);
+                SCMutexLock(&dt->lock);
                 return dt;
             }
         }
     }
 
-    /* lock & return */
-    SCMutexLock(&dt->lock);
+    /* Take our reference while holding the row lock, but don't wait
+     * for the tracker lock with the row still locked: that would block
+     * all other trackers in the row while the tracker is busy. The
+     * reference keeps the tracker from being pruned or timed out. */
     (void) DefragTrackerIncrUsecnt(dt);
     DRLOCK_UNLOCK(hb);
+    SCMutexLock(&dt->lock);
     return dt;
 }
 
@@ -640,18 +643,21 @@ DefragTracker *DefragLookupTrackerFromHash (Packet *p)
                 hb->head = dt;
 
                 /* found our tracker, lock & return */
-                SCMutexLock(&dt->lock);
                 (void) DefragTrackerIncrUsecnt(dt);
                 DRLOCK_UNLOCK(hb);
+                SCMutexLock(&dt->lock);
                 return dt;
             }
         }
     }
 
-    /* lock & return */
-    SCMutexLock(&dt->lock);
+    /* Take our reference while holding the row lock, but don't wait
+     * for the tracker lock with the row still locked: that would block
+     * all other trackers in the row while the tracker is busy. The
+     * reference keeps the tracker from being pruned or timed out. */
     (void) DefragTrackerIncrUsecnt(dt);
     DRLOCK_UNLOCK(hb);
+    SCMutexLock(&dt->lock);
     return dt;
 }
 
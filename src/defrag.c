@@ -49,6 +49,7 @@
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
 #include "util-host-os-info.h"
+#include "util-cpu.h"
 
 #include "defrag.h"
 #include "defrag-hash.h"
@@ -65,6 +66,16 @@
 #define DEFAULT_DEFRAG_HASH_SIZE 0xffff
 #define DEFAULT_DEFRAG_POOL_SIZE 0xffff
 
+/**
+ * Fragments preallocated by each thread pool at most.
+ */
+#define DEFRAG_THREAD_FRAG_PREALLOC 256
+
+/**
+ * Maximum number of per thread fragment pools.
+ */
+#define DEFRAG_THREAD_POOLS_MAX 1024
+
 /**
  * Default timeout (in seconds) before a defragmentation tracker will
  * be released.
@@ -128,7 +139,11 @@ DefragFragReset(Frag *frag)
 {
     if (frag->pkt != NULL)
         SCFree(frag->pkt);
+
+    /* keep the pool id intact, PoolThreadReturn needs it */
+    PoolThreadReserved res = frag->res;
     memset(frag, 0, sizeof(*frag));
+    frag->res = res;
 }
 
 /**
@@ -151,17 +166,74 @@ DefragTrackerFreeFrags(DefragTracker *tracker)
 {
     Frag *frag;
 
-    /* Lock the frag pool as we'll be return items to it. */
-    SCMutexLock(&defrag_context->frag_pool_lock);
-
     while ((frag = TAILQ_FIRST(&tracker->frags)) != NULL) {
         TAILQ_REMOVE(&tracker->frags, frag, next);
 
-        /* Don't SCFree the frag, just give it back to its pool. */
+        /* Don't SCFree the frag, just give it back to its pool. The
+         * frag may go back to the pool of another thread. */
         DefragFragReset(frag);
-        PoolReturn(defrag_context->frag_pool, frag);
+        PoolThreadReturn(defrag_context->frag_pool, frag);
+        (void) SC_ATOMIC_SUB(defrag_context->frag_cnt, 1);
+    }
+}
+
+/**
+ * \brief Register a per thread fragment pool.
+ *
+ * Each decoder thread gets its own pool so that getting a fragment
+ * doesn't contend on a global lock. Fragments can be returned to the
+ * pool of any thread.
+ *
+ * The pools are all set up by DefragContextNew, as other threads access
+ * them without a lock. Registering only claims a free pool. When all of
+ * them are taken the thread uses the shared pool.
+ *
+ * \retval id pool id to use with DefragInsertFrag, 0 is the shared
+ *         pool that is used when no thread pool is available.
+ */
+int
+DefragThreadFragPoolRegister(void)
+{
+    int id;
+    int size;
+
+    if (defrag_context == NULL)
+        return 0;
+
+    SCMutexLock(&defrag_context->frag_pool_lock);
+    size = PoolThreadSize(defrag_context->frag_pool);
+    for (id = 1; id < size; id++) {
+        if (!defrag_context->frag_pool_used[id]) {
+            defrag_context->frag_pool_used[id] = 1;
+            SCMutexUnlock(&defrag_context->frag_pool_lock);
+            SCLogDebug("thread frag pool id %d", id);
+            return id;
+        }
     }
+    SCMutexUnlock(&defrag_context->frag_pool_lock);
+
+    SCLogDebug("all %d thread frag pools in use, using shared pool", size - 1);
+    return 0;
+}
 
+/**
+ * \brief Release a per thread fragment pool.
+ *
+ * Fragments of the pool may still be held by trackers and are returned
+ * to it later, so the pool itself stays. It's handed out again by
+ * DefragThreadFragPoolRegister.
+ *
+ * \param id pool id from DefragThreadFragPoolRegister
+ */
+void
+DefragThreadFragPoolUnregister(int id)
+{
+    if (defrag_context == NULL || id <= 0)
+        return;
+
+    SCMutexLock(&defrag_context->frag_pool_lock);
+    if (id < PoolThreadSize(defrag_context->frag_pool))
+        defrag_context->frag_pool_used[id] = 0;
     SCMutexUnlock(&defrag_context->frag_pool_lock);
 }
 
@@ -191,8 +263,30 @@ DefragContextNew(void)
     if (!ConfGetInt("defrag.max-frags", &frag_pool_size) || frag_pool_size == 0) {
         frag_pool_size = DEFAULT_DEFRAG_POOL_SIZE;
     }
-    intmax_t frag_pool_prealloc = frag_pool_size / 2;
-    dc->frag_pool = PoolInit(frag_pool_size, frag_pool_prealloc,
+    dc->max_frags = (uint32_t)frag_pool_size;
+    SC_ATOMIC_INIT(dc->frag_cnt);
+
+    /* Number of per thread pools. Decoder threads claim one each through
+     * DefragThreadFragPoolRegister, any others use the shared pool. */
+    intmax_t thread_pools;
+    if (!ConfGetInt("defrag.thread-pools", &thread_pools) || thread_pools <= 0) {
+        thread_pools = UtilCpuGetNumProcessorsOnline();
+        if (thread_pools <= 0)
+            thread_pools = 1;
+    }
+    if (thread_pools > DEFRAG_THREAD_POOLS_MAX)
+        thread_pools = DEFRAG_THREAD_POOLS_MAX;
+
+    /* the pools preallocate at most half of max-frags together */
+    intmax_t frag_pool_prealloc = (frag_pool_size / 2) / (thread_pools + 1);
+    if (frag_pool_prealloc > DEFRAG_THREAD_FRAG_PREALLOC)
+        frag_pool_prealloc = DEFRAG_THREAD_FRAG_PREALLOC;
+
+    /* Pool 0 is shared by callers without a thread pool. All pools are
+     * set up here: the array must not move once threads use it. */
+    dc->frag_pool = PoolThreadInit(thread_pools + 1,
+        0, /* unlimited, max_frags is enforced globally */
+        (uint32_t)frag_pool_prealloc,
         sizeof(Frag),
         NULL, DefragFragInit, dc, NULL, NULL);
     if (dc->frag_pool == NULL) {
@@ -200,6 +294,12 @@ DefragContextNew(void)
             "Defrag: Failed to initialize fragment pool.");
         exit(EXIT_FAILURE);
     }
+    dc->frag_pool_used = SCCalloc(thread_pools + 1, sizeof(uint8_t));
+    if (dc->frag_pool_used == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC,
+            "Defrag: Failed to initialize fragment pool.");
+        exit(EXIT_FAILURE);
+    }
     if (SCMutexInit(&dc->frag_pool_lock, NULL) != 0) {
         SCLogError(SC_ERR_MUTEX,
             "Defrag: Failed to initialize frag pool mutex.");
@@ -230,7 +330,9 @@ DefragContextNew(void)
     SCLogDebug("\tMaximum defrag trackers: %"PRIuMAX, tracker_pool_size);
     SCLogDebug("\tPreallocated defrag trackers: %"PRIuMAX, tracker_pool_size);
     SCLogDebug("\tMaximum fragments: %"PRIuMAX, (uintmax_t)frag_pool_size);
-    SCLogDebug("\tPreallocated fragments: %"PRIuMAX, (uintmax_t)frag_pool_prealloc);
+    SCLogDebug("\tThread fragment pools: %"PRIuMAX, (uintmax_t)thread_pools);
+    SCLogDebug("\tPreallocated fragments per pool: %"PRIuMAX,
+            (uintmax_t)frag_pool_prealloc);
 
     return dc;
 }
@@ -241,7 +343,10 @@ DefragContextDestroy(DefragContext *dc)
     if (dc == NULL)
         return;
 
-    PoolFree(dc->frag_pool);
+    PoolThreadFree(dc->frag_pool);
+    SCFree(dc->frag_pool_used);
+    SCMutexDestroy(&dc->frag_pool_lock);
+    SC_ATOMIC_DESTROY(dc->frag_cnt);
     SCFree(dc);
 }
 
@@ -263,10 +368,19 @@ Defrag4Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
      * fragments are inserted if frag_offset order. */
     Frag *frag;
     int len = 0;
+    int hdr_len = 0;
+    int end = 0;
     TAILQ_FOREACH(frag, &tracker->frags, next) {
         if (frag->skip)
             continue;
 
+        /* track the headers of the first fragment and the end of the
+         * data, together they bound the size of the packet. */
+        if (frag->offset == 0)
+            hdr_len = frag->len - frag->data_len;
+        if (frag->offset + frag->data_len > end)
+            end = frag->offset + frag->data_len;
+
         if (frag == TAILQ_FIRST(&tracker->frags)) {
             if (frag->offset != 0) {
                 goto done;
@@ -296,6 +410,11 @@ Defrag4Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
     PKT_SET_SRC(rp, PKT_SRC_DEFRAG);
     rp->recursion_level = p->recursion_level;
 
+    /* Size the packet for the whole payload up front so the fragments
+     * are copied straight to their final place. On failure the copies
+     * below allocate (or fail) like before. */
+    (void) PacketReserveData(rp, hdr_len + end);
+
     int fragmentable_offset = 0;
     int fragmentable_len = 0;
     int hlen = 0;
@@ -376,10 +495,19 @@ Defrag6Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
      * fragments are inserted if frag_offset order. */
     Frag *frag;
     int len = 0;
+    int hdr_len = 0;
+    int end = 0;
     TAILQ_FOREACH(frag, &tracker->frags, next) {
         if (frag->skip)
             continue;
 
+        /* track the headers of the first fragment and the end of the
+         * data, together they bound the size of the packet. */
+        if (frag->offset == 0)
+            hdr_len = frag->len - frag->data_len;
+        if (frag->offset + frag->data_len > end)
+            end = frag->offset + frag->data_len;
+
         if (frag == TAILQ_FIRST(&tracker->frags)) {
             if (frag->offset != 0) {
                 goto done;
@@ -400,8 +528,7 @@ Defrag6Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
 
     /* Allocate a Packet for the reassembled packet.  On failure we
      * SCFree all the resources held by this tracker. */
-    rp = PacketDefragPktSetup(p, (uint8_t *)p->ip6h,
-            IPV6_GET_PLEN(p) + sizeof(IPV6Hdr), 0);
+    rp = PacketDefragPktSetup(p, NULL, 0, 0);
     if (rp == NULL) {
         SCLogError(SC_ERR_MEM_ALLOC, "Failed to allocate packet for "
                 "fragmentation re-assembly, dumping fragments.");
@@ -409,6 +536,11 @@ Defrag6Reassemble(ThreadVars *tv, DefragTracker *tracker, Packet *p)
     }
     PKT_SET_SRC(rp, PKT_SRC_DEFRAG);
 
+    /* Size the packet for the whole payload up front so the fragments
+     * are copied straight to their final place. On failure the copies
+     * below allocate (or fail) like before. */
+    (void) PacketReserveData(rp, hdr_len + end);
+
     int unfragmentable_len = 0;
     int fragmentable_offset = 0;
     int fragmentable_len = 0;
@@ -695,31 +827,40 @@ insert:
     }
 
     /* Allocate fragment and insert. */
-    SCMutexLock(&defrag_context->frag_pool_lock);
-    Frag *new = PoolGet(defrag_context->frag_pool);
-    SCMutexUnlock(&defrag_context->frag_pool_lock);
-    if (new == NULL) {
-        if (af == AF_INET) {
-            ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
-        } else {
-            ENGINE_SET_EVENT(p, IPV6_FRAG_IGNORED);
+    if (SC_ATOMIC_ADD(defrag_context->frag_cnt, 1) > defrag_context->max_frags) {
+        (void) SC_ATOMIC_SUB(defrag_context->frag_cnt, 1);
+        if (tv != NULL && dtv != NULL) {
+            SCPerfCounterIncr(dtv->counter_defrag_max_hit, tv->sc_perf_pca);
         }
-        goto done;
+        goto lost;
     }
-    new->pkt = SCMalloc(GET_PKT_LEN(p));
+    Frag *new = PoolThreadGetById(defrag_context->frag_pool,
+            dtv != NULL ? dtv->defrag_frag_pool_id : 0);
+    if (new == NULL) {
+        (void) SC_ATOMIC_SUB(defrag_context->frag_cnt, 1);
+        goto lost;
+    }
+    /* The first fragment provides the headers of the reassembled
+     * packet so it is stored as a whole. Of the other fragments only
+     * the data is used, so store just that. */
+    if (frag_offset + ltrim == 0) {
+        new->len = GET_PKT_LEN(p);
+        new->data_offset = data_offset;
+    } else {
+        new->len = data_len - ltrim;
+        new->data_offset = 0;
+    }
+    new->pkt = SCMalloc(new->len);
     if (new->pkt == NULL) {
-        SCMutexLock(&defrag_context->frag_pool_lock);
-        PoolReturn(defrag_context->frag_pool, new);
-        SCMutexUnlock(&defrag_context->frag_pool_lock);
-        if (af == AF_INET) {
-            ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
-        } else {
-            ENGINE_SET_EVENT(p, IPV6_FRAG_IGNORED);
-        }
-        goto done;
+        PoolThreadReturn(defrag_context->frag_pool, new);
+        (void) SC_ATOMIC_SUB(defrag_context->frag_cnt, 1);
+        goto lost;
+    }
+    if (frag_offset + ltrim == 0) {
+        memcpy(new->pkt, GET_PKT_DATA(p), new->len);
+    } else {
+        memcpy(new->pkt, GET_PKT_DATA(p) + data_offset + ltrim, new->len);
     }
-    memcpy(new->pkt, GET_PKT_DATA(p) + ltrim, GET_PKT_LEN(p) - ltrim);
-    new->len = GET_PKT_LEN(p) - ltrim;
     /* in case of unfragmentable exthdrs, update the 'next hdr' field
      * in the raw buffer so the reassembled packet will point to the
      * correct next header after stripping the frag header */
@@ -733,7 +874,6 @@ insert:
 
     new->hlen = hlen;
     new->offset = frag_offset + ltrim;
-    new->data_offset = data_offset;
     new->data_len = data_len - ltrim;
     new->ip_hdr_offset = ip_hdr_offset;
     new->frag_hdr_offset = frag_hdr_offset;
@@ -798,6 +938,19 @@ done:
         }
     }
     return r;
+
+lost:
+    /* Without this fragment the packet can never be reassembled. Give
+     * the fragments we hold back so they can be used by trackers that
+     * can still complete, and drop the rest of ours early. */
+    if (af == AF_INET) {
+        ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
+    } else {
+        ENGINE_SET_EVENT(p, IPV6_FRAG_IGNORED);
+    }
+    tracker->hopeless = 1;
+    DefragTrackerFreeFrags(tracker);
+    goto done;
 }
 
 /**
@@ -929,6 +1082,22 @@ Defrag(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, PacketQueue *pq)
     if (tracker == NULL)
         return NULL;
 
+    /* Drop fragments for a tracker that can't complete anymore before
+     * doing any work on them. */
+    if (tracker->hopeless) {
+        if (tv != NULL && dtv != NULL) {
+            SCPerfCounterIncr(dtv->counter_defrag_tracker_drop,
+                tv->sc_perf_pca);
+        }
+        if (af == AF_INET) {
+            ENGINE_SET_EVENT(p, IPV4_FRAG_IGNORED);
+        } else {
+            ENGINE_SET_EVENT(p, IPV6_FRAG_IGNORED);
+        }
+        DefragTrackerRelease(tracker);
+        return NULL;
+    }
+
     Packet *rp = DefragInsertFrag(tv, dtv, tracker, p, pq);
     DefragTrackerRelease(tracker);
 
@@ -1524,7 +1693,7 @@ DefragDoSturgesNovakTest(int policy, u_char *expected, size_t expected_len)
     SCFree(reassembled);
 
     /* Make sure all frags were returned back to the pool. */
-    if (defrag_context->frag_pool->outstanding != 0) {
+    if (SC_ATOMIC_GET(defrag_context->frag_cnt) != 0) {
         goto end;
     }
 
@@ -1652,8 +1821,8 @@ IPV6DefragDoSturgesNovakTest(int policy, u_char *expected, size_t expected_len)
     SCFree(reassembled);
 
     /* Make sure all frags were returned to the pool. */
-    if (defrag_context->frag_pool->outstanding != 0) {
-        printf("defrag_context->frag_pool->outstanding %u: ", defrag_context->frag_pool->outstanding);
+    if (SC_ATOMIC_GET(defrag_context->frag_cnt) != 0) {
+        printf("defrag_context->frag_cnt %u: ", SC_ATOMIC_GET(defrag_context->frag_cnt));
         goto end;
     }
 
@@ -2170,7 +2339,7 @@ DefragIPv4NoDataTest(void)
 
     /* The fragment should have been ignored so no fragments should
      * have been allocated from the pool. */
-    if (dc->frag_pool->outstanding != 0)
+    if (SC_ATOMIC_GET(dc->frag_cnt) != 0)
         return 0;
 
     ret = 1;
@@ -2211,7 +2380,7 @@ DefragIPv4TooLargeTest(void)
 
     /* The fragment should have been ignored so no fragments should have
      * been allocated from the pool. */
-    if (dc->frag_pool->outstanding != 0)
+    if (SC_ATOMIC_GET(dc->frag_cnt) != 0)
         return 0;
 
     ret = 1;
@@ -2321,6 +2490,204 @@ end:
     return ret;
 }
 
+/**
+ * Test that once a fragment is lost to the frag cap the tracker gives
+ * back its fragments and the rest of the fragments are dropped early.
+ */
+static int
+DefragHopelessTrackerTest(void)
+{
+    Packet *p1 = NULL, *p2 = NULL, *p3 = NULL;
+    int ret = 0;
+
+    DefragInit();
+
+    /* Only allow a single fragment to be outstanding. */
+    defrag_context->max_frags = 1;
+
+    p1 = BuildTestPacket(1, 0, 1, 'A', 8);
+    if (p1 == NULL)
+        goto end;
+    p2 = BuildTestPacket(1, 1, 1, 'B', 8);
+    if (p2 == NULL)
+        goto end;
+    p3 = BuildTestPacket(1, 2, 0, 'C', 3);
+    if (p3 == NULL)
+        goto end;
+
+    if (Defrag(NULL, NULL, p1, NULL) != NULL)
+        goto end;
+    if (SC_ATOMIC_GET(defrag_context->frag_cnt) != 1) {
+        printf("frag_cnt %u, expected 1: ",
+                SC_ATOMIC_GET(defrag_context->frag_cnt));
+        goto end;
+    }
+
+    /* Over the cap: the tracker can't complete anymore and should have
+     * returned the fragment it held. */
+    if (Defrag(NULL, NULL, p2, NULL) != NULL)
+        goto end;
+    if (!ENGINE_ISSET_EVENT(p2, IPV4_FRAG_IGNORED)) {
+        printf("p2 not ignored: ");
+        goto end;
+    }
+    if (SC_ATOMIC_GET(defrag_context->frag_cnt) != 0) {
+        printf("frag_cnt %u, expected 0: ",
+                SC_ATOMIC_GET(defrag_context->frag_cnt));
+        goto end;
+    }
+
+    /* There is room again, but the last fragment belongs to a hopeless
+     * tracker so it should be dropped without being stored. */
+    if (Defrag(NULL, NULL, p3, NULL) != NULL)
+        goto end;
+    if (!ENGINE_ISSET_EVENT(p3, IPV4_FRAG_IGNORED)) {
+        printf("p3 not ignored: ");
+        goto end;
+    }
+    if (SC_ATOMIC_GET(defrag_context->frag_cnt) != 0) {
+        printf("frag_cnt %u, expected 0: ",
+                SC_ATOMIC_GET(defrag_context->frag_cnt));
+        goto end;
+    }
+
+    ret = 1;
+end:
+    if (p1 != NULL)
+        SCFree(p1);
+    if (p2 != NULL)
+        SCFree(p2);
+    if (p3 != NULL)
+        SCFree(p3);
+    DefragDestroy();
+    return ret;
+}
+
+/**
+ * Test that registering thread pools only claims pools set up at init,
+ * falls back to the shared pool when they are all taken and reuses a
+ * released pool.
+ */
+static int
+DefragThreadFragPoolTest(void)
+{
+    int ret = 0;
+    int id = 0;
+    int i, size;
+    PoolThreadElement *array;
+
+    DefragInit();
+
+    size = PoolThreadSize(defrag_context->frag_pool);
+    array = defrag_context->frag_pool->array;
+    if (size < 2) {
+        printf("no thread pools: ");
+        goto end;
+    }
+
+    for (i = 1; i < size; i++) {
+        id = DefragThreadFragPoolRegister();
+        if (id != i) {
+            printf("expected pool %d, got %d: ", i, id);
+            goto end;
+        }
+    }
+    if (DefragThreadFragPoolRegister() != 0) {
+        printf("expected the shared pool: ");
+        goto end;
+    }
+
+    DefragThreadFragPoolUnregister(1);
+    if (DefragThreadFragPoolRegister() != 1) {
+        printf("released pool not reused: ");
+        goto end;
+    }
+
+    if (PoolThreadSize(defrag_context->frag_pool) != size ||
+        defrag_context->frag_pool->array != array) {
+        printf("thread pool array changed: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    DefragDestroy();
+    return ret;
+}
+
+/**
+ * Test reassembly of a packet that doesn't fit in the packet's own
+ * buffer, so the payload has to go to the external buffer.
+ */
+static int
+DefragLargePacketTest(void)
+{
+    Packet *p1 = NULL, *p2 = NULL, *p3 = NULL;
+    Packet *reassembled = NULL;
+    int id = 12;
+    int i;
+    int ret = 0;
+
+    DefragInit();
+
+    p1 = BuildTestPacket(id, 0, 1, 'A', 1000);
+    if (p1 == NULL)
+        goto end;
+    p2 = BuildTestPacket(id, 125, 1, 'B', 1000);
+    if (p2 == NULL)
+        goto end;
+    p3 = BuildTestPacket(id, 250, 0, 'C', 1000);
+    if (p3 == NULL)
+        goto end;
+
+    if (Defrag(NULL, NULL, p3, NULL) != NULL)
+        goto end;
+    if (Defrag(NULL, NULL, p2, NULL) != NULL)
+        goto end;
+    reassembled = Defrag(NULL, NULL, p1, NULL);
+    if (reassembled == NULL)
+        goto end;
+
+    if (reassembled->ext_pkt == NULL) {
+        printf("expected external buffer: ");
+        goto end;
+    }
+    if (IPV4_GET_IPLEN(reassembled) != 3020) {
+        printf("ip len %u, expected 3020: ", IPV4_GET_IPLEN(reassembled));
+        goto end;
+    }
+    if (GET_PKT_LEN(reassembled) != 3020)
+        goto end;
+
+    for (i = 20; i < 1020; i++) {
+        if (GET_PKT_DATA(reassembled)[i] != 'A')
+            goto end;
+    }
+    for (i = 1020; i < 2020; i++) {
+        if (GET_PKT_DATA(reassembled)[i] != 'B')
+            goto end;
+    }
+    for (i = 2020; i < 3020; i++) {
+        if (GET_PKT_DATA(reassembled)[i] != 'C')
+            goto end;
+    }
+
+    ret = 1;
+end:
+    if (p1 != NULL)
+        SCFree(p1);
+    if (p2 != NULL)
+        SCFree(p2);
+    if (p3 != NULL)
+        SCFree(p3);
+    if (reassembled != NULL) {
+        PACKET_FREE_EXTDATA(reassembled);
+        SCFree(reassembled);
+    }
+    DefragDestroy();
+    return ret;
+}
+
 #endif /* UNITTESTS */
 
 void
@@ -2369,6 +2736,12 @@ DefragRegisterTests(void)
 
     UtRegisterTest("DefragTimeoutTest",
         DefragTimeoutTest, 1);
+    UtRegisterTest("DefragHopelessTrackerTest",
+        DefragHopelessTrackerTest, 1);
+    UtRegisterTest("DefragThreadFragPoolTest",
+        DefragThreadFragPoolTest, 1);
+    UtRegisterTest("DefragLargePacketTest",
+        DefragLargePacketTest, 1);
 #endif /* UNITTESTS */
 }
 
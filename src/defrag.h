@@ -25,14 +25,20 @@
 #define __DEFRAG_H__
 
 #include "util-pool.h"
+#include "util-pool-thread.h"
 
 /**
  * A context for an instance of a fragmentation re-assembler, in case
  * we ever need more than one.
  */
 typedef struct DefragContext_ {
-    Pool *frag_pool; /**< Pool of fragments. */
-    SCMutex frag_pool_lock;
+    PoolThread *frag_pool; /**< Per thread pools of fragments. */
+    SCMutex frag_pool_lock; /**< Protects frag_pool_used. */
+    uint8_t *frag_pool_used; /**< Per pool id, set if a thread claimed the
+                              *   pool. */
+
+    uint32_t max_frags; /**< Max fragments outstanding over all pools. */
+    SC_ATOMIC_DECLARE(unsigned int, frag_cnt); /**< Fragments outstanding. */
 
     time_t timeout; /**< Default timeout. */
 } DefragContext;
@@ -41,6 +47,8 @@ typedef struct DefragContext_ {
  * Storage for an individual fragment.
  */
 typedef struct Frag_ {
+    PoolThreadReserved res;     /**< Pool id, managed by PoolThread. */
+
     uint16_t offset;            /**< The offset of this fragment, already
                                  *   multiplied by 8. */
 
@@ -56,7 +64,9 @@ typedef struct Frag_ {
     uint16_t frag_hdr_offset;   /**< Offset in the packet where the frag
                                  * header starts. */
 
-    uint16_t data_offset;       /**< Offset to the packet data. */
+    uint16_t data_offset;       /**< Offset to the packet data. Only the
+                                 * first fragment is stored with its
+                                 * headers, for the others this is 0. */
     uint16_t data_len;          /**< Length of data. */
 
     uint16_t ltrim;             /**< Number of leading bytes to trim when
@@ -79,6 +89,7 @@ typedef struct Frag_ {
     (t)->af = 0; \
     (t)->seen_last = 0; \
     (t)->remove = 0; \
+    (t)->hopeless = 0; \
     CLEAR_ADDR(&(t)->src_addr); \
     CLEAR_ADDR(&(t)->dst_addr); \
     (t)->frags.tqh_first = NULL; \
@@ -107,6 +118,10 @@ typedef struct DefragTracker_ {
 
     uint8_t remove; /**< remove */
 
+    uint8_t hopeless; /**< A fragment was lost, this tracker can't be
+                       * reassembled anymore. Its remaining fragments
+                       * are dropped until it times out. */
+
     Address src_addr; /**< Source address for this tracker. */
     Address dst_addr; /**< Destination address for this tracker. */
 
@@ -130,6 +145,8 @@ typedef struct DefragTracker_ {
 void DefragInit(void);
 void DefragDestroy(void);
 void DefragReload(void); /**< use only in unittests */
+int DefragThreadFragPoolRegister(void);
+void DefragThreadFragPoolUnregister(int id);
 
 uint8_t DefragGetOsPolicy(Packet *);
 void DefragTrackerFreeFrags(DefragTracker *);
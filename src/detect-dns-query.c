@@ -94,6 +94,9 @@ static int DetectDnsQuerySetup(DetectEngineCtx *de_ctx, Signature *s, char *str)
 {
     s->list = DETECT_SM_LIST_DNSQUERY_MATCH;
     s->alproto = ALPROTO_DNS;
+
+    /* the parser only keeps the query names if something uses them */
+    DNSConfigSetStore(DNS_STORE_QUERIES);
     return 0;
 }
 
@@ -320,6 +320,12 @@ void PacketAlertFinalize(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx
         }
     }
 
+    if (p->alerts.cnt > 0 && p->flow != NULL) {
+        FLOWLOCK_WRLOCK(p->flow);
+        p->flow->flags |= FLOW_HAS_ALERTS;
+        FLOWLOCK_UNLOCK(p->flow);
+    }
+
     /* At this point, we should have all the new alerts. Now check the tag
      * keyword context for sessions and hosts */
     if (!(p->flags & PKT_PSEUDO_STREAM_END))
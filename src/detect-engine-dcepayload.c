@@ -68,7 +68,7 @@ int DetectEngineInspectDcePayload(DetectEngineCtx *de_ctx,
     SCEnter();
     DCERPCState *dcerpc_state = (DCERPCState *)alstate;
     uint8_t *dce_stub_data = NULL;
-    uint16_t dce_stub_data_len;
+    uint32_t dce_stub_data_len;
     int r = 0;
 
     if (s->sm_lists[DETECT_SM_LIST_DMATCH] == NULL || dcerpc_state == NULL) {
@@ -10128,6 +10128,130 @@ int DcePayloadParseTest46(void)
     return result;
 }
 
+/**
+ * \test A content split over two fragments of a request, that arrive in
+ *       separate parser runs, matches once the second fragment is in.
+ */
+int DcePayloadParseTest47(void)
+{
+    int result = 0;
+
+    uint8_t request1[] = {
+        0x05, 0x00, 0x00, 0x01, 0x10, 0x00, 0x00, 0x00,
+        0x24, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+        0x17, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1a, 0x00,
+        0x77, 0x65, 0x20, 0x6e, 0x65, 0x65, 0x64, 0x20, /* "we need " */
+        0x74, 0x6f, 0x20, 0x66                          /* "to f" */
+    };
+    uint32_t request1_len = sizeof(request1);
+
+    uint8_t request2[] = {
+        0x05, 0x00, 0x00, 0x02, 0x10, 0x00, 0x00, 0x00,
+        0x23, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+        0x0b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1a, 0x00,
+        0x69, 0x78, 0x20, 0x74, 0x68, 0x69, 0x73, 0x20, /* "ix this " */
+        0x6e, 0x6f, 0x77                                /* "now" */
+    };
+    uint32_t request2_len = sizeof(request2);
+
+    TcpSession ssn;
+    Packet *p[2] = { NULL, NULL };
+    ThreadVars tv;
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    Flow f;
+    int r;
+    int i;
+
+    char *sig1 = "alert tcp any any -> any any "
+        "(msg:\"testing dce content across fragments\"; dce_stub_data; "
+        "content:\"to fix\"; sid:1;)";
+
+    Signature *s;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&tv, 0, sizeof(ThreadVars));
+    memset(&f, 0, sizeof(Flow));
+    memset(&ssn, 0, sizeof(TcpSession));
+
+    for (i = 0; i < 2; i++) {
+        p[i] = UTHBuildPacket(NULL, 0, IPPROTO_TCP);
+        p[i]->flow = &f;
+        p[i]->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+        p[i]->flowflags |= FLOW_PKT_TOSERVER;
+        p[i]->flowflags |= FLOW_PKT_ESTABLISHED;
+    }
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+    f.alproto = ALPROTO_DCERPC;
+
+    StreamTcpInitConfig(TRUE);
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, sig1);
+    s = de_ctx->sig_list;
+    if (s == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&tv, (void *)de_ctx, (void *)&det_ctx);
+
+    /* first fragment */
+    SCMutexLock(&f.m);
+    r = AppLayerParserParse(alp_tctx, &f, ALPROTO_DCERPC, STREAM_TOSERVER, request1, request1_len);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+    SigMatchSignatures(&tv, de_ctx, det_ctx, p[0]);
+    if (PacketAlertCheck(p[0], 1)) {
+        printf("sid 1 matched but shouldn't have for packet 1: ");
+        goto end;
+    }
+
+    /* last fragment, completes the content */
+    SCMutexLock(&f.m);
+    r = AppLayerParserParse(alp_tctx, &f, ALPROTO_DCERPC, STREAM_TOSERVER, request2, request2_len);
+    if (r != 0) {
+        printf("toserver chunk 2 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+    SigMatchSignatures(&tv, de_ctx, det_ctx, p[1]);
+    if (!(PacketAlertCheck(p[1], 1))) {
+        printf("sid 1 didn't match but should have for packet 2: ");
+        goto end;
+    }
+
+    result = 1;
+
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+
+        DetectEngineThreadCtxDeinit(&tv, (void *)det_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+
+    StreamTcpFreeConfig(TRUE);
+
+    UTHFreePackets(p, 2);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DcePayloadRegisterTests(void)
@@ -10186,6 +10310,7 @@ void DcePayloadRegisterTests(void)
     UtRegisterTest("DcePayloadParseTest44", DcePayloadParseTest44, 1);
     UtRegisterTest("DcePayloadParseTest45", DcePayloadParseTest45, 1);
     UtRegisterTest("DcePayloadParseTest46", DcePayloadParseTest46, 1);
+    UtRegisterTest("DcePayloadParseTest47", DcePayloadParseTest47, 1);
 #endif /* UNITTESTS */
 
     return;
@@ -55,6 +55,7 @@
 #include "util-unittest-helper.h"
 #include "app-layer.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-body.h"
 #include "app-layer-protos.h"
 
 #include "conf.h"
@@ -144,9 +145,8 @@ static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         goto end;
     }
 
-    HtpBodyChunk *cur = htud->request_body.first;
-    if (cur == NULL) {
-        SCLogDebug("No http chunks to inspect for this transacation");
+    if (htud->request_body.store_len == 0) {
+        SCLogDebug("No http body data to inspect for this transacation");
         goto end;
     }
 
@@ -163,49 +163,24 @@ static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         goto end;
     }
 
-    int first = 1;
-    while (cur != NULL) {
-        /* see if we can filter out chunks */
-        if (htud->request_body.body_inspected > 0) {
-            if (cur->stream_offset < htud->request_body.body_inspected) {
-                if ((htud->request_body.body_inspected - cur->stream_offset) > htp_state->cfg->request_inspect_min_size) {
-                    cur = cur->next;
-                    continue;
-                } else {
-                    /* include this one */
-                }
-            } else {
-                /* include this one */
-            }
-        }
-
-        if (first) {
-            det_ctx->hcbd[index].offset = cur->stream_offset;
-            first = 0;
-        }
+    /* inspect the new data, plus up to the window of data we inspected
+     * already. The data is used from the body store directly. */
+    uint64_t offset = 0;
+    if (htud->request_body.body_inspected > htp_state->cfg->request_inspect_min_size)
+        offset = htud->request_body.body_inspected - htp_state->cfg->request_inspect_min_size;
 
-        /* see if we need to grow the buffer */
-        if (det_ctx->hcbd[index].buffer == NULL || (det_ctx->hcbd[index].buffer_len + cur->len) > det_ctx->hcbd[index].buffer_size) {
-            void *ptmp;
-            det_ctx->hcbd[index].buffer_size += cur->len * 2;
-
-            if ((ptmp = SCRealloc(det_ctx->hcbd[index].buffer, det_ctx->hcbd[index].buffer_size)) == NULL) {
-                SCFree(det_ctx->hcbd[index].buffer);
-                det_ctx->hcbd[index].buffer = NULL;
-                det_ctx->hcbd[index].buffer_size = 0;
-                det_ctx->hcbd[index].buffer_len = 0;
-                goto end;
-            }
-            det_ctx->hcbd[index].buffer = ptmp;
-        }
-        memcpy(det_ctx->hcbd[index].buffer + det_ctx->hcbd[index].buffer_len, cur->data, cur->len);
-        det_ctx->hcbd[index].buffer_len += cur->len;
+    uint64_t data_offset = 0;
+    uint32_t data_len = 0;
+    uint8_t *data = HtpBodyGetData(&htud->request_body, offset, &data_offset, &data_len);
+    if (data == NULL)
+        goto end;
 
-        cur = cur->next;
-    }
+    det_ctx->hcbd[index].buffer = data;
+    det_ctx->hcbd[index].buffer_len = data_len;
+    det_ctx->hcbd[index].offset = data_offset;
 
     /* update inspected tracker */
-    htud->request_body.body_inspected = htud->request_body.last->stream_offset + htud->request_body.last->len;
+    htud->request_body.body_inspected = data_offset + data_len;
 
     buffer = det_ctx->hcbd[index].buffer;
     *buffer_len = det_ctx->hcbd[index].buffer_len;
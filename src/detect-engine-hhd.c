@@ -56,152 +56,167 @@
 #include "util-unittest-helper.h"
 #include "app-layer.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-mem.h"
 #include "app-layer-protos.h"
 
-#define BUFFER_STEP 50
-
-static inline int HHDCreateSpace(DetectEngineThreadCtx *det_ctx, uint16_t size)
+/** \internal
+ *  \brief cookies are inspected by http_cookie, not by http_header */
+static inline int HHDSkipHeader(htp_header_t *h, uint8_t flags)
 {
-    void *ptmp;
-    if (size > det_ctx->hhd_buffers_size) {
-        ptmp = SCRealloc(det_ctx->hhd_buffers,
-                         (det_ctx->hhd_buffers_size + BUFFER_STEP) * sizeof(uint8_t *));
-        if (ptmp == NULL) {
-            SCFree(det_ctx->hhd_buffers);
-            det_ctx->hhd_buffers = NULL;
-            det_ctx->hhd_buffers_size = 0;
-            det_ctx->hhd_buffers_list_len = 0;
-            return -1;
+    size_t size = bstr_size(h->name);
+
+    if (flags & STREAM_TOSERVER) {
+        if (size == 6 &&
+            SCMemcmpLowercase("cookie", bstr_ptr(h->name), 6) == 0) {
+            return 1;
         }
-        det_ctx->hhd_buffers = ptmp;
-
-        memset(det_ctx->hhd_buffers + det_ctx->hhd_buffers_size, 0, BUFFER_STEP * sizeof(uint8_t *));
-        ptmp = SCRealloc(det_ctx->hhd_buffers_len,
-                         (det_ctx->hhd_buffers_size + BUFFER_STEP) * sizeof(uint32_t));
-        if (ptmp == NULL) {
-            SCFree(det_ctx->hhd_buffers_len);
-            det_ctx->hhd_buffers_len = NULL;
-            det_ctx->hhd_buffers_size = 0;
-            det_ctx->hhd_buffers_list_len = 0;
-            return -1;
+    } else {
+        if (size == 10 &&
+            SCMemcmpLowercase("set-cookie", bstr_ptr(h->name), 10) == 0) {
+            return 1;
         }
-        det_ctx->hhd_buffers_len = ptmp;
-
-        memset(det_ctx->hhd_buffers_len + det_ctx->hhd_buffers_size, 0, BUFFER_STEP * sizeof(uint32_t));
-        det_ctx->hhd_buffers_size += BUFFER_STEP;
     }
-    memset(det_ctx->hhd_buffers_len + det_ctx->hhd_buffers_list_len, 0, (size - det_ctx->hhd_buffers_list_len) * sizeof(uint32_t));
-
     return 0;
 }
 
-static uint8_t *DetectEngineHHDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
-                                              DetectEngineCtx *de_ctx,
-                                              DetectEngineThreadCtx *det_ctx,
-                                              Flow *f, HtpState *htp_state,
-                                              uint8_t flags,
-                                              uint32_t *buffer_len)
+/** \internal
+ *  \brief Write the normalized headers into a buffer sized by the caller */
+static void HHDFillBuffer(htp_table_t *headers, uint8_t flags, uint8_t *buffer)
 {
-    uint8_t *headers_buffer = NULL;
-    int index = 0;
-    *buffer_len = 0;
+    htp_header_t *h = NULL;
+    size_t no_of_headers = htp_table_size(headers);
+    size_t i = 0;
+    uint8_t *ptr = buffer;
 
-    if (det_ctx->hhd_buffers_list_len == 0) {
-        if (HHDCreateSpace(det_ctx, 1) < 0)
-            goto end;
-        index = 0;
+    for (i = 0; i < no_of_headers; i++) {
+        h = htp_table_get_index(headers, i, NULL);
+        if (HHDSkipHeader(h, flags))
+            continue;
 
-        if (det_ctx->hhd_buffers_list_len == 0) {
-            det_ctx->hhd_start_tx_id = tx_id;
-        }
-        det_ctx->hhd_buffers_list_len++;
-    } else {
-        if ((tx_id - det_ctx->hhd_start_tx_id) < det_ctx->hhd_buffers_list_len) {
-            if (det_ctx->hhd_buffers_len[(tx_id - det_ctx->hhd_start_tx_id)] != 0) {
-                *buffer_len = det_ctx->hhd_buffers_len[(tx_id - det_ctx->hhd_start_tx_id)];
-                return det_ctx->hhd_buffers[(tx_id - det_ctx->hhd_start_tx_id)];
-            }
-        } else {
-            if (HHDCreateSpace(det_ctx, (tx_id - det_ctx->hhd_start_tx_id) + 1) < 0)
-                goto end;
-
-            if (det_ctx->hhd_buffers_list_len == 0) {
-                det_ctx->hhd_start_tx_id = tx_id;
-            }
-            det_ctx->hhd_buffers_list_len++;
-        }
-        index = (tx_id - det_ctx->hhd_start_tx_id);
+        size_t size1 = bstr_size(h->name);
+        size_t size2 = bstr_size(h->value);
+
+        memcpy(ptr, bstr_ptr(h->name), size1);
+        ptr += size1;
+        *ptr++ = ':';
+        *ptr++ = ' ';
+        memcpy(ptr, bstr_ptr(h->value), size2);
+        ptr += size2;
+        *ptr++ = '\r';
+        *ptr++ = '\n';
     }
+}
+
+/**
+ *  \brief Get the normalized headers buffer of a tx
+ *
+ *  The buffer is built on first use and kept in the tx user data, so
+ *  that it's built once per tx instead of for each inspection. It's
+ *  rebuilt only if headers were added since, e.g. trailers.
+ *
+ *  If the tx can't keep the buffer, because it has no user data or the
+ *  http memcap is reached, it's built in the thread's scratch buffer
+ *  instead so the headers are still inspected.
+ *
+ *  \param buffer_len set to the length of the buffer, 0 if there is none
+ *  \retval buffer or NULL
+ */
+static uint8_t *DetectEngineHHDGetBufferForTX(DetectEngineThreadCtx *det_ctx,
+                                              htp_tx_t *tx, uint8_t flags,
+                                              uint32_t *buffer_len)
+{
+    *buffer_len = 0;
+
+    HtpTxUserData *tx_ud = htp_tx_get_user_data(tx);
 
     htp_table_t *headers;
+    uint8_t **norm = NULL;
+    uint32_t *norm_len = NULL;
+    uint32_t *norm_gen = NULL;
+    uint32_t gen = 0;
     if (flags & STREAM_TOSERVER) {
         if (AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOSERVER) <= HTP_REQUEST_HEADERS)
-            goto end;
+            return NULL;
         headers = tx->request_headers;
+        if (tx_ud != NULL) {
+            norm = &tx_ud->request_headers_norm;
+            norm_len = &tx_ud->request_headers_norm_len;
+            norm_gen = &tx_ud->request_headers_norm_gen;
+            gen = tx_ud->request_headers_gen;
+        }
     } else {
         if (AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOCLIENT) <= HTP_RESPONSE_HEADERS)
-            goto end;
+            return NULL;
         headers = tx->response_headers;
+        if (tx_ud != NULL) {
+            norm = &tx_ud->response_headers_norm;
+            norm_len = &tx_ud->response_headers_norm_len;
+            norm_gen = &tx_ud->response_headers_norm_gen;
+            gen = tx_ud->response_headers_gen;
+        }
     }
     if (headers == NULL)
-        goto end;
+        return NULL;
+
+    if (norm != NULL) {
+        /* the parser bumps the generation on new header or trailer data,
+         * the table size alone doesn't change on folded lines */
+        if (*norm_gen == gen + 1) {
+            *buffer_len = *norm_len;
+            return *norm;
+        }
+
+        if (*norm != NULL) {
+            HTPFree(*norm, *norm_len);
+            *norm = NULL;
+            *norm_len = 0;
+        }
+    }
 
     htp_header_t *h = NULL;
-    headers_buffer = det_ctx->hhd_buffers[index];
+    size_t no_of_headers = htp_table_size(headers);
     size_t headers_buffer_len = 0;
     size_t i = 0;
 
-    size_t no_of_headers = htp_table_size(headers);
-    for (; i < no_of_headers; i++) {
+    /* size the buffer first so it's allocated only once */
+    for (i = 0; i < no_of_headers; i++) {
         h = htp_table_get_index(headers, i, NULL);
-        size_t size1 = bstr_size(h->name);
-        size_t size2 = bstr_size(h->value);
-
-        if (flags & STREAM_TOSERVER) {
-            if (size1 == 6 &&
-                SCMemcmpLowercase("cookie", bstr_ptr(h->name), 6) == 0) {
-                continue;
-            }
-        } else {
-            if (size1 == 10 &&
-                SCMemcmpLowercase("set-cookie", bstr_ptr(h->name), 10) == 0) {
-                continue;
-            }
-        }
-
+        if (HHDSkipHeader(h, flags))
+            continue;
         /* the extra 4 bytes if for ": " and "\r\n" */
-        uint8_t *new_headers_buffer = SCRealloc(headers_buffer, headers_buffer_len + size1 + size2 + 4);
-        if (unlikely(new_headers_buffer == NULL)) {
-            if (headers_buffer != NULL) {
-                SCFree(headers_buffer);
-                headers_buffer = NULL;
-            }
-            det_ctx->hhd_buffers[index] = NULL;
-            det_ctx->hhd_buffers_len[index] = 0;
-            goto end;
-        }
-        headers_buffer = new_headers_buffer;
+        headers_buffer_len += bstr_size(h->name) + bstr_size(h->value) + 4;
+    }
+    if (headers_buffer_len == 0 || headers_buffer_len > UINT32_MAX)
+        return NULL;
 
-        memcpy(headers_buffer + headers_buffer_len, bstr_ptr(h->name), size1);
-        headers_buffer_len += size1;
-        headers_buffer[headers_buffer_len] = ':';
-        headers_buffer[headers_buffer_len + 1] = ' ';
-        headers_buffer_len += 2;
-        memcpy(headers_buffer + headers_buffer_len, bstr_ptr(h->value), size2);
-        headers_buffer_len += size2 + 2;
-        /* \r */
-        headers_buffer[headers_buffer_len - 2] = '\r';
-        /* \n */
-        headers_buffer[headers_buffer_len - 1] = '\n';
+    uint8_t *headers_buffer = NULL;
+    if (norm != NULL) {
+        headers_buffer = HTPMalloc(headers_buffer_len);
+        if (headers_buffer != NULL) {
+            HHDFillBuffer(headers, flags, headers_buffer);
+
+            /* store the buffer, we will need it for further inspection */
+            *norm = headers_buffer;
+            *norm_len = (uint32_t)headers_buffer_len;
+            *norm_gen = gen + 1;
+
+            *buffer_len = (uint32_t)headers_buffer_len;
+            return headers_buffer;
+        }
     }
 
-    /* store the buffers.  We will need it for further inspection */
-    det_ctx->hhd_buffers[index] = headers_buffer;
-    det_ctx->hhd_buffers_len[index] = headers_buffer_len;
+    /* not kept in the tx, build it for this inspection only */
+    if (headers_buffer_len > det_ctx->hhd_buffer_size) {
+        headers_buffer = SCRealloc(det_ctx->hhd_buffer, headers_buffer_len);
+        if (unlikely(headers_buffer == NULL))
+            return NULL;
+        det_ctx->hhd_buffer = headers_buffer;
+        det_ctx->hhd_buffer_size = (uint32_t)headers_buffer_len;
+    }
+    HHDFillBuffer(headers, flags, det_ctx->hhd_buffer);
 
     *buffer_len = (uint32_t)headers_buffer_len;
- end:
-    return headers_buffer;
+    return det_ctx->hhd_buffer;
 }
 
 int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
@@ -210,11 +225,7 @@ int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
 {
     uint32_t cnt = 0;
     uint32_t buffer_len = 0;
-    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, idx,
-                                                    NULL, det_ctx,
-                                                    f, htp_state,
-                                                    flags,
-                                                    &buffer_len);
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(det_ctx, tx, flags, &buffer_len);
     if (buffer_len == 0)
         goto end;
 
@@ -231,13 +242,8 @@ int DetectEngineInspectHttpHeader(ThreadVars *tv,
                                   void *alstate,
                                   void *tx, uint64_t tx_id)
 {
-    HtpState *htp_state = (HtpState *)alstate;
     uint32_t buffer_len = 0;
-    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, tx_id,
-                                                    de_ctx, det_ctx,
-                                                    f, htp_state,
-                                                    flags,
-                                                    &buffer_len);
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(det_ctx, tx, flags, &buffer_len);
     if (buffer_len == 0)
         goto end;
 
@@ -264,20 +270,6 @@ int DetectEngineInspectHttpHeader(ThreadVars *tv,
     return DETECT_ENGINE_INSPECT_SIG_NO_MATCH;
 }
 
-void DetectEngineCleanHHDBuffers(DetectEngineThreadCtx *det_ctx)
-{
-    if (det_ctx->hhd_buffers_list_len != 0) {
-        int i;
-        for (i = 0; i < det_ctx->hhd_buffers_list_len; i++) {
-            det_ctx->hhd_buffers_len[i] = 0;
-        }
-        det_ctx->hhd_buffers_list_len = 0;
-    }
-    det_ctx->hhd_start_tx_id = 0;
-
-    return;
-}
-
 /***********************************Unittests**********************************/
 
 #ifdef UNITTESTS
@@ -3811,6 +3803,271 @@ end:
     return result;
 }
 
+/**
+ * \test the normalized buffer is built once per tx and kept in the tx
+ */
+static int DetectEngineHttpHeaderTest34(void)
+{
+    TcpSession ssn;
+    DetectEngineThreadCtx det_ctx;
+    Flow f;
+    uint8_t http_buf[] =
+        "GET /index.html HTTP/1.0\r\n"
+        "Host: one\r\n"
+        "Cookie: two\r\n"
+        "User-Agent: three\r\n\r\n";
+    uint32_t http_len = sizeof(http_buf) - 1;
+    uint8_t expected[] = "Host: one\r\nUser-Agent: three\r\n";
+    uint32_t expected_len = sizeof(expected) - 1;
+    int result = 0;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&det_ctx, 0, sizeof(det_ctx));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    SCMutexLock(&f.m);
+    int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf, http_len);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+
+    if (f.alstate == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    htp_tx_t *tx = AppLayerParserGetTx(IPPROTO_TCP, ALPROTO_HTTP, f.alstate, 0);
+    if (tx == NULL) {
+        printf("no tx: ");
+        goto end;
+    }
+
+    uint32_t buffer_len = 0;
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len);
+    if (buffer == NULL || buffer_len != expected_len ||
+        memcmp(buffer, expected, expected_len) != 0) {
+        printf("unexpected buffer: ");
+        goto end;
+    }
+
+    uint32_t buffer_len2 = 0;
+    uint8_t *buffer2 = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len2);
+    if (buffer2 != buffer || buffer_len2 != buffer_len) {
+        printf("buffer was rebuilt: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
+/**
+ * \test the normalized buffer is rebuilt when a trailer updates a header
+ *       without changing the number of headers
+ */
+static int DetectEngineHttpHeaderTest35(void)
+{
+    TcpSession ssn;
+    DetectEngineThreadCtx det_ctx;
+    Flow f;
+    uint8_t http_buf1[] =
+        "POST /index.html HTTP/1.1\r\n"
+        "Host: one\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "X-Foo: two\r\n\r\n"
+        "5\r\nabcde\r\n";
+    uint32_t http_len1 = sizeof(http_buf1) - 1;
+    uint8_t http_buf2[] =
+        "0\r\n"
+        "X-Foo: three\r\n\r\n";
+    uint32_t http_len2 = sizeof(http_buf2) - 1;
+    uint8_t expected1[] = "Host: one\r\nTransfer-Encoding: chunked\r\n"
+        "X-Foo: two\r\n";
+    uint32_t expected1_len = sizeof(expected1) - 1;
+    uint8_t expected2[] = "Host: one\r\nTransfer-Encoding: chunked\r\n"
+        "X-Foo: two, three\r\n";
+    uint32_t expected2_len = sizeof(expected2) - 1;
+    int result = 0;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&det_ctx, 0, sizeof(det_ctx));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    SCMutexLock(&f.m);
+    int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf1, http_len1);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+
+    if (f.alstate == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    htp_tx_t *tx = AppLayerParserGetTx(IPPROTO_TCP, ALPROTO_HTTP, f.alstate, 0);
+    if (tx == NULL) {
+        printf("no tx: ");
+        goto end;
+    }
+
+    uint32_t buffer_len = 0;
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len);
+    if (buffer == NULL || buffer_len != expected1_len ||
+        memcmp(buffer, expected1, expected1_len) != 0) {
+        printf("unexpected buffer before the trailer: ");
+        goto end;
+    }
+
+    SCMutexLock(&f.m);
+    r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf2, http_len2);
+    if (r != 0) {
+        printf("toserver chunk 2 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+
+    buffer_len = 0;
+    buffer = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len);
+    if (buffer == NULL || buffer_len != expected2_len ||
+        memcmp(buffer, expected2, expected2_len) != 0) {
+        printf("buffer wasn't rebuilt after the trailer: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
+/**
+ * \test the normalized buffer is still built at the http memcap, when the
+ *       tx can't keep it, and when the tx has no user data
+ */
+static int DetectEngineHttpHeaderTest36(void)
+{
+    TcpSession ssn;
+    DetectEngineThreadCtx det_ctx;
+    Flow f;
+    uint8_t http_buf[] =
+        "GET /index.html HTTP/1.0\r\n"
+        "Host: one\r\n"
+        "User-Agent: two\r\n\r\n";
+    uint32_t http_len = sizeof(http_buf) - 1;
+    uint8_t expected[] = "Host: one\r\nUser-Agent: two\r\n";
+    uint32_t expected_len = sizeof(expected) - 1;
+    uint64_t memcap = htp_config_memcap;
+    int result = 0;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&det_ctx, 0, sizeof(det_ctx));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    SCMutexLock(&f.m);
+    int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf, http_len);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+
+    if (f.alstate == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    htp_tx_t *tx = AppLayerParserGetTx(IPPROTO_TCP, ALPROTO_HTTP, f.alstate, 0);
+    if (tx == NULL) {
+        printf("no tx: ");
+        goto end;
+    }
+    HtpTxUserData *tx_ud = htp_tx_get_user_data(tx);
+    if (tx_ud == NULL) {
+        printf("no tx user data: ");
+        goto end;
+    }
+
+    /* memcap exhausted: nothing can be kept in the tx */
+    htp_config_memcap = 1;
+
+    uint32_t buffer_len = 0;
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len);
+    if (buffer == NULL || buffer_len != expected_len ||
+        memcmp(buffer, expected, expected_len) != 0) {
+        printf("unexpected buffer at the memcap: ");
+        goto end;
+    }
+    if (tx_ud->request_headers_norm != NULL || buffer != det_ctx.hhd_buffer) {
+        printf("buffer not built in the scratch buffer: ");
+        goto end;
+    }
+
+    /* no user data, e.g. after the parser failed to grow it */
+    htp_tx_set_user_data(tx, NULL);
+    buffer_len = 0;
+    buffer = DetectEngineHHDGetBufferForTX(&det_ctx, tx, STREAM_TOSERVER, &buffer_len);
+    htp_tx_set_user_data(tx, tx_ud);
+    if (buffer == NULL || buffer_len != expected_len ||
+        memcmp(buffer, expected, expected_len) != 0) {
+        printf("unexpected buffer without tx user data: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    htp_config_memcap = memcap;
+    if (det_ctx.hhd_buffer != NULL)
+        SCFree(det_ctx.hhd_buffer);
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectEngineHttpHeaderRegisterTests(void)
@@ -3887,6 +4144,12 @@ void DetectEngineHttpHeaderRegisterTests(void)
                    DetectEngineHttpHeaderTest32, 1);
     UtRegisterTest("DetectEngineHttpHeaderTest33",
                    DetectEngineHttpHeaderTest33, 1);
+    UtRegisterTest("DetectEngineHttpHeaderTest34",
+                   DetectEngineHttpHeaderTest34, 1);
+    UtRegisterTest("DetectEngineHttpHeaderTest35",
+                   DetectEngineHttpHeaderTest35, 1);
+    UtRegisterTest("DetectEngineHttpHeaderTest36",
+                   DetectEngineHttpHeaderTest36, 1);
 
 #endif /* UNITTESTS */
 
@@ -56,6 +56,7 @@
 #include "util-unittest-helper.h"
 #include "app-layer.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-body.h"
 #include "app-layer-protos.h"
 
 #include "conf.h"
@@ -143,9 +144,8 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         goto end;
     }
 
-    HtpBodyChunk *cur = htud->response_body.first;
-    if (cur == NULL) {
-        SCLogDebug("No http chunks to inspect for this transacation");
+    if (htud->response_body.store_len == 0) {
+        SCLogDebug("No http body data to inspect for this transacation");
         goto end;
     }
 
@@ -170,49 +170,24 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         goto end;
     }
 
-    int first = 1;
-    while (cur != NULL) {
-        /* see if we can filter out chunks */
-        if (htud->response_body.body_inspected > 0) {
-            if (cur->stream_offset < htud->response_body.body_inspected) {
-                if ((htud->response_body.body_inspected - cur->stream_offset) > htp_state->cfg->response_inspect_window) {
-                    cur = cur->next;
-                    continue;
-                } else {
-                    /* include this one */
-                }
-            } else {
-                /* include this one */
-            }
-        }
-
-        if (first) {
-            det_ctx->hsbd[index].offset = cur->stream_offset;
-            first = 0;
-        }
-
-        /* see if we need to grow the buffer */
-        if (det_ctx->hsbd[index].buffer == NULL || (det_ctx->hsbd[index].buffer_len + cur->len) > det_ctx->hsbd[index].buffer_size) {
-            void *ptmp;
-            det_ctx->hsbd[index].buffer_size += cur->len * 2;
+    /* inspect the new data, plus up to the window of data we inspected
+     * already. The data is used from the body store directly. */
+    uint64_t offset = 0;
+    if (htud->response_body.body_inspected > htp_state->cfg->response_inspect_window)
+        offset = htud->response_body.body_inspected - htp_state->cfg->response_inspect_window;
 
-            if ((ptmp = SCRealloc(det_ctx->hsbd[index].buffer, det_ctx->hsbd[index].buffer_size)) == NULL) {
-                SCFree(det_ctx->hsbd[index].buffer);
-                det_ctx->hsbd[index].buffer = NULL;
-                det_ctx->hsbd[index].buffer_size = 0;
-                det_ctx->hsbd[index].buffer_len = 0;
-                goto end;
-            }
-            det_ctx->hsbd[index].buffer = ptmp;
-        }
-        memcpy(det_ctx->hsbd[index].buffer + det_ctx->hsbd[index].buffer_len, cur->data, cur->len);
-        det_ctx->hsbd[index].buffer_len += cur->len;
+    uint64_t data_offset = 0;
+    uint32_t data_len = 0;
+    uint8_t *data = HtpBodyGetData(&htud->response_body, offset, &data_offset, &data_len);
+    if (data == NULL)
+        goto end;
 
-        cur = cur->next;
-    }
+    det_ctx->hsbd[index].buffer = data;
+    det_ctx->hsbd[index].buffer_len = data_len;
+    det_ctx->hsbd[index].offset = data_offset;
 
     /* update inspected tracker */
-    htud->response_body.body_inspected = htud->response_body.last->stream_offset + htud->response_body.last->len;
+    htud->response_body.body_inspected = data_offset + data_len;
 
     buffer = det_ctx->hsbd[index].buffer;
     *buffer_len = det_ctx->hsbd[index].buffer_len;
@@ -22,11 +22,10 @@
  * This is done by this code. It uses the ::Flow structure to store
  * the list of signatures to match on the reconstructed stream.
  *
- * The Flow::de_state is a ::DetectEngineState structure. This is
- * basically a containter for storage item of type ::DeStateStore.
- * They contains an array of ::DeStateStoreItem which store the
- * state of match for an individual signature identified by
- * DeStateStoreItem::sid.
+ * The Flow::de_state is a ::DetectEngineState structure. It holds a
+ * ::DetectEngineStateDirection per direction, with a growable array of
+ * ::DeStateStoreItem which store the state of match for an individual
+ * signature identified by DeStateStoreItem::sid.
  *
  * The state is constructed by DeStateDetectStartDetection() which
  * also starts the matching. Work is continued by
@@ -83,52 +82,60 @@
 
 /******** static internal helpers *********/
 
-static DeStateStore *DeStateStoreAlloc(void)
+/** number of words of the inspect bitset used by cnt items */
+#define DE_STATE_INSPECT_WORDS(cnt) (((cnt) + 31) / 32)
+
+static int DeStateStoreGrow(DetectEngineStateDirection *dir_state)
 {
-    DeStateStore *d = SCMalloc(sizeof(DeStateStore));
-    if (unlikely(d == NULL))
-        return NULL;
-    memset(d, 0, sizeof(DeStateStore));
+    uint32_t size = dir_state->size ? dir_state->size * 2 : DE_STATE_STORE_INIT_SIZE;
+
+    DeStateStoreItem *store = SCRealloc(dir_state->store,
+                                        size * sizeof(DeStateStoreItem));
+    if (unlikely(store == NULL))
+        return -1;
+    dir_state->store = store;
+
+    uint32_t *inspect = SCRealloc(dir_state->inspect,
+                                  (size / 32) * sizeof(uint32_t));
+    if (unlikely(inspect == NULL))
+        return -1;
+    memset(inspect + dir_state->size / 32, 0,
+           ((size - dir_state->size) / 32) * sizeof(uint32_t));
+    dir_state->inspect = inspect;
+    dir_state->size = size;
+
+    return 0;
+}
 
-    return d;
+/** \brief set the inspect bit of an item from its flags */
+static inline void DeStateUpdateInspectBit(DetectEngineStateDirection *dir_state,
+                                           SigIntId idx)
+{
+    uint32_t bit = 1U << (idx % 32);
+
+    if (dir_state->store[idx].flags & (DE_STATE_FLAG_FULL_INSPECT |
+                                       DE_STATE_FLAG_SIG_CANT_MATCH))
+        dir_state->inspect[idx / 32] &= ~bit;
+    else
+        dir_state->inspect[idx / 32] |= bit;
 }
 
 static void DeStateSignatureAppend(DetectEngineState *state, Signature *s,
                                    SigMatch *sm, uint32_t inspect_flags,
                                    uint8_t direction)
 {
-    int jump = 0;
-    int i = 0;
     DetectEngineStateDirection *dir_state = &state->dir_state[direction & STREAM_TOSERVER ? 0 : 1];
-    DeStateStore *store = dir_state->head;
 
-    if (store == NULL) {
-        store = DeStateStoreAlloc();
-        if (store != NULL) {
-            dir_state->head = store;
-            dir_state->tail = store;
-        }
-    } else {
-        jump = dir_state->cnt / DE_STATE_CHUNK_SIZE;
-        for (i = 0; i < jump; i++) {
-            store = store->next;
-        }
-        if (store == NULL) {
-            store = DeStateStoreAlloc();
-            if (store != NULL) {
-                dir_state->tail->next = store;
-                dir_state->tail = store;
-            }
-        }
+    if (dir_state->cnt == dir_state->size) {
+        if (DeStateStoreGrow(dir_state) < 0)
+            return;
     }
 
-    if (store == NULL)
-        return;
-
-    SigIntId idx = dir_state->cnt++ % DE_STATE_CHUNK_SIZE;
-    store->store[idx].sid = s->num;
-    store->store[idx].flags = inspect_flags;
-    store->store[idx].nm = sm;
+    SigIntId idx = dir_state->cnt++;
+    dir_state->store[idx].sid = s->num;
+    dir_state->store[idx].flags = inspect_flags;
+    dir_state->store[idx].nm = sm;
+    DeStateUpdateInspectBit(dir_state, idx);
 
     return;
 }
@@ -195,17 +202,13 @@ DetectEngineState *DetectEngineStateAlloc(void)
 
 void DetectEngineStateFree(DetectEngineState *state)
 {
-    DeStateStore *store;
-    DeStateStore *store_next;
     int i = 0;
 
     for (i = 0; i < 2; i++) {
-        store = state->dir_state[i].head;
-        while (store != NULL) {
-            store_next = store->next;
-            SCFree(store);
-            store = store_next;
-        }
+        if (state->dir_state[i].store != NULL)
+            SCFree(state->dir_state[i].store);
+        if (state->dir_state[i].inspect != NULL)
+            SCFree(state->dir_state[i].inspect);
     }
     SCFree(state);
 
@@ -493,13 +496,14 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
     HtpState *htp_state = NULL;
     SMBState *smb_state = NULL;
 
-    SigIntId store_cnt = 0;
-    SigIntId state_cnt = 0;
+    SigIntId idx = 0;
+    uint32_t w = 0;
+    uint32_t b = 0;
     int match = 0;
     uint8_t alert = 0;
 
     DetectEngineStateDirection *dir_state = &f->de_state->dir_state[flags & STREAM_TOSERVER ? 0 : 1];
-    DeStateStore *store = dir_state->head;
+    uint32_t words = DE_STATE_INSPECT_WORDS(dir_state->cnt);
     void *inspect_tx = NULL;
     uint64_t inspect_tx_id = 0;
     uint64_t total_txs = 0;
@@ -537,45 +541,35 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
         alproto_supports_txs = 1;
     }
 
-    for (; store != NULL; store = store->next) {
-        for (store_cnt = 0;
-             store_cnt < DE_STATE_CHUNK_SIZE && state_cnt < dir_state->cnt;
-             store_cnt++, state_cnt++)
-        {
-            total_matches = 0;
-            DeStateStoreItem *item = &store->store[store_cnt];
-            Signature *s = de_ctx->sig_array[item->sid];
+    /* a new file reenables the file inspection of the signatures that
+     * were done with the previous one */
+    if (dir_state->flags & (DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW |
+                            DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW)) {
+        for (idx = 0; idx < dir_state->cnt; idx++) {
+            DeStateStoreItem *item = &dir_state->store[idx];
 
-            if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
-                if (item->flags & (DE_STATE_FLAG_FILE_TC_INSPECT |
-                                   DE_STATE_FLAG_FILE_TS_INSPECT)) {
-                    if ((flags & STREAM_TOCLIENT) &&
-                        (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
-                    {
-                        item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
-                        item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
-                    }
+            if (!(item->flags & (DE_STATE_FLAG_FILE_TC_INSPECT |
+                                 DE_STATE_FLAG_FILE_TS_INSPECT)))
+                continue;
 
-                    if ((flags & STREAM_TOSERVER) &&
-                        (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
-                    {
-                        item->flags &= ~DE_STATE_FLAG_FILE_TS_INSPECT;
-                        item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
-                    }
+            if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
+                if ((flags & STREAM_TOCLIENT) &&
+                    (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
+                {
+                    item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
+                    item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
                 }
 
-                if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
-                    if (alproto_supports_txs) {
-                        if ((total_txs - inspect_tx_id) <= 1)
-                            det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    } else {
-                        det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    }
-                    continue;
+                if ((flags & STREAM_TOSERVER) &&
+                    (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
+                {
+                    item->flags &= ~DE_STATE_FLAG_FILE_TS_INSPECT;
+                    item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
                 }
             }
 
-            if (item->flags & DE_STATE_FLAG_SIG_CANT_MATCH) {
+            if (!(item->flags & DE_STATE_FLAG_FULL_INSPECT) &&
+                (item->flags & DE_STATE_FLAG_SIG_CANT_MATCH)) {
                 if ((flags & STREAM_TOSERVER) &&
                     (item->flags & DE_STATE_FLAG_FILE_TS_INSPECT) &&
                     (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
@@ -588,17 +582,43 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
                 {
                     item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
                     item->flags &= ~DE_STATE_FLAG_SIG_CANT_MATCH;
-                } else {
-                    if (alproto_supports_txs) {
-                        if ((total_txs - inspect_tx_id) <= 1)
-                            det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    } else {
-                        det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    }
-                    continue;
                 }
             }
 
+            DeStateUpdateInspectBit(dir_state, idx);
+        }
+    }
+
+    /* the signatures that are done with the tx don't need to be inspected
+     * again, unless there is a newer tx they'll start over on */
+    if (!alproto_supports_txs || (total_txs - inspect_tx_id) <= 1) {
+        for (w = 0; w < words; w++) {
+            uint32_t done = ~dir_state->inspect[w];
+            if (done == 0)
+                continue;
+            for (b = 0; b < 32; b++) {
+                idx = w * 32 + b;
+                if (idx >= dir_state->cnt)
+                    break;
+                if (done & (1U << b))
+                    det_ctx->de_state_sig_array[dir_state->store[idx].sid] = DE_STATE_MATCH_NO_NEW_STATE;
+            }
+        }
+    }
+
+    for (w = 0; w < words; w++) {
+        uint32_t todo = dir_state->inspect[w];
+        if (todo == 0)
+            continue;
+        for (b = 0; b < 32; b++) {
+            if (!(todo & (1U << b)))
+                continue;
+
+            idx = w * 32 + b;
+            total_matches = 0;
+            DeStateStoreItem *item = &dir_state->store[idx];
+            Signature *s = de_ctx->sig_array[item->sid];
+
             alert = 0;
             inspect_flags = 0;
             match = 0;
@@ -719,6 +739,7 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
 
             item->flags |= inspect_flags;
             item->nm = sm;
+            DeStateUpdateInspectBit(dir_state, idx);
             if ((total_txs - inspect_tx_id) <= 1)
                 det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
 
@@ -787,11 +808,17 @@ void DetectEngineStateReset(DetectEngineState *state, uint8_t direction)
 {
     if (state != NULL) {
         if (direction & STREAM_TOSERVER) {
+            if (state->dir_state[0].inspect != NULL)
+                memset(state->dir_state[0].inspect, 0,
+                       DE_STATE_INSPECT_WORDS(state->dir_state[0].cnt) * sizeof(uint32_t));
             state->dir_state[0].cnt = 0;
             state->dir_state[0].filestore_cnt = 0;
             state->dir_state[0].flags = 0;
         }
         if (direction & STREAM_TOCLIENT) {
+            if (state->dir_state[1].inspect != NULL)
+                memset(state->dir_state[1].inspect, 0,
+                       DE_STATE_INSPECT_WORDS(state->dir_state[1].cnt) * sizeof(uint32_t));
             state->dir_state[1].cnt = 0;
             state->dir_state[1].filestore_cnt = 0;
             state->dir_state[1].flags = 0;
@@ -821,8 +848,8 @@ static int DeStateTest01(void)
 {
     SCLogDebug("sizeof(DetectEngineState)\t\t%"PRIuMAX,
             (uintmax_t)sizeof(DetectEngineState));
-    SCLogDebug("sizeof(DeStateStore)\t\t\t%"PRIuMAX,
-            (uintmax_t)sizeof(DeStateStore));
+    SCLogDebug("sizeof(DetectEngineStateDirection)\t%"PRIuMAX,
+            (uintmax_t)sizeof(DetectEngineStateDirection));
     SCLogDebug("sizeof(DeStateStoreItem)\t\t%"PRIuMAX"",
             (uintmax_t)sizeof(DeStateStoreItem));
 
@@ -879,27 +906,27 @@ static int DeStateTest02(void)
     s.num = 166;
     DeStateSignatureAppend(state, &s, NULL, 0, direction);
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head == NULL) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store == NULL) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[1].sid != 11) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].cnt != 17) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->next == NULL) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[1].sid != 11) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[14].sid != 144) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[14].sid != 144) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->next->store[0].sid != 155) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[15].sid != 155) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->next->store[1].sid != 166) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[16].sid != 166) {
         goto end;
     }
 
@@ -931,23 +958,93 @@ static int DeStateTest03(void)
     s.num = 22;
     DeStateSignatureAppend(state, &s, NULL, DE_STATE_FLAG_URI_INSPECT, direction);
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head == NULL) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store == NULL) {
+        goto end;
+    }
+
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[0].sid != 11) {
+        goto end;
+    }
+
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[0].flags & DE_STATE_FLAG_URI_INSPECT) {
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[0].sid != 11) {
+    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[1].sid != 22) {
+        goto end;
+    }
+
+    if (!(state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].store[1].flags & DE_STATE_FLAG_URI_INSPECT)) {
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (state != NULL) {
+        DetectEngineStateFree(state);
+    }
+    return result;
+}
+
+/**
+ * \test the inspect bitset only has the items set that aren't fully
+ *       inspected and can still match, and is cleared by a reset.
+ */
+static int DeStateTest04(void)
+{
+    int result = 0;
+    SigIntId i;
+
+    DetectEngineState *state = DetectEngineStateAlloc();
+    if (state == NULL) {
+        printf("d == NULL: ");
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[0].flags & DE_STATE_FLAG_URI_INSPECT) {
+    Signature s;
+    memset(&s, 0x00, sizeof(s));
+
+    uint8_t direction = STREAM_TOCLIENT;
+    DetectEngineStateDirection *dir_state = &state->dir_state[1];
+
+    for (i = 0; i < 40; i++) {
+        uint32_t flags = DE_STATE_FLAG_URI_INSPECT;
+        if (i % 3 == 0)
+            flags |= DE_STATE_FLAG_FULL_INSPECT;
+        else if (i % 5 == 0)
+            flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
+
+        s.num = i * 2;
+        DeStateSignatureAppend(state, &s, NULL, flags, direction);
+    }
+
+    if (dir_state->cnt != 40 || dir_state->size != 64 ||
+        state->dir_state[0].cnt != 0) {
+        printf("cnt %u size %u: ", dir_state->cnt, dir_state->size);
         goto end;
     }
 
-    if (state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[1].sid != 22) {
+    for (i = 0; i < 40; i++) {
+        int set = (dir_state->inspect[i / 32] & (1U << (i % 32))) != 0;
+        if (dir_state->store[i].sid != i * 2 ||
+            set != (i % 3 != 0 && i % 5 != 0)) {
+            printf("item %u sid %u set %d: ", i, dir_state->store[i].sid, set);
+            goto end;
+        }
+    }
+
+    DetectEngineStateReset(state, direction);
+    if (dir_state->cnt != 0 || dir_state->inspect[0] != 0 ||
+        dir_state->inspect[1] != 0) {
+        printf("state not reset: ");
         goto end;
     }
 
-    if (!(state->dir_state[direction & STREAM_TOSERVER ? 0 : 1].head->store[1].flags & DE_STATE_FLAG_URI_INSPECT)) {
+    s.num = 7;
+    DeStateSignatureAppend(state, &s, NULL, 0, direction);
+    if (dir_state->cnt != 1 || dir_state->store[0].sid != 7 ||
+        dir_state->inspect[0] != 1) {
+        printf("append after reset failed: ");
         goto end;
     }
 
@@ -1962,6 +2059,7 @@ void DeStateRegisterTests(void)
     UtRegisterTest("DeStateTest01", DeStateTest01, 1);
     UtRegisterTest("DeStateTest02", DeStateTest02, 1);
     UtRegisterTest("DeStateTest03", DeStateTest03, 1);
+    UtRegisterTest("DeStateTest04", DeStateTest04, 1);
     UtRegisterTest("DeStateSigTest01", DeStateSigTest01, 1);
     UtRegisterTest("DeStateSigTest02", DeStateSigTest02, 1);
     UtRegisterTest("DeStateSigTest03", DeStateSigTest03, 1);
@@ -53,8 +53,8 @@
 #define DETECT_ENGINE_INSPECT_SIG_CANT_MATCH 2
 #define DETECT_ENGINE_INSPECT_SIG_CANT_MATCH_FILESTORE 3
 
-/** number of DeStateStoreItem's in one DeStateStore object */
-#define DE_STATE_CHUNK_SIZE             15
+/** initial number of items in a direction's store, doubled as needed */
+#define DE_STATE_STORE_INIT_SIZE        32
 
 /* per sig flags */
 #define DE_STATE_FLAG_URI_INSPECT         (1)
@@ -108,15 +108,19 @@ typedef struct DeStateStoreItem_ {
     SigIntId sid;
 } DeStateStoreItem;
 
-typedef struct DeStateStore_ {
-    DeStateStoreItem store[DE_STATE_CHUNK_SIZE];
-    struct DeStateStore_ *next;
-} DeStateStore;
-
+/** Signatures stored for the transaction being inspected. The items are
+ *  kept in an array in the order the signatures were stored, so that the
+ *  index of an item is a dense id of the signature within the state. The
+ *  inspect bitset has a bit set per item that still needs inspection, so
+ *  continued detection skips the fully inspected and can't match items
+ *  a word at a time. */
 typedef struct DetectEngineStateDirection_ {
-    DeStateStore *head;
-    DeStateStore *tail;
+    DeStateStoreItem *store;
+    /** bitset of the items to inspect, size / 32 words */
+    uint32_t *inspect;
     SigIntId cnt;
+    /** allocated number of items */
+    uint32_t size;
     uint16_t filestore_cnt;
     uint8_t alversion;
     uint8_t flags;
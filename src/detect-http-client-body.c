@@ -54,6 +54,7 @@
 #include "app-layer.h"
 #include "app-layer-parser.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-body.h"
 #include "detect-http-client-body.h"
 #include "stream-tcp.h"
 
@@ -1634,26 +1635,28 @@ static int DetectHttpClientBodyTest15(void)
 
     HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(t1);
 
-    HtpBodyChunk *cur = htud->request_body.first;
-    if (htud->request_body.first == NULL) {
+    uint64_t body_offset = 0;
+    uint32_t body_len = 0;
+    uint8_t *body = HtpBodyGetData(&htud->request_body, 0, &body_offset, &body_len);
+    if (body == NULL) {
         SCLogDebug("No body data in t1 (it should be removed only when the tx is destroyed): ");
         goto end;
     }
 
-    if (memcmp(cur->data, "Body one!!", strlen("Body one!!")) != 0) {
+    if (memcmp(body, "Body one!!", strlen("Body one!!")) != 0) {
         SCLogDebug("Body data in t1 is not correctly set: ");
         goto end;
     }
 
     htud = (HtpTxUserData *) htp_tx_get_user_data(t2);
 
-    cur = htud->request_body.first;
-    if (htud->request_body.first == NULL) {
+    body = HtpBodyGetData(&htud->request_body, 0, &body_offset, &body_len);
+    if (body == NULL) {
         SCLogDebug("No body data in t1 (it should be removed only when the tx is destroyed): ");
         goto end;
     }
 
-    if (memcmp(cur->data, "Body two!!", strlen("Body two!!")) != 0) {
+    if (memcmp(body, "Body two!!", strlen("Body two!!")) != 0) {
         SCLogDebug("Body data in t1 is not correctly set: ");
         goto end;
     }
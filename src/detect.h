@@ -755,8 +755,7 @@ enum {
 };
 
 typedef struct HttpReassembledBody_ {
-    uint8_t *buffer;
-    uint32_t buffer_size;   /**< size of the buffer itself */
+    uint8_t *buffer;        /**< points into the tx's body store, not owned */
     uint32_t buffer_len;    /**< data len in the buffer */
     uint64_t offset;        /**< data offset */
 } HttpReassembledBody;
@@ -793,11 +792,10 @@ typedef struct DetectionEngineThreadCtx_ {
     uint16_t hcbd_buffers_size;
     uint16_t hcbd_buffers_list_len;
 
-    uint8_t **hhd_buffers;
-    uint32_t *hhd_buffers_len;
-    uint16_t hhd_buffers_size;
-    uint16_t hhd_buffers_list_len;
-    uint64_t hhd_start_tx_id;
+    /** scratch space for the http_header buffer of a tx that can't keep
+     *  its own, e.g. at the http memcap */
+    uint8_t *hhd_buffer;
+    uint32_t hhd_buffer_size;
 
     /** id for alert counter */
     uint16_t counter_alerts;
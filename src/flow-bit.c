@@ -169,6 +169,25 @@ int FlowBitIsnotset(Flow *f, uint16_t idx)
     return r;
 }
 
+/**
+ *  \brief Check if any flowbit is set on a flow
+ *
+ *  \param f *LOCKED* flow
+ *
+ *  \retval 1 at least one flowbit is set
+ *  \retval 0 no flowbits set
+ */
+int FlowBitHasAny(Flow *f)
+{
+    GenericVar *gv = f->flowvar;
+    for ( ; gv != NULL; gv = gv->next) {
+        if (gv->type == DETECT_FLOWBITS)
+            return 1;
+    }
+
+    return 0;
+}
+
 void FlowBitFree(FlowBit *fb)
 {
     if (fb == NULL)
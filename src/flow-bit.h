@@ -43,5 +43,6 @@ void FlowBitUnset(Flow *, uint16_t);
 void FlowBitToggle(Flow *, uint16_t);
 int FlowBitIsset(Flow *, uint16_t);
 int FlowBitIsnotset(Flow *, uint16_t);
+int FlowBitHasAny(Flow *);
 #endif /* __FLOW_BIT_H__ */
 
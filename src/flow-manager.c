@@ -65,6 +65,7 @@
 #include "defrag-timeout.h"
 
 #include "output-flow.h"
+#include "util-logopenfile-compress.h"
 
 /* Run mode selected at suricata.c */
 extern int run_mode;
@@ -544,6 +545,8 @@ static TmEcode FlowManager(ThreadVars *th_v, void *thread_data)
             DefragTimeoutHash(&ts);
             //uint32_t hosts_pruned =
             HostTimeoutHash(&ts);
+            /* flush compressed log files on idle links */
+            LogFileCompressSyncAll();
         }
 /*
         SCPerfCounterAddUI64(flow_mgr_host_prune, th_v->sc_perf_pca, (uint64_t)hosts_pruned);
@@ -47,7 +47,8 @@ typedef struct AppLayerParserState_ AppLayerParserState;
 /** At least on packet from the destination address was seen */
 #define FLOW_TO_DST_SEEN                  0x00000002
 
-// vacany 1x
+/** flow is queued for a tx log thread */
+#define FLOW_TX_LOG_QUEUED                0x00000004
 
 /** no magic on files in this flow */
 #define FLOW_FILE_NO_MAGIC_TS             0x00000008
@@ -66,6 +67,9 @@ typedef struct AppLayerParserState_ AppLayerParserState;
 /** All packets in this flow should be dropped */
 #define FLOW_ACTION_DROP                  0x00000200
 
+/** At least one packet of this flow alerted */
+#define FLOW_HAS_ALERTS                   0x00000400
+
 /** Sgh for toserver direction set (even if it's NULL) */
 #define FLOW_SGH_TOSERVER                 0x00000800
 /** Sgh for toclient direction set (even if it's NULL) */
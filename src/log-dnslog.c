@@ -339,6 +339,7 @@ static OutputCtx *LogDnsLogInitCtx(ConfNode *conf)
 
     AppLayerParserRegisterLogger(IPPROTO_UDP, ALPROTO_DNS);
     AppLayerParserRegisterLogger(IPPROTO_TCP, ALPROTO_DNS);
+    DNSConfigSetStore(DNS_STORE_QUERIES|DNS_STORE_ANSWERS);
 
     return output_ctx;
 }
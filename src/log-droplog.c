@@ -155,6 +155,13 @@ static OutputCtx *LogDropLogInitCtx(ConfNode *conf)
         LogFileFreeCtx(logfile_ctx);
         return NULL;
     }
+    /* records are written to the fp directly */
+    if (logfile_ctx->compress != NULL) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "drop log doesn't "
+                "support compression");
+        LogFileFreeCtx(logfile_ctx);
+        return NULL;
+    }
     OutputRegisterFileRotationFlag(&logfile_ctx->rotation_flag);
 
     OutputCtx *output_ctx = SCCalloc(1, sizeof(OutputCtx));
@@ -376,6 +376,13 @@ static OutputCtx *LogFileLogInitCtx(ConfNode *conf)
         LogFileFreeCtx(logfile_ctx);
         return NULL;
     }
+    /* records are written to the fp directly */
+    if (logfile_ctx->compress != NULL) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "file log doesn't "
+                "support compression");
+        LogFileFreeCtx(logfile_ctx);
+        return NULL;
+    }
     OutputRegisterFileRotationFlag(&logfile_ctx->rotation_flag);
 
     OutputCtx *output_ctx = SCCalloc(1, sizeof(OutputCtx));
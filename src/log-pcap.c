@@ -48,11 +48,17 @@
 #include "util-atomic.h"
 
 #include "source-pcap.h"
+#include "flow-storage.h"
 
 #include "output.h"
 
 #include "queue.h"
 
+#if defined(HAVE_AIO_H) && defined(HAVE_AIO_WRITE)
+#include <aio.h>
+#define PCAPLOG_HAVE_AIO 1
+#endif
+
 #define DEFAULT_LOG_FILENAME            "pcaplog"
 #define MODULE_NAME                     "PcapLog"
 #define MIN_LIMIT                       1 * 1024 * 1024
@@ -72,14 +78,92 @@
 #define USE_STREAM_DEPTH_DISABLED       0
 #define USE_STREAM_DEPTH_ENABLED        1
 
+/** buffered writer: submit full buffers with POSIX AIO */
+#define PCAPLOG_IO_ASYNC                0x01
+/** buffered writer: open the files with O_DIRECT */
+#define PCAPLOG_IO_DIRECT               0x02
+
+#define COND_ALL                        0
+#define COND_ALERTS                     1
+
+#define DEFAULT_COND_HISTORY            32
+#define DEFAULT_COND_MEMCAP             64 * 1024 * 1024
+
+#define PCAPLOG_BUFFER_ALIGN            4096
+#define PCAPLOG_DEFAULT_BUFFER_SIZE     4 * 1024 * 1024
+#define PCAPLOG_MIN_BUFFER_SIZE         64 * 1024
+
 SC_ATOMIC_DECLARE(uint32_t, thread_cnt);
 
+/** flow storage id of the per flow packet ring of conditional logging */
+static int pcap_log_flow_id = -1;
+
+/** memory used by the per flow packet rings */
+SC_ATOMIC_DECLARE(uint64_t, cond_memuse);
+/** packets not kept in a ring because of the memcap */
+SC_ATOMIC_DECLARE(uint64_t, cond_memcap_drops);
+static uint64_t cond_memcap = DEFAULT_COND_MEMCAP;
+
+/** packet kept in memory until its flow triggers logging */
+typedef struct PcapLogRingPkt_ {
+    struct timeval ts;
+    uint32_t len;
+    uint8_t data[];
+} PcapLogRingPkt;
+
+/**
+ *  \brief Per flow state of conditional logging
+ *
+ *  Until the flow has an alert or a tag match the last "size" packets
+ *  are kept here. Once it triggers they are written, and so is every
+ *  following packet of the flow.
+ */
+typedef struct PcapLogFlowRing_ {
+    int triggered;
+    uint16_t size;
+    uint16_t head;              /**< oldest packet */
+    uint16_t cnt;
+    PcapLogRingPkt *pkts[];
+} PcapLogFlowRing;
+
 typedef struct PcapFileName_ {
     char *filename;
     char *dirname;
     TAILQ_ENTRY(PcapFileName_) next; /**< Pointer to next Pcap File for tailq. */
 } PcapFileName;
 
+/** on disk record header, pcap_pkthdr has a struct timeval */
+typedef struct PcapLogRecordHdr_ {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t caplen;
+    uint32_t len;
+} PcapLogRecordHdr;
+
+/**
+ *  \brief Buffered pcap file writer
+ *
+ *  Used instead of libpcap's stdio based pcap_dump when "buffer-size" is
+ *  set. Records are copied into one of two aligned buffers, a buffer is
+ *  written out only when it is full so every write is a whole multiple of
+ *  the buffer size at an aligned offset. With PCAPLOG_IO_ASYNC the full
+ *  buffer is submitted with aio_write and the other one is filled while
+ *  the write is in flight.
+ */
+typedef struct PcapLogWriter_ {
+    int fd;
+    int io_flags;               /**< PCAPLOG_IO_* */
+    uint32_t size;              /**< size of each buffer */
+    uint32_t used;              /**< bytes in the current buffer */
+    int cur;                    /**< buffer being filled */
+    uint8_t *buf[2];
+    uint64_t offset;            /**< file offset of the next buffer */
+#ifdef PCAPLOG_HAVE_AIO
+    struct aiocb cb;
+    int pending;                /**< cb is in flight */
+#endif
+} PcapLogWriter;
+
 typedef struct PcapLogProfileData_ {
     uint64_t total;
     uint64_t cnt;
@@ -128,6 +212,13 @@ typedef struct PcapLogData_ {
     int threads;                /**< number of threads (only set in the global) */
     char *filename_parts[MAX_TOKS];
     int filename_part_cnt;
+
+    int conditional;            /**< COND_ALL or COND_ALERTS */
+    uint16_t cond_history;      /**< packets per flow kept until it triggers */
+
+    uint32_t buffer_size;       /**< buffered writer buffer size, 0 to use libpcap */
+    int io_flags;               /**< PCAPLOG_IO_* for the buffered writer */
+    PcapLogWriter *writer;      /**< buffered writer, NULL if libpcap writes */
 } PcapLogData;
 
 typedef struct PcapLogThreadData_ {
@@ -145,6 +236,8 @@ static TmEcode PcapLogDataDeinit(ThreadVars *, void *);
 static void PcapLogFileDeInitCtx(OutputCtx *);
 static OutputCtx *PcapLogInitCtx(ConfNode *);
 static void PcapLogProfilingDump(PcapLogData *);
+static void PcapLogRegisterTests(void);
+static void PcapLogFlowRingFree(void *);
 
 void TmModulePcapLogRegister(void)
 {
@@ -152,11 +245,22 @@ void TmModulePcapLogRegister(void)
     tmm_modules[TMM_PCAPLOG].ThreadInit = PcapLogDataInit;
     tmm_modules[TMM_PCAPLOG].Func = PcapLog;
     tmm_modules[TMM_PCAPLOG].ThreadDeinit = PcapLogDataDeinit;
-    tmm_modules[TMM_PCAPLOG].RegisterTests = NULL;
+    tmm_modules[TMM_PCAPLOG].RegisterTests = PcapLogRegisterTests;
 
     OutputRegisterModule(MODULE_NAME, "pcap-log", PcapLogInitCtx);
 
     SC_ATOMIC_INIT(thread_cnt);
+    SC_ATOMIC_INIT(cond_memuse);
+    SC_ATOMIC_INIT(cond_memcap_drops);
+
+    /* storage has to be registered before the config is read, it's
+     * only a pointer per flow if conditional logging isn't used */
+    pcap_log_flow_id = FlowStorageRegister("pcap-log", sizeof(void *),
+            NULL, PcapLogFlowRingFree);
+    if (pcap_log_flow_id == -1) {
+        SCLogError(SC_ERR_FLOW_INIT, "Can't initiate flow storage for pcap-log");
+        exit(EXIT_FAILURE);
+    }
     return;
 }
 
@@ -167,6 +271,225 @@ void TmModulePcapLogRegister(void)
     (prof).total += (UtilCpuGetTicks() - pcaplog_profile_ticks); \
     (prof).cnt++
 
+static PcapLogWriter *PcapLogWriterNew(uint32_t size, int io_flags)
+{
+    PcapLogWriter *w = SCCalloc(1, sizeof(*w));
+    if (unlikely(w == NULL))
+        return NULL;
+
+    w->fd = -1;
+    w->size = size;
+    w->io_flags = io_flags;
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        w->buf[i] = SCMallocAligned(size, PCAPLOG_BUFFER_ALIGN);
+        if (w->buf[i] == NULL) {
+            if (i == 1)
+                SCFreeAligned(w->buf[0]);
+            SCFree(w);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+static void PcapLogWriterFree(PcapLogWriter *w)
+{
+    if (w == NULL)
+        return;
+
+    SCFreeAligned(w->buf[0]);
+    SCFreeAligned(w->buf[1]);
+    SCFree(w);
+}
+
+/** \internal
+ *  \brief write out len bytes of a buffer at the writer's offset */
+static int PcapLogWriterWriteSync(PcapLogWriter *w, const uint8_t *buf,
+        uint32_t len)
+{
+    uint32_t done = 0;
+
+    while (done < len) {
+        ssize_t r = pwrite(w->fd, buf + done, len - done, w->offset + done);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            SCLogWarning(SC_ERR_FWRITE, "pcap-log write failed: %s",
+                    strerror(errno));
+            return -1;
+        }
+        done += (uint32_t)r;
+    }
+    w->offset += len;
+    return 0;
+}
+
+/** \internal
+ *  \brief wait for the write in flight, if any */
+static int PcapLogWriterWait(PcapLogWriter *w)
+{
+#ifdef PCAPLOG_HAVE_AIO
+    if (!w->pending)
+        return 0;
+
+    const struct aiocb *list[1] = { &w->cb };
+    int err;
+    while ((err = aio_error(&w->cb)) == EINPROGRESS) {
+        (void)aio_suspend(list, 1, NULL);
+    }
+    w->pending = 0;
+
+    /* the error of the write is the aio_error() result, not errno */
+    ssize_t r = aio_return(&w->cb);
+    if (err != 0) {
+        SCLogWarning(SC_ERR_FWRITE, "pcap-log async write failed: %s",
+                strerror(err));
+        return -1;
+    } else if (r != (ssize_t)w->cb.aio_nbytes) {
+        SCLogWarning(SC_ERR_FWRITE, "pcap-log async write failed: "
+                "short write");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/** \internal
+ *  \brief write out the full current buffer and switch to the other one */
+static int PcapLogWriterSubmit(PcapLogWriter *w)
+{
+    int r = 0;
+
+#ifdef PCAPLOG_HAVE_AIO
+    if (w->io_flags & PCAPLOG_IO_ASYNC) {
+        /* the other buffer is reused next, its write has to be done */
+        r = PcapLogWriterWait(w);
+
+        memset(&w->cb, 0, sizeof(w->cb));
+        w->cb.aio_fildes = w->fd;
+        w->cb.aio_buf = w->buf[w->cur];
+        w->cb.aio_nbytes = w->used;
+        w->cb.aio_offset = w->offset;
+        if (aio_write(&w->cb) == 0) {
+            w->pending = 1;
+            w->offset += w->used;
+        } else if (PcapLogWriterWriteSync(w, w->buf[w->cur], w->used) < 0) {
+            r = -1;
+        }
+        w->cur ^= 1;
+        w->used = 0;
+        return r;
+    }
+#endif
+    r = PcapLogWriterWriteSync(w, w->buf[w->cur], w->used);
+    w->used = 0;
+    return r;
+}
+
+/** \internal
+ *  \brief add data to the buffers, records may span two buffers */
+static int PcapLogWriterAppend(PcapLogWriter *w, const uint8_t *data,
+        uint32_t len)
+{
+    int r = 0;
+
+    while (len > 0) {
+        uint32_t n = w->size - w->used;
+        if (n > len)
+            n = len;
+        memcpy(w->buf[w->cur] + w->used, data, n);
+        w->used += n;
+        data += n;
+        len -= n;
+
+        if (w->used == w->size) {
+            if (PcapLogWriterSubmit(w) < 0)
+                r = -1;
+        }
+    }
+    return r;
+}
+
+/** \internal
+ *  \brief create the file and buffer its pcap file header */
+static int PcapLogWriterOpen(PcapLogWriter *w, const char *filename,
+        int datalink)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (w->io_flags & PCAPLOG_IO_DIRECT)
+        flags |= O_DIRECT;
+#endif
+
+    w->fd = open(filename, flags, 0640);
+    if (w->fd < 0) {
+        SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", filename,
+                strerror(errno));
+        return -1;
+    }
+    w->offset = 0;
+    w->used = 0;
+
+    struct pcap_file_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = 0xa1b2c3d4;
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.snaplen = 65535;
+    hdr.linktype = datalink;
+    return PcapLogWriterAppend(w, (uint8_t *)&hdr, sizeof(hdr));
+}
+
+static int PcapLogWriterWritePacket(PcapLogWriter *w,
+        const struct pcap_pkthdr *h, const uint8_t *data)
+{
+    PcapLogRecordHdr rec;
+    rec.ts_sec = (uint32_t)h->ts.tv_sec;
+    rec.ts_usec = (uint32_t)h->ts.tv_usec;
+    rec.caplen = h->caplen;
+    rec.len = h->len;
+
+    if (PcapLogWriterAppend(w, (uint8_t *)&rec, sizeof(rec)) < 0)
+        return -1;
+    return PcapLogWriterAppend(w, data, h->caplen);
+}
+
+/** \internal
+ *  \brief write out what is buffered and close the file
+ *
+ *  The last buffer is only partially filled, so with O_DIRECT it's
+ *  written after switching back to regular io for the file.
+ */
+static int PcapLogWriterClose(PcapLogWriter *w)
+{
+    int r = 0;
+
+    if (w->fd < 0)
+        return 0;
+
+    if (PcapLogWriterWait(w) < 0)
+        r = -1;
+
+    if (w->used > 0) {
+#ifdef O_DIRECT
+        if (w->io_flags & PCAPLOG_IO_DIRECT) {
+            int fl = fcntl(w->fd, F_GETFL);
+            if (fl != -1)
+                (void)fcntl(w->fd, F_SETFL, fl & ~O_DIRECT);
+        }
+#endif
+        if (PcapLogWriterWriteSync(w, w->buf[w->cur], w->used) < 0)
+            r = -1;
+        w->used = 0;
+    }
+
+    close(w->fd);
+    w->fd = -1;
+    return r;
+}
+
 /**
  * \brief Function to close pcaplog file
  *
@@ -180,6 +503,8 @@ static int PcapLogCloseFile(ThreadVars *t, PcapLogData *pl)
 
         if (pl->pcap_dumper != NULL)
             pcap_dump_close(pl->pcap_dumper);
+        if (pl->writer != NULL)
+            (void)PcapLogWriterClose(pl->writer);
         pl->size_current = 0;
         pl->pcap_dumper = NULL;
 
@@ -283,6 +608,19 @@ static int PcapLogOpenHandles(PcapLogData *pl, Packet *p)
 
     SCLogDebug("Setting pcap-log link type to %u", p->datalink);
 
+    if (pl->buffer_size > 0) {
+        if (pl->writer == NULL) {
+            pl->writer = PcapLogWriterNew(pl->buffer_size, pl->io_flags);
+            if (pl->writer == NULL)
+                return TM_ECODE_FAILED;
+        }
+        if (PcapLogWriterOpen(pl->writer, pl->filename, p->datalink) < 0)
+            return TM_ECODE_FAILED;
+
+        PCAPLOG_PROFILE_END(pl->profile_handles);
+        return TM_ECODE_OK;
+    }
+
     if (pl->pcap_dead_handle == NULL) {
         if ((pl->pcap_dead_handle = pcap_open_dead(p->datalink,
                         -1)) == NULL) {
@@ -329,49 +667,30 @@ static void PcapLogUnlock(PcapLogData *pl)
     }
 }
 
-/**
- * \brief Pcap logging main function
- *
- * \param t threadvar
- * \param p packet
- * \param data thread module specific data
- * \param pq pre-packet-queue
- * \param postpq post-packet-queue
+/** \internal
+ *  \brief write a packet to the current file, rotating it if needed
  *
- * \retval TM_ECODE_OK on succes
- * \retval TM_ECODE_FAILED on serious error
+ *  Called with the lock held. The packet data and time are passed in
+ *  separately as they come from the per flow ring for packets that were
+ *  held back by conditional logging, p is only used for its link type.
  */
-static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue *pq,
-                 PacketQueue *postpq)
+static TmEcode PcapLogWrite(ThreadVars *t, PcapLogData *pl, Packet *p,
+        const struct timeval *ts, const uint8_t *data, uint32_t pktlen)
 {
     size_t len;
     int rotate = 0;
     int ret = 0;
 
-    PcapLogThreadData *td = (PcapLogThreadData *)thread_data;
-    PcapLogData *pl = td->pcap_log;
-
-    if ((p->flags & PKT_PSEUDO_STREAM_END) ||
-        ((p->flags & PKT_STREAM_NOPCAPLOG) &&
-         (pl->use_stream_depth == USE_STREAM_DEPTH_ENABLED)) ||
-        (IS_TUNNEL_PKT(p) && !IS_TUNNEL_ROOT_PKT(p)))
-    {
-        return TM_ECODE_OK;
-    }
-
-    PcapLogLock(pl);
-
     pl->pkt_cnt++;
-    pl->h->ts.tv_sec = p->ts.tv_sec;
-    pl->h->ts.tv_usec = p->ts.tv_usec;
-    pl->h->caplen = GET_PKT_LEN(p);
-    pl->h->len = GET_PKT_LEN(p);
-    len = sizeof(*pl->h) + GET_PKT_LEN(p);
+    pl->h->ts.tv_sec = ts->tv_sec;
+    pl->h->ts.tv_usec = ts->tv_usec;
+    pl->h->caplen = pktlen;
+    pl->h->len = pktlen;
+    len = sizeof(*pl->h) + pktlen;
 
     if (pl->filename == NULL) {
         ret = PcapLogOpenFileCtx(pl);
         if (ret < 0) {
-            PcapLogUnlock(pl);
             return TM_ECODE_FAILED;
         }
         SCLogDebug("Opening PCAP log file %s", pl->filename);
@@ -379,7 +698,7 @@ static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue
 
     if (pl->mode == LOGMODE_SGUIL) {
         struct tm local_tm;
-        struct tm *tms = SCLocalTime(p->ts.tv_sec, &local_tm);
+        struct tm *tms = SCLocalTime(ts->tv_sec, &local_tm);
         if (tms->tm_mday != pl->prev_day) {
             rotate = 1;
             pl->prev_day = tms->tm_mday;
@@ -388,7 +707,6 @@ static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue
 
     if ((pl->size_current + len) > pl->size_limit || rotate) {
         if (PcapLogRotateFile(t,pl) < 0) {
-            PcapLogUnlock(pl);
             SCLogDebug("rotation of pcap failed");
             return TM_ECODE_FAILED;
         }
@@ -396,15 +714,21 @@ static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue
 
     /* XXX pcap handles, nfq, pfring, can only have one link type ipfw? we do
      * this here as we don't know the link type until we get our first packet */
-    if (pl->pcap_dead_handle == NULL || pl->pcap_dumper == NULL) {
+    if (pl->buffer_size > 0 ? (pl->writer == NULL || pl->writer->fd < 0) :
+            (pl->pcap_dead_handle == NULL || pl->pcap_dumper == NULL)) {
         if (PcapLogOpenHandles(pl, p) != TM_ECODE_OK) {
-            PcapLogUnlock(pl);
             return TM_ECODE_FAILED;
         }
     }
 
     PCAPLOG_PROFILE_START;
-    pcap_dump((u_char *)pl->pcap_dumper, pl->h, GET_PKT_DATA(p));
+    if (pl->writer != NULL) {
+        if (PcapLogWriterWritePacket(pl->writer, pl->h, data) < 0) {
+            return TM_ECODE_FAILED;
+        }
+    } else {
+        pcap_dump((u_char *)pl->pcap_dumper, pl->h, data);
+    }
     pl->size_current += len;
     PCAPLOG_PROFILE_END(pl->profile_write);
     pl->profile_data_size += len;
@@ -412,10 +736,190 @@ static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue
     SCLogDebug("pl->size_current %"PRIu64",  pl->size_limit %"PRIu64,
                pl->size_current, pl->size_limit);
 
-    PcapLogUnlock(pl);
     return TM_ECODE_OK;
 }
 
+static void PcapLogFlowRingClear(PcapLogFlowRing *ring)
+{
+    while (ring->cnt > 0) {
+        PcapLogRingPkt *rp = ring->pkts[ring->head];
+        (void) SC_ATOMIC_SUB(cond_memuse, sizeof(*rp) + rp->len);
+        SCFree(rp);
+        ring->pkts[ring->head] = NULL;
+        ring->head = (ring->head + 1) % ring->size;
+        ring->cnt--;
+    }
+}
+
+/** \brief flow storage free callback */
+static void PcapLogFlowRingFree(void *ptr)
+{
+    PcapLogFlowRing *ring = ptr;
+    if (ring == NULL)
+        return;
+
+    PcapLogFlowRingClear(ring);
+    (void) SC_ATOMIC_SUB(cond_memuse,
+            sizeof(*ring) + ring->size * sizeof(PcapLogRingPkt *));
+    SCFree(ring);
+}
+
+/** \internal
+ *  \param force allocate even if over the memcap, used for flows that
+ *         triggered and only need the ring to remember that
+ */
+static PcapLogFlowRing *PcapLogFlowRingNew(uint16_t size, int force)
+{
+    size_t alloc = sizeof(PcapLogFlowRing) + size * sizeof(PcapLogRingPkt *);
+
+    if (!force && SC_ATOMIC_GET(cond_memuse) + alloc > cond_memcap)
+        return NULL;
+
+    PcapLogFlowRing *ring = SCCalloc(1, alloc);
+    if (unlikely(ring == NULL))
+        return NULL;
+    ring->size = size;
+    (void) SC_ATOMIC_ADD(cond_memuse, alloc);
+    return ring;
+}
+
+/** \internal
+ *  \brief keep a copy of a packet in the ring, replacing the oldest one
+ *         if the ring is full
+ *
+ *  \retval 0 packet added
+ *  \retval -1 not added because of the memcap or a failed alloc
+ */
+static int PcapLogFlowRingAdd(PcapLogFlowRing *ring, const struct timeval *ts,
+        const uint8_t *data, uint32_t len)
+{
+    if (ring->size == 0)
+        return -1;
+
+    if (ring->cnt == ring->size) {
+        PcapLogRingPkt *old = ring->pkts[ring->head];
+        (void) SC_ATOMIC_SUB(cond_memuse, sizeof(*old) + old->len);
+        SCFree(old);
+        ring->pkts[ring->head] = NULL;
+        ring->head = (ring->head + 1) % ring->size;
+        ring->cnt--;
+    }
+
+    if (SC_ATOMIC_GET(cond_memuse) + sizeof(PcapLogRingPkt) + len > cond_memcap) {
+        (void) SC_ATOMIC_ADD(cond_memcap_drops, 1);
+        return -1;
+    }
+
+    PcapLogRingPkt *rp = SCMalloc(sizeof(*rp) + len);
+    if (unlikely(rp == NULL)) {
+        (void) SC_ATOMIC_ADD(cond_memcap_drops, 1);
+        return -1;
+    }
+    rp->ts = *ts;
+    rp->len = len;
+    memcpy(rp->data, data, len);
+    (void) SC_ATOMIC_ADD(cond_memuse, sizeof(*rp) + len);
+
+    ring->pkts[(ring->head + ring->cnt) % ring->size] = rp;
+    ring->cnt++;
+    return 0;
+}
+
+/** \internal
+ *  \brief conditional logging: hold back packets per flow until the
+ *         flow has an alert or a tag match
+ */
+static TmEcode PcapLogConditional(ThreadVars *t, PcapLogData *pl, Packet *p)
+{
+    int trigger = (p->alerts.cnt > 0 || (p->flags & PKT_HAS_TAG));
+    TmEcode ret = TM_ECODE_OK;
+
+    if (p->flow == NULL) {
+        if (trigger) {
+            PcapLogLock(pl);
+            ret = PcapLogWrite(t, pl, p, &p->ts, GET_PKT_DATA(p), GET_PKT_LEN(p));
+            PcapLogUnlock(pl);
+        }
+        return ret;
+    }
+
+    Flow *f = p->flow;
+    FLOWLOCK_WRLOCK(f);
+    PcapLogFlowRing *ring = FlowGetStorageById(f, pcap_log_flow_id);
+    if (ring == NULL) {
+        ring = PcapLogFlowRingNew(trigger ? 0 : pl->cond_history, trigger);
+        if (ring == NULL) {
+            (void) SC_ATOMIC_ADD(cond_memcap_drops, 1);
+            FLOWLOCK_UNLOCK(f);
+            return TM_ECODE_OK;
+        }
+        FlowSetStorageById(f, pcap_log_flow_id, ring);
+    }
+
+    if (!ring->triggered && !trigger) {
+        (void)PcapLogFlowRingAdd(ring, &p->ts, GET_PKT_DATA(p), GET_PKT_LEN(p));
+        FLOWLOCK_UNLOCK(f);
+        return TM_ECODE_OK;
+    }
+
+    PcapLogLock(pl);
+    if (!ring->triggered) {
+        /* write what led up to the trigger first */
+        ring->triggered = 1;
+        while (ring->cnt > 0 && ret == TM_ECODE_OK) {
+            PcapLogRingPkt *rp = ring->pkts[ring->head];
+            ret = PcapLogWrite(t, pl, p, &rp->ts, rp->data, rp->len);
+            (void) SC_ATOMIC_SUB(cond_memuse, sizeof(*rp) + rp->len);
+            SCFree(rp);
+            ring->pkts[ring->head] = NULL;
+            ring->head = (ring->head + 1) % ring->size;
+            ring->cnt--;
+        }
+        PcapLogFlowRingClear(ring);
+    }
+    if (ret == TM_ECODE_OK)
+        ret = PcapLogWrite(t, pl, p, &p->ts, GET_PKT_DATA(p), GET_PKT_LEN(p));
+    PcapLogUnlock(pl);
+
+    FLOWLOCK_UNLOCK(f);
+    return ret;
+}
+
+/**
+ * \brief Pcap logging main function
+ *
+ * \param t threadvar
+ * \param p packet
+ * \param data thread module specific data
+ * \param pq pre-packet-queue
+ * \param postpq post-packet-queue
+ *
+ * \retval TM_ECODE_OK on succes
+ * \retval TM_ECODE_FAILED on serious error
+ */
+static TmEcode PcapLog (ThreadVars *t, Packet *p, void *thread_data, PacketQueue *pq,
+                 PacketQueue *postpq)
+{
+    PcapLogThreadData *td = (PcapLogThreadData *)thread_data;
+    PcapLogData *pl = td->pcap_log;
+
+    if ((p->flags & PKT_PSEUDO_STREAM_END) ||
+        ((p->flags & PKT_STREAM_NOPCAPLOG) &&
+         (pl->use_stream_depth == USE_STREAM_DEPTH_ENABLED)) ||
+        (IS_TUNNEL_PKT(p) && !IS_TUNNEL_ROOT_PKT(p)))
+    {
+        return TM_ECODE_OK;
+    }
+
+    if (pl->conditional == COND_ALERTS)
+        return PcapLogConditional(t, pl, p);
+
+    PcapLogLock(pl);
+    TmEcode ret = PcapLogWrite(t, pl, p, &p->ts, GET_PKT_DATA(p), GET_PKT_LEN(p));
+    PcapLogUnlock(pl);
+    return ret;
+}
+
 static PcapLogData *PcapLogDataCopy(const PcapLogData *pl)
 {
     BUG_ON(pl->mode != LOGMODE_MULTI);
@@ -445,6 +949,10 @@ static PcapLogData *PcapLogDataCopy(const PcapLogData *pl)
     copy->timestamp_format = pl->timestamp_format;
     copy->use_stream_depth = pl->use_stream_depth;
     copy->size_limit = pl->size_limit;
+    copy->conditional = pl->conditional;
+    copy->cond_history = pl->cond_history;
+    copy->buffer_size = pl->buffer_size;
+    copy->io_flags = pl->io_flags;
 
     TAILQ_INIT(&copy->pcap_file_list);
     SCMutexInit(&copy->plog_lock, NULL);
@@ -548,11 +1056,15 @@ static TmEcode PcapLogDataDeinit(ThreadVars *t, void *thread_data)
     PcapLogThreadData *td = (PcapLogThreadData *)thread_data;
     PcapLogData *pl = td->pcap_log;
 
-    if (pl->pcap_dumper != NULL) {
+    if (pl->pcap_dumper != NULL || pl->writer != NULL) {
         if (PcapLogCloseFile(t,pl) < 0) {
             SCLogDebug("PcapLogCloseFile failed");
         }
     }
+    if (pl->is_private) {
+        PcapLogWriterFree(pl->writer);
+        pl->writer = NULL;
+    }
 
     if (pl->mode == LOGMODE_MULTI) {
         SCMutexLock(&g_pcap_data->plog_lock);
@@ -682,6 +1194,8 @@ static OutputCtx *PcapLogInitCtx(ConfNode *conf)
     pl->use_ringbuffer = RING_BUFFER_MODE_DISABLED;
     pl->timestamp_format = TS_FORMAT_SEC;
     pl->use_stream_depth = USE_STREAM_DEPTH_DISABLED;
+    pl->conditional = COND_ALL;
+    pl->cond_history = DEFAULT_COND_HISTORY;
 
     TAILQ_INIT(&pl->pcap_file_list);
 
@@ -847,6 +1361,84 @@ static OutputCtx *PcapLogInitCtx(ConfNode *conf)
         }
     }
 
+    if (conf != NULL) {
+        const char *s_cond = ConfNodeLookupChildValue(conf, "conditional");
+        if (s_cond != NULL) {
+            if (strcasecmp(s_cond, "alerts") == 0) {
+                pl->conditional = COND_ALERTS;
+            } else if (strcasecmp(s_cond, "all") != 0) {
+                SCLogError(SC_ERR_INVALID_ARGUMENT,
+                    "log-pcap: invalid conditional \"%s\". Valid options: "
+                    "\"all\" or \"alerts\"", s_cond);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        const char *s_history = ConfNodeLookupChildValue(conf, "conditional-history");
+        if (s_history != NULL) {
+            if (ByteExtractStringUint16(&pl->cond_history, 10, 0, s_history) <= 0) {
+                SCLogError(SC_ERR_INVALID_ARGUMENT,
+                    "log-pcap: invalid conditional-history \"%s\"", s_history);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        const char *s_memcap = ConfNodeLookupChildValue(conf, "conditional-memcap");
+        if (s_memcap != NULL) {
+            if (ParseSizeStringU64(s_memcap, &cond_memcap) < 0) {
+                SCLogError(SC_ERR_INVALID_ARGUMENT,
+                    "log-pcap: invalid conditional-memcap \"%s\"", s_memcap);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (pl->conditional == COND_ALERTS) {
+            SCLogInfo("pcap-log only logging flows with alerts, keeping up "
+                    "to %"PRIu16" packets per flow, memcap %"PRIu64,
+                    pl->cond_history, cond_memcap);
+        }
+
+        const char *s_size = ConfNodeLookupChildValue(conf, "buffer-size");
+        if (s_size != NULL) {
+            uint64_t size = 0;
+            if (ParseSizeStringU64(s_size, &size) < 0 ||
+                    size < PCAPLOG_MIN_BUFFER_SIZE || size > UINT32_MAX) {
+                SCLogError(SC_ERR_INVALID_ARGUMENT,
+                    "log-pcap buffer-size \"%s\" is invalid, must be "
+                    "at least %u bytes", s_size, PCAPLOG_MIN_BUFFER_SIZE);
+                exit(EXIT_FAILURE);
+            }
+            /* whole blocks, so full buffers can be written with O_DIRECT */
+            pl->buffer_size = (uint32_t)size & ~(PCAPLOG_BUFFER_ALIGN - 1);
+        }
+
+        if (ConfNodeChildValueIsTrue(conf, "async-io")) {
+#ifdef PCAPLOG_HAVE_AIO
+            pl->io_flags |= PCAPLOG_IO_ASYNC;
+#else
+            SCLogWarning(SC_ERR_NOT_SUPPORTED, "log-pcap async-io needs "
+                    "POSIX AIO support, writing synchronously");
+#endif
+        }
+        if (ConfNodeChildValueIsTrue(conf, "direct-io")) {
+#ifdef O_DIRECT
+            pl->io_flags |= PCAPLOG_IO_DIRECT;
+#else
+            SCLogWarning(SC_ERR_NOT_SUPPORTED, "log-pcap direct-io is not "
+                    "supported on this platform");
+#endif
+        }
+        if (pl->io_flags != 0 && pl->buffer_size == 0)
+            pl->buffer_size = PCAPLOG_DEFAULT_BUFFER_SIZE;
+
+        if (pl->buffer_size > 0) {
+            SCLogInfo("pcap-log writing with %"PRIu32" byte buffers%s%s",
+                    pl->buffer_size,
+                    (pl->io_flags & PCAPLOG_IO_ASYNC) ? ", async io" : "",
+                    (pl->io_flags & PCAPLOG_IO_DIRECT) ? ", direct io" : "");
+        }
+    }
+
     /* create the output ctx and send it back */
 
     OutputCtx *output_ctx = SCCalloc(1, sizeof(OutputCtx));
@@ -873,6 +1465,16 @@ static void PcapLogFileDeInitCtx(OutputCtx *output_ctx)
         SCLogDebug("PCAP files left at exit: %s\n", pf->filename);
     }
 
+    PcapLogWriterFree(pl->writer);
+    pl->writer = NULL;
+
+    if (pl->conditional == COND_ALERTS &&
+            SC_ATOMIC_GET(cond_memcap_drops) > 0) {
+        SCLogInfo("pcap-log: %"PRIu64" packets were not kept for "
+                "conditional logging due to the memcap",
+                SC_ATOMIC_GET(cond_memcap_drops));
+    }
+
     return;
 }
 
@@ -1173,3 +1775,156 @@ void PcapLogProfileSetup(void)
         }
     }
 }
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+static int PcapLogWriterTestFile(int io_flags)
+{
+    int result = 0;
+    char filename[] = "/tmp/suricata-pcaplog-XXXXXX";
+    uint8_t pkt[1500];
+    uint8_t *data = NULL;
+    int i;
+
+    int fd = mkstemp(filename);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    PcapLogWriter *w = PcapLogWriterNew(PCAPLOG_BUFFER_ALIGN, io_flags);
+    if (w == NULL)
+        goto end;
+    if (PcapLogWriterOpen(w, filename, DLT_EN10MB) < 0)
+        goto end;
+
+    /* records span several buffers */
+    struct pcap_pkthdr h;
+    for (i = 0; i < 10; i++) {
+        memset(pkt, i, sizeof(pkt));
+        h.ts.tv_sec = 1000 + i;
+        h.ts.tv_usec = i;
+        h.caplen = h.len = 100 + i * 100;
+        if (PcapLogWriterWritePacket(w, &h, pkt) < 0)
+            goto end;
+    }
+    if (PcapLogWriterClose(w) < 0)
+        goto end;
+
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        goto end;
+    size_t expect = sizeof(struct pcap_file_header);
+    for (i = 0; i < 10; i++)
+        expect += sizeof(PcapLogRecordHdr) + 100 + i * 100;
+    if ((size_t)st.st_size != expect)
+        goto end;
+
+    data = SCMalloc(expect);
+    FILE *fp = fopen(filename, "r");
+    if (data == NULL || fp == NULL) {
+        if (fp != NULL)
+            fclose(fp);
+        goto end;
+    }
+    size_t n = fread(data, 1, expect, fp);
+    fclose(fp);
+    if (n != expect)
+        goto end;
+
+    struct pcap_file_header *fh = (struct pcap_file_header *)data;
+    if (fh->magic != 0xa1b2c3d4 || fh->linktype != DLT_EN10MB)
+        goto end;
+
+    size_t off = sizeof(*fh);
+    for (i = 0; i < 10; i++) {
+        PcapLogRecordHdr *rec = (PcapLogRecordHdr *)(data + off);
+        if (rec->ts_sec != (uint32_t)(1000 + i) || rec->caplen != (uint32_t)(100 + i * 100))
+            goto end;
+        off += sizeof(*rec);
+        if (data[off] != i || data[off + rec->caplen - 1] != i)
+            goto end;
+        off += rec->caplen;
+    }
+
+    result = 1;
+end:
+    if (data != NULL)
+        SCFree(data);
+    PcapLogWriterFree(w);
+    unlink(filename);
+    return result;
+}
+
+/** \test buffered writer output is a valid pcap file */
+static int PcapLogWriterTest01(void)
+{
+    return PcapLogWriterTestFile(0);
+}
+
+/** \test same with async io */
+static int PcapLogWriterTest02(void)
+{
+#ifdef PCAPLOG_HAVE_AIO
+    return PcapLogWriterTestFile(PCAPLOG_IO_ASYNC);
+#else
+    return 1;
+#endif
+}
+
+/** \test per flow ring keeps the last packets and honours the memcap */
+static int PcapLogFlowRingTest01(void)
+{
+    int result = 0;
+    uint8_t pkt[100];
+    struct timeval ts = { 0, 0 };
+    uint64_t memcap = cond_memcap;
+    int i;
+
+    SC_ATOMIC_INIT(cond_memuse);
+    SC_ATOMIC_INIT(cond_memcap_drops);
+    cond_memcap = 1024;
+
+    PcapLogFlowRing *ring = PcapLogFlowRingNew(3, 0);
+    if (ring == NULL)
+        goto end;
+
+    for (i = 0; i < 5; i++) {
+        ts.tv_sec = i;
+        if (PcapLogFlowRingAdd(ring, &ts, pkt, sizeof(pkt)) != 0)
+            goto end;
+    }
+    if (ring->cnt != 3 || ring->pkts[ring->head]->ts.tv_sec != 2)
+        goto end;
+
+    /* too large for what is left of the memcap */
+    uint8_t big[1024];
+    if (PcapLogFlowRingAdd(ring, &ts, big, sizeof(big)) != -1)
+        goto end;
+    if (SC_ATOMIC_GET(cond_memcap_drops) != 1)
+        goto end;
+
+    PcapLogFlowRingFree(ring);
+    ring = NULL;
+    if (SC_ATOMIC_GET(cond_memuse) != 0)
+        goto end;
+
+    result = 1;
+end:
+    if (ring != NULL)
+        PcapLogFlowRingFree(ring);
+    cond_memcap = memcap;
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+static void PcapLogRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PcapLogWriterTest01", PcapLogWriterTest01, 1);
+    UtRegisterTest("PcapLogWriterTest02", PcapLogWriterTest02, 1);
+    UtRegisterTest("PcapLogFlowRingTest01", PcapLogFlowRingTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,167 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * DNS records for the binlog output, one per query, answer and
+ * authority entry.
+ */
+
+#include "suricata-common.h"
+#include "debug.h"
+#include "decode.h"
+#include "flow.h"
+#include "conf.h"
+
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-threads.h"
+
+#include "util-debug.h"
+#include "util-buffer.h"
+#include "util-logopenfile.h"
+#include "app-layer.h"
+#include "app-layer-parser.h"
+#include "app-layer-dns-common.h"
+#include "output.h"
+#include "output-binlog.h"
+#include "output-binlog-dns.h"
+
+#define MODULE_NAME "BinLogDns"
+
+/** layout version of BINLOG_RECORD_DNS */
+#define BINLOG_DNS_VERSION 1
+
+static void BinLogDnsRecordStart(BinLogRecord *r, BinLogThread *aft,
+        const Packet *p, DNSTransaction *tx, uint64_t tx_id, uint8_t kind)
+{
+    BinLogRecordInit(r, aft->buffer, BINLOG_RECORD_DNS, BINLOG_DNS_VERSION);
+    BinLogPutFlowKey(r, p->flow, 0);
+    BinLogPutTime(r, &p->ts);
+    BinLogPutU64(r, tx_id);
+    BinLogPutU16(r, tx->tx_id);
+    BinLogPutU8(r, kind);
+}
+
+static void BinLogDnsQuery(BinLogThread *aft, const Packet *p,
+        DNSTransaction *tx, uint64_t tx_id, DNSQueryEntry *entry)
+{
+    BinLogRecord r;
+
+    BinLogDnsRecordStart(&r, aft, p, tx, tx_id, BINLOG_DNS_QUERY);
+    BinLogPutU16(&r, entry->type);
+    BinLogPutU32(&r, 0);
+    BinLogPutBytes16(&r, (uint8_t *)entry + sizeof(DNSQueryEntry), entry->len);
+    BinLogPutBytes16(&r, NULL, 0);
+
+    BinLogRecordWrite(&r, aft->file_ctx, p->flow);
+}
+
+/**
+ *  \param entry answer or authority entry, NULL for a NXDOMAIN record
+ */
+static void BinLogDnsAnswer(BinLogThread *aft, const Packet *p,
+        DNSTransaction *tx, uint64_t tx_id, uint8_t kind,
+        DNSAnswerEntry *entry)
+{
+    BinLogRecord r;
+
+    BinLogDnsRecordStart(&r, aft, p, tx, tx_id, kind);
+    if (entry == NULL) {
+        BinLogPutU16(&r, 0);
+        BinLogPutU32(&r, 0);
+        BinLogPutBytes16(&r, NULL, 0);
+        BinLogPutBytes16(&r, NULL, 0);
+        BinLogRecordWrite(&r, aft->file_ctx, p->flow);
+        return;
+    }
+
+    const uint8_t *fqdn = (uint8_t *)entry + sizeof(DNSAnswerEntry);
+    const uint8_t *data = fqdn + entry->fqdn_len;
+    uint16_t data_len = 0;
+
+    if (entry->type == DNS_RECORD_TYPE_A ||
+            entry->type == DNS_RECORD_TYPE_AAAA) {
+        data_len = entry->data_len;
+    } else if (entry->type == DNS_RECORD_TYPE_TXT && entry->data_len > 0) {
+        /* up to 255 bytes, up to the first NUL, like eve */
+        data_len = entry->data_len < 255 ? entry->data_len : 255;
+        const uint8_t *nul = memchr(data, '\0', data_len);
+        if (nul != NULL)
+            data_len = (uint16_t)(nul - data);
+    }
+
+    BinLogPutU16(&r, entry->type);
+    BinLogPutU32(&r, entry->ttl);
+    BinLogPutBytes16(&r, fqdn, entry->fqdn_len);
+    BinLogPutBytes16(&r, data, data_len);
+
+    BinLogRecordWrite(&r, aft->file_ctx, p->flow);
+}
+
+static int BinLogDnsLogger(ThreadVars *tv, void *thread_data, const Packet *p,
+        Flow *f, void *alstate, void *txptr, uint64_t tx_id)
+{
+    SCEnter();
+    BinLogThread *aft = (BinLogThread *)thread_data;
+    DNSTransaction *tx = txptr;
+
+    DNSQueryEntry *query = NULL;
+    TAILQ_FOREACH(query, &tx->query_list, next) {
+        BinLogDnsQuery(aft, p, tx, tx_id, query);
+    }
+
+    if (tx->no_such_name) {
+        BinLogDnsAnswer(aft, p, tx, tx_id, BINLOG_DNS_NXDOMAIN, NULL);
+    }
+
+    DNSAnswerEntry *entry = NULL;
+    TAILQ_FOREACH(entry, &tx->answer_list, next) {
+        BinLogDnsAnswer(aft, p, tx, tx_id, BINLOG_DNS_ANSWER, entry);
+    }
+    TAILQ_FOREACH(entry, &tx->authority_list, next) {
+        BinLogDnsAnswer(aft, p, tx, tx_id, BINLOG_DNS_AUTHORITY, entry);
+    }
+
+    SCReturnInt(TM_ECODE_OK);
+}
+
+static OutputCtx *BinLogDnsInitCtxSub(ConfNode *conf, OutputCtx *parent_ctx)
+{
+    OutputCtx *output_ctx = BinLogInitSubCtx(conf, parent_ctx);
+    if (output_ctx == NULL)
+        return NULL;
+
+    AppLayerParserRegisterLogger(IPPROTO_UDP, ALPROTO_DNS);
+    AppLayerParserRegisterLogger(IPPROTO_TCP, ALPROTO_DNS);
+    DNSConfigSetStore(DNS_STORE_QUERIES|DNS_STORE_ANSWERS);
+    return output_ctx;
+}
+
+void TmModuleBinLogDnsRegister(void)
+{
+    tmm_modules[TMM_BINLOGDNS].name = MODULE_NAME;
+    tmm_modules[TMM_BINLOGDNS].ThreadInit = BinLogThreadInit;
+    tmm_modules[TMM_BINLOGDNS].ThreadDeinit = BinLogThreadDeinit;
+    tmm_modules[TMM_BINLOGDNS].RegisterTests = NULL;
+    tmm_modules[TMM_BINLOGDNS].cap_flags = 0;
+    tmm_modules[TMM_BINLOGDNS].flags = TM_FLAG_LOGAPI_TM;
+
+    OutputRegisterTxSubModule("binlog", MODULE_NAME, "binlog.dns",
+            BinLogDnsInitCtxSub, ALPROTO_DNS, BinLogDnsLogger);
+}
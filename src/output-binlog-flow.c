@@ -0,0 +1,91 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Flow records for the binlog output, the binary counterpart of the
+ * eve "flow" type.
+ */
+
+#include "suricata-common.h"
+#include "debug.h"
+#include "decode.h"
+#include "flow.h"
+#include "conf.h"
+
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-threads.h"
+
+#include "util-debug.h"
+#include "util-buffer.h"
+#include "util-logopenfile.h"
+#include "app-layer.h"
+#include "output.h"
+#include "output-binlog.h"
+#include "output-binlog-flow.h"
+
+#include "stream-tcp-private.h"
+
+#define MODULE_NAME "BinLogFlow"
+
+/** layout version of BINLOG_RECORD_FLOW */
+#define BINLOG_FLOW_VERSION 1
+
+static int BinLogFlowLogger(ThreadVars *tv, void *thread_data, Flow *f)
+{
+    SCEnter();
+    BinLogThread *aft = (BinLogThread *)thread_data;
+    BinLogRecord r;
+
+    BinLogRecordInit(&r, aft->buffer, BINLOG_RECORD_FLOW, BINLOG_FLOW_VERSION);
+    BinLogPutFlowKey(&r, f, 0);
+    BinLogPutTime(&r, &f->startts);
+    BinLogPutTime(&r, &f->lastts);
+    BinLogPutU32(&r, f->todstpktcnt);
+    BinLogPutU32(&r, f->tosrcpktcnt);
+    BinLogPutU64(&r, f->todstbytecnt);
+    BinLogPutU64(&r, f->tosrcbytecnt);
+    BinLogPutU8(&r, f->flow_end_flags);
+    BinLogPutStr8(&r, AppProtoToString(f->alproto));
+
+    if (f->proto == IPPROTO_TCP) {
+        TcpSession *ssn = f->protoctx;
+
+        BinLogPutU8(&r, ssn ? ssn->tcp_packet_flags : 0);
+        BinLogPutU8(&r, ssn ? ssn->client.tcp_flags : 0);
+        BinLogPutU8(&r, ssn ? ssn->server.tcp_flags : 0);
+        BinLogPutU8(&r, ssn ? ssn->state : 0xff);
+    }
+
+    BinLogRecordWrite(&r, aft->file_ctx, f);
+    SCReturnInt(TM_ECODE_OK);
+}
+
+void TmModuleBinLogFlowRegister(void)
+{
+    tmm_modules[TMM_BINLOGFLOW].name = MODULE_NAME;
+    tmm_modules[TMM_BINLOGFLOW].ThreadInit = BinLogThreadInit;
+    tmm_modules[TMM_BINLOGFLOW].ThreadDeinit = BinLogThreadDeinit;
+    tmm_modules[TMM_BINLOGFLOW].RegisterTests = NULL;
+    tmm_modules[TMM_BINLOGFLOW].cap_flags = 0;
+    tmm_modules[TMM_BINLOGFLOW].flags = TM_FLAG_LOGAPI_TM;
+
+    OutputRegisterFlowSubModule("binlog", MODULE_NAME, "binlog.flow",
+            BinLogInitSubCtx, BinLogFlowLogger);
+}
@@ -0,0 +1,106 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Unidirectional flow records for the binlog output, the binary
+ * counterpart of the eve "netflow" type.
+ */
+
+#include "suricata-common.h"
+#include "debug.h"
+#include "decode.h"
+#include "flow.h"
+#include "conf.h"
+
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-threads.h"
+
+#include "util-debug.h"
+#include "util-buffer.h"
+#include "util-logopenfile.h"
+#include "app-layer.h"
+#include "output.h"
+#include "output-binlog.h"
+#include "output-binlog-netflow.h"
+
+#include "stream-tcp-private.h"
+
+#define MODULE_NAME "BinLogNetFlow"
+
+/** layout version of BINLOG_RECORD_NETFLOW */
+#define BINLOG_NETFLOW_VERSION 1
+
+/**
+ *  \param dir 0: client to server, 1: server to client
+ */
+static void BinLogNetFlowLogDirection(BinLogThread *aft, Flow *f, int dir)
+{
+    TcpSession *ssn = f->proto == IPPROTO_TCP ? f->protoctx : NULL;
+    BinLogRecord r;
+    AppProto alproto;
+
+    BinLogRecordInit(&r, aft->buffer, BINLOG_RECORD_NETFLOW,
+            BINLOG_NETFLOW_VERSION);
+    BinLogPutFlowKey(&r, f, dir);
+    BinLogPutTime(&r, &f->startts);
+    BinLogPutTime(&r, &f->lastts);
+    if (dir == 0) {
+        alproto = f->alproto_ts ? f->alproto_ts : f->alproto;
+        BinLogPutU32(&r, f->todstpktcnt);
+        BinLogPutU64(&r, f->todstbytecnt);
+    } else {
+        alproto = f->alproto_tc ? f->alproto_tc : f->alproto;
+        BinLogPutU32(&r, f->tosrcpktcnt);
+        BinLogPutU64(&r, f->tosrcbytecnt);
+    }
+    BinLogPutStr8(&r, AppProtoToString(alproto));
+
+    if (f->proto == IPPROTO_TCP) {
+        uint8_t flags = 0;
+        if (ssn != NULL)
+            flags = dir == 0 ? ssn->client.tcp_flags : ssn->server.tcp_flags;
+        BinLogPutU8(&r, flags);
+    }
+
+    BinLogRecordWrite(&r, aft->file_ctx, f);
+}
+
+static int BinLogNetFlowLogger(ThreadVars *tv, void *thread_data, Flow *f)
+{
+    SCEnter();
+    BinLogThread *aft = (BinLogThread *)thread_data;
+
+    BinLogNetFlowLogDirection(aft, f, 0);
+    BinLogNetFlowLogDirection(aft, f, 1);
+    SCReturnInt(TM_ECODE_OK);
+}
+
+void TmModuleBinLogNetFlowRegister(void)
+{
+    tmm_modules[TMM_BINLOGNETFLOW].name = MODULE_NAME;
+    tmm_modules[TMM_BINLOGNETFLOW].ThreadInit = BinLogThreadInit;
+    tmm_modules[TMM_BINLOGNETFLOW].ThreadDeinit = BinLogThreadDeinit;
+    tmm_modules[TMM_BINLOGNETFLOW].RegisterTests = NULL;
+    tmm_modules[TMM_BINLOGNETFLOW].cap_flags = 0;
+    tmm_modules[TMM_BINLOGNETFLOW].flags = TM_FLAG_LOGAPI_TM;
+
+    OutputRegisterFlowSubModule("binlog", MODULE_NAME, "binlog.netflow",
+            BinLogInitSubCtx, BinLogNetFlowLogger);
+}
@@ -0,0 +1,420 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Binary log output. The "binlog" output opens the file, the flow,
+ * netflow and dns sub-modules (binlog "types") write their records to
+ * it. See output-binlog.h for the record layouts, contrib/suri-binlog
+ * reads them back.
+ */
+
+#include "suricata-common.h"
+#include "debug.h"
+#include "decode.h"
+#include "flow.h"
+#include "conf.h"
+#include "output.h"
+
+#include "util-buffer.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+#include "util-logopenfile.h"
+#include "util-logopenfile-async.h"
+#include "util-logopenfile-shard.h"
+
+#include "output-binlog.h"
+
+#define DEFAULT_LOG_FILENAME "binlog.bin"
+#define MODULE_NAME "BinLog"
+
+static void BinLogPutRaw(BinLogRecord *r, const void *data, uint32_t len)
+{
+    MemBuffer *b = r->buffer;
+
+    if (unlikely(r->error))
+        return;
+
+    if (unlikely(len > b->size - b->offset)) {
+        r->error = 1;
+        return;
+    }
+
+    memcpy(b->buffer + b->offset, data, len);
+    b->offset += len;
+}
+
+/**
+ *  \brief start a record in a buffer
+ *
+ *  The length in the header is filled in by BinLogRecordWrite().
+ */
+void BinLogRecordInit(BinLogRecord *r, MemBuffer *buffer, uint16_t type,
+        uint16_t version)
+{
+    r->buffer = buffer;
+    r->error = 0;
+    MemBufferReset(buffer);
+
+    BinLogPutU32(r, 0);
+    BinLogPutU16(r, type);
+    BinLogPutU16(r, version);
+}
+
+void BinLogPutU8(BinLogRecord *r, uint8_t val)
+{
+    BinLogPutRaw(r, &val, sizeof(val));
+}
+
+void BinLogPutU16(BinLogRecord *r, uint16_t val)
+{
+    uint16_t nval = htons(val);
+    BinLogPutRaw(r, &nval, sizeof(nval));
+}
+
+void BinLogPutU32(BinLogRecord *r, uint32_t val)
+{
+    uint32_t nval = htonl(val);
+    BinLogPutRaw(r, &nval, sizeof(nval));
+}
+
+void BinLogPutU64(BinLogRecord *r, uint64_t val)
+{
+    BinLogPutU32(r, (uint32_t)(val >> 32));
+    BinLogPutU32(r, (uint32_t)val);
+}
+
+void BinLogPutTime(BinLogRecord *r, const struct timeval *tv)
+{
+    BinLogPutU64(r, (uint64_t)tv->tv_sec * 1000000 + (uint64_t)tv->tv_usec);
+}
+
+/** \brief add a string, truncated to 255 bytes */
+void BinLogPutStr8(BinLogRecord *r, const char *str)
+{
+    size_t len = str ? strlen(str) : 0;
+    if (len > 255)
+        len = 255;
+
+    BinLogPutU8(r, (uint8_t)len);
+    if (len > 0)
+        BinLogPutRaw(r, str, (uint32_t)len);
+}
+
+void BinLogPutBytes16(BinLogRecord *r, const uint8_t *data, uint16_t len)
+{
+    BinLogPutU16(r, len);
+    if (len > 0)
+        BinLogPutRaw(r, data, len);
+}
+
+/**
+ *  \brief add the flow key
+ *
+ *  \param dir 0: src is the client, 1: src is the server
+ */
+void BinLogPutFlowKey(BinLogRecord *r, const Flow *f, int dir)
+{
+    const FlowAddress *src = dir == 0 ? &f->src : &f->dst;
+    const FlowAddress *dst = dir == 0 ? &f->dst : &f->src;
+    uint32_t addr_len = 0;
+    uint8_t ipver = 0;
+
+    if (FLOW_IS_IPV4(f)) {
+        ipver = 4;
+        addr_len = 4;
+    } else if (FLOW_IS_IPV6(f)) {
+        ipver = 6;
+        addr_len = 16;
+    }
+
+    BinLogPutU64(r, (uint64_t)(uintptr_t)f);
+    BinLogPutU8(r, ipver);
+    BinLogPutU8(r, f->proto);
+    BinLogPutU16(r, f->vlan_id[0]);
+    BinLogPutU16(r, dir == 0 ? f->sp : f->dp);
+    BinLogPutU16(r, dir == 0 ? f->dp : f->sp);
+    if (addr_len > 0) {
+        /* addresses are stored in network byte order already */
+        BinLogPutRaw(r, src->addr_data32, addr_len);
+        BinLogPutRaw(r, dst->addr_data32, addr_len);
+    }
+}
+
+/**
+ *  \brief fill in the record length and write the record
+ *
+ *  \param f flow of the record, selects the file if the output is
+ *           sharded, may be NULL
+ *
+ *  \retval 0 written
+ *  \retval -1 record was incomplete or no file to write it to
+ */
+int BinLogRecordWrite(BinLogRecord *r, LogFileCtx *file_ctx, const Flow *f)
+{
+    if (unlikely(r->error)) {
+        SCLogDebug("incomplete binlog record, not logging it");
+        return -1;
+    }
+
+    MemBuffer *buffer = r->buffer;
+    uint32_t len = htonl(MEMBUFFER_OFFSET(buffer));
+    memcpy(MEMBUFFER_BUFFER(buffer), &len, sizeof(len));
+
+    if (file_ctx->shard != NULL) {
+        file_ctx = LogFileShardGet(file_ctx, LogFileShardHashPtr(f));
+        if (unlikely(file_ctx == NULL))
+            return -1;
+    }
+
+    if (file_ctx->async != NULL) {
+        file_ctx->Write((const char *)MEMBUFFER_BUFFER(buffer),
+            MEMBUFFER_OFFSET(buffer), file_ctx);
+        return 0;
+    }
+
+    SCMutexLock(&file_ctx->fp_mutex);
+    file_ctx->Write((const char *)MEMBUFFER_BUFFER(buffer),
+        MEMBUFFER_OFFSET(buffer), file_ctx);
+    SCMutexUnlock(&file_ctx->fp_mutex);
+    return 0;
+}
+
+static void BinLogDeInitCtx(OutputCtx *output_ctx)
+{
+    BinLogCtx *binlog_ctx = (BinLogCtx *)output_ctx->data;
+    LogFileCtx *logfile_ctx = binlog_ctx->file_ctx;
+    OutputUnregisterFileRotationFlag(&logfile_ctx->rotation_flag);
+    LogFileFreeCtx(logfile_ctx);
+    SCFree(binlog_ctx);
+    SCFree(output_ctx);
+}
+
+/**
+ *  \brief Create the binlog output ctx, the sub-modules share its file
+ *
+ *  \param conf "binlog" output config
+ *
+ *  \retval output_ctx or NULL on error
+ */
+static OutputCtx *BinLogInitCtx(ConfNode *conf)
+{
+    BinLogCtx *binlog_ctx = SCCalloc(1, sizeof(BinLogCtx));
+    if (unlikely(binlog_ctx == NULL))
+        return NULL;
+
+    binlog_ctx->file_ctx = LogFileNewCtx();
+    if (binlog_ctx->file_ctx == NULL) {
+        SCFree(binlog_ctx);
+        return NULL;
+    }
+
+    if (SCConfLogOpenGeneric(conf, binlog_ctx->file_ctx, DEFAULT_LOG_FILENAME) < 0) {
+        LogFileFreeCtx(binlog_ctx->file_ctx);
+        SCFree(binlog_ctx);
+        return NULL;
+    }
+
+    /* with shards the async buffers are set up per shard */
+    int r = LogFileShardSetup(conf, binlog_ctx->file_ctx);
+    if (r == 0)
+        r = LogFileAsyncSetup(conf, binlog_ctx->file_ctx);
+    if (r < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    OutputCtx *output_ctx = SCCalloc(1, sizeof(OutputCtx));
+    if (unlikely(output_ctx == NULL)) {
+        LogFileFreeCtx(binlog_ctx->file_ctx);
+        SCFree(binlog_ctx);
+        return NULL;
+    }
+    output_ctx->data = binlog_ctx;
+    output_ctx->DeInit = BinLogDeInitCtx;
+
+    OutputRegisterFileRotationFlag(&binlog_ctx->file_ctx->rotation_flag);
+    return output_ctx;
+}
+
+static void BinLogDeInitSubCtx(OutputCtx *output_ctx)
+{
+    SCFree(output_ctx->data);
+    SCFree(output_ctx);
+}
+
+/**
+ *  \brief InitSub function for the binlog sub-modules, the sub-module
+ *         logs to the parent's file
+ */
+OutputCtx *BinLogInitSubCtx(ConfNode *conf, OutputCtx *parent_ctx)
+{
+    BinLogCtx *parent = parent_ctx->data;
+
+    BinLogCtx *binlog_ctx = SCMalloc(sizeof(BinLogCtx));
+    if (unlikely(binlog_ctx == NULL))
+        return NULL;
+
+    OutputCtx *output_ctx = SCCalloc(1, sizeof(OutputCtx));
+    if (unlikely(output_ctx == NULL)) {
+        SCFree(binlog_ctx);
+        return NULL;
+    }
+
+    binlog_ctx->file_ctx = parent->file_ctx;
+    output_ctx->data = binlog_ctx;
+    output_ctx->DeInit = BinLogDeInitSubCtx;
+    return output_ctx;
+}
+
+#define OUTPUT_BUFFER_SIZE 65535
+TmEcode BinLogThreadInit(ThreadVars *t, void *initdata, void **data)
+{
+    if (initdata == NULL) {
+        SCLogDebug("Error getting context for binlog. \"initdata\" argument NULL");
+        return TM_ECODE_FAILED;
+    }
+
+    BinLogThread *aft = SCCalloc(1, sizeof(BinLogThread));
+    if (unlikely(aft == NULL))
+        return TM_ECODE_FAILED;
+
+    aft->file_ctx = ((BinLogCtx *)((OutputCtx *)initdata)->data)->file_ctx;
+    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    if (aft->buffer == NULL) {
+        SCFree(aft);
+        return TM_ECODE_FAILED;
+    }
+
+    *data = (void *)aft;
+    return TM_ECODE_OK;
+}
+
+TmEcode BinLogThreadDeinit(ThreadVars *t, void *data)
+{
+    BinLogThread *aft = (BinLogThread *)data;
+    if (aft == NULL)
+        return TM_ECODE_OK;
+
+    MemBufferFree(aft->buffer);
+    SCFree(aft);
+    return TM_ECODE_OK;
+}
+
+void OutputBinLogRegister(void)
+{
+    OutputRegisterModule(MODULE_NAME, "binlog", BinLogInitCtx);
+}
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+/**
+ *  \test layout of the record header and flow key
+ */
+static int BinLogTest01(void)
+{
+    int result = 0;
+    BinLogRecord r;
+    MemBuffer *buffer = MemBufferCreateNew(128);
+    Flow *f = UTHBuildFlow(AF_INET, "192.168.1.1", "10.0.0.1", 1024, 53);
+    if (buffer == NULL || f == NULL)
+        goto end;
+    f->proto = IPPROTO_UDP;
+
+    BinLogRecordInit(&r, buffer, BINLOG_RECORD_DNS, 1);
+    BinLogPutFlowKey(&r, f, 1);
+    BinLogPutStr8(&r, "dns");
+    if (r.error)
+        goto end;
+
+    uint8_t *b = MEMBUFFER_BUFFER(buffer);
+    uint8_t hdr[] = { 0x00, 0x00, 0x00, 0x00, 0x00, BINLOG_RECORD_DNS, 0x00, 0x01 };
+    if (memcmp(b, hdr, sizeof(hdr)) != 0)
+        goto end;
+
+    /* flow id, then the key in server to client direction */
+    uint8_t key[] = { 4, IPPROTO_UDP, 0x00, 0x00, 0x00, 53, 0x04, 0x00,
+                      10, 0, 0, 1, 192, 168, 1, 1, 3, 'd', 'n', 's' };
+    if (MEMBUFFER_OFFSET(buffer) != BINLOG_RECORD_HDR_LEN + 8 + sizeof(key))
+        goto end;
+    if (memcmp(b + BINLOG_RECORD_HDR_LEN + 8, key, sizeof(key)) != 0)
+        goto end;
+
+    result = 1;
+end:
+    if (f != NULL)
+        UTHFreeFlow(f);
+    if (buffer != NULL)
+        MemBufferFree(buffer);
+    return result;
+}
+
+/**
+ *  \test a record that doesn't fit the buffer is not written
+ */
+static int BinLogTest02(void)
+{
+    int result = 0;
+    BinLogRecord r;
+    uint8_t data[32];
+    LogFileCtx *file_ctx = NULL;
+    MemBuffer *buffer = MemBufferCreateNew(32);
+    if (buffer == NULL)
+        goto end;
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    file_ctx->fp = tmpfile();
+    if (file_ctx->fp == NULL)
+        goto end;
+
+    memset(data, 'a', sizeof(data));
+    BinLogRecordInit(&r, buffer, BINLOG_RECORD_FLOW, 1);
+    BinLogPutBytes16(&r, data, sizeof(data));
+    if (!r.error || BinLogRecordWrite(&r, file_ctx, NULL) != -1)
+        goto end;
+
+    BinLogRecordInit(&r, buffer, BINLOG_RECORD_FLOW, 1);
+    BinLogPutBytes16(&r, data, 4);
+    if (BinLogRecordWrite(&r, file_ctx, NULL) != 0)
+        goto end;
+    if (ftell(file_ctx->fp) != BINLOG_RECORD_HDR_LEN + 2 + 4)
+        goto end;
+    if (MEMBUFFER_BUFFER(buffer)[3] != BINLOG_RECORD_HDR_LEN + 2 + 4)
+        goto end;
+
+    result = 1;
+end:
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    if (buffer != NULL)
+        MemBufferFree(buffer);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void BinLogRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("BinLogTest01", BinLogTest01, 1);
+    UtRegisterTest("BinLogTest02", BinLogTest02, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,132 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Binary log output ("binlog"): a stream of length prefixed records
+ * with a fixed layout per record type. All integers are in network
+ * byte order.
+ *
+ * Record:
+ *   uint32_t length       whole record, including this header
+ *   uint16_t type         BINLOG_RECORD_*
+ *   uint16_t version      layout version of the type
+ *   payload
+ *
+ * Flow key, starts the payload of every record type:
+ *   uint64_t flow_id
+ *   uint8_t  ip version   4, 6 or 0 if unknown (no addresses follow)
+ *   uint8_t  ip proto
+ *   uint16_t vlan id      0 if none
+ *   uint16_t src port
+ *   uint16_t dst port
+ *   src address, dst address: 4 or 16 bytes each
+ *
+ * Variable length fields are prefixed by their length: "str8" by an
+ * uint8_t, "bytes16" by an uint16_t. Times are uint64_t usec since the
+ * epoch.
+ *
+ * BINLOG_RECORD_FLOW, at flow end:
+ *   flow key              src is the client
+ *   time start, end
+ *   uint32_t pkts_toserver, pkts_toclient
+ *   uint64_t bytes_toserver, bytes_toclient
+ *   uint8_t  end flags    FLOW_END_FLAG_* values
+ *   str8     app proto
+ *   TCP only:
+ *   uint8_t  tcp flags, tcp flags toserver, tcp flags toclient
+ *   uint8_t  tcp state    TcpState value, 0xff if there was no session
+ *
+ * BINLOG_RECORD_NETFLOW, at flow end, one per direction:
+ *   flow key              src is the sender
+ *   time start, end
+ *   uint32_t pkts
+ *   uint64_t bytes
+ *   str8     app proto
+ *   TCP only:
+ *   uint8_t  tcp flags
+ *
+ * BINLOG_RECORD_DNS, per query, answer and authority entry:
+ *   flow key              src is the client
+ *   time     packet time
+ *   uint64_t tx_id
+ *   uint16_t dns id
+ *   uint8_t  kind         BINLOG_DNS_*
+ *   uint16_t rrtype
+ *   uint32_t ttl          0 for queries
+ *   bytes16  rrname
+ *   bytes16  rdata        address for A/AAAA, text for TXT, else empty
+ */
+
+#ifndef __OUTPUT_BINLOG_H__
+#define __OUTPUT_BINLOG_H__
+
+#include "tm-threads.h"
+#include "output.h"
+#include "util-buffer.h"
+#include "util-logopenfile.h"
+
+#define BINLOG_RECORD_FLOW      1
+#define BINLOG_RECORD_NETFLOW   2
+#define BINLOG_RECORD_DNS       3
+
+/** size of the record header */
+#define BINLOG_RECORD_HDR_LEN   8
+
+#define BINLOG_DNS_QUERY        1
+#define BINLOG_DNS_ANSWER       2
+#define BINLOG_DNS_AUTHORITY    3
+#define BINLOG_DNS_NXDOMAIN     4
+
+/** output ctx data of the binlog parent, shared by the sub-modules */
+typedef struct BinLogCtx_ {
+    LogFileCtx *file_ctx;
+} BinLogCtx;
+
+/** thread data of the binlog sub-modules */
+typedef struct BinLogThread_ {
+    LogFileCtx *file_ctx;
+    MemBuffer *buffer;
+} BinLogThread;
+
+typedef struct BinLogRecord_ {
+    MemBuffer *buffer;
+    /** record didn't fit the buffer and must not be written */
+    int error;
+} BinLogRecord;
+
+void BinLogRecordInit(BinLogRecord *r, MemBuffer *buffer, uint16_t type,
+        uint16_t version);
+void BinLogPutU8(BinLogRecord *r, uint8_t val);
+void BinLogPutU16(BinLogRecord *r, uint16_t val);
+void BinLogPutU32(BinLogRecord *r, uint32_t val);
+void BinLogPutU64(BinLogRecord *r, uint64_t val);
+void BinLogPutTime(BinLogRecord *r, const struct timeval *tv);
+void BinLogPutStr8(BinLogRecord *r, const char *str);
+void BinLogPutBytes16(BinLogRecord *r, const uint8_t *data, uint16_t len);
+void BinLogPutFlowKey(BinLogRecord *r, const Flow *f, int dir);
+int BinLogRecordWrite(BinLogRecord *r, LogFileCtx *file_ctx, const Flow *f);
+
+OutputCtx *BinLogInitSubCtx(ConfNode *conf, OutputCtx *parent_ctx);
+TmEcode BinLogThreadInit(ThreadVars *t, void *initdata, void **data);
+TmEcode BinLogThreadDeinit(ThreadVars *t, void *data);
+
+void OutputBinLogRegister(void);
+void BinLogRegisterTests(void);
+
+#endif /* __OUTPUT_BINLOG_H__ */
@@ -99,7 +99,7 @@ static int AlertJsonPrintStreamSegmentCallback(const Packet *p, void *data, uint
 /** Handle the case where no JSON support is compiled in.
  *
  */
-static void AlertJsonHttp(const Flow *f, json_t *js)
+static void AlertJsonHttp(const Flow *f, JsonBuilder *jb)
 {
     HtpState *htp_state = (HtpState *)f->alstate;
     if (htp_state) {
@@ -107,35 +107,54 @@ static void AlertJsonHttp(const Flow *f, json_t *js)
         htp_tx_t *tx = AppLayerParserGetTx(IPPROTO_TCP, ALPROTO_HTTP, htp_state, tx_id);
 
         if (tx) {
-            json_t *hjs = json_object();
-            if (unlikely(hjs == NULL))
-                return;
+            JsonBuilderOpenObject(jb, "http");
 
-            JsonHttpLogJSONBasic(hjs, tx);
-            JsonHttpLogJSONExtended(hjs, tx);
+            JsonHttpLogJSONBasic(jb, tx);
+            JsonHttpLogJSONExtended(jb, tx);
 
-            json_object_set_new(js, "http", hjs);
+            JsonBuilderCloseObject(jb);
         }
     }
 
     return;
 }
 
+static void AlertJsonSignature(JsonBuilder *jb, const PacketAlert *pa)
+{
+    const char *action = "allowed";
+    if (pa->action & (ACTION_REJECT|ACTION_REJECT_DST|ACTION_REJECT_BOTH)) {
+        action = "blocked";
+    } else if ((pa->action & ACTION_DROP) && EngineModeIsIPS()) {
+        action = "blocked";
+    }
+
+    JsonBuilderSetString(jb, "action", action);
+    JsonBuilderSetInt(jb, "gid", pa->s->gid);
+    JsonBuilderSetInt(jb, "signature_id", pa->s->id);
+    JsonBuilderSetInt(jb, "rev", pa->s->rev);
+    JsonBuilderSetString(jb, "signature",
+            (pa->s->msg) ? pa->s->msg : "");
+    JsonBuilderSetString(jb, "category",
+            (pa->s->class_msg) ? pa->s->class_msg : "");
+    JsonBuilderSetInt(jb, "severity", pa->s->prio);
+}
+
 static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 {
     MemBuffer *payload = aft->payload_buffer;
     AlertJsonOutputCtx *json_output_ctx = aft->json_output_ctx;
+    JsonBuilder jb;
+    JsonBuilderMark mark;
 
     int i;
 
     if (p->alerts.cnt == 0)
         return TM_ECODE_OK;
 
-    MemBufferReset(aft->json_buffer);
-
-    json_t *js = CreateJSONHeader((Packet *)p, 0, "alert");
-    if (unlikely(js == NULL))
-        return TM_ECODE_OK;
+    /* all alerts of the packet share the header */
+    JsonBuilderInit(&jb, aft->json_buffer);
+    OutputJsonBuilderHeader(&jb, p, 0, "alert");
+    JsonBuilderGetMark(&jb, &mark);
 
     for (i = 0; i < p->alerts.cnt; i++) {
         const PacketAlert *pa = &p->alerts.alerts[i];
@@ -143,34 +162,14 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
             continue;
         }
 
-        char *action = "allowed";
-        if (pa->action & (ACTION_REJECT|ACTION_REJECT_DST|ACTION_REJECT_BOTH)) {
-            action = "blocked";
-        } else if ((pa->action & ACTION_DROP) && EngineModeIsIPS()) {
-            action = "blocked";
-        }
-
-        json_t *ajs = json_object();
-        if (ajs == NULL) {
-            json_decref(js);
-            return TM_ECODE_OK;
-        }
-
-        json_object_set_new(ajs, "action", json_string(action));
-        json_object_set_new(ajs, "gid", json_integer(pa->s->gid));
-        json_object_set_new(ajs, "signature_id", json_integer(pa->s->id));
-        json_object_set_new(ajs, "rev", json_integer(pa->s->rev));
-        json_object_set_new(ajs, "signature",
-                            json_string((pa->s->msg) ? pa->s->msg : ""));
-        json_object_set_new(ajs, "category",
-                            json_string((pa->s->class_msg) ? pa->s->class_msg : ""));
-        json_object_set_new(ajs, "severity", json_integer(pa->s->prio));
-
-        if (pa->flags & PACKET_ALERT_FLAG_TX)
-            json_object_set_new(ajs, "tx_id", json_integer(pa->tx_id));
+        JsonBuilderRestoreMark(&jb, &mark);
 
         /* alert */
-        json_object_set_new(js, "alert", ajs);
+        JsonBuilderOpenObject(&jb, "alert");
+        AlertJsonSignature(&jb, pa);
+        if (pa->flags & PACKET_ALERT_FLAG_TX)
+            JsonBuilderSetInt(&jb, "tx_id", pa->tx_id);
+        JsonBuilderCloseObject(&jb);
 
         if (json_output_ctx->flags & LOG_JSON_HTTP) {
             if (p->flow != NULL) {
@@ -179,7 +178,7 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 
                 /* http alert */
                 if (proto == ALPROTO_HTTP)
-                    AlertJsonHttp(p->flow, js);
+                    AlertJsonHttp(p->flow, &jb);
 
                 FLOWLOCK_UNLOCK(p->flow);
             }
@@ -210,13 +209,13 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
                 if (json_output_ctx->flags & LOG_JSON_PAYLOAD_BASE64) {
                     unsigned long len = JSON_STREAM_BUFFER_SIZE * 2;
                     unsigned char encoded[len];
-                    Base64Encode((unsigned char *)payload, payload->offset, encoded, &len);
-                    json_object_set_new(js, "payload", json_string((char *)encoded));
+                    Base64Encode(payload->buffer, payload->offset, encoded, &len);
+                    JsonBuilderSetString(&jb, "payload", (char *)encoded);
                 }
 
                 if (json_output_ctx->flags & LOG_JSON_PAYLOAD) {
-                    json_object_set_new(js, "payload_printable",
-                                        json_string((char *)payload->buffer));
+                    JsonBuilderSetStringN(&jb, "payload_printable",
+                            payload->buffer, payload->offset);
                 }
             } else {
                 /* This is a single packet and not a stream */
@@ -231,15 +230,16 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
                     unsigned long len = sizeof(packet_buf) * 2;
                     unsigned char encoded[len];
                     Base64Encode(packet_buf, offset, encoded, &len);
-                    json_object_set_new(js, "payload", json_string((char *)encoded));
+                    JsonBuilderSetString(&jb, "payload", (char *)encoded);
                 }
 
                 if (json_output_ctx->flags & LOG_JSON_PAYLOAD) {
-                    json_object_set_new(js, "payload_printable", json_string((char *)packet_buf));
+                    JsonBuilderSetStringN(&jb, "payload_printable",
+                            packet_buf, offset);
                 }
             }
 
-            json_object_set_new(js, "stream", json_integer(stream));
+            JsonBuilderSetInt(&jb, "stream", stream);
         }
 
         /* base64-encoded full packet */
@@ -247,30 +247,25 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
             unsigned long len = GET_PKT_LEN(p) * 2;
             unsigned char encoded_packet[len];
             Base64Encode((unsigned char*) GET_PKT_DATA(p), GET_PKT_LEN(p), encoded_packet, &len);
-            json_object_set_new(js, "packet", json_string((char *)encoded_packet));
+            JsonBuilderSetString(&jb, "packet", (char *)encoded_packet);
         }
 
-        OutputJSONBuffer(js, aft->file_ctx, aft->json_buffer);
-        json_object_del(js, "alert");
+        JsonBuilderCloseObject(&jb);
+        OutputJSONBuilderBuffer(&jb, aft->file_ctx, p->flow);
     }
-    json_object_clear(js);
-    json_decref(js);
 
     return TM_ECODE_OK;
 }
 
 static int AlertJsonDecoderEvent(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 {
-    MemBuffer *buffer = (MemBuffer *)aft->json_buffer;
     int i;
     char timebuf[64];
-    json_t *js;
+    JsonBuilder jb;
 
     if (p->alerts.cnt == 0)
         return TM_ECODE_OK;
 
-    MemBufferReset(buffer);
-
     CreateIsoTimeString(&p->ts, timebuf, sizeof(timebuf));
 
     for (i = 0; i < p->alerts.cnt; i++) {
@@ -279,51 +274,19 @@ static int AlertJsonDecoderEvent(ThreadVars *tv, JsonAlertLogThread *aft, const
             continue;
         }
 
-        char *action = "allowed";
-        if (pa->action & (ACTION_REJECT|ACTION_REJECT_DST|ACTION_REJECT_BOTH)) {
-            action = "blocked";
-        } else if ((pa->action & ACTION_DROP) && EngineModeIsIPS()) {
-            action = "blocked";
-        }
-
-        char buf[(32 * 3) + 1];
-        PrintRawLineHexBuf(buf, sizeof(buf), GET_PKT_DATA(p), GET_PKT_LEN(p) < 32 ? GET_PKT_LEN(p) : 32);
-
-        js = json_object();
-        if (js == NULL)
-            return TM_ECODE_OK;
-
-        json_t *ajs = json_object();
-        if (ajs == NULL) {
-            json_decref(js);
-            return TM_ECODE_OK;
-        }
+        JsonBuilderInit(&jb, aft->json_buffer);
+        JsonBuilderOpenObject(&jb, NULL);
 
         /* time & tx */
-        json_object_set_new(js, "timestamp", json_string(timebuf));
-
-        /* tuple */
-        //json_object_set_new(js, "srcip", json_string(srcip));
-        //json_object_set_new(js, "sp", json_integer(p->sp));
-        //json_object_set_new(js, "dstip", json_string(dstip));
-        //json_object_set_new(js, "dp", json_integer(p->dp));
-        //json_object_set_new(js, "proto", json_integer(proto));
-
-        json_object_set_new(ajs, "action", json_string(action));
-        json_object_set_new(ajs, "gid", json_integer(pa->s->gid));
-        json_object_set_new(ajs, "signature_id", json_integer(pa->s->id));
-        json_object_set_new(ajs, "rev", json_integer(pa->s->rev));
-        json_object_set_new(ajs, "signature",
-                            json_string((pa->s->msg) ? pa->s->msg : ""));
-        json_object_set_new(ajs, "category",
-                            json_string((pa->s->class_msg) ? pa->s->class_msg : ""));
-        json_object_set_new(ajs, "severity", json_integer(pa->s->prio));
+        JsonBuilderSetString(&jb, "timestamp", timebuf);
 
         /* alert */
-        json_object_set_new(js, "alert", ajs);
-        OutputJSONBuffer(js, aft->file_ctx, buffer);
-        json_object_clear(js);
-        json_decref(js);
+        JsonBuilderOpenObject(&jb, "alert");
+        AlertJsonSignature(&jb, pa);
+        JsonBuilderCloseObject(&jb);
+
+        JsonBuilderCloseObject(&jb);
+        OutputJSONBuilderBuffer(&jb, aft->file_ctx, p->flow);
     }
 
     return TM_ECODE_OK;
@@ -70,133 +70,122 @@ typedef struct LogDnsLogThread_ {
     MemBuffer *buffer;
 } LogDnsLogThread;
 
-static void LogQuery(LogDnsLogThread *aft, json_t *js, DNSTransaction *tx,
+static void LogQuery(LogDnsLogThread *aft, const Packet *p, DNSTransaction *tx,
         uint64_t tx_id, DNSQueryEntry *entry)
 {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    JsonBuilder jb;
 
     SCLogDebug("got a DNS request and now logging !!");
 
-    json_t *djs = json_object();
-    if (djs == NULL) {
-        return;
-    }
+    JsonBuilderInit(&jb, aft->buffer);
+    OutputJsonBuilderHeader(&jb, p, 1, "dns");
 
-    /* reset */
-    MemBufferReset(buffer);
+    JsonBuilderOpenObject(&jb, "dns");
 
     /* type */
-    json_object_set_new(djs, "type", json_string("query"));
+    JsonBuilderSetString(&jb, "type", "query");
 
     /* id */
-    json_object_set_new(djs, "id", json_integer(tx->tx_id));
+    JsonBuilderSetInt(&jb, "id", tx->tx_id);
 
     /* query */
-    char *c;
-    c = BytesToString((uint8_t *)((uint8_t *)entry + sizeof(DNSQueryEntry)), entry->len);
-    if (c != NULL) {
-        json_object_set_new(djs, "rrname", json_string(c));
-        SCFree(c);
-    }
+    JsonBuilderSetStringN(&jb, "rrname",
+            (uint8_t *)((uint8_t *)entry + sizeof(DNSQueryEntry)), entry->len);
 
     /* name */
     char record[16] = "";
     DNSCreateTypeString(entry->type, record, sizeof(record));
-    json_object_set_new(djs, "rrtype", json_string(record));
+    JsonBuilderSetString(&jb, "rrtype", record);
 
     /* tx id (tx counter) */
-    json_object_set_new(djs, "tx_id", json_integer(tx_id));
+    JsonBuilderSetInt(&jb, "tx_id", tx_id);
 
     /* dns */
-    json_object_set_new(js, "dns", djs);
-    OutputJSONBuffer(js, aft->dnslog_ctx->file_ctx, buffer);
-    json_object_del(js, "dns");
+    JsonBuilderCloseObject(&jb);
+    JsonBuilderCloseObject(&jb);
+
+    OutputJSONBuilderBuffer(&jb, aft->dnslog_ctx->file_ctx, p->flow);
 }
 
-static void OutputAnswer(LogDnsLogThread *aft, json_t *djs, DNSTransaction *tx, DNSAnswerEntry *entry)
+static void OutputAnswer(LogDnsLogThread *aft, const Packet *p, JsonBuilder *jb, DNSTransaction *tx, DNSAnswerEntry *entry)
 {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
-    json_t *js = json_object();
-    if (js == NULL)
-        return;
+    JsonBuilderOpenObject(jb, "dns");
 
     /* type */
-    json_object_set_new(js, "type", json_string("answer"));
+    JsonBuilderSetString(jb, "type", "answer");
 
     /* id */
-    json_object_set_new(js, "id", json_integer(tx->tx_id));
+    JsonBuilderSetInt(jb, "id", tx->tx_id);
 
     if (entry != NULL) {
         /* query */
         if (entry->fqdn_len > 0) {
-            char *c;
-            c = BytesToString((uint8_t *)((uint8_t *)entry + sizeof(DNSAnswerEntry)),
+            JsonBuilderSetStringN(jb, "rrname",
+                    (uint8_t *)((uint8_t *)entry + sizeof(DNSAnswerEntry)),
                     entry->fqdn_len);
-            if (c != NULL) {
-                json_object_set_new(js, "rrname", json_string(c));
-                SCFree(c);
-            }
         }
 
         /* name */
         char record[16] = "";
         DNSCreateTypeString(entry->type, record, sizeof(record));
-        json_object_set_new(js, "rrtype", json_string(record));
+        JsonBuilderSetString(jb, "rrtype", record);
 
         /* ttl */
-        json_object_set_new(js, "ttl", json_integer(entry->ttl));
+        JsonBuilderSetInt(jb, "ttl", entry->ttl);
 
         uint8_t *ptr = (uint8_t *)((uint8_t *)entry + sizeof(DNSAnswerEntry)+ entry->fqdn_len);
         if (entry->type == DNS_RECORD_TYPE_A) {
             char a[16] = "";
             PrintInet(AF_INET, (const void *)ptr, a, sizeof(a));
-            json_object_set_new(js, "rdata", json_string(a));
+            JsonBuilderSetString(jb, "rdata", a);
         } else if (entry->type == DNS_RECORD_TYPE_AAAA) {
             char a[46] = "";
             PrintInet(AF_INET6, (const void *)ptr, a, sizeof(a));
-            json_object_set_new(js, "rdata", json_string(a));
+            JsonBuilderSetString(jb, "rdata", a);
         } else if (entry->data_len == 0) {
-            json_object_set_new(js, "rdata", json_string(""));
+            JsonBuilderSetString(jb, "rdata", "");
         } else if (entry->type == DNS_RECORD_TYPE_TXT) {
-            if (entry->data_len != 0) {
-                char buffer[256] = "";
-                uint16_t copy_len = entry->data_len < (sizeof(buffer) - 1) ?
-                    entry->data_len : sizeof(buffer) - 1;
-                memcpy(buffer, ptr, copy_len);
-                buffer[copy_len] = '\0';
-                json_object_set_new(js, "rdata", json_string(buffer));
-            } else {
-                json_object_set_new(js, "rdata", json_string(""));
-            }
+            /* up to 255 bytes, up to the first NUL */
+            uint16_t copy_len = entry->data_len < 255 ? entry->data_len : 255;
+            uint8_t *nul = memchr(ptr, '\0', copy_len);
+            if (nul != NULL)
+                copy_len = (uint16_t)(nul - ptr);
+            JsonBuilderSetStringN(jb, "rdata", ptr, copy_len);
         }
     }
 
-    /* reset */
-    MemBufferReset(buffer);
-    json_object_set_new(djs, "dns", js);
-    OutputJSONBuffer(djs, aft->dnslog_ctx->file_ctx, buffer);
-    json_object_del(djs, "dns");
+    JsonBuilderCloseObject(jb);
+    JsonBuilderCloseObject(jb);
 
-    return;
+    OutputJSONBuilderBuffer(jb, aft->dnslog_ctx->file_ctx, p->flow);
 }
 
-static void LogAnswers(LogDnsLogThread *aft, json_t *js, DNSTransaction *tx, uint64_t tx_id)
+static void LogAnswers(LogDnsLogThread *aft, const Packet *p, DNSTransaction *tx, uint64_t tx_id)
 {
+    JsonBuilder jb;
+    JsonBuilderMark mark;
 
     SCLogDebug("got a DNS response and now logging !!");
 
+    /* all answers share the header */
+    JsonBuilderInit(&jb, aft->buffer);
+    OutputJsonBuilderHeader(&jb, p, 0, "dns");
+    JsonBuilderGetMark(&jb, &mark);
+
     if (tx->no_such_name) {
-        OutputAnswer(aft, js, tx, NULL);
+        OutputAnswer(aft, p, &jb, tx, NULL);
     }
 
     DNSAnswerEntry *entry = NULL;
     TAILQ_FOREACH(entry, &tx->answer_list, next) {
-        OutputAnswer(aft, js, tx, entry);
+        JsonBuilderRestoreMark(&jb, &mark);
+        OutputAnswer(aft, p, &jb, tx, entry);
     }
 
     entry = NULL;
     TAILQ_FOREACH(entry, &tx->authority_list, next) {
-        OutputAnswer(aft, js, tx, entry);
+        JsonBuilderRestoreMark(&jb, &mark);
+        OutputAnswer(aft, p, &jb, tx, entry);
     }
 
 }
@@ -207,26 +196,13 @@ static int JsonDnsLogger(ThreadVars *tv, void *thread_data, const Packet *p, Flo
 
     LogDnsLogThread *td = (LogDnsLogThread *)thread_data;
     DNSTransaction *tx = txptr;
-    json_t *js;
 
     DNSQueryEntry *query = NULL;
     TAILQ_FOREACH(query, &tx->query_list, next) {
-        js = CreateJSONHeader((Packet *)p, 1, "dns");
-        if (unlikely(js == NULL))
-            return TM_ECODE_OK;
-
-        LogQuery(td, js, tx, tx_id, query);
-
-        json_decref(js);
+        LogQuery(td, p, tx, tx_id, query);
     }
 
-    js = CreateJSONHeader((Packet *)p, 0, "dns");
-    if (unlikely(js == NULL))
-        return TM_ECODE_OK;
-
-    LogAnswers(td, js, tx, tx_id);
-
-    json_decref(js);
+    LogAnswers(td, p, tx, tx_id);
 
     SCReturnInt(TM_ECODE_OK);
 }
@@ -315,6 +291,7 @@ static OutputCtx *JsonDnsLogInitCtxSub(ConfNode *conf, OutputCtx *parent_ctx)
 
     AppLayerParserRegisterLogger(IPPROTO_UDP, ALPROTO_DNS);
     AppLayerParserRegisterLogger(IPPROTO_TCP, ALPROTO_DNS);
+    DNSConfigSetStore(DNS_STORE_QUERIES|DNS_STORE_ANSWERS);
 
     return output_ctx;
 }
@@ -361,6 +338,7 @@ static OutputCtx *JsonDnsLogInitCtx(ConfNode *conf)
 
     AppLayerParserRegisterLogger(IPPROTO_UDP, ALPROTO_DNS);
     AppLayerParserRegisterLogger(IPPROTO_TCP, ALPROTO_DNS);
+    DNSConfigSetStore(DNS_STORE_QUERIES|DNS_STORE_ANSWERS);
 
     return output_ctx;
 }
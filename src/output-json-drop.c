@@ -133,7 +133,7 @@ static int DropLogJSON (JsonDropLogThread *aft, const Packet *p)
             break;
     }
     json_object_set_new(js, "drop", djs);
-    OutputJSONBuffer(js, aft->file_ctx, buffer);
+    OutputJSONBuffer(js, aft->file_ctx, buffer, p->flow);
     json_object_del(js, "drop");
     json_object_clear(js);
     json_decref(js);
@@ -181,17 +181,20 @@ static void FileWriteJsonRecord(JsonFileLogThread *aft, const Packet *p, const F
     /* reset */
     MemBufferReset(buffer);
 
-    json_t *hjs = json_object();
-    if (unlikely(hjs == NULL)) {
-        json_decref(js);
-        return;
-    }
+    json_t *hjs = NULL;
+    if (p->flow->alproto == ALPROTO_HTTP) {
+        hjs = json_object();
+        if (unlikely(hjs == NULL)) {
+            json_decref(js);
+            return;
+        }
 
-    json_object_set_new(hjs, "url", LogFileMetaGetUri(p, ff));
-    json_object_set_new(hjs, "hostname", LogFileMetaGetHost(p, ff));
-    json_object_set_new(hjs, "http_refer", LogFileMetaGetReferer(p, ff));
-    json_object_set_new(hjs, "http_user_agent", LogFileMetaGetUserAgent(p, ff));
-    json_object_set_new(js, "http", hjs);
+        json_object_set_new(hjs, "url", LogFileMetaGetUri(p, ff));
+        json_object_set_new(hjs, "hostname", LogFileMetaGetHost(p, ff));
+        json_object_set_new(hjs, "http_refer", LogFileMetaGetReferer(p, ff));
+        json_object_set_new(hjs, "http_user_agent", LogFileMetaGetUserAgent(p, ff));
+        json_object_set_new(js, "http", hjs);
+    }
 
     json_t *fjs = json_object();
     if (unlikely(fjs == NULL)) {
@@ -241,7 +244,7 @@ static void FileWriteJsonRecord(JsonFileLogThread *aft, const Packet *p, const F
 
     /* originally just 'file', but due to bug 1127 naming it fileinfo */
     json_object_set_new(js, "fileinfo", fjs);
-    OutputJSONBuffer(js, aft->filelog_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, aft->filelog_ctx->file_ctx, buffer, p->flow);
     json_object_del(js, "fileinfo");
     json_object_del(js, "http");
 
@@ -178,28 +178,24 @@ struct {
     { "www_authenticate", "www-authenticate", 0 },
 };
 
-void JsonHttpLogJSONBasic(json_t *js, htp_tx_t *tx)
+/** \brief add a bstr as string, straight from the libhtp buffer */
+static void JsonHttpSetBstr(JsonBuilder *jb, const char *key, bstr *b)
 {
-    char *c;
+    JsonBuilderSetStringN(jb, key, bstr_ptr(b), bstr_len(b));
+}
 
+void JsonHttpLogJSONBasic(JsonBuilder *jb, htp_tx_t *tx)
+{
     /* hostname */
     if (tx->request_hostname != NULL)
     {
-        c = bstr_util_strdup_to_c(tx->request_hostname);
-        if (c != NULL) {
-            json_object_set_new(js, "hostname", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "hostname", tx->request_hostname);
     }
 
     /* uri */
     if (tx->request_uri != NULL)
     {
-        c = bstr_util_strdup_to_c(tx->request_uri);
-        if (c != NULL) {
-            json_object_set_new(js, "url", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "url", tx->request_uri);
     }
 
     /* user agent */
@@ -208,11 +204,7 @@ void JsonHttpLogJSONBasic(json_t *js, htp_tx_t *tx)
         h_user_agent = htp_table_get_c(tx->request_headers, "user-agent");
     }
     if (h_user_agent != NULL) {
-        c = bstr_util_strdup_to_c(h_user_agent->value);
-        if (c != NULL) {
-            json_object_set_new(js, "http_user_agent", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "http_user_agent", h_user_agent->value);
     }
 
     /* x-forwarded-for */
@@ -221,11 +213,7 @@ void JsonHttpLogJSONBasic(json_t *js, htp_tx_t *tx)
         h_x_forwarded_for = htp_table_get_c(tx->request_headers, "x-forwarded-for");
     }
     if (h_x_forwarded_for != NULL) {
-        c = bstr_util_strdup_to_c(h_x_forwarded_for->value);
-        if (c != NULL) {
-            json_object_set_new(js, "xff", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "xff", h_x_forwarded_for->value);
     }
 
     /* content-type */
@@ -234,21 +222,18 @@ void JsonHttpLogJSONBasic(json_t *js, htp_tx_t *tx)
         h_content_type = htp_table_get_c(tx->response_headers, "content-type");
     }
     if (h_content_type != NULL) {
-        char *p;
-        c = bstr_util_strdup_to_c(h_content_type->value);
-        if (c != NULL) {
-            p = strchr(c, ';');
-            if (p != NULL)
-                *p = '\0';
-            json_object_set_new(js, "http_content_type", json_string(c));
-            SCFree(c);
-        }
+        /* only the type, strip the parameters */
+        const uint8_t *c = bstr_ptr(h_content_type->value);
+        uint32_t c_len = bstr_len(h_content_type->value);
+        const uint8_t *p = memchr(c, ';', c_len);
+        if (p != NULL)
+            c_len = p - c;
+        JsonBuilderSetStringN(jb, "http_content_type", c, c_len);
     }
 }
 
-static void JsonHttpLogJSONCustom(LogHttpFileCtx *http_ctx, json_t *js, htp_tx_t *tx)
+static void JsonHttpLogJSONCustom(LogHttpFileCtx *http_ctx, JsonBuilder *jb, htp_tx_t *tx)
 {
-    char *c;
     HttpField f;
 
     for (f = HTTP_FIELD_ACCEPT; f < HTTP_FIELD_SIZE; f++)
@@ -275,96 +260,67 @@ static void JsonHttpLogJSONCustom(LogHttpFileCtx *http_ctx, json_t *js, htp_tx_t
                     }
                 }
                 if (h_field != NULL) {
-                    c = bstr_util_strdup_to_c(h_field->value);
-                    if (c != NULL) {
-                        json_object_set_new(js,
-                                http_fields[f].config_field,
-                                json_string(c));
-                        SCFree(c);
-                    }
+                    JsonHttpSetBstr(jb, http_fields[f].config_field,
+                            h_field->value);
                 }
             }
         }
     }
 }
 
-void JsonHttpLogJSONExtended(json_t *js, htp_tx_t *tx)
+void JsonHttpLogJSONExtended(JsonBuilder *jb, htp_tx_t *tx)
 {
-    char *c;
-
     /* referer */
     htp_header_t *h_referer = NULL;
     if (tx->request_headers != NULL) {
         h_referer = htp_table_get_c(tx->request_headers, "referer");
     }
     if (h_referer != NULL) {
-        c = bstr_util_strdup_to_c(h_referer->value);
-        if (c != NULL) {
-            json_object_set_new(js, "http_refer", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "http_refer", h_referer->value);
     }
 
     /* method */
     if (tx->request_method != NULL) {
-        c = bstr_util_strdup_to_c(tx->request_method);
-        if (c != NULL) {
-            json_object_set_new(js, "http_method", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "http_method", tx->request_method);
     }
 
     /* protocol */
     if (tx->request_protocol != NULL) {
-        c = bstr_util_strdup_to_c(tx->request_protocol);
-        if (c != NULL) {
-            json_object_set_new(js, "protocol", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "protocol", tx->request_protocol);
     }
 
     /* response status */
     if (tx->response_status != NULL) {
-        c = bstr_util_strdup_to_c(tx->response_status);
-        if (c != NULL) {
-            json_object_set_new(js, "status", json_string(c));
-            SCFree(c);
-        }
+        JsonHttpSetBstr(jb, "status", tx->response_status);
 
         htp_header_t *h_location = htp_table_get_c(tx->response_headers, "location");
         if (h_location != NULL) {
-            c = bstr_util_strdup_to_c(h_location->value);
-            if (c != NULL) {
-                json_object_set_new(js, "redirect", json_string(c));
-                SCFree(c);
-            }
+            JsonHttpSetBstr(jb, "redirect", h_location->value);
         }
     }
 
     /* length */
-    json_object_set_new(js, "length", json_integer(tx->response_message_len));
+    JsonBuilderSetInt(jb, "length", tx->response_message_len);
 }
 
 /* JSON format logging */
-static void JsonHttpLogJSON(JsonHttpLogThread *aft, json_t *js, htp_tx_t *tx, uint64_t tx_id)
+static void JsonHttpLogJSON(JsonHttpLogThread *aft, JsonBuilder *jb, htp_tx_t *tx, uint64_t tx_id)
 {
     LogHttpFileCtx *http_ctx = aft->httplog_ctx;
-    json_t *hjs = json_object();
-    if (hjs == NULL) {
-        return;
-    }
 
-    JsonHttpLogJSONBasic(hjs, tx);
+    JsonBuilderOpenObject(jb, "http");
+
+    JsonHttpLogJSONBasic(jb, tx);
     /* log custom fields if configured */
     if (http_ctx->fields != 0)
-        JsonHttpLogJSONCustom(http_ctx, hjs, tx);
+        JsonHttpLogJSONCustom(http_ctx, jb, tx);
     if (http_ctx->flags & LOG_HTTP_EXTENDED)
-        JsonHttpLogJSONExtended(hjs, tx);
+        JsonHttpLogJSONExtended(jb, tx);
 
     /* tx id for correlation with alerts */
-    json_object_set_new(hjs, "tx_id", json_integer(tx_id));
+    JsonBuilderSetInt(jb, "tx_id", tx_id);
 
-    json_object_set_new(js, "http", hjs);
+    JsonBuilderCloseObject(jb);
 }
 
 static int JsonHttpLogger(ThreadVars *tv, void *thread_data, const Packet *p, Flow *f, void *alstate, void *txptr, uint64_t tx_id)
@@ -373,24 +329,17 @@ static int JsonHttpLogger(ThreadVars *tv, void *thread_data, const Packet *p, Fl
 
     htp_tx_t *tx = txptr;
     JsonHttpLogThread *jhl = (JsonHttpLogThread *)thread_data;
-    MemBuffer *buffer = (MemBuffer *)jhl->buffer;
-
-    json_t *js = CreateJSONHeader((Packet *)p, 1, "http"); //TODO const
-    if (unlikely(js == NULL))
-        return TM_ECODE_OK;
+    JsonBuilder jb;
 
     SCLogDebug("got a HTTP request and now logging !!");
 
-    /* reset */
-    MemBufferReset(buffer);
-
-    JsonHttpLogJSON(jhl, js, tx, tx_id);
+    JsonBuilderInit(&jb, jhl->buffer);
+    OutputJsonBuilderHeader(&jb, p, 1, "http");
 
-    OutputJSONBuffer(js, jhl->httplog_ctx->file_ctx, buffer);
-    json_object_del(js, "http");
+    JsonHttpLogJSON(jhl, &jb, tx, tx_id);
 
-    json_object_clear(js);
-    json_decref(js);
+    JsonBuilderCloseObject(&jb);
+    OutputJSONBuilderBuffer(&jb, jhl->httplog_ctx->file_ctx, f);
 
     SCReturnInt(TM_ECODE_OK);
 }
@@ -27,8 +27,10 @@
 void TmModuleJsonHttpLogRegister (void);
 
 #ifdef HAVE_LIBJANSSON
-void JsonHttpLogJSONBasic(json_t *js, htp_tx_t *tx);
-void JsonHttpLogJSONExtended(json_t *js, htp_tx_t *tx);
+#include "util-json-builder.h"
+
+void JsonHttpLogJSONBasic(JsonBuilder *jb, htp_tx_t *tx);
+void JsonHttpLogJSONExtended(JsonBuilder *jb, htp_tx_t *tx);
 #endif /* HAVE_LIBJANSSON */
 
 #endif /* __OUTPUT_JSON_HTTP_H__ */
@@ -124,7 +124,7 @@ static int JsonSshLogger(ThreadVars *tv, void *thread_data, const Packet *p)
 
     json_object_set_new(js, "ssh", tjs);
 
-    OutputJSONBuffer(js, ssh_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, ssh_ctx->file_ctx, buffer, p->flow);
     json_object_clear(js);
     json_decref(js);
 
@@ -57,7 +57,12 @@
 #include "util-optimize.h"
 #include "util-buffer.h"
 #include "util-logopenfile.h"
+#include "util-logopenfile-async.h"
+#include "util-logopenfile-shard.h"
+#include "util-json-builder.h"
+#include "util-time.h"
 #include "util-device.h"
+#include "unix-manager.h"
 
 
 #ifndef HAVE_LIBJANSSON
@@ -185,60 +190,72 @@ void CreateJSONFlowId(json_t *js, const Flow *f)
     json_object_set_new(js, "flow_id", json_integer(addr));
 }
 
-json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
-{
-    char timebuf[64];
-    char srcip[46], dstip[46];
-    Port sp, dp;
-
-    json_t *js = json_object();
-    if (unlikely(js == NULL))
-        return NULL;
-
-    CreateIsoTimeString(&p->ts, timebuf, sizeof(timebuf));
+/** addresses, ports and protocol name of a record header */
+typedef struct JsonTuple_ {
+    char srcip[46];
+    char dstip[46];
+    Port sp;
+    Port dp;
+    char proto[16];
+} JsonTuple;
 
-    srcip[0] = '\0';
-    dstip[0] = '\0';
+static void JsonPacketTuple(const Packet *p, int direction_sensitive, JsonTuple *t)
+{
+    t->srcip[0] = '\0';
+    t->dstip[0] = '\0';
     if (direction_sensitive) {
         if ((PKT_IS_TOSERVER(p))) {
             if (PKT_IS_IPV4(p)) {
-                PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), srcip, sizeof(srcip));
-                PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), dstip, sizeof(dstip));
+                PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), t->srcip, sizeof(t->srcip));
+                PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), t->dstip, sizeof(t->dstip));
             } else if (PKT_IS_IPV6(p)) {
-                PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), srcip, sizeof(srcip));
-                PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), dstip, sizeof(dstip));
+                PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), t->srcip, sizeof(t->srcip));
+                PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), t->dstip, sizeof(t->dstip));
             }
-            sp = p->sp;
-            dp = p->dp;
+            t->sp = p->sp;
+            t->dp = p->dp;
         } else {
             if (PKT_IS_IPV4(p)) {
-                PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), srcip, sizeof(srcip));
-                PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), dstip, sizeof(dstip));
+                PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), t->srcip, sizeof(t->srcip));
+                PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), t->dstip, sizeof(t->dstip));
             } else if (PKT_IS_IPV6(p)) {
-                PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), srcip, sizeof(srcip));
-                PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), dstip, sizeof(dstip));
+                PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), t->srcip, sizeof(t->srcip));
+                PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), t->dstip, sizeof(t->dstip));
             }
-            sp = p->dp;
-            dp = p->sp;
+            t->sp = p->dp;
+            t->dp = p->sp;
         }
     } else {
         if (PKT_IS_IPV4(p)) {
-            PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), srcip, sizeof(srcip));
-            PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), dstip, sizeof(dstip));
+            PrintInet(AF_INET, (const void *)GET_IPV4_SRC_ADDR_PTR(p), t->srcip, sizeof(t->srcip));
+            PrintInet(AF_INET, (const void *)GET_IPV4_DST_ADDR_PTR(p), t->dstip, sizeof(t->dstip));
         } else if (PKT_IS_IPV6(p)) {
-            PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), srcip, sizeof(srcip));
-            PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), dstip, sizeof(dstip));
+            PrintInet(AF_INET6, (const void *)GET_IPV6_SRC_ADDR(p), t->srcip, sizeof(t->srcip));
+            PrintInet(AF_INET6, (const void *)GET_IPV6_DST_ADDR(p), t->dstip, sizeof(t->dstip));
         }
-        sp = p->sp;
-        dp = p->dp;
+        t->sp = p->sp;
+        t->dp = p->dp;
     }
 
-    char proto[16];
     if (SCProtoNameValid(IP_GET_IPPROTO(p)) == TRUE) {
-        strlcpy(proto, known_proto[IP_GET_IPPROTO(p)], sizeof(proto));
+        strlcpy(t->proto, known_proto[IP_GET_IPPROTO(p)], sizeof(t->proto));
     } else {
-        snprintf(proto, sizeof(proto), "%03" PRIu32, IP_GET_IPPROTO(p));
+        snprintf(t->proto, sizeof(t->proto), "%03" PRIu32, IP_GET_IPPROTO(p));
     }
+}
+
+json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
+{
+    char timebuf[64];
+    JsonTuple t;
+
+    json_t *js = json_object();
+    if (unlikely(js == NULL))
+        return NULL;
+
+    CreateIsoTimeString(&p->ts, timebuf, sizeof(timebuf));
+
+    JsonPacketTuple(p, direction_sensitive, &t);
 
     /* time & tx */
     json_object_set_new(js, "timestamp", json_string(timebuf));
@@ -288,27 +305,27 @@ json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
     }
 
     /* tuple */
-    json_object_set_new(js, "src_ip", json_string(srcip));
+    json_object_set_new(js, "src_ip", json_string(t.srcip));
     switch(p->proto) {
         case IPPROTO_ICMP:
             break;
         case IPPROTO_UDP:
         case IPPROTO_TCP:
         case IPPROTO_SCTP:
-            json_object_set_new(js, "src_port", json_integer(sp));
+            json_object_set_new(js, "src_port", json_integer(t.sp));
             break;
     }
-    json_object_set_new(js, "dest_ip", json_string(dstip));
+    json_object_set_new(js, "dest_ip", json_string(t.dstip));
     switch(p->proto) {
         case IPPROTO_ICMP:
             break;
         case IPPROTO_UDP:
         case IPPROTO_TCP:
         case IPPROTO_SCTP:
-            json_object_set_new(js, "dest_port", json_integer(dp));
+            json_object_set_new(js, "dest_port", json_integer(t.dp));
             break;
     }
-    json_object_set_new(js, "proto", json_string(proto));
+    json_object_set_new(js, "proto", json_string(t.proto));
     switch (p->proto) {
         case IPPROTO_ICMP:
             if (p->icmpv4h) {
@@ -331,7 +348,270 @@ json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
     return js;
 }
 
-int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer)
+/** \brief JsonBuilder version of JsonTcpFlags() */
+void OutputJsonBuilderTcpFlags(JsonBuilder *jb, uint8_t flags)
+{
+    if (flags & TH_SYN)
+        JsonBuilderSetBool(jb, "syn", 1);
+    if (flags & TH_FIN)
+        JsonBuilderSetBool(jb, "fin", 1);
+    if (flags & TH_RST)
+        JsonBuilderSetBool(jb, "rst", 1);
+    if (flags & TH_PUSH)
+        JsonBuilderSetBool(jb, "psh", 1);
+    if (flags & TH_ACK)
+        JsonBuilderSetBool(jb, "ack", 1);
+    if (flags & TH_URG)
+        JsonBuilderSetBool(jb, "urg", 1);
+    if (flags & TH_ECN)
+        JsonBuilderSetBool(jb, "ecn", 1);
+    if (flags & TH_CWR)
+        JsonBuilderSetBool(jb, "cwr", 1);
+}
+
+static void OutputJsonBuilderFlowId(JsonBuilder *jb, const Flow *f)
+{
+    if (f == NULL)
+        return;
+#if __WORDSIZE == 64
+    uint64_t addr = (uint64_t)f;
+#else
+    uint32_t addr = (uint32_t)f;
+#endif
+    JsonBuilderSetInt(jb, "flow_id", (int64_t)addr);
+}
+
+/**
+ *  \brief JsonBuilder version of CreateJSONHeader()
+ *
+ *  Starts a new record in the builder: opens the top level object and
+ *  adds the common header fields. The object is left open for the
+ *  logger to add its own fields.
+ */
+void OutputJsonBuilderHeader(JsonBuilder *jb, const Packet *p,
+        int direction_sensitive, const char *event_type)
+{
+    char timebuf[64];
+    JsonTuple t;
+
+    CreateIsoTimeString(&p->ts, timebuf, sizeof(timebuf));
+
+    JsonPacketTuple(p, direction_sensitive, &t);
+
+    JsonBuilderOpenObject(jb, NULL);
+
+    /* time & tx */
+    JsonBuilderSetString(jb, "timestamp", timebuf);
+
+    OutputJsonBuilderFlowId(jb, (const Flow *)p->flow);
+
+    /* sensor id */
+    if (sensor_id >= 0)
+        JsonBuilderSetInt(jb, "sensor_id", sensor_id);
+
+    /* input interface */
+    if (p->livedev) {
+        JsonBuilderSetString(jb, "in_iface", p->livedev->dev);
+    }
+
+    /* pcap_cnt */
+    if (p->pcap_cnt != 0) {
+        JsonBuilderSetInt(jb, "pcap_cnt", p->pcap_cnt);
+    }
+
+    JsonBuilderSetString(jb, "event_type", event_type);
+
+    /* vlan */
+    switch (p->vlan_idx) {
+        case 1:
+            JsonBuilderSetInt(jb, "vlan", VLAN_GET_ID1(p));
+            break;
+        case 2:
+            JsonBuilderOpenArray(jb, "vlan");
+            JsonBuilderSetInt(jb, NULL, VLAN_GET_ID1(p));
+            JsonBuilderSetInt(jb, NULL, VLAN_GET_ID2(p));
+            JsonBuilderCloseArray(jb);
+            break;
+        default:
+            break;
+    }
+
+    /* tuple */
+    JsonBuilderSetString(jb, "src_ip", t.srcip);
+    switch(p->proto) {
+        case IPPROTO_UDP:
+        case IPPROTO_TCP:
+        case IPPROTO_SCTP:
+            JsonBuilderSetInt(jb, "src_port", t.sp);
+            break;
+    }
+    JsonBuilderSetString(jb, "dest_ip", t.dstip);
+    switch(p->proto) {
+        case IPPROTO_UDP:
+        case IPPROTO_TCP:
+        case IPPROTO_SCTP:
+            JsonBuilderSetInt(jb, "dest_port", t.dp);
+            break;
+    }
+    JsonBuilderSetString(jb, "proto", t.proto);
+    switch (p->proto) {
+        case IPPROTO_ICMP:
+            if (p->icmpv4h) {
+                JsonBuilderSetInt(jb, "icmp_type", p->icmpv4h->type);
+                JsonBuilderSetInt(jb, "icmp_code", p->icmpv4h->code);
+            }
+            break;
+        case IPPROTO_ICMPV6:
+            if (p->icmpv6h) {
+                JsonBuilderSetInt(jb, "icmp_type", p->icmpv6h->type);
+                JsonBuilderSetInt(jb, "icmp_code", p->icmpv6h->code);
+            }
+            break;
+    }
+}
+
+/**
+ *  \brief Start a new record for a flow
+ *
+ *  Like OutputJsonBuilderHeader(), but based on the flow and with the
+ *  current time as timestamp.
+ *
+ *  \param dir 0 to log the flow as is, 1 to swap source and destination
+ */
+void OutputJsonBuilderFlowHeader(JsonBuilder *jb, const Flow *f,
+        const char *event_type, int dir)
+{
+    char timebuf[64];
+    char srcip[46], dstip[46];
+    Port sp, dp;
+
+    struct timeval tv;
+    memset(&tv, 0x00, sizeof(tv));
+    TimeGet(&tv);
+
+    CreateIsoTimeString(&tv, timebuf, sizeof(timebuf));
+
+    const void *src = NULL, *dst = NULL;
+    int af = 0;
+    if (FLOW_IS_IPV4(f)) {
+        af = AF_INET;
+        src = (const void *)&(f->src.addr_data32[0]);
+        dst = (const void *)&(f->dst.addr_data32[0]);
+    } else if (FLOW_IS_IPV6(f)) {
+        af = AF_INET6;
+        src = (const void *)&(f->src.address);
+        dst = (const void *)&(f->dst.address);
+    }
+
+    srcip[0] = '\0';
+    dstip[0] = '\0';
+    if (af != 0) {
+        PrintInet(af, dir == 0 ? src : dst, srcip, sizeof(srcip));
+        PrintInet(af, dir == 0 ? dst : src, dstip, sizeof(dstip));
+    }
+
+    if (dir == 0) {
+        sp = f->sp;
+        dp = f->dp;
+    } else {
+        sp = f->dp;
+        dp = f->sp;
+    }
+
+    char proto[16];
+    if (SCProtoNameValid(f->proto) == TRUE) {
+        strlcpy(proto, known_proto[f->proto], sizeof(proto));
+    } else {
+        snprintf(proto, sizeof(proto), "%03" PRIu32, f->proto);
+    }
+
+    JsonBuilderOpenObject(jb, NULL);
+
+    /* time */
+    JsonBuilderSetString(jb, "timestamp", timebuf);
+
+    OutputJsonBuilderFlowId(jb, f);
+
+    JsonBuilderSetString(jb, "event_type", event_type);
+
+    /* tuple */
+    JsonBuilderSetString(jb, "src_ip", srcip);
+    switch(f->proto) {
+        case IPPROTO_UDP:
+        case IPPROTO_TCP:
+        case IPPROTO_SCTP:
+            JsonBuilderSetInt(jb, "src_port", sp);
+            break;
+    }
+    JsonBuilderSetString(jb, "dest_ip", dstip);
+    switch(f->proto) {
+        case IPPROTO_UDP:
+        case IPPROTO_TCP:
+        case IPPROTO_SCTP:
+            JsonBuilderSetInt(jb, "dest_port", dp);
+            break;
+    }
+    JsonBuilderSetString(jb, "proto", proto);
+    switch (f->proto) {
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            JsonBuilderSetInt(jb, "icmp_type", f->type);
+            JsonBuilderSetInt(jb, "icmp_code", f->code);
+            break;
+    }
+}
+
+/**
+ *  \brief Write out a record built with a JsonBuilder
+ *
+ *  The top level object needs to be closed already. Records that didn't
+ *  fit in the buffer are dropped.
+ */
+int OutputJSONBuilderBuffer(JsonBuilder *jb, LogFileCtx *file_ctx, const Flow *f)
+{
+    if (unlikely(jb->error || jb->depth != 0)) {
+        SCLogDebug("incomplete JSON record, not logging it");
+        return -1;
+    }
+
+    MemBuffer *buffer = jb->buffer;
+
+    UnixManagerStreamPublish(UNIX_STREAM_EVENTS,
+            (const char *)MEMBUFFER_BUFFER(buffer), MEMBUFFER_OFFSET(buffer));
+
+    if (json_out == ALERT_SYSLOG) {
+        SCMutexLock(&file_ctx->fp_mutex);
+        syslog(alert_syslog_level, "%s", (const char *)MEMBUFFER_BUFFER(buffer));
+        SCMutexUnlock(&file_ctx->fp_mutex);
+        return 0;
+    }
+    if (json_out != ALERT_FILE)
+        return 0;
+
+    JsonBuilderAppendRaw(jb, "\n", 1);
+    if (unlikely(jb->error))
+        return -1;
+
+    if (file_ctx->shard != NULL) {
+        file_ctx = LogFileShardGet(file_ctx, LogFileShardHashPtr(f));
+        if (unlikely(file_ctx == NULL))
+            return -1;
+    }
+
+    if (file_ctx->async != NULL) {
+        file_ctx->Write((const char *)MEMBUFFER_BUFFER(buffer),
+            MEMBUFFER_OFFSET(buffer), file_ctx);
+        return 0;
+    }
+
+    SCMutexLock(&file_ctx->fp_mutex);
+    file_ctx->Write((const char *)MEMBUFFER_BUFFER(buffer),
+        MEMBUFFER_OFFSET(buffer), file_ctx);
+    SCMutexUnlock(&file_ctx->fp_mutex);
+    return 0;
+}
+
+int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer, const Flow *f)
 {
     char *js_s = json_dumps(js,
                             JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_ENSURE_ASCII|
@@ -344,6 +624,26 @@ int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer)
     if (unlikely(js_s == NULL))
         return TM_ECODE_OK;
 
+    UnixManagerStreamPublish(UNIX_STREAM_EVENTS, js_s, strlen(js_s));
+
+    if (file_ctx->shard != NULL && json_out == ALERT_FILE) {
+        file_ctx = LogFileShardGet(file_ctx, LogFileShardHashPtr(f));
+        if (unlikely(file_ctx == NULL)) {
+            free(js_s);
+            return 0;
+        }
+    }
+
+    /* async files queue the record in a per thread buffer, no need
+     * to serialize the threads here */
+    if (file_ctx->async != NULL && json_out == ALERT_FILE) {
+        MemBufferWriteString(buffer, "%s\n", js_s);
+        file_ctx->Write((const char *)MEMBUFFER_BUFFER(buffer),
+            MEMBUFFER_OFFSET(buffer), file_ctx);
+        free(js_s);
+        return 0;
+    }
+
     SCMutexLock(&file_ctx->fp_mutex);
     if (json_out == ALERT_SYSLOG) {
         syslog(alert_syslog_level, "%s", js_s);
@@ -467,6 +767,14 @@ OutputCtx *OutputJsonInitCtx(ConfNode *conf)
             }
             OutputRegisterFileRotationFlag(&json_ctx->file_ctx->rotation_flag);
 
+            /* with shards the async buffers are set up per shard */
+            int r = LogFileShardSetup(conf, json_ctx->file_ctx);
+            if (r == 0)
+                r = LogFileAsyncSetup(conf, json_ctx->file_ctx);
+            if (r < 0) {
+                exit(EXIT_FAILURE);
+            }
+
             const char *format_s = ConfNodeLookupChildValue(conf, "format");
             if (format_s != NULL) {
                 if (strcmp(format_s, "indent") == 0) {
@@ -31,12 +31,20 @@ void TmModuleOutputJsonRegister (void);
 #include "suricata-common.h"
 #include "util-buffer.h"
 #include "util-logopenfile.h"
+#include "util-json-builder.h"
 
 void CreateJSONFlowId(json_t *js, const Flow *f);
 void JsonTcpFlags(uint8_t flags, json_t *js);
 json_t *CreateJSONHeader(Packet *p, int direction_sensative, char *event_type);
 TmEcode OutputJSON(json_t *js, void *data, uint64_t *count);
-int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer);
+int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer, const Flow *f);
+
+void OutputJsonBuilderTcpFlags(JsonBuilder *jb, uint8_t flags);
+void OutputJsonBuilderHeader(JsonBuilder *jb, const Packet *p,
+        int direction_sensitive, const char *event_type);
+void OutputJsonBuilderFlowHeader(JsonBuilder *jb, const Flow *f,
+        const char *event_type, int dir);
+int OutputJSONBuilderBuffer(JsonBuilder *jb, LogFileCtx *file_ctx, const Flow *f);
 OutputCtx *OutputJsonInitCtx(ConfNode *);
 
 enum JsonOutput { ALERT_FILE,
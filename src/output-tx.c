@@ -21,15 +21,40 @@
  * \author Victor Julien <victor@inliniac.net>
  *
  * AppLayer TX Logger Output registration functions
+ *
+ * By default the transactions are logged from the packet threads. With
+ * "tx-logging.threads" set, the packet threads only hand flows with
+ * completed transactions over to a pool of "TxLogThread" management
+ * threads. The flow is referenced while it's queued, so it's not timed
+ * out, and the log id isn't moved until the transactions are logged, so
+ * the app layer doesn't free them. A flow is queued at most once at a
+ * time and always to the same log thread.
  */
 
 #include "suricata-common.h"
 #include "tm-modules.h"
+#include "tm-threads.h"
 #include "output-tx.h"
 #include "app-layer.h"
 #include "app-layer-parser.h"
+#include "conf.h"
+#include "counters.h"
+#include "flow.h"
+#include "host.h"
+#include "pkt-var.h"
+#include "util-atomic.h"
+#include "util-signal.h"
+#include "util-unittest.h"
 #include "util-profiling.h"
 
+/** default number of queued flows per tx log thread */
+#define OUTPUT_TX_LOG_DEFAULT_QUEUE_SIZE    4096
+/** max flows a tx log thread takes from its queue at once */
+#define OUTPUT_TX_LOG_BATCH                 64
+/** wait time in msec for the tx log threads and for packet threads
+ *  blocked on a full queue */
+#define OUTPUT_TX_LOG_WAIT                  10
+
 typedef struct OutputLoggerThreadStore_ {
     void *thread_data;
     struct OutputLoggerThreadStore_ *next;
@@ -55,6 +80,38 @@ typedef struct OutputTxLogger_ {
 
 static OutputTxLogger *list = NULL;
 
+/** a flow with completed transactions, queued by a packet thread. The
+ *  packet fields are copied so the loggers get a similar packet. */
+typedef struct OutputTxLogJob_ {
+    Flow *f;    /**< referenced while queued */
+    struct timeval ts;
+    uint64_t pcap_cnt;
+    struct LiveDevice_ *livedev;
+    uint16_t vlan_id[2];
+    uint8_t vlan_idx;
+    uint8_t flowflags;
+} OutputTxLogJob;
+
+/** queue of a tx log thread */
+typedef struct OutputTxLogQueue_ {
+    SCCtrlMutex m;
+    SCCtrlCondT cond;       /**< signalled when a job is added */
+    SCCtrlCondT space_cond; /**< signalled when jobs are taken */
+    OutputTxLogJob *jobs;
+    uint32_t size;
+    uint32_t head;          /**< next job to take */
+    uint32_t len;
+} OutputTxLogQueue;
+
+/** number of tx log threads, 0 if the packet threads log */
+static uint32_t tx_log_threads = 0;
+static uint32_t tx_log_queue_size = OUTPUT_TX_LOG_DEFAULT_QUEUE_SIZE;
+static OutputTxLogQueue *tx_log_queues = NULL;
+
+SC_ATOMIC_DECLARE(uint32_t, tx_log_thread_cnt);
+
+static void OutputTxLogRegisterTests(void);
+
 int OutputRegisterTxLogger(const char *name, AppProto alproto, TxLogger LogFunc, OutputCtx *output_ctx)
 {
     int module_id = TmModuleGetIdByName(name);
@@ -85,12 +142,17 @@ int OutputRegisterTxLogger(const char *name, AppProto alproto, TxLogger LogFunc,
     return 0;
 }
 
-static TmEcode OutputTxLog(ThreadVars *tv, Packet *p, void *thread_data, PacketQueue *pq, PacketQueue *postpq)
+/** \internal
+ *  \brief log the completed transactions of a flow
+ *
+ *  \param f *WRITE LOCKED* flow
+ *  \param p packet to pass to the loggers. A pseudo packet when called
+ *           from a tx log thread.
+ *  \param alstate app layer state of the flow
+ */
+static void OutputTxLogFlow(ThreadVars *tv, OutputLoggerThreadData *op_thread_data,
+        Packet *p, Flow *f, AppProto alproto, void *alstate)
 {
-    BUG_ON(thread_data == NULL);
-    BUG_ON(list == NULL);
-
-    OutputLoggerThreadData *op_thread_data = (OutputLoggerThreadData *)thread_data;
     OutputTxLogger *logger = list;
     OutputLoggerThreadStore *store = op_thread_data->store;
 
@@ -98,25 +160,6 @@ static TmEcode OutputTxLog(ThreadVars *tv, Packet *p, void *thread_data, PacketQ
     BUG_ON(logger != NULL && store == NULL);
     BUG_ON(logger == NULL && store == NULL);
 
-    if (p->flow == NULL)
-        return TM_ECODE_OK;
-
-    Flow * const f = p->flow;
-
-    FLOWLOCK_WRLOCK(f); /* WRITE lock before we updated flow logged id */
-    AppProto alproto = f->alproto;//AppLayerGetProtoFromPacket(p);
-
-    if (AppLayerParserProtocolIsTxAware(p->proto, alproto) == 0)
-        goto end;
-    if (AppLayerParserProtocolHasLogger(p->proto, alproto) == 0)
-        goto end;
-
-    void *alstate = f->alstate;//AppLayerGetProtoStateFromPacket((const Packet *)p);
-    if (alstate == NULL) {
-        SCLogDebug("no alstate");
-        goto end;
-    }
-
     uint64_t total_txs = AppLayerParserGetTxCnt(p->proto, alproto, alstate);
     uint64_t tx_id = AppLayerParserGetTransactionLogId(f->alparser);
     int tx_progress_done_value_ts =
@@ -175,6 +218,154 @@ static TmEcode OutputTxLog(ThreadVars *tv, Packet *p, void *thread_data, PacketQ
             AppLayerParserSetTransactionLogId(f->alparser);
         }
     }
+}
+
+/** \internal
+ *  \brief check if the next transaction to log is complete
+ *
+ *  \param f *LOCKED* flow
+ */
+static int OutputTxLogHasCompletedTx(uint8_t ipproto, Flow *f, AppProto alproto,
+        void *alstate)
+{
+    uint64_t total_txs = AppLayerParserGetTxCnt(ipproto, alproto, alstate);
+    uint64_t tx_id = AppLayerParserGetTransactionLogId(f->alparser);
+
+    for (; tx_id < total_txs; tx_id++) {
+        void *tx = AppLayerParserGetTx(ipproto, alproto, alstate, tx_id);
+        if (tx == NULL)
+            continue;
+
+        if (AppLayerParserStateIssetFlag(f->alparser, APP_LAYER_PARSER_EOF))
+            return 1;
+
+        if (AppLayerParserGetStateProgress(ipproto, alproto, tx, 0) <
+                AppLayerParserGetStateProgressCompletionStatus(ipproto, alproto, 0))
+            return 0;
+        if (AppLayerParserGetStateProgress(ipproto, alproto, tx, 1) <
+                AppLayerParserGetStateProgressCompletionStatus(ipproto, alproto, 1))
+            return 0;
+        return 1;
+    }
+    return 0;
+}
+
+static inline OutputTxLogQueue *OutputTxLogQueueGet(const Flow *f)
+{
+    /* keep a flow on one thread, so its transactions are logged in
+     * order without the threads competing for the flow lock */
+    uintptr_t h = (uintptr_t)f;
+    return &tx_log_queues[(h >> 6) % tx_log_threads];
+}
+
+static void OutputTxLogWait(SCCtrlCondT *cond, SCCtrlMutex *m)
+{
+    struct timeval tv;
+    struct timespec cond_time;
+
+    gettimeofday(&tv, NULL);
+    uint64_t nsec = (uint64_t)tv.tv_usec * 1000 +
+        (uint64_t)OUTPUT_TX_LOG_WAIT * 1000000;
+    cond_time.tv_sec = tv.tv_sec + (nsec / 1000000000);
+    cond_time.tv_nsec = nsec % 1000000000;
+
+    SCCtrlCondTimedwait(cond, m, &cond_time);
+}
+
+/** \internal
+ *  \brief queue a flow for a tx log thread
+ *
+ *  Blocks while the queue is full. That can't deadlock on the flow
+ *  lock: the log threads only lock flows that are queued already.
+ *
+ *  \param f *WRITE LOCKED* flow, not queued yet
+ */
+static void OutputTxLogEnqueue(OutputTxLogQueue *q, const Packet *p, Flow *f)
+{
+    OutputTxLogJob job;
+    memset(&job, 0x00, sizeof(job));
+
+    FlowReference(&job.f, f);
+    job.ts = p->ts;
+    job.pcap_cnt = p->pcap_cnt;
+    job.livedev = p->livedev;
+    job.vlan_id[0] = p->vlan_id[0];
+    job.vlan_id[1] = p->vlan_id[1];
+    job.vlan_idx = p->vlan_idx;
+    job.flowflags = p->flowflags;
+
+    f->flags |= FLOW_TX_LOG_QUEUED;
+
+    SCCtrlMutexLock(&q->m);
+    while (q->len == q->size) {
+        OutputTxLogWait(&q->space_cond, &q->m);
+    }
+    q->jobs[(q->head + q->len) % q->size] = job;
+    q->len++;
+    SCCtrlCondSignal(&q->cond);
+    SCCtrlMutexUnlock(&q->m);
+}
+
+/** \internal
+ *  \brief take up to max jobs from the queue, in order
+ *
+ *  \retval cnt number of jobs taken
+ */
+static uint32_t OutputTxLogDequeue(OutputTxLogQueue *q, OutputTxLogJob *jobs,
+        uint32_t max)
+{
+    uint32_t cnt = 0;
+
+    SCCtrlMutexLock(&q->m);
+    while (cnt < max && q->len > 0) {
+        jobs[cnt++] = q->jobs[q->head];
+        q->head = (q->head + 1) % q->size;
+        q->len--;
+    }
+    if (cnt > 0)
+        SCCtrlCondSignal(&q->space_cond);
+    SCCtrlMutexUnlock(&q->m);
+
+    return cnt;
+}
+
+static TmEcode OutputTxLog(ThreadVars *tv, Packet *p, void *thread_data, PacketQueue *pq, PacketQueue *postpq)
+{
+    BUG_ON(thread_data == NULL);
+    BUG_ON(list == NULL);
+
+    OutputLoggerThreadData *op_thread_data = (OutputLoggerThreadData *)thread_data;
+
+    if (p->flow == NULL)
+        return TM_ECODE_OK;
+
+    Flow * const f = p->flow;
+
+    FLOWLOCK_WRLOCK(f); /* WRITE lock before we updated flow logged id */
+    AppProto alproto = f->alproto;//AppLayerGetProtoFromPacket(p);
+
+    if (AppLayerParserProtocolIsTxAware(p->proto, alproto) == 0)
+        goto end;
+    if (AppLayerParserProtocolHasLogger(p->proto, alproto) == 0)
+        goto end;
+
+    void *alstate = f->alstate;//AppLayerGetProtoStateFromPacket((const Packet *)p);
+    if (alstate == NULL) {
+        SCLogDebug("no alstate");
+        goto end;
+    }
+
+    if (tx_log_threads > 0) {
+        /* the log thread logs everything completed by the time it gets
+         * to the flow, so one queued job per flow is enough */
+        if (!(f->flags & FLOW_TX_LOG_QUEUED) &&
+                OutputTxLogHasCompletedTx(p->proto, f, alproto, alstate)) {
+            OutputTxLogEnqueue(OutputTxLogQueueGet(f), p, f);
+        }
+        goto end;
+    }
+
+    OutputTxLogFlow(tv, op_thread_data, p, f, alproto, alstate);
 
 end:
     FLOWLOCK_UNLOCK(f);
@@ -184,7 +375,7 @@ end:
 /** \brief thread init for the tx logger
  *  This will run the thread init functions for the individual registered
  *  loggers */
-static TmEcode OutputTxLogThreadInit(ThreadVars *tv, void *initdata, void **data)
+static TmEcode OutputTxLogThreadInitLoggers(ThreadVars *tv, void **data)
 {
     OutputLoggerThreadData *td = SCMalloc(sizeof(*td));
     if (td == NULL)
@@ -233,6 +424,20 @@ static TmEcode OutputTxLogThreadInit(ThreadVars *tv, void *initdata, void **data
     return TM_ECODE_OK;
 }
 
+static TmEcode OutputTxLogThreadInit(ThreadVars *tv, void *initdata, void **data)
+{
+    /* with tx log threads the packet threads only queue the flows */
+    if (tx_log_threads > 0) {
+        OutputLoggerThreadData *td = SCCalloc(1, sizeof(*td));
+        if (td == NULL)
+            return TM_ECODE_FAILED;
+        *data = (void *)td;
+        return TM_ECODE_OK;
+    }
+
+    return OutputTxLogThreadInitLoggers(tv, data);
+}
+
 static TmEcode OutputTxLogThreadDeinit(ThreadVars *tv, void *thread_data)
 {
     OutputLoggerThreadData *op_thread_data = (OutputLoggerThreadData *)thread_data;
@@ -282,6 +487,315 @@ static void OutputTxLogExitPrintStats(ThreadVars *tv, void *thread_data)
     }
 }
 
+/** thread data of a tx log thread */
+typedef struct TxLogThreadData_ {
+    OutputTxLogQueue *q;
+    /** OutputLoggerThreadData of the loggers */
+    void *logger_data;
+    /** pseudo packet handed to the loggers */
+    Packet *p;
+
+    uint16_t counter_queue_depth;
+    uint16_t counter_flows;
+} TxLogThreadData;
+
+/** \internal
+ *  \brief setup the pseudo packet for a queued flow
+ *
+ *  The tuple and the ip and tcp/udp headers are taken from the flow, in
+ *  the direction of the packet that queued it. The rest is copied from
+ *  that packet.
+ */
+static void OutputTxLogPacketSetup(Packet *p, const OutputTxLogJob *job)
+{
+    Flow *f = job->f;
+    int toserver = !(job->flowflags & FLOW_PKT_TOCLIENT);
+    const FlowAddress *src = toserver ? &f->src : &f->dst;
+    const FlowAddress *dst = toserver ? &f->dst : &f->src;
+    uint32_t hlen = 0;
+
+    FlowReference(&p->flow, f);
+    p->flags |= PKT_HAS_FLOW;
+    p->flowflags = job->flowflags;
+    p->datalink = DLT_RAW;
+    p->proto = f->proto;
+    p->ts = job->ts;
+    p->pcap_cnt = job->pcap_cnt;
+    p->livedev = job->livedev;
+    p->vlan_id[0] = job->vlan_id[0];
+    p->vlan_id[1] = job->vlan_id[1];
+    p->vlan_idx = job->vlan_idx;
+    p->sp = toserver ? f->sp : f->dp;
+    p->dp = toserver ? f->dp : f->sp;
+
+    if (FLOW_IS_IPV4(f)) {
+        FLOW_COPY_IPV4_ADDR_TO_PACKET(src, &p->src);
+        FLOW_COPY_IPV4_ADDR_TO_PACKET(dst, &p->dst);
+
+        p->ip4h = (IPV4Hdr *)GET_PKT_DATA(p);
+        memset(p->ip4h, 0x00, 20);
+        p->ip4h->ip_verhl = 0x45;
+        p->ip4h->ip_ttl = 64;
+        p->ip4h->ip_proto = f->proto;
+        p->ip4h->s_ip_src.s_addr = src->addr_data32[0];
+        p->ip4h->s_ip_dst.s_addr = dst->addr_data32[0];
+        hlen = 20;
+    } else if (FLOW_IS_IPV6(f)) {
+        FLOW_COPY_IPV6_ADDR_TO_PACKET(src, &p->src);
+        FLOW_COPY_IPV6_ADDR_TO_PACKET(dst, &p->dst);
+
+        p->ip6h = (IPV6Hdr *)GET_PKT_DATA(p);
+        memset(p->ip6h, 0x00, 40);
+        p->ip6h->s_ip6_vfc = 0x60;
+        p->ip6h->s_ip6_nxt = f->proto;
+        p->ip6h->s_ip6_hlim = 64;
+        memcpy(p->ip6h->s_ip6_src, src->addr_data32, 16);
+        memcpy(p->ip6h->s_ip6_dst, dst->addr_data32, 16);
+        hlen = 40;
+    } else {
+        return;
+    }
+
+    if (f->proto == IPPROTO_TCP) {
+        p->tcph = (TCPHdr *)(GET_PKT_DATA(p) + hlen);
+        memset(p->tcph, 0x00, 20);
+        p->tcph->th_sport = htons(p->sp);
+        p->tcph->th_dport = htons(p->dp);
+        p->tcph->th_offx2 = 0x50;
+        hlen += 20;
+    } else if (f->proto == IPPROTO_UDP) {
+        p->udph = (UDPHdr *)(GET_PKT_DATA(p) + hlen);
+        memset(p->udph, 0x00, 8);
+        p->udph->uh_sport = htons(p->sp);
+        p->udph->uh_dport = htons(p->dp);
+        p->udph->uh_len = htons(8);
+        hlen += 8;
+    }
+
+    if (p->ip4h != NULL)
+        p->ip4h->ip_len = htons(hlen);
+    else
+        p->ip6h->s_ip6_plen = htons(hlen - 40);
+    SET_PKT_LEN(p, hlen);
+}
+
+/** \internal
+ *  \brief log the completed transactions of a queued flow and release it
+ */
+static void TxLogThreadRunJob(ThreadVars *tv, TxLogThreadData *td, OutputTxLogJob *job)
+{
+    Flow *f = job->f;
+    Packet *p = td->p;
+
+    FLOWLOCK_WRLOCK(f);
+    f->flags &= ~FLOW_TX_LOG_QUEUED;
+
+    /* the flow may have changed since it was queued */
+    if (f->alstate != NULL &&
+            AppLayerParserProtocolIsTxAware(f->proto, f->alproto) &&
+            AppLayerParserProtocolHasLogger(f->proto, f->alproto))
+    {
+        OutputTxLogPacketSetup(p, job);
+        OutputTxLogFlow(tv, (OutputLoggerThreadData *)td->logger_data, p, f,
+                f->alproto, f->alstate);
+    }
+    FLOWLOCK_UNLOCK(f);
+
+    PACKET_RECYCLE(p);
+    FlowDeReference(&job->f);
+}
+
+static TmEcode TxLogThreadInit(ThreadVars *t, void *initdata, void **data)
+{
+    TxLogThreadData *td = SCCalloc(1, sizeof(TxLogThreadData));
+    if (td == NULL)
+        return TM_ECODE_FAILED;
+
+    uint32_t instance = SC_ATOMIC_ADD(tx_log_thread_cnt, 1);
+    BUG_ON(instance == 0 || instance > tx_log_threads);
+    td->q = &tx_log_queues[instance - 1];
+
+    td->p = PacketGetFromAlloc();
+    if (td->p == NULL) {
+        SCFree(td);
+        return TM_ECODE_FAILED;
+    }
+
+    if (OutputTxLogThreadInitLoggers(t, &td->logger_data) != TM_ECODE_OK) {
+        SCLogError(SC_ERR_THREAD_INIT, "initializing tx loggers for thread failed");
+        PacketFree(td->p);
+        SCFree(td);
+        return TM_ECODE_FAILED;
+    }
+
+    td->counter_queue_depth = SCPerfTVRegisterCounter("tx_log.queue_depth", t,
+            SC_PERF_TYPE_UINT64, "NULL");
+    td->counter_flows = SCPerfTVRegisterCounter("tx_log.flows", t,
+            SC_PERF_TYPE_UINT64, "NULL");
+
+    *data = td;
+    return TM_ECODE_OK;
+}
+
+static TmEcode TxLogThreadDeinit(ThreadVars *t, void *data)
+{
+    TxLogThreadData *td = (TxLogThreadData *)data;
+    if (td == NULL)
+        return TM_ECODE_OK;
+
+    if (td->logger_data != NULL) {
+        OutputTxLogThreadDeinit(t, td->logger_data);
+        SCFree(td->logger_data);
+    }
+    if (td->p != NULL)
+        PacketFree(td->p);
+    SCFree(td);
+    return TM_ECODE_OK;
+}
+
+static void TxLogThreadExitPrintStats(ThreadVars *t, void *data)
+{
+    TxLogThreadData *td = (TxLogThreadData *)data;
+    if (td != NULL && td->logger_data != NULL)
+        OutputTxLogExitPrintStats(t, td->logger_data);
+}
+
+/** \brief tx log thread: log the flows queued by the packet threads */
+static TmEcode TxLogThread(ThreadVars *th_v, void *thread_data)
+{
+    /* block usr2. usr2 to be handled by the main thread only */
+    UtilSignalBlock(SIGUSR2);
+
+    TxLogThreadData *td = (TxLogThreadData *)thread_data;
+    OutputTxLogJob jobs[OUTPUT_TX_LOG_BATCH];
+
+    while (1)
+    {
+        if (TmThreadsCheckFlag(th_v, THV_PAUSE)) {
+            TmThreadsSetFlag(th_v, THV_PAUSED);
+            TmThreadTestThreadUnPaused(th_v);
+            TmThreadsUnsetFlag(th_v, THV_PAUSED);
+        }
+
+        uint32_t cnt = OutputTxLogDequeue(td->q, jobs, OUTPUT_TX_LOG_BATCH);
+        uint32_t i;
+        for (i = 0; i < cnt; i++) {
+            TxLogThreadRunJob(th_v, td, &jobs[i]);
+        }
+
+        if (cnt > 0) {
+            SCPerfCounterAddUI64(td->counter_flows, th_v->sc_perf_pca, cnt);
+        } else {
+            /* the packet threads are killed before us, so once the
+             * queue is empty there is nothing left to log */
+            if (TmThreadsCheckFlag(th_v, THV_KILL)) {
+                SCPerfSyncCounters(th_v);
+                break;
+            }
+
+            SCCtrlMutexLock(&td->q->m);
+            if (td->q->len == 0)
+                OutputTxLogWait(&td->q->cond, &td->q->m);
+            SCCtrlMutexUnlock(&td->q->m);
+        }
+
+        SCPerfCounterSetUI64(td->counter_queue_depth, th_v->sc_perf_pca,
+                td->q->len);
+        SCPerfSyncCountersIfSignalled(th_v);
+    }
+
+    return TM_ECODE_OK;
+}
+
+/** \brief read the tx-logging config, after the outputs are set up and
+ *         before the packet threads are created */
+void OutputTxLogInitConfig(void)
+{
+    intmax_t threads = 0;
+    intmax_t queue_size = OUTPUT_TX_LOG_DEFAULT_QUEUE_SIZE;
+
+    (void)ConfGetInt("tx-logging.threads", &threads);
+    (void)ConfGetInt("tx-logging.queue-size", &queue_size);
+
+    if (threads < 0 || threads > 1024) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT,
+                "invalid tx-logging.threads setting %"PRIdMAX, threads);
+        exit(EXIT_FAILURE);
+    }
+    if (queue_size < 1 || queue_size > (1 << 24)) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT,
+                "invalid tx-logging.queue-size setting %"PRIdMAX, queue_size);
+        exit(EXIT_FAILURE);
+    }
+
+    /* nothing to do for the threads */
+    if (list == NULL)
+        threads = 0;
+
+    tx_log_threads = (uint32_t)threads;
+    tx_log_queue_size = (uint32_t)queue_size;
+
+    if (tx_log_threads > 0) {
+        SCLogInfo("using %u tx log threads, queue size %u", tx_log_threads,
+                tx_log_queue_size);
+    }
+}
+
+/** \brief spawn the tx log threads, if configured */
+void OutputTxLogThreadSpawn(void)
+{
+    if (tx_log_threads == 0)
+        return;
+
+    tx_log_queues = SCCalloc(tx_log_threads, sizeof(OutputTxLogQueue));
+    if (tx_log_queues == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "allocating tx log queues failed");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t u;
+    for (u = 0; u < tx_log_threads; u++) {
+        OutputTxLogQueue *q = &tx_log_queues[u];
+        SCCtrlMutexInit(&q->m, NULL);
+        SCCtrlCondInit(&q->cond, NULL);
+        SCCtrlCondInit(&q->space_cond, NULL);
+        q->size = tx_log_queue_size;
+        q->jobs = SCCalloc(q->size, sizeof(OutputTxLogJob));
+        if (q->jobs == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "allocating tx log queue failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (u = 0; u < tx_log_threads; u++) {
+        ThreadVars *tv_txlog = TmThreadCreateMgmtThreadByName("TxLogThread",
+                "TxLogThread", 0);
+        if (tv_txlog == NULL) {
+            SCLogError(SC_ERR_THREAD_CREATE, "creating tx log thread failed");
+            exit(EXIT_FAILURE);
+        }
+        TmThreadSetCPU(tv_txlog, MANAGEMENT_CPU_SET);
+
+        if (TmThreadSpawn(tv_txlog) != TM_ECODE_OK) {
+            SCLogError(SC_ERR_THREAD_SPAWN, "spawning tx log thread failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void TmModuleTxLogThreadRegister(void)
+{
+    tmm_modules[TMM_TXLOGTHREAD].name = "TxLogThread";
+    tmm_modules[TMM_TXLOGTHREAD].ThreadInit = TxLogThreadInit;
+    tmm_modules[TMM_TXLOGTHREAD].ThreadExitPrintStats = TxLogThreadExitPrintStats;
+    tmm_modules[TMM_TXLOGTHREAD].ThreadDeinit = TxLogThreadDeinit;
+    tmm_modules[TMM_TXLOGTHREAD].Management = TxLogThread;
+    tmm_modules[TMM_TXLOGTHREAD].cap_flags = 0;
+    tmm_modules[TMM_TXLOGTHREAD].flags = TM_FLAG_MANAGEMENT_TM;
+
+    SC_ATOMIC_INIT(tx_log_thread_cnt);
+}
+
 void TmModuleTxLoggerRegister (void)
 {
     tmm_modules[TMM_TXLOGGER].name = "__tx_logger__";
@@ -289,6 +803,7 @@ void TmModuleTxLoggerRegister (void)
     tmm_modules[TMM_TXLOGGER].Func = OutputTxLog;
     tmm_modules[TMM_TXLOGGER].ThreadExitPrintStats = OutputTxLogExitPrintStats;
     tmm_modules[TMM_TXLOGGER].ThreadDeinit = OutputTxLogThreadDeinit;
+    tmm_modules[TMM_TXLOGGER].RegisterTests = OutputTxLogRegisterTests;
     tmm_modules[TMM_TXLOGGER].cap_flags = 0;
 }
 
@@ -301,4 +816,154 @@ void OutputTxShutdown(void)
         logger = next_logger;
     }
     list = NULL;
+
+    if (tx_log_queues != NULL) {
+        uint32_t u;
+        for (u = 0; u < tx_log_threads; u++) {
+            OutputTxLogQueue *q = &tx_log_queues[u];
+            SCFree(q->jobs);
+            SCCtrlCondDestroy(&q->cond);
+            SCCtrlCondDestroy(&q->space_cond);
+            SCCtrlMutexDestroy(&q->m);
+        }
+        SCFree(tx_log_queues);
+        tx_log_queues = NULL;
+    }
+    tx_log_threads = 0;
+}
+
+#ifdef UNITTESTS
+#include "flow-util.h"
+
+static void OutputTxLogTestFlowSetup(Flow *f)
+{
+    memset(f, 0x00, sizeof(*f));
+    FLOW_INITIALIZE(f);
+    f->flags |= FLOW_IPV4;
+    f->proto = IPPROTO_TCP;
+    f->src.addr_data32[0] = htonl(0x0a000001);
+    f->dst.addr_data32[0] = htonl(0x0a000002);
+    f->sp = 1024;
+    f->dp = 80;
+}
+
+/** \test jobs are taken in order, the flow is referenced while queued */
+static int OutputTxLogQueueTest01(void)
+{
+    int result = 0;
+    Flow f1, f2;
+    OutputTxLogQueue q;
+    OutputTxLogJob jobs[4];
+    Packet *p = PacketGetFromAlloc();
+    if (p == NULL)
+        return 0;
+
+    OutputTxLogTestFlowSetup(&f1);
+    OutputTxLogTestFlowSetup(&f2);
+
+    memset(&q, 0x00, sizeof(q));
+    SCCtrlMutexInit(&q.m, NULL);
+    SCCtrlCondInit(&q.cond, NULL);
+    SCCtrlCondInit(&q.space_cond, NULL);
+    q.size = 2;
+    q.head = 1; /* make it wrap */
+    q.jobs = SCCalloc(q.size, sizeof(OutputTxLogJob));
+    if (q.jobs == NULL)
+        goto end;
+
+    p->ts.tv_sec = 100;
+    p->flowflags = FLOW_PKT_TOCLIENT;
+    OutputTxLogEnqueue(&q, p, &f1);
+    p->ts.tv_sec = 200;
+    p->flowflags = FLOW_PKT_TOSERVER;
+    OutputTxLogEnqueue(&q, p, &f2);
+
+    if (!(f1.flags & FLOW_TX_LOG_QUEUED) || !(f2.flags & FLOW_TX_LOG_QUEUED))
+        goto end;
+    if (SC_ATOMIC_GET(f1.use_cnt) != 1 || SC_ATOMIC_GET(f2.use_cnt) != 1)
+        goto end;
+
+    if (OutputTxLogDequeue(&q, jobs, 4) != 2 || q.len != 0)
+        goto end;
+    if (jobs[0].f != &f1 || jobs[0].ts.tv_sec != 100 ||
+            jobs[0].flowflags != FLOW_PKT_TOCLIENT)
+        goto end;
+    if (jobs[1].f != &f2 || jobs[1].ts.tv_sec != 200)
+        goto end;
+    if (OutputTxLogDequeue(&q, jobs + 2, 2) != 0)
+        goto end;
+
+    FlowDeReference(&jobs[0].f);
+    FlowDeReference(&jobs[1].f);
+    if (SC_ATOMIC_GET(f1.use_cnt) != 0 || SC_ATOMIC_GET(f2.use_cnt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    if (q.jobs != NULL)
+        SCFree(q.jobs);
+    SCCtrlCondDestroy(&q.cond);
+    SCCtrlCondDestroy(&q.space_cond);
+    SCCtrlMutexDestroy(&q.m);
+    FLOW_DESTROY(&f1);
+    FLOW_DESTROY(&f2);
+    PacketFree(p);
+    return result;
+}
+
+/** \test the pseudo packet has the tuple of the queueing packet */
+static int OutputTxLogPacketTest01(void)
+{
+    int result = 0;
+    Flow f;
+    OutputTxLogJob job;
+    Packet *p = PacketGetFromAlloc();
+    if (p == NULL)
+        return 0;
+
+    OutputTxLogTestFlowSetup(&f);
+
+    memset(&job, 0x00, sizeof(job));
+    job.f = &f;
+    job.ts.tv_sec = 1234;
+    job.flowflags = FLOW_PKT_TOCLIENT;
+    job.vlan_id[0] = 10;
+    job.vlan_idx = 1;
+
+    OutputTxLogPacketSetup(p, &job);
+
+    if (p->flow != &f || SC_ATOMIC_GET(f.use_cnt) != 1)
+        goto end;
+    if (!PKT_IS_IPV4(p) || !PKT_IS_TCP(p) || !PKT_IS_TOCLIENT(p))
+        goto end;
+    if (p->src.addr_data32[0] != f.dst.addr_data32[0] ||
+            p->dst.addr_data32[0] != f.src.addr_data32[0])
+        goto end;
+    if (p->ip4h->s_ip_src.s_addr != f.dst.addr_data32[0])
+        goto end;
+    if (p->sp != 80 || p->dp != 1024 || ntohs(p->tcph->th_sport) != 80)
+        goto end;
+    if (p->ts.tv_sec != 1234 || p->vlan_idx != 1 || p->vlan_id[0] != 10)
+        goto end;
+    if (GET_PKT_LEN(p) != 40)
+        goto end;
+
+    PACKET_RECYCLE(p);
+    if (p->flow != NULL || SC_ATOMIC_GET(f.use_cnt) != 0)
+        goto end;
+
+    result = 1;
+end:
+    FLOW_DESTROY(&f);
+    PacketFree(p);
+    return result;
+}
+#endif /* UNITTESTS */
+
+static void OutputTxLogRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("OutputTxLogQueueTest01", OutputTxLogQueueTest01, 1);
+    UtRegisterTest("OutputTxLogPacketTest01", OutputTxLogPacketTest01, 1);
+#endif
 }
@@ -39,6 +39,10 @@ typedef int (*TxLogger)(ThreadVars *, void *thread_data, const Packet *, Flow *f
 int OutputRegisterTxLogger(const char *name, AppProto alproto, TxLogger LogFunc, OutputCtx *);
 
 void TmModuleTxLoggerRegister (void);
+void TmModuleTxLogThreadRegister(void);
+
+void OutputTxLogInitConfig(void);
+void OutputTxLogThreadSpawn(void);
 
 void OutputTxShutdown(void);
 
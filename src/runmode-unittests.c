@@ -101,6 +101,11 @@
 #include "util-byte.h"
 #include "util-proto-name.h"
 #include "util-memrchr.h"
+#include "util-json-builder.h"
+#include "util-logopenfile-shard.h"
+#include "util-logopenfile-compress.h"
+#include "util-decode-mime.h"
+#include "output-binlog.h"
 
 #include "util-mpm-ac.h"
 #include "detect-engine-mpm.h"
@@ -143,6 +148,7 @@ void RunUnittests(int list_unittests, char *regex_arg)
 #endif
     /* load the pattern matchers */
     MpmTableSetup();
+    ChecksumSimdSetup();
 #ifdef __SC_CUDA_SUPPORT__
     MpmCudaEnvironmentSetup();
 #endif
@@ -257,6 +263,12 @@ void RunUnittests(int list_unittests, char *regex_arg)
     DetectPortTests();
     SCAtomicRegisterTests();
     MemrchrRegisterTests();
+    ChecksumSimdRegisterTests();
+    JsonBuilderRegisterTests();
+    LogFileShardRegisterTests();
+    LogFileCompressRegisterTests();
+    MimeDecRegisterTests();
+    BinLogRegisterTests();
 #ifdef __SC_CUDA_SUPPORT__
     CudaBufferRegisterUnittests();
 #endif
@@ -674,14 +674,17 @@ void RunModeInitializeOutputs(void)
             continue;
         }
 
-        // TODO if module == parent, find it's children
-        if (strcmp(output->val, "eve-log") == 0) {
+        /* parent outputs, their types are sub-modules sharing the
+         * parent's output ctx */
+        if (strcmp(output->val, "eve-log") == 0 ||
+                strcmp(output->val, "binlog") == 0) {
             ConfNode *types = ConfNodeLookupChild(output_config, "types");
             SCLogDebug("types %p", types);
             if (types != NULL) {
                 ConfNode *type = NULL;
                 TAILQ_FOREACH(type, &types->head, next) {
-                    SCLogInfo("enabling 'eve-log' module '%s'", type->val);
+                    SCLogInfo("enabling '%s' module '%s'", output->val,
+                            type->val);
 
                     char subname[256];
                     snprintf(subname, sizeof(subname), "%s.%s", output->val, type->val);
@@ -717,7 +720,7 @@ void RunModeInitializeOutputs(void)
                     SetupOutput(sub_module->name, sub_module, sub_output_ctx);
                 }
             }
-            /* add 'eve-log' to free list as it's the owner of the
+            /* add the parent to free list as it's the owner of the
              * main output ctx from which the sub-modules share the
              * LogFileCtx */
             AddOutputToFreeList(module, output_ctx);
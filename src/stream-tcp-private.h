@@ -168,7 +168,9 @@ enum
 #define STREAMTCP_STREAM_FLAG_APPPROTO_DETECTION_SKIPPED 0x0100
 /** Raw reassembly disabled for new segments */
 #define STREAMTCP_STREAM_FLAG_NEW_RAW_DISABLED 0x0200
-// vacancy 2x
+/** Reassembly depth was reduced by the memcap policy */
+#define STREAMTCP_STREAM_FLAG_DEPTH_SHED       0x0400
+// vacancy 1x
 /** NOTE: flags field is 12 bits */
 
 
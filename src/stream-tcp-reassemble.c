@@ -58,8 +58,10 @@
 #include "app-layer-protos.h"
 #include "app-layer.h"
 #include "app-layer-events.h"
+#include "app-layer-parser.h"
 
 #include "detect-engine-state.h"
+#include "flow-bit.h"
 
 #include "util-profiling.h"
 
@@ -1718,25 +1720,108 @@ int StreamTcpReassembleDepthReached(Packet *p)
     return 0;
 }
 
+/**
+ *  \internal
+ *  \brief Check if a flow should keep its full reassembly depth when
+ *         the memcap policy starts shedding.
+ *
+ *  Flows that have flowbits set or that alerted are part of a detection
+ *  in progress so we keep reassembling them. Open app layer transactions
+ *  don't count: nearly every app layer flow has one, including the bulk
+ *  transfers that should be shed first.
+ *
+ *  \param f *LOCKED* flow
+ *
+ *  \retval 1 flow is prioritized
+ *  \retval 0 flow can be shed
+ */
+static int StreamTcpReassembleFlowIsPrioritized(Flow *f)
+{
+    if (f == NULL)
+        return 0;
+
+    if (f->flags & FLOW_HAS_ALERTS)
+        return 1;
+
+    if (FlowBitHasAny(f))
+        return 1;
+
+    return 0;
+}
+
+/**
+ *  \internal
+ *  \brief Get the reassembly depth for a stream, taking the memcap
+ *         policy into account.
+ *
+ *  Once the reassembly memory use passes the policy threshold, the depth
+ *  of non-prioritized streams is reduced linearly from the configured depth
+ *  to the policy's min-depth as the memory use approaches the memcap. As
+ *  the depth is relative to the ISN, streams are ranked by the data they
+ *  reassembled so far (ra_base_seq - isn): the largest are the first to
+ *  be cut off. If no depth is configured the min-depth is applied as soon
+ *  as the threshold is passed.
+ *
+ *  The depth is computed again for each segment, so streams that weren't
+ *  cut get their depth back once the memory use drops. A stream that was
+ *  cut stays cut: its reassembly stopped and the data after the cut is
+ *  gone, resuming would hand a stream with a gap to the app layer.
+ *
+ *  \param f *LOCKED* flow
+ *
+ *  \retval depth depth to enforce, 0 for unlimited
+ */
+static uint32_t StreamTcpReassembleGetDepth(Flow *f)
+{
+    uint32_t depth = stream_config.reassembly_depth;
+
+    if (!(stream_config.flags & STREAMTCP_INIT_FLAG_MEMCAP_POLICY) ||
+            stream_config.reassembly_memcap == 0)
+        return depth;
+
+    uint64_t memuse = SC_ATOMIC_GET(ra_memuse);
+    uint64_t threshold = (stream_config.reassembly_memcap *
+            stream_config.reassembly_shed_threshold) / 100;
+    if (memuse <= threshold)
+        return depth;
+
+    if (StreamTcpReassembleFlowIsPrioritized(f))
+        return depth;
+
+    uint32_t min_depth = stream_config.reassembly_shed_min_depth;
+    if (depth == 0)
+        return min_depth;
+    if (min_depth >= depth)
+        return depth;
+
+    uint64_t range = stream_config.reassembly_memcap - threshold;
+    uint64_t over = memuse - threshold;
+    if (over >= range)
+        return min_depth;
+
+    return depth - (uint32_t)(((uint64_t)(depth - min_depth) * over) / range);
+}
+
 /**
  *  \internal
  *  \brief Function to Check the reassembly depth valuer against the
  *        allowed max depth of the stream reassmbly for TCP streams.
  *
  *  \param stream stream direction
+ *  \param depth depth to enforce, 0 for unlimited
  *  \param seq sequence number where "size" starts
  *  \param size size of the segment that is added
  *
  *  \retval size Part of the size that fits in the depth, 0 if none
  */
-static uint32_t StreamTcpReassembleCheckDepth(TcpStream *stream,
+static uint32_t StreamTcpReassembleCheckDepth(TcpStream *stream, uint32_t depth,
         uint32_t seq, uint32_t size)
 {
     SCEnter();
 
     /* if the configured depth value is 0, it means there is no limit on
        reassembly depth. Otherwise carry on my boy ;) */
-    if (stream_config.reassembly_depth == 0) {
+    if (depth == 0) {
         SCReturnUInt(size);
     }
 
@@ -1749,24 +1834,24 @@ static uint32_t StreamTcpReassembleCheckDepth(TcpStream *stream,
      * checking and just reject the rest of the packets including
      * retransmissions. Saves us the hassle of dealing with sequence
      * wraps as well */
-    if (SEQ_GEQ((StreamTcpReassembleGetRaBaseSeq(stream)+1),(stream->isn + stream_config.reassembly_depth))) {
+    if (SEQ_GEQ((StreamTcpReassembleGetRaBaseSeq(stream)+1),(stream->isn + depth))) {
         stream->flags |= STREAMTCP_STREAM_FLAG_DEPTH_REACHED;
         SCReturnUInt(0);
     }
 
     SCLogDebug("full Depth not yet reached: %"PRIu32" <= %"PRIu32,
             (StreamTcpReassembleGetRaBaseSeq(stream)+1),
-            (stream->isn + stream_config.reassembly_depth));
+            (stream->isn + depth));
 
-    if (SEQ_GEQ(seq, stream->isn) && SEQ_LT(seq, (stream->isn + stream_config.reassembly_depth))) {
+    if (SEQ_GEQ(seq, stream->isn) && SEQ_LT(seq, (stream->isn + depth))) {
         /* packet (partly?) fits the depth window */
 
-        if (SEQ_LEQ((seq + size),(stream->isn + stream_config.reassembly_depth))) {
+        if (SEQ_LEQ((seq + size),(stream->isn + depth))) {
             /* complete fit */
             SCReturnUInt(size);
         } else {
             /* partial fit, return only what fits */
-            uint32_t part = (stream->isn + stream_config.reassembly_depth) - seq;
+            uint32_t part = (stream->isn + depth) - seq;
 #if DEBUG
             BUG_ON(part > size);
 #else
@@ -1855,9 +1940,29 @@ int StreamTcpReassembleHandleSegmentHandleData(ThreadVars *tv, TcpReassemblyThre
 
     /* If we have reached the defined depth for either of the stream, then stop
        reassembling the TCP session */
-    uint32_t size = StreamTcpReassembleCheckDepth(stream, TCP_GET_SEQ(p), p->payload_len);
+    uint32_t depth = stream_config.reassembly_depth;
+    if (!(stream->flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED)) {
+        depth = StreamTcpReassembleGetDepth(p->flow);
+    }
+    uint32_t size = StreamTcpReassembleCheckDepth(stream, depth,
+            TCP_GET_SEQ(p), p->payload_len);
     SCLogDebug("ssn %p: check depth returned %"PRIu32, ssn, size);
 
+    if (depth != stream_config.reassembly_depth && size < p->payload_len) {
+        /* memcap policy reduced the depth and cut (part of) this segment */
+        SCPerfCounterAddUI64(ra_ctx->counter_tcp_reass_shed_bytes, tv->sc_perf_pca,
+                (uint64_t)(p->payload_len - size));
+
+        if ((stream->flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED) &&
+            !(stream->flags & STREAMTCP_STREAM_FLAG_DEPTH_SHED))
+        {
+            stream->flags |= STREAMTCP_STREAM_FLAG_DEPTH_SHED;
+            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_shed, tv->sc_perf_pca);
+            SCLogDebug("ssn %p: reassembly depth reduced to %"PRIu32" by "
+                    "memcap policy", ssn, depth);
+        }
+    }
+
     if (stream->flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED) {
         /* increment stream depth counter */
         SCPerfCounterIncr(ra_ctx->counter_tcp_stream_depth, tv->sc_perf_pca);
@@ -7313,6 +7418,81 @@ end:
     return ret;
 }
 
+/** \test   Test the memcap policy depth reduction and flow prioritization */
+static int StreamTcpReassembleTest48(void)
+{
+    int ret = 0;
+    Flow f;
+    FlowBit fb;
+
+    memset(&f, 0, sizeof(f));
+    memset(&fb, 0, sizeof(fb));
+
+    StreamTcpInitConfig(TRUE);
+
+    /* take the prealloc'd segments out of the accounting so we have
+     * a predictable memuse */
+    uint64_t memuse = SC_ATOMIC_GET(ra_memuse);
+    StreamTcpReassembleDecrMemuse(memuse);
+
+    stream_config.flags |= STREAMTCP_INIT_FLAG_MEMCAP_POLICY;
+    stream_config.reassembly_depth = 100000;
+    stream_config.reassembly_shed_min_depth = 1000;
+    stream_config.reassembly_shed_threshold = 50;
+    stream_config.reassembly_memcap = 20000;
+
+    /* below the threshold: configured depth */
+    StreamTcpReassembleIncrMemuse(10000);
+    uint32_t depth = StreamTcpReassembleGetDepth(&f);
+    if (depth != 100000) {
+        printf("expected depth 100000 below threshold, got %"PRIu32": ", depth);
+        goto end;
+    }
+
+    /* half way between threshold and memcap: half way reduced depth */
+    StreamTcpReassembleIncrMemuse(5000);
+    depth = StreamTcpReassembleGetDepth(&f);
+    if (depth != 50500) {
+        printf("expected depth 50500, got %"PRIu32": ", depth);
+        goto end;
+    }
+
+    /* flows with flowbits keep their depth */
+    fb.type = DETECT_FLOWBITS;
+    f.flowvar = (GenericVar *)&fb;
+    depth = StreamTcpReassembleGetDepth(&f);
+    f.flowvar = NULL;
+    if (depth != 100000) {
+        printf("expected depth 100000 for flow with flowbits, got %"PRIu32": ", depth);
+        goto end;
+    }
+
+    /* so do flows that alerted */
+    f.flags |= FLOW_HAS_ALERTS;
+    depth = StreamTcpReassembleGetDepth(&f);
+    f.flags &= ~FLOW_HAS_ALERTS;
+    if (depth != 100000) {
+        printf("expected depth 100000 for flow with alerts, got %"PRIu32": ", depth);
+        goto end;
+    }
+
+    /* memcap reached: min depth */
+    StreamTcpReassembleIncrMemuse(5000);
+    depth = StreamTcpReassembleGetDepth(&f);
+    if (depth != 1000) {
+        printf("expected min depth at memcap, got %"PRIu32": ", depth);
+        goto end;
+    }
+
+    ret = 1;
+end:
+    StreamTcpReassembleDecrMemuse(SC_ATOMIC_GET(ra_memuse));
+    StreamTcpReassembleIncrMemuse(memuse);
+    stream_config.flags &= ~STREAMTCP_INIT_FLAG_MEMCAP_POLICY;
+    StreamTcpFreeConfig(TRUE);
+    return ret;
+}
+
 /**
  *  \test   Test to make sure that reassembly_depth is enforced.
  *
@@ -9023,6 +9203,7 @@ void StreamTcpReassembleRegisterTests(void)
     UtRegisterTest("StreamTcpReassembleTest45 -- Depth Test", StreamTcpReassembleTest45, 1);
     UtRegisterTest("StreamTcpReassembleTest46 -- Depth Test", StreamTcpReassembleTest46, 1);
     UtRegisterTest("StreamTcpReassembleTest47 -- TCP Sequence Wraparound Test", StreamTcpReassembleTest47, 1);
+    UtRegisterTest("StreamTcpReassembleTest48 -- Memcap Policy Test", StreamTcpReassembleTest48, 1);
 
     UtRegisterTest("StreamTcpReassembleInlineTest01 -- inline RAW ra", StreamTcpReassembleInlineTest01, 1);
     UtRegisterTest("StreamTcpReassembleInlineTest02 -- inline RAW ra 2", StreamTcpReassembleInlineTest02, 1);
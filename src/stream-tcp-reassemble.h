@@ -61,6 +61,10 @@ typedef struct TcpReassemblyThreadCtx_ {
     uint16_t counter_tcp_reass_memuse;
     /** count number of streams with a unrecoverable stream gap (missing pkts) */
     uint16_t counter_tcp_reass_gap;
+    /** number of streams that had their depth reduced by the memcap policy */
+    uint16_t counter_tcp_reass_shed;
+    /** bytes not reassembled because of the memcap policy */
+    uint16_t counter_tcp_reass_shed_bytes;
     /** account memory usage by suricata to handle HTTP protocol (not counting
      * libhtp memory usage)*/
     uint16_t counter_htp_memuse;
@@ -82,6 +82,8 @@
 #define STREAMTCP_DEFAULT_TOSERVER_CHUNK_SIZE   2560
 #define STREAMTCP_DEFAULT_TOCLIENT_CHUNK_SIZE   2560
 #define STREAMTCP_DEFAULT_MAX_SYNACK_QUEUED     5
+#define STREAMTCP_DEFAULT_SHED_THRESHOLD        80 /* % of reassembly memcap */
+#define STREAMTCP_DEFAULT_SHED_MIN_DEPTH        (64 * 1024) /* 64kb */
 
 #define STREAMTCP_NEW_TIMEOUT                   60
 #define STREAMTCP_EST_TIMEOUT                   3600
@@ -491,6 +493,56 @@ void StreamTcpInitConfig(char quiet)
         SCLogInfo("stream.reassembly \"depth\": %"PRIu32"", stream_config.reassembly_depth);
     }
 
+    int memcap_policy = 0;
+    if (ConfGetBool("stream.reassembly.memcap-policy.enabled", &memcap_policy) == 1 &&
+            memcap_policy == 1) {
+        stream_config.flags |= STREAMTCP_INIT_FLAG_MEMCAP_POLICY;
+    }
+
+    if ((ConfGetInt("stream.reassembly.memcap-policy.threshold", &value)) == 1) {
+        if (value > 0 && value < 100) {
+            stream_config.reassembly_shed_threshold = (uint8_t)value;
+        } else {
+            SCLogError(SC_ERR_INVALID_VALUE,
+                       "stream.reassembly.memcap-policy.threshold "
+                       "must be between 1 and 99");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        stream_config.reassembly_shed_threshold = STREAMTCP_DEFAULT_SHED_THRESHOLD;
+    }
+
+    char *temp_stream_reassembly_min_depth_str;
+    if (ConfGet("stream.reassembly.memcap-policy.min-depth",
+                &temp_stream_reassembly_min_depth_str) == 1) {
+        if (ParseSizeStringU32(temp_stream_reassembly_min_depth_str,
+                               &stream_config.reassembly_shed_min_depth) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "Error parsing "
+                       "stream.reassembly.memcap-policy.min-depth "
+                       "from conf file - %s.  Killing engine",
+                       temp_stream_reassembly_min_depth_str);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        stream_config.reassembly_shed_min_depth = STREAMTCP_DEFAULT_SHED_MIN_DEPTH;
+    }
+
+    if (stream_config.reassembly_depth != 0 &&
+            stream_config.reassembly_shed_min_depth > stream_config.reassembly_depth) {
+        stream_config.reassembly_shed_min_depth = stream_config.reassembly_depth;
+    }
+
+    if (!quiet) {
+        SCLogInfo("stream.reassembly \"memcap-policy\": %s",
+                stream_config.flags & STREAMTCP_INIT_FLAG_MEMCAP_POLICY ?
+                "enabled" : "disabled");
+        if (stream_config.flags & STREAMTCP_INIT_FLAG_MEMCAP_POLICY) {
+            SCLogInfo("stream.reassembly.memcap-policy \"threshold\": %"PRIu8"%%, "
+                    "\"min-depth\": %"PRIu32, stream_config.reassembly_shed_threshold,
+                    stream_config.reassembly_shed_min_depth);
+        }
+    }
+
     int randomize = 0;
     if ((ConfGetBool("stream.reassembly.randomize-chunk-size", &randomize)) == 0) {
         /* randomize by default if value not set
@@ -4681,6 +4733,12 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     stt->ra_ctx->counter_tcp_reass_gap = SCPerfTVRegisterCounter("tcp.reassembly_gap", tv,
                                                         SC_PERF_TYPE_UINT64,
                                                         "NULL");
+    stt->ra_ctx->counter_tcp_reass_shed = SCPerfTVRegisterCounter("tcp.reassembly_shed", tv,
+                                                        SC_PERF_TYPE_UINT64,
+                                                        "NULL");
+    stt->ra_ctx->counter_tcp_reass_shed_bytes = SCPerfTVRegisterCounter("tcp.reassembly_shed_bytes", tv,
+                                                        SC_PERF_TYPE_UINT64,
+                                                        "NULL");
     /** \fixme Find a better place in 2.1 as it is linked with app layer */
     stt->ra_ctx->counter_htp_memuse = SCPerfTVRegisterCounter("http.memuse", tv,
                                                         SC_PERF_TYPE_UINT64,
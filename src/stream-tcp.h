@@ -38,6 +38,7 @@
 /* Flag to indicate that the checksum validation for the stream engine
    has been enabled */
 #define STREAMTCP_INIT_FLAG_CHECKSUM_VALIDATION    0x01
+#define STREAMTCP_INIT_FLAG_MEMCAP_POLICY          0x02
 
 /*global flow data*/
 typedef struct TcpStreamCnf_ {
@@ -56,6 +57,13 @@ typedef struct TcpStreamCnf_ {
     int async_oneside;
     uint32_t reassembly_depth;  /**< Depth until when we reassemble the stream */
 
+    /** memcap policy: depth low priority streams are reduced to when the
+     *  reassembly memcap is fully used */
+    uint32_t reassembly_shed_min_depth;
+    /** memcap policy: percentage of the reassembly memcap in use at which
+     *  we start reducing the depth of low priority streams */
+    uint8_t reassembly_shed_threshold;
+
     uint16_t reassembly_toserver_chunk_size;
     uint16_t reassembly_toclient_chunk_size;
 
@@ -96,6 +96,10 @@
 #include "log-filestore.h"
 
 #include "output-json.h"
+#include "output-binlog.h"
+#include "output-binlog-flow.h"
+#include "output-binlog-netflow.h"
+#include "output-binlog-dns.h"
 
 #include "stream-tcp.h"
 
@@ -123,6 +127,7 @@
 #include "flow.h"
 #include "flow-timeout.h"
 #include "flow-manager.h"
+#include "util-logopenfile-async.h"
 #include "flow-var.h"
 #include "flow-bit.h"
 #include "pkt-var.h"
@@ -133,6 +138,8 @@
 #include "app-layer.h"
 #include "app-layer-parser.h"
 #include "app-layer-htp.h"
+#include "app-layer-ssl.h"
+#include "app-layer-tls-handshake.h"
 
 #include "util-radix-tree.h"
 #include "util-host-os-info.h"
@@ -806,6 +813,8 @@ void RegisterAllModules()
     /* managers */
     TmModuleFlowManagerRegister();
     TmModuleFlowRecyclerRegister();
+    TmModuleLogFileWriterRegister();
+    TmModuleTxLogThreadRegister();
     /* nfq */
     TmModuleReceiveNFQRegister();
     TmModuleVerdictNFQRegister();
@@ -885,6 +894,11 @@ void RegisterAllModules()
     /* flow/netflow */
     TmModuleJsonFlowLogRegister();
     TmModuleJsonNetFlowLogRegister();
+    /* binlog and its types */
+    OutputBinLogRegister();
+    TmModuleBinLogFlowRegister();
+    TmModuleBinLogNetFlowRegister();
+    TmModuleBinLogDnsRegister();
 
     /* log api */
     TmModulePacketLoggerRegister();
@@ -1964,6 +1978,8 @@ static int PostConfLoadedSetup(SCInstance *suri)
 
     /* load the pattern matchers */
     MpmTableSetup();
+    /* select the checksum implementation */
+    ChecksumSimdSetup();
 #ifdef __SC_CUDA_SUPPORT__
     MpmCudaEnvironmentSetup();
 #endif
@@ -2266,6 +2282,7 @@ int main(int argc, char **argv)
 
     if (suri.run_mode != RUNMODE_UNIX_SOCKET) {
         RunModeInitializeOutputs();
+        OutputTxLogInitConfig();
     }
 
     if (ParseInterfacesList(suri.run_mode, suri.pcap_dev) != TM_ECODE_OK) {
@@ -2301,6 +2318,12 @@ int main(int argc, char **argv)
         SCPerfSpawnThreads();
     }
 
+    /* Spawn the writer thread for async outputs, if any */
+    LogFileWriterThreadSpawn();
+
+    /* Spawn the tx log threads, if configured */
+    OutputTxLogThreadSpawn();
+
 #ifdef __SC_CUDA_SUPPORT__
     if (PatternMatchDefaultMatcher() == MPM_AC_CUDA)
         SCACCudaStartDispatcher();
@@ -2427,6 +2450,7 @@ int main(int argc, char **argv)
 
     HTPFreeConfig();
     HTPAtExitPrintStats();
+    TLSCertCacheFree();
 
 #ifdef DBG_MEM_ALLOC
     SCLogInfo("Total memory used (without SCFree()): %"PRIdMAX, (intmax_t)global_mem);
@@ -260,9 +260,14 @@ const char * TmModuleTmmIdToString(TmmId id)
         CASE_CODE (TMM_JSONNETFLOWLOG);
         CASE_CODE (TMM_JSONSSHLOG);
         CASE_CODE (TMM_JSONTLSLOG);
+        CASE_CODE (TMM_BINLOGFLOW);
+        CASE_CODE (TMM_BINLOGNETFLOW);
+        CASE_CODE (TMM_BINLOGDNS);
         CASE_CODE (TMM_OUTPUTJSON);
         CASE_CODE (TMM_FLOWMANAGER);
         CASE_CODE (TMM_FLOWRECYCLER);
+        CASE_CODE (TMM_LOGFILEWRITER);
+        CASE_CODE (TMM_TXLOGTHREAD);
 
         CASE_CODE (TMM_SIZE);
     }
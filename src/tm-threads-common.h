@@ -93,9 +93,14 @@ typedef enum {
     TMM_DECODENFLOG,
     TMM_JSONFLOWLOG,
     TMM_JSONNETFLOWLOG,
+    TMM_BINLOGFLOW,
+    TMM_BINLOGNETFLOW,
+    TMM_BINLOGDNS,
 
     TMM_FLOWMANAGER,
     TMM_FLOWRECYCLER,
+    TMM_LOGFILEWRITER,
+    TMM_TXLOGTHREAD,
 
     TMM_SIZE,
 } TmmId;
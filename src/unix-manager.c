@@ -32,6 +32,10 @@
 #include "util-privs.h"
 #include "util-debug.h"
 #include "util-signal.h"
+#include "util-atomic.h"
+#include "util-misc.h"
+#include "util-time.h"
+#include "counters.h"
 
 #include <sys/un.h>
 #include <sys/stat.h>
@@ -51,6 +55,11 @@
 #define SOCKET_FILENAME "suricata-command.socket"
 #define SOCKET_TARGET SOCKET_PATH SOCKET_FILENAME
 
+/** default size of the buffer of a subscribed client */
+#define UNIX_STREAM_DEFAULT_BUFFER_SIZE (1024 * 1024)
+/** default interval in seconds of the stats snapshots */
+#define UNIX_STREAM_DEFAULT_STATS_INTERVAL 10
+
 typedef struct Command_ {
     char *name;
     TmEcode (*Func)(json_t *, json_t *, void *);
@@ -70,6 +79,27 @@ typedef struct UnixClient_ {
     TAILQ_ENTRY(UnixClient_) next;
 } UnixClient;
 
+/** client that ran the "subscribe" command. Records are queued in its
+ *  buffer by the producing threads and sent out by the unix manager
+ *  thread. Records that don't fit are dropped, the producers never wait
+ *  for the client. */
+typedef struct UnixSubscriber_ {
+    int fd;
+    int types;              /**< UNIX_STREAM_* */
+    uint32_t stats_interval;
+    time_t stats_next;
+
+    /** protects the buffer */
+    SCMutex m;
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t start;         /**< offset of the first byte to send */
+    uint32_t len;           /**< bytes queued */
+    uint64_t drops;         /**< records dropped */
+
+    TAILQ_ENTRY(UnixSubscriber_) next;
+} UnixSubscriber;
+
 typedef struct UnixCommand_ {
     time_t start_timestamp;
     int socket;
@@ -78,8 +108,19 @@ typedef struct UnixCommand_ {
     TAILQ_HEAD(, Command_) commands;
     TAILQ_HEAD(, Task_) tasks;
     TAILQ_HEAD(, UnixClient_) clients;
+    /** set by the subscribe command, attached to the client once the
+     *  answer is sent */
+    UnixSubscriber *subscribing;
 } UnixCommand;
 
+/** subscribed clients. The list is changed by the unix manager thread
+ *  only, under the write lock. The producers walk it read locked. */
+static TAILQ_HEAD(, UnixSubscriber_) unix_subscribers =
+    TAILQ_HEAD_INITIALIZER(unix_subscribers);
+static SCRWLock unix_subscribers_lock = PTHREAD_RWLOCK_INITIALIZER;
+/** number of subscribers, checked by the producers without lock */
+SC_ATOMIC_DECLARE(uint32_t, unix_subscribers_cnt);
+
 /**
  * \brief Create a command unix socket on system
  *
@@ -207,6 +248,14 @@ void UnixCommandSetMaxFD(UnixCommand *this)
             this->select_max = item->fd + 1;
         }
     }
+
+    /* only the unix manager thread changes the list */
+    UnixSubscriber *sub;
+    TAILQ_FOREACH(sub, &unix_subscribers, next) {
+        if (sub->fd >= this->select_max) {
+            this->select_max = sub->fd + 1;
+        }
+    }
 }
 
 /**
@@ -236,6 +285,203 @@ void UnixCommandClose(UnixCommand  *this, int fd)
     SCFree(item);
 }
 
+static void UnixSubscriberFree(UnixSubscriber *sub)
+{
+    if (sub->fd >= 0)
+        close(sub->fd);
+    SCMutexDestroy(&sub->m);
+    if (sub->buf != NULL)
+        SCFree(sub->buf);
+    SCFree(sub);
+}
+
+/**
+ * \brief Queue a record for a subscriber, newline terminated
+ *
+ * \retval 1 queued
+ * \retval 0 dropped, the buffer is full
+ */
+static int UnixSubscriberAppend(UnixSubscriber *sub, const char *record, size_t len)
+{
+    int ret = 0;
+
+    SCMutexLock(&sub->m);
+    if ((uint64_t)len + 1 > (uint64_t)(sub->size - sub->len)) {
+        sub->drops++;
+        goto end;
+    }
+
+    uint32_t pos = (sub->start + sub->len) % sub->size;
+    uint32_t first = sub->size - pos;
+    if (len < first)
+        first = (uint32_t)len;
+    memcpy(sub->buf + pos, record, first);
+    if (len > first)
+        memcpy(sub->buf, record + first, len - first);
+    sub->buf[(pos + len) % sub->size] = '\n';
+    sub->len += (uint32_t)len + 1;
+    ret = 1;
+end:
+    SCMutexUnlock(&sub->m);
+    return ret;
+}
+
+/**
+ * \brief Send what the socket takes without blocking
+ *
+ * \retval 0 client is gone
+ * \retval 1 ok
+ */
+static int UnixSubscriberFlush(UnixSubscriber *sub)
+{
+    int ret = 1;
+
+    SCMutexLock(&sub->m);
+    while (sub->len > 0) {
+        uint32_t chunk = sub->size - sub->start;
+        if (chunk > sub->len)
+            chunk = sub->len;
+
+        ssize_t sent = send(sub->fd, sub->buf + sub->start, chunk,
+                MSG_NOSIGNAL|MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+            SCLogInfo("Unix socket: subscriber send() error: %s",
+                    strerror(errno));
+            ret = 0;
+            break;
+        }
+        sub->start = (sub->start + (uint32_t)sent) % sub->size;
+        sub->len -= (uint32_t)sent;
+        if ((uint32_t)sent < chunk)
+            break;
+    }
+    if (sub->len == 0)
+        sub->start = 0;
+    SCMutexUnlock(&sub->m);
+    return ret;
+}
+
+/**
+ * \brief Queue a counter snapshot for a subscriber
+ */
+static void UnixSubscriberStats(UnixSubscriber *sub, time_t now)
+{
+    char timebuf[64];
+    struct timeval ts = { now, 0 };
+    json_t *answer = json_object();
+    if (answer == NULL)
+        return;
+
+    json_t *js = json_object();
+    if (js == NULL) {
+        json_decref(answer);
+        return;
+    }
+
+    CreateIsoTimeString(&ts, timebuf, sizeof(timebuf));
+    json_object_set_new(js, "timestamp", json_string(timebuf));
+    json_object_set_new(js, "event_type", json_string("stats"));
+
+    if (SCPerfOutputCounterSocket(NULL, answer, NULL) == TM_ECODE_OK) {
+        json_object_set(js, "stats", json_object_get(answer, "message"));
+    }
+
+    SCMutexLock(&sub->m);
+    uint64_t drops = sub->drops;
+    SCMutexUnlock(&sub->m);
+
+    json_t *jstream = json_object();
+    if (jstream != NULL) {
+        json_object_set_new(jstream, "drops", json_integer(drops));
+        json_object_set_new(js, "stream", jstream);
+    }
+
+    char *js_s = json_dumps(js, JSON_PRESERVE_ORDER|JSON_COMPACT);
+    if (js_s != NULL) {
+        (void)UnixSubscriberAppend(sub, js_s, strlen(js_s));
+        free(js_s);
+    }
+    json_decref(js);
+    json_decref(answer);
+}
+
+/**
+ * \brief Turn the client into a subscriber, after the command answer is
+ *        sent
+ */
+static void UnixCommandSubscribe(UnixCommand *this, UnixClient *client)
+{
+    UnixSubscriber *sub = this->subscribing;
+    this->subscribing = NULL;
+
+    int flags = fcntl(client->fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(client->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        SCLogWarning(SC_ERR_SOCKET, "Unix socket: can't set subscriber "
+                "socket non blocking: %s", strerror(errno));
+        UnixSubscriberFree(sub);
+        UnixCommandClose(this, client->fd);
+        return;
+    }
+
+    /* the fd moves to the subscriber */
+    TAILQ_REMOVE(&this->clients, client, next);
+    sub->fd = client->fd;
+    SCFree(client);
+
+    SCRWLockWRLock(&unix_subscribers_lock);
+    TAILQ_INSERT_TAIL(&unix_subscribers, sub, next);
+    SCRWLockUnlock(&unix_subscribers_lock);
+    (void) SC_ATOMIC_ADD(unix_subscribers_cnt, 1);
+
+    UnixCommandSetMaxFD(this);
+    SCLogInfo("Unix socket: client subscribed to%s%s",
+            (sub->types & UNIX_STREAM_EVENTS) ? " events" : "",
+            (sub->types & UNIX_STREAM_STATS) ? " stats" : "");
+}
+
+static void UnixSubscriberRemove(UnixCommand *this, UnixSubscriber *sub)
+{
+    SCRWLockWRLock(&unix_subscribers_lock);
+    TAILQ_REMOVE(&unix_subscribers, sub, next);
+    SCRWLockUnlock(&unix_subscribers_lock);
+    (void) SC_ATOMIC_SUB(unix_subscribers_cnt, 1);
+
+    if (sub->drops > 0) {
+        SCLogInfo("Unix socket: subscriber gone, %"PRIu64" records dropped",
+                sub->drops);
+    } else {
+        SCLogInfo("Unix socket: subscriber gone");
+    }
+    UnixSubscriberFree(sub);
+    if (this != NULL)
+        UnixCommandSetMaxFD(this);
+}
+
+/**
+ * \brief Queue a record for all clients subscribed to its type
+ *
+ * Called by the packet and output threads. Never blocks on a client:
+ * the record is dropped for a client whose buffer is full.
+ *
+ * \param type UNIX_STREAM_EVENTS or UNIX_STREAM_STATS
+ * \param record the record, without trailing newline
+ */
+void UnixManagerStreamPublish(int type, const char *record, size_t len)
+{
+    if (SC_ATOMIC_GET(unix_subscribers_cnt) == 0)
+        return;
+
+    UnixSubscriber *sub;
+    SCRWLockRDLock(&unix_subscribers_lock);
+    TAILQ_FOREACH(sub, &unix_subscribers, next) {
+        if (sub->types & type)
+            (void)UnixSubscriberAppend(sub, record, len);
+    }
+    SCRWLockUnlock(&unix_subscribers_lock);
+}
+
 /**
  * \brief Callback function used to send message to socket
  */
@@ -448,6 +694,10 @@ int UnixCommandExecute(UnixCommand * this, char *command, UnixClient *client)
         goto error_cmd;
     }
 
+    /* from now on the client only receives the stream */
+    if (this->subscribing != NULL)
+        UnixCommandSubscribe(this, client);
+
     json_decref(jsoncmd);
     json_decref(server_msg);
     return ret;
@@ -456,6 +706,10 @@ error_cmd:
     json_decref(jsoncmd);
 error:
     json_decref(server_msg);
+    if (this->subscribing != NULL) {
+        UnixSubscriberFree(this->subscribing);
+        this->subscribing = NULL;
+    }
     UnixCommandClose(this, client->fd);
     return 0;
 }
@@ -494,19 +748,43 @@ int UnixMain(UnixCommand * this)
     struct timeval tv;
     int ret;
     fd_set select_set;
+    fd_set write_set;
     UnixClient *uclient;
     UnixClient *tclient;
+    UnixSubscriber *sub;
+    UnixSubscriber *tsub;
+    int wait_write = 0;
+    time_t now = time(NULL);
 
     /* Wait activity on the socket */
     FD_ZERO(&select_set);
+    FD_ZERO(&write_set);
     FD_SET(this->socket, &select_set);
     TAILQ_FOREACH(uclient, &this->clients, next) {
         FD_SET(uclient->fd, &select_set);
     }
+    /* subscribers: read to notice the client going away, write while
+     * there is something queued */
+    TAILQ_FOREACH(sub, &unix_subscribers, next) {
+        if ((sub->types & UNIX_STREAM_STATS) && now >= sub->stats_next) {
+            UnixSubscriberStats(sub, now);
+            sub->stats_next = now + sub->stats_interval;
+        }
+        FD_SET(sub->fd, &select_set);
 
+        SCMutexLock(&sub->m);
+        if (sub->len > 0) {
+            FD_SET(sub->fd, &write_set);
+            wait_write = 1;
+        }
+        SCMutexUnlock(&sub->m);
+    }
+
+    /* with subscribers, wake up often to pick up new records */
     tv.tv_sec = 0;
-    tv.tv_usec = 200 * 1000;
-    ret = select(this->select_max, &select_set, NULL, NULL, &tv);
+    tv.tv_usec = SC_ATOMIC_GET(unix_subscribers_cnt) ? 20 * 1000 : 200 * 1000;
+    ret = select(this->select_max, &select_set,
+            wait_write ? &write_set : NULL, NULL, &tv);
 
     /* catch select() error */
     if (ret == -1) {
@@ -522,6 +800,22 @@ int UnixMain(UnixCommand * this)
         return 1;
     }
 
+    TAILQ_FOREACH_SAFE(sub, &unix_subscribers, next, tsub) {
+        if (ret > 0 && FD_ISSET(sub->fd, &select_set)) {
+            char buffer[256];
+            ssize_t r = recv(sub->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                        errno != EINTR)) {
+                UnixSubscriberRemove(this, sub);
+                continue;
+            }
+            /* anything sent by a subscriber is ignored */
+        }
+        if (UnixSubscriberFlush(sub) == 0) {
+            UnixSubscriberRemove(this, sub);
+        }
+    }
+
     /* timeout: continue */
     if (ret == 0) {
         return 1;
@@ -701,6 +995,85 @@ TmEcode UnixManagerListCommand(json_t *cmd,
 }
 
 
+/**
+ * \brief Subscribe the client to the record stream
+ *
+ * Arguments: "events" (bool, default true), "stats" (bool, default
+ * false), "stats-interval" (seconds) and "buffer-size" (bytes).
+ */
+TmEcode UnixManagerSubscribeCommand(json_t *cmd,
+                                    json_t *answer, void *data)
+{
+    SCEnter();
+    UnixCommand *ucmd = (UnixCommand *)data;
+    int types = 0;
+    uint32_t size = UNIX_STREAM_DEFAULT_BUFFER_SIZE;
+    uint32_t interval = UNIX_STREAM_DEFAULT_STATS_INTERVAL;
+    char *conf_val = NULL;
+
+    if (ConfGet("unix-command.stream-buffer-size", &conf_val) == 1) {
+        if (ParseSizeStringU32(conf_val, &size) < 0 || size == 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid "
+                    "unix-command.stream-buffer-size \"%s\"", conf_val);
+            size = UNIX_STREAM_DEFAULT_BUFFER_SIZE;
+        }
+    }
+
+    json_t *jarg = json_object_get(cmd, "events");
+    if (jarg == NULL || json_is_true(jarg))
+        types |= UNIX_STREAM_EVENTS;
+    jarg = json_object_get(cmd, "stats");
+    if (json_is_true(jarg))
+        types |= UNIX_STREAM_STATS;
+    if (types == 0) {
+        json_object_set_new(answer, "message", json_string("nothing to subscribe to"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    jarg = json_object_get(cmd, "stats-interval");
+    if (jarg != NULL) {
+        if (!json_is_integer(jarg) || json_integer_value(jarg) < 1) {
+            json_object_set_new(answer, "message", json_string("invalid stats-interval"));
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        interval = (uint32_t)json_integer_value(jarg);
+    }
+    jarg = json_object_get(cmd, "buffer-size");
+    if (jarg != NULL) {
+        if (!json_is_integer(jarg) || json_integer_value(jarg) < 4096 ||
+                json_integer_value(jarg) > (json_int_t)size) {
+            json_object_set_new(answer, "message", json_string("invalid buffer-size"));
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        size = (uint32_t)json_integer_value(jarg);
+    }
+
+    UnixSubscriber *sub = SCCalloc(1, sizeof(UnixSubscriber));
+    if (unlikely(sub == NULL)) {
+        json_object_set_new(answer, "message", json_string("internal memory error"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    sub->buf = SCMalloc(size);
+    if (unlikely(sub->buf == NULL)) {
+        SCFree(sub);
+        json_object_set_new(answer, "message", json_string("internal memory error"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+    SCMutexInit(&sub->m, NULL);
+    sub->fd = -1;
+    sub->size = size;
+    sub->types = types;
+    sub->stats_interval = interval;
+    sub->stats_next = time(NULL) + interval;
+
+    if (ucmd->subscribing != NULL)
+        UnixSubscriberFree(ucmd->subscribing);
+    ucmd->subscribing = sub;
+
+    json_object_set_new(answer, "message", json_string("subscribed"));
+    SCReturnInt(TM_ECODE_OK);
+}
+
 #if 0
 TmEcode UnixManagerReloadRules(json_t *cmd,
                                json_t *server_msg, void *data)
@@ -859,6 +1232,7 @@ void *UnixManagerThread(void *td)
     UnixManagerRegisterCommand("capture-mode", UnixManagerCaptureModeCommand, &command, 0);
     UnixManagerRegisterCommand("conf-get", UnixManagerConfGetCommand, &command, UNIX_CMD_TAKE_ARGS);
     UnixManagerRegisterCommand("dump-counters", SCPerfOutputCounterSocket, NULL, 0);
+    UnixManagerRegisterCommand("subscribe", UnixManagerSubscribeCommand, &command, UNIX_CMD_TAKE_ARGS);
 #if 0
     UnixManagerRegisterCommand("reload-rules", UnixManagerReloadRules, NULL, 0);
 #endif
@@ -877,6 +1251,12 @@ void *UnixManagerThread(void *td)
                 close(item->fd);
                 SCFree(item);
             }
+            UnixSubscriber *sub;
+            UnixSubscriber *tsub;
+            TAILQ_FOREACH_SAFE(sub, &unix_subscribers, next, tsub) {
+                (void)UnixSubscriberFlush(sub);
+                UnixSubscriberRemove(NULL, sub);
+            }
             SCPerfSyncCounters(th_v);
             break;
         }
@@ -901,6 +1281,7 @@ void UnixManagerThreadSpawn(DetectEngineCtx *de_ctx, int mode)
 
     SCCtrlCondInit(&unix_manager_ctrl_cond, NULL);
     SCCtrlMutexInit(&unix_manager_ctrl_mutex, NULL);
+    SC_ATOMIC_INIT(unix_subscribers_cnt);
 
     tv_unixmgr = TmThreadCreateCmdThread("UnixManagerThread",
                                           UnixManagerThread, 0);
@@ -976,4 +1357,9 @@ void UnixSocketKillSocketThread(void)
     return;
 }
 
+void UnixManagerStreamPublish(int type, const char *record, size_t len)
+{
+    return;
+}
+
 #endif /* BUILD_UNIX_SOCKET */
@@ -30,11 +30,16 @@
 
 #define UNIX_CMD_TAKE_ARGS 1
 
+/* record types for subscribed clients */
+#define UNIX_STREAM_EVENTS  0x01
+#define UNIX_STREAM_STATS   0x02
+
 SCCtrlCondT unix_manager_ctrl_cond;
 SCCtrlMutex unix_manager_ctrl_mutex;
 
 void UnixManagerThreadSpawn(DetectEngineCtx *de_ctx, int mode);
 void UnixSocketKillSocketThread(void);
+void UnixManagerStreamPublish(int type, const char *record, size_t len);
 
 
 #ifdef BUILD_UNIX_SOCKET
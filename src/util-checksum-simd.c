@@ -0,0 +1,267 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * One's complement sum of 16 bit words.
+ *
+ * The sum is independent of byte order (RFC 1071), so the words are added
+ * in host order and the callers fold and complement the result. The SIMD
+ * versions widen the 16 bit words into 32 bit lanes and add those up, so
+ * no carries have to be handled in the inner loop. The implementation is
+ * selected at startup based on what the CPU supports, the code itself is
+ * compiled using function level target attributes so no special compiler
+ * flags are needed.
+ */
+
+#include "suricata-common.h"
+#include "util-checksum-simd.h"
+#include "util-unittest.h"
+
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__tile__) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CHECKSUM_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/** number of 16 byte blocks we can add into the 32 bit lanes before they
+ *  can overflow: each lane receives 2 words of at most 0xffff per block */
+#define CHECKSUM_SIMD_BLOCKS_MAX 32768
+
+static inline uint32_t ChecksumFold(uint64_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (uint32_t)sum;
+}
+
+static uint32_t ChecksumSumWordsScalar(const uint16_t *pkt, uint32_t len)
+{
+    uint64_t sum = 0;
+
+    while (len >= 32) {
+        sum += pkt[0] + pkt[1] + pkt[2] + pkt[3] + pkt[4] + pkt[5] + pkt[6] +
+            pkt[7] + pkt[8] + pkt[9] + pkt[10] + pkt[11] + pkt[12] + pkt[13] +
+            pkt[14] + pkt[15];
+        len -= 32;
+        pkt += 16;
+    }
+
+    while (len > 1) {
+        sum += pkt[0];
+        pkt += 1;
+        len -= 2;
+    }
+
+    return ChecksumFold(sum);
+}
+
+#ifdef CHECKSUM_SIMD_X86
+__attribute__((target("sse2")))
+static uint32_t ChecksumSumWordsSSE2(const uint16_t *pkt, uint32_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const uint8_t *ptr = (const uint8_t *)pkt;
+    uint64_t sum = 0;
+
+    while (len >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        uint32_t blocks = len / 16;
+        if (blocks > CHECKSUM_SIMD_BLOCKS_MAX)
+            blocks = CHECKSUM_SIMD_BLOCKS_MAX;
+        len -= blocks * 16;
+
+        for ( ; blocks > 0; blocks--) {
+            __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            ptr += 16;
+        }
+
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    sum += ChecksumSumWordsScalar((const uint16_t *)ptr, len);
+    return ChecksumFold(sum);
+}
+
+__attribute__((target("avx2")))
+static uint32_t ChecksumSumWordsAVX2(const uint16_t *pkt, uint32_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const uint8_t *ptr = (const uint8_t *)pkt;
+    uint64_t sum = 0;
+
+    while (len >= 32) {
+        __m256i acc = _mm256_setzero_si256();
+        uint32_t blocks = len / 32;
+        if (blocks > CHECKSUM_SIMD_BLOCKS_MAX)
+            blocks = CHECKSUM_SIMD_BLOCKS_MAX;
+        len -= blocks * 32;
+
+        for ( ; blocks > 0; blocks--) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+            ptr += 32;
+        }
+
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+            lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    sum += ChecksumSumWordsScalar((const uint16_t *)ptr, len);
+    return ChecksumFold(sum);
+}
+#endif /* CHECKSUM_SIMD_X86 */
+
+ChecksumSumWordsFunc ChecksumSumWords = ChecksumSumWordsScalar;
+
+/**
+ *  \brief Get an implementation of the word sum
+ *
+ *  \param impl CHECKSUM_IMPL_* value
+ *
+ *  \retval func the implementation or NULL if it's not supported by
+ *          either the build or the CPU we're running on
+ */
+ChecksumSumWordsFunc ChecksumSimdGetFunc(int impl)
+{
+    switch (impl) {
+        case CHECKSUM_IMPL_SCALAR:
+            return ChecksumSumWordsScalar;
+#ifdef CHECKSUM_SIMD_X86
+        case CHECKSUM_IMPL_SSE2:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse2"))
+                return ChecksumSumWordsSSE2;
+            break;
+        case CHECKSUM_IMPL_AVX2:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return ChecksumSumWordsAVX2;
+            break;
+#endif
+        default:
+            break;
+    }
+    return NULL;
+}
+
+const char *ChecksumSimdImplName(int impl)
+{
+    switch (impl) {
+        case CHECKSUM_IMPL_SCALAR:
+            return "scalar";
+        case CHECKSUM_IMPL_SSE2:
+            return "sse2";
+        case CHECKSUM_IMPL_AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ *  \brief Select the fastest word sum implementation the CPU supports.
+ */
+void ChecksumSimdSetup(void)
+{
+    int impl;
+
+    for (impl = CHECKSUM_IMPL_MAX - 1; impl >= CHECKSUM_IMPL_SCALAR; impl--) {
+        ChecksumSumWordsFunc Func = ChecksumSimdGetFunc(impl);
+        if (Func != NULL) {
+            ChecksumSumWords = Func;
+            SCLogDebug("using %s checksum implementation",
+                    ChecksumSimdImplName(impl));
+            return;
+        }
+    }
+}
+
+#ifdef UNITTESTS
+/** \test compare all supported implementations against the scalar one
+ *        for a range of lengths and alignments */
+static int ChecksumSimdTest01(void)
+{
+    uint8_t buf[4096 + 32];
+    uint32_t i, len, offset;
+    int impl;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)((i * 7919) ^ (i >> 3));
+
+    for (impl = CHECKSUM_IMPL_SCALAR + 1; impl < CHECKSUM_IMPL_MAX; impl++) {
+        ChecksumSumWordsFunc Func = ChecksumSimdGetFunc(impl);
+        if (Func == NULL)
+            continue;
+
+        for (offset = 0; offset < 4; offset += 2) {
+            for (len = 0; len <= 4096; len += 2) {
+                const uint16_t *pkt = (const uint16_t *)(buf + offset);
+                uint32_t expected = ChecksumSumWordsScalar(pkt, len);
+                uint32_t result = Func(pkt, len);
+                if (result != expected) {
+                    printf("%s: len %"PRIu32" offset %"PRIu32": %04x != %04x: ",
+                            ChecksumSimdImplName(impl), len, offset,
+                            result, expected);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/** \test all 0xff words, so every lane is at its max */
+static int ChecksumSimdTest02(void)
+{
+    static uint8_t buf[65536];
+    int impl;
+
+    memset(buf, 0xff, sizeof(buf));
+
+    for (impl = CHECKSUM_IMPL_SCALAR; impl < CHECKSUM_IMPL_MAX; impl++) {
+        ChecksumSumWordsFunc Func = ChecksumSimdGetFunc(impl);
+        if (Func == NULL)
+            continue;
+
+        if (Func((const uint16_t *)buf, sizeof(buf)) != 0xffff) {
+            printf("%s: wrong sum: ", ChecksumSimdImplName(impl));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+#endif /* UNITTESTS */
+
+void ChecksumSimdRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("ChecksumSimdTest01", ChecksumSimdTest01, 1);
+    UtRegisterTest("ChecksumSimdTest02", ChecksumSimdTest02, 1);
+#endif /* UNITTESTS */
+}
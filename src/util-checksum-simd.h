@@ -0,0 +1,52 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * One's complement sum of 16 bit words, with SSE2/AVX2 implementations
+ * selected at runtime. Used by the checksum calculation helpers in the
+ * decoder headers for the bulk of the packet data.
+ */
+
+#ifndef __UTIL_CHECKSUM_SIMD_H__
+#define __UTIL_CHECKSUM_SIMD_H__
+
+/** below this many bytes the inline scalar loops are used */
+#define CHECKSUM_SIMD_MIN_LEN   64
+
+enum {
+    CHECKSUM_IMPL_SCALAR = 0,
+    CHECKSUM_IMPL_SSE2,
+    CHECKSUM_IMPL_AVX2,
+    CHECKSUM_IMPL_MAX,
+};
+
+/** \brief sum 'len' bytes (len is a multiple of 2) as 16 bit words
+ *  \retval sum folded into 16 bits, not complemented */
+typedef uint32_t (*ChecksumSumWordsFunc)(const uint16_t *pkt, uint32_t len);
+
+/** implementation selected by ChecksumSimdSetup() */
+extern ChecksumSumWordsFunc ChecksumSumWords;
+
+void ChecksumSimdSetup(void);
+ChecksumSumWordsFunc ChecksumSimdGetFunc(int impl);
+const char *ChecksumSimdImplName(int impl);
+
+void ChecksumSimdRegisterTests(void);
+
+#endif /* __UTIL_CHECKSUM_SIMD_H__ */
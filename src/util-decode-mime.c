@@ -0,0 +1,800 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Streaming MIME decoder.
+ *
+ * The message is fed line by line, without the line delimiters. Part
+ * headers are unfolded and only Content-Type, Content-Transfer-Encoding
+ * and Content-Disposition are looked at. Parts with a file name are
+ * decoded (base64, quoted-printable or as is) into a fixed size output
+ * buffer that is passed to the FileData callback whenever it fills up,
+ * so the memory use per message is bounded by the size of the parse
+ * state, regardless of the message size. Parts without a file name,
+ * like the text of the message, are skipped.
+ *
+ * The CRLF before a boundary belongs to the boundary, so the line break
+ * after a line of a not base64 encoded part is only output when the
+ * next line of the part is seen.
+ */
+
+#include "suricata-common.h"
+#include "util-debug.h"
+#include "util-memcmp.h"
+#include "util-unittest.h"
+
+#include "util-decode-mime.h"
+
+/* parser states */
+#define MIME_STATE_HEADERS  0
+#define MIME_STATE_BODY     1
+/** preamble or epilogue of a multipart body */
+#define MIME_STATE_SKIP     2
+
+/**
+ *  \brief Allocate a parser for a single message
+ *
+ *  \param cb file callbacks
+ *  \param data passed to the callbacks
+ *
+ *  \retval state parser or NULL on error
+ */
+MimeDecParseState *MimeDecInitParser(const MimeDecCallbacks *cb, void *data)
+{
+    MimeDecParseState *state = SCMalloc(sizeof(MimeDecParseState));
+    if (unlikely(state == NULL))
+        return NULL;
+    memset(state, 0x00, sizeof(MimeDecParseState));
+
+    state->state = MIME_STATE_HEADERS;
+    state->cb = cb;
+    state->data = data;
+    return state;
+}
+
+void MimeDecDeInitParser(MimeDecParseState *state)
+{
+    if (state != NULL)
+        SCFree(state);
+}
+
+static void MimeDecFlush(MimeDecParseState *state)
+{
+    if (state->out_len > 0 && state->in_file) {
+        if (state->cb->FileData(state->out, state->out_len, state->data) < 0) {
+            SCLogDebug("file data callback failed, stop decoding the part");
+            state->in_file = 0;
+        }
+    }
+    state->out_len = 0;
+}
+
+static inline void MimeDecOutputByte(MimeDecParseState *state, uint8_t b)
+{
+    state->out[state->out_len++] = b;
+    if (state->out_len == MIME_CHUNK_SIZE)
+        MimeDecFlush(state);
+}
+
+static void MimeDecOutput(MimeDecParseState *state, const uint8_t *buf,
+        uint32_t len)
+{
+    while (len > 0 && state->in_file) {
+        uint32_t n = MIME_CHUNK_SIZE - state->out_len;
+        if (n > len)
+            n = len;
+        memcpy(state->out + state->out_len, buf, n);
+        state->out_len += n;
+        buf += n;
+        len -= n;
+        if (state->out_len == MIME_CHUNK_SIZE)
+            MimeDecFlush(state);
+    }
+}
+
+static inline void MimeDecOutputPendingCrlf(MimeDecParseState *state)
+{
+    if (state->crlf_pending) {
+        MimeDecOutputByte(state, '\r');
+        MimeDecOutputByte(state, '\n');
+        state->crlf_pending = 0;
+    }
+}
+
+static inline int MimeDecBase64Value(uint8_t c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+static inline int MimeDecHexValue(uint8_t c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    /* lowercase is not allowed by the RFC, but common */
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/** \brief output an incomplete base64 quantum, at padding or part end */
+static void MimeDecBase64Finish(MimeDecParseState *state)
+{
+    if (state->b64_len >= 2)
+        MimeDecOutputByte(state, (uint8_t)((state->b64[0] << 2) | (state->b64[1] >> 4)));
+    if (state->b64_len == 3)
+        MimeDecOutputByte(state, (uint8_t)((state->b64[1] << 4) | (state->b64[2] >> 2)));
+    if (state->b64_len == 1)
+        state->anomalies |= MIME_ANOM_INVALID_BASE64;
+    state->b64_len = 0;
+}
+
+static void MimeDecBase64Line(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len)
+{
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        if (line[i] == '=') {
+            MimeDecBase64Finish(state);
+            continue;
+        }
+
+        int v = MimeDecBase64Value(line[i]);
+        if (v < 0) {
+            if (line[i] != ' ' && line[i] != '\t')
+                state->anomalies |= MIME_ANOM_INVALID_BASE64;
+            continue;
+        }
+
+        state->b64[state->b64_len++] = (uint8_t)v;
+        if (state->b64_len == 4) {
+            MimeDecOutputByte(state, (uint8_t)((state->b64[0] << 2) | (state->b64[1] >> 4)));
+            MimeDecOutputByte(state, (uint8_t)((state->b64[1] << 4) | (state->b64[2] >> 2)));
+            MimeDecOutputByte(state, (uint8_t)((state->b64[2] << 6) | state->b64[3]));
+            state->b64_len = 0;
+        }
+    }
+}
+
+static void MimeDecQPLine(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len)
+{
+    int soft_break = 0;
+
+    /* trailing whitespace was added in transport */
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t'))
+        len--;
+    if (len > 0 && line[len - 1] == '=') {
+        soft_break = 1;
+        len--;
+    }
+
+    MimeDecOutputPendingCrlf(state);
+
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        if (line[i] == '=') {
+            if (i + 2 < len) {
+                int hi = MimeDecHexValue(line[i + 1]);
+                int lo = MimeDecHexValue(line[i + 2]);
+                if (hi >= 0 && lo >= 0) {
+                    MimeDecOutputByte(state, (uint8_t)((hi << 4) | lo));
+                    i += 2;
+                    continue;
+                }
+            }
+            /* keep the '=' as is */
+            state->anomalies |= MIME_ANOM_INVALID_QP;
+        }
+        MimeDecOutputByte(state, line[i]);
+    }
+
+    state->crlf_pending = !soft_break;
+}
+
+static void MimeDecRawLine(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len)
+{
+    MimeDecOutputPendingCrlf(state);
+    MimeDecOutput(state, line, len);
+    state->crlf_pending = 1;
+}
+
+static inline int MimeDecHeaderIs(const uint8_t *name, uint32_t name_len,
+        const char *lc_name)
+{
+    size_t len = strlen(lc_name);
+    return (name_len == len && SCMemcmpLowercase(lc_name, name, len) == 0);
+}
+
+/**
+ *  \brief Get a parameter of a header value, like the boundary in
+ *         "multipart/mixed; boundary=xyz"
+ *
+ *  \param name lowercase parameter name
+ *
+ *  \retval 1 found, param points into value
+ *  \retval 0 not found
+ */
+static int MimeDecGetParam(const uint8_t *value, uint32_t value_len,
+        const char *name, const uint8_t **param, uint32_t *param_len)
+{
+    uint32_t name_len = strlen(name);
+    uint32_t i = 0;
+
+    while (i < value_len) {
+        /* parameters follow a ';' */
+        while (i < value_len && value[i] != ';')
+            i++;
+        i++;
+        while (i < value_len && (value[i] == ' ' || value[i] == '\t'))
+            i++;
+        if (i >= value_len || value_len - i <= name_len)
+            break;
+
+        if (value[i + name_len] != '=' ||
+                SCMemcmpLowercase(name, value + i, name_len) != 0)
+            continue;
+
+        i += name_len + 1;
+        uint32_t start;
+        if (i < value_len && value[i] == '"') {
+            start = ++i;
+            while (i < value_len && value[i] != '"')
+                i++;
+        } else {
+            start = i;
+            while (i < value_len && value[i] != ';' &&
+                    value[i] != ' ' && value[i] != '\t')
+                i++;
+        }
+        *param = value + start;
+        *param_len = i - start;
+        return 1;
+    }
+    return 0;
+}
+
+static void MimeDecSetFilename(MimeDecParseState *state, const uint8_t *name,
+        uint32_t len)
+{
+    if (len > MIME_MAX_FILENAME_LEN) {
+        state->anomalies |= MIME_ANOM_LONG_FILENAME;
+        len = MIME_MAX_FILENAME_LEN;
+    }
+    memcpy(state->filename, name, len);
+    state->filename_len = (uint16_t)len;
+}
+
+/** \brief apply the header collected in state->hdr to the current part */
+static void MimeDecProcessHeader(MimeDecParseState *state)
+{
+    const uint8_t *hdr = state->hdr;
+    uint32_t len = state->hdr_len;
+    state->hdr_len = 0;
+
+    const uint8_t *colon = memchr(hdr, ':', len);
+    if (colon == NULL)
+        return;
+
+    uint32_t name_len = colon - hdr;
+    while (name_len > 0 && (hdr[name_len - 1] == ' ' || hdr[name_len - 1] == '\t'))
+        name_len--;
+
+    const uint8_t *value = colon + 1;
+    uint32_t value_len = len - (value - hdr);
+    while (value_len > 0 && (*value == ' ' || *value == '\t')) {
+        value++;
+        value_len--;
+    }
+
+    const uint8_t *param = NULL;
+    uint32_t param_len = 0;
+
+    if (MimeDecHeaderIs(hdr, name_len, "content-type")) {
+        if (value_len >= 10 && SCMemcmpLowercase("multipart/", value, 10) == 0 &&
+                MimeDecGetParam(value, value_len, "boundary", &param, &param_len))
+        {
+            if (param_len > MIME_MAX_BOUNDARY_LEN) {
+                state->anomalies |= MIME_ANOM_LONG_BOUNDARY;
+            } else {
+                memcpy(state->part_boundary, param, param_len);
+                state->part_boundary_len = (uint8_t)param_len;
+            }
+        }
+        /* the disposition file name takes precedence */
+        if (state->filename_len == 0 &&
+                MimeDecGetParam(value, value_len, "name", &param, &param_len))
+            MimeDecSetFilename(state, param, param_len);
+
+    } else if (MimeDecHeaderIs(hdr, name_len, "content-transfer-encoding")) {
+        if (value_len >= 6 && SCMemcmpLowercase("base64", value, 6) == 0)
+            state->encoding = MIME_ENC_BASE64;
+        else if (value_len >= 16 &&
+                SCMemcmpLowercase("quoted-printable", value, 16) == 0)
+            state->encoding = MIME_ENC_QP;
+        else
+            state->encoding = MIME_ENC_NONE;
+
+    } else if (MimeDecHeaderIs(hdr, name_len, "content-disposition")) {
+        if (MimeDecGetParam(value, value_len, "filename", &param, &param_len))
+            MimeDecSetFilename(state, param, param_len);
+    }
+}
+
+static void MimeDecAppendHeader(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len)
+{
+    if (state->hdr_len + len > MIME_MAX_HEADER_LEN) {
+        state->anomalies |= MIME_ANOM_LONG_HEADER;
+        len = MIME_MAX_HEADER_LEN - state->hdr_len;
+    }
+    memcpy(state->hdr + state->hdr_len, line, len);
+    state->hdr_len += len;
+}
+
+/** \brief end of the headers of a part */
+static void MimeDecStartBody(MimeDecParseState *state)
+{
+    if (state->part_boundary_len > 0) {
+        if (state->depth == MIME_MAX_DEPTH) {
+            /* the parts are skipped until a known boundary */
+            state->anomalies |= MIME_ANOM_DEPTH_EXCEEDED;
+        } else {
+            memcpy(state->boundary[state->depth], state->part_boundary,
+                    state->part_boundary_len);
+            state->boundary_len[state->depth] = state->part_boundary_len;
+            state->depth++;
+        }
+        state->state = MIME_STATE_SKIP;
+        return;
+    }
+
+    state->state = MIME_STATE_BODY;
+    if (state->filename_len > 0 &&
+            state->cb->FileOpen(state->filename, state->filename_len,
+                state->data) == 0)
+    {
+        state->in_file = 1;
+    }
+}
+
+/** \brief end of a part: close its file and reset the part state */
+static void MimeDecEndPart(MimeDecParseState *state, int truncated)
+{
+    if (state->in_file) {
+        if (state->encoding == MIME_ENC_BASE64)
+            MimeDecBase64Finish(state);
+        MimeDecFlush(state);
+        if (state->in_file)
+            state->cb->FileClose(truncated, state->data);
+        state->in_file = 0;
+    }
+
+    state->encoding = MIME_ENC_NONE;
+    state->crlf_pending = 0;
+    state->b64_len = 0;
+    state->out_len = 0;
+    state->hdr_len = 0;
+    state->part_boundary_len = 0;
+    state->filename_len = 0;
+}
+
+/**
+ *  \brief Find the boundary a line is a delimiter of, innermost first
+ *
+ *  \param close set to 1 if it's a close delimiter
+ *
+ *  \retval level index into state->boundary or -1 if none
+ */
+static int MimeDecGetBoundaryLevel(const MimeDecParseState *state,
+        const uint8_t *line, uint32_t len, int *close)
+{
+    int level;
+    for (level = state->depth - 1; level >= 0; level--) {
+        uint32_t blen = state->boundary_len[level];
+        if (len < 2 + blen || memcmp(line + 2, state->boundary[level], blen) != 0)
+            continue;
+
+        const uint8_t *rest = line + 2 + blen;
+        uint32_t rest_len = len - 2 - blen;
+        if (rest_len >= 2 && rest[0] == '-' && rest[1] == '-') {
+            *close = 1;
+            return level;
+        }
+        /* only transport padding may follow */
+        while (rest_len > 0 && (*rest == ' ' || *rest == '\t')) {
+            rest++;
+            rest_len--;
+        }
+        if (rest_len == 0) {
+            *close = 0;
+            return level;
+        }
+    }
+    return -1;
+}
+
+/**
+ *  \brief Parse a line of the message
+ *
+ *  \param line line without the line delimiter
+ *
+ *  \retval 0 ok
+ */
+int MimeDecParseLine(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len)
+{
+    if (state->depth > 0 && len >= 2 && line[0] == '-' && line[1] == '-') {
+        int close = 0;
+        int level = MimeDecGetBoundaryLevel(state, line, len, &close);
+        if (level >= 0) {
+            MimeDecEndPart(state, 0);
+            if (close) {
+                /* epilogue of the multipart body */
+                state->depth = (uint8_t)level;
+                state->state = MIME_STATE_SKIP;
+            } else {
+                state->depth = (uint8_t)(level + 1);
+                state->state = MIME_STATE_HEADERS;
+            }
+            return 0;
+        }
+    }
+
+    switch (state->state) {
+        case MIME_STATE_HEADERS:
+            if (len == 0) {
+                MimeDecProcessHeader(state);
+                MimeDecStartBody(state);
+            } else if (line[0] == ' ' || line[0] == '\t') {
+                /* folded header, continues the previous line */
+                MimeDecAppendHeader(state, line, len);
+            } else {
+                MimeDecProcessHeader(state);
+                MimeDecAppendHeader(state, line, len);
+            }
+            break;
+
+        case MIME_STATE_BODY:
+            if (!state->in_file)
+                break;
+
+            if (state->encoding == MIME_ENC_BASE64)
+                MimeDecBase64Line(state, line, len);
+            else if (state->encoding == MIME_ENC_QP)
+                MimeDecQPLine(state, line, len);
+            else
+                MimeDecRawLine(state, line, len);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ *  \brief End of the message. A file that is still open is closed, as
+ *         truncated if the message ended inside a multipart body.
+ *
+ *  \retval 0 ok
+ */
+int MimeDecParseComplete(MimeDecParseState *state)
+{
+    MimeDecEndPart(state, state->depth > 0);
+    state->depth = 0;
+    state->state = MIME_STATE_HEADERS;
+    return 0;
+}
+
+#ifdef UNITTESTS
+
+typedef struct MimeDecTestFile_ {
+    int opened;
+    int closed;
+    int truncated;
+    int chunks;
+    uint16_t name_len;
+    uint8_t name[MIME_MAX_FILENAME_LEN];
+    uint32_t len;
+    uint8_t buf[16384];
+} MimeDecTestFile;
+
+static int MimeDecTestFileOpen(const uint8_t *name, uint16_t name_len, void *data)
+{
+    MimeDecTestFile *tf = (MimeDecTestFile *)data;
+    tf->opened++;
+    memcpy(tf->name, name, name_len);
+    tf->name_len = name_len;
+    tf->len = 0;
+    return 0;
+}
+
+static int MimeDecTestFileData(const uint8_t *chunk, uint32_t len, void *data)
+{
+    MimeDecTestFile *tf = (MimeDecTestFile *)data;
+    if (tf->len + len > sizeof(tf->buf))
+        return -1;
+    memcpy(tf->buf + tf->len, chunk, len);
+    tf->len += len;
+    tf->chunks++;
+    return 0;
+}
+
+static int MimeDecTestFileClose(int truncated, void *data)
+{
+    MimeDecTestFile *tf = (MimeDecTestFile *)data;
+    tf->closed++;
+    tf->truncated = truncated;
+    return 0;
+}
+
+static const MimeDecCallbacks mime_test_cb = {
+    MimeDecTestFileOpen, MimeDecTestFileData, MimeDecTestFileClose
+};
+
+/** \internal feed a nul separated list of lines */
+static void MimeDecTestFeed(MimeDecParseState *state, const char **lines)
+{
+    for ( ; *lines != NULL; lines++) {
+        MimeDecParseLine(state, (const uint8_t *)*lines, strlen(*lines));
+    }
+}
+
+/** \test base64 attachment with a quantum split over two lines */
+static int MimeDecTest01(void)
+{
+    int result = 0;
+    MimeDecTestFile tf;
+    memset(&tf, 0x00, sizeof(tf));
+    const char *lines[] = {
+        "From: a@example.com",
+        "Content-Type: multipart/mixed;",
+        "    boundary=\"XYZ\"",
+        "",
+        "This is a multi-part message in MIME format.",
+        "--XYZ",
+        "Content-Type: text/plain",
+        "",
+        "Not a file.",
+        "--XYZ",
+        "Content-Type: application/octet-stream; name=\"wrong.bin\"",
+        "Content-Transfer-Encoding: base64",
+        "Content-Disposition: attachment; filename=\"test.txt\"",
+        "",
+        "SGVsbG8sIFdvcmxkIQ0KVGhpcyB",
+        "pcyBhIHRlc3QgYXR0YWNobWVudC4NCg==",
+        "",
+        "--XYZ--",
+        "epilogue",
+        NULL };
+    const char *expect = "Hello, World!\r\nThis is a test attachment.\r\n";
+
+    MimeDecParseState *state = MimeDecInitParser(&mime_test_cb, &tf);
+    if (state == NULL)
+        return 0;
+
+    MimeDecTestFeed(state, lines);
+    MimeDecParseComplete(state);
+
+    if (tf.opened != 1 || tf.closed != 1 || tf.truncated != 0) {
+        printf("opened %d closed %d truncated %d: ", tf.opened, tf.closed, tf.truncated);
+        goto end;
+    }
+    if (tf.name_len != 8 || memcmp(tf.name, "test.txt", 8) != 0) {
+        printf("wrong file name: ");
+        goto end;
+    }
+    if (tf.len != strlen(expect) || memcmp(tf.buf, expect, tf.len) != 0) {
+        printf("wrong file content (%u bytes): ", tf.len);
+        goto end;
+    }
+    if (state->anomalies != 0) {
+        printf("anomalies %08x: ", state->anomalies);
+        goto end;
+    }
+    result = 1;
+end:
+    MimeDecDeInitParser(state);
+    return result;
+}
+
+/** \test quoted-printable, the CRLF before the boundary is not data */
+static int MimeDecTest02(void)
+{
+    int result = 0;
+    MimeDecTestFile tf;
+    memset(&tf, 0x00, sizeof(tf));
+    const char *lines[] = {
+        "Content-Type: multipart/mixed; boundary=b1",
+        "",
+        "--b1",
+        "Content-Type: text/plain; name=qp.txt",
+        "Content-Transfer-Encoding: quoted-printable",
+        "",
+        "a=3Db=  ",
+        "c=zz",
+        "d",
+        "--b1--",
+        NULL };
+    const char *expect = "a=bc=zz\r\nd";
+
+    MimeDecParseState *state = MimeDecInitParser(&mime_test_cb, &tf);
+    if (state == NULL)
+        return 0;
+
+    MimeDecTestFeed(state, lines);
+    MimeDecParseComplete(state);
+
+    if (tf.opened != 1 || tf.closed != 1) {
+        printf("opened %d closed %d: ", tf.opened, tf.closed);
+        goto end;
+    }
+    if (tf.name_len != 6 || memcmp(tf.name, "qp.txt", 6) != 0) {
+        printf("wrong file name: ");
+        goto end;
+    }
+    if (tf.len != strlen(expect) || memcmp(tf.buf, expect, tf.len) != 0) {
+        printf("wrong file content (%u bytes): ", tf.len);
+        goto end;
+    }
+    if (!(state->anomalies & MIME_ANOM_INVALID_QP)) {
+        printf("invalid qp not flagged: ");
+        goto end;
+    }
+    result = 1;
+end:
+    MimeDecDeInitParser(state);
+    return result;
+}
+
+/** \test nested multipart, the outer close delimiter ends the inner
+ *        body too */
+static int MimeDecTest03(void)
+{
+    int result = 0;
+    MimeDecTestFile tf;
+    memset(&tf, 0x00, sizeof(tf));
+    const char *lines[] = {
+        "Content-Type: multipart/mixed; boundary=outer",
+        "",
+        "--outer",
+        "Content-Type: multipart/alternative; boundary=\"inner\"",
+        "",
+        "--inner",
+        "Content-Type: text/plain",
+        "",
+        "text",
+        "--inner",
+        "Content-Disposition: attachment;",
+        "\tfilename=plain.txt",
+        "",
+        "line 1",
+        "--innerx",
+        "line 2",
+        "--outer--",
+        NULL };
+    const char *expect = "line 1\r\n--innerx\r\nline 2";
+
+    MimeDecParseState *state = MimeDecInitParser(&mime_test_cb, &tf);
+    if (state == NULL)
+        return 0;
+
+    MimeDecTestFeed(state, lines);
+    if (state->depth != 0) {
+        printf("depth %u, expected 0: ", state->depth);
+        goto end;
+    }
+    MimeDecParseComplete(state);
+
+    if (tf.opened != 1 || tf.closed != 1 || tf.truncated != 0) {
+        printf("opened %d closed %d truncated %d: ", tf.opened, tf.closed, tf.truncated);
+        goto end;
+    }
+    if (tf.name_len != 9 || memcmp(tf.name, "plain.txt", 9) != 0) {
+        printf("wrong file name: ");
+        goto end;
+    }
+    if (tf.len != strlen(expect) || memcmp(tf.buf, expect, tf.len) != 0) {
+        printf("wrong file content (%u bytes): ", tf.len);
+        goto end;
+    }
+    result = 1;
+end:
+    MimeDecDeInitParser(state);
+    return result;
+}
+
+/** \test data larger than the output buffer is passed in chunks, a
+ *        message without close delimiter truncates the file */
+static int MimeDecTest04(void)
+{
+    int result = 0;
+    MimeDecTestFile tf;
+    memset(&tf, 0x00, sizeof(tf));
+    const char *hdr[] = {
+        "Content-Type: multipart/mixed; boundary=b",
+        "",
+        "--b",
+        "Content-Type: application/octet-stream; name=zero.bin",
+        "Content-Transfer-Encoding: base64",
+        "",
+        NULL };
+    /* 76 chars, 57 zero bytes */
+    const char *line = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+    int i;
+
+    MimeDecParseState *state = MimeDecInitParser(&mime_test_cb, &tf);
+    if (state == NULL)
+        return 0;
+
+    MimeDecTestFeed(state, hdr);
+    for (i = 0; i < 200; i++) {
+        MimeDecParseLine(state, (const uint8_t *)line, strlen(line));
+    }
+    if (tf.chunks != (200 * 57) / MIME_CHUNK_SIZE) {
+        printf("%d chunks passed before the end: ", tf.chunks);
+        goto end;
+    }
+    MimeDecParseComplete(state);
+
+    if (tf.opened != 1 || tf.closed != 1 || tf.truncated != 1) {
+        printf("opened %d closed %d truncated %d: ", tf.opened, tf.closed, tf.truncated);
+        goto end;
+    }
+    if (tf.len != 200 * 57) {
+        printf("file len %u, expected %u: ", tf.len, 200 * 57);
+        goto end;
+    }
+    for (i = 0; i < (int)tf.len; i++) {
+        if (tf.buf[i] != 0) {
+            printf("wrong data at %d: ", i);
+            goto end;
+        }
+    }
+    result = 1;
+end:
+    MimeDecDeInitParser(state);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void MimeDecRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("MimeDecTest01", MimeDecTest01, 1);
+    UtRegisterTest("MimeDecTest02", MimeDecTest02, 1);
+    UtRegisterTest("MimeDecTest03", MimeDecTest03, 1);
+    UtRegisterTest("MimeDecTest04", MimeDecTest04, 1);
+#endif /* UNITTESTS */
+}
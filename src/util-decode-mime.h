@@ -0,0 +1,109 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Streaming MIME decoder. A message is fed line by line, attachments
+ * are decoded and handed to the caller in chunks of at most
+ * MIME_CHUNK_SIZE bytes.
+ */
+
+#ifndef __UTIL_DECODE_MIME_H__
+#define __UTIL_DECODE_MIME_H__
+
+/** max nesting of multipart bodies */
+#define MIME_MAX_DEPTH          8
+/** max boundary length, RFC 2046 */
+#define MIME_MAX_BOUNDARY_LEN   70
+/** max length of an unfolded header, longer headers are truncated */
+#define MIME_MAX_HEADER_LEN     1024
+/** max length of a file name, longer names are truncated */
+#define MIME_MAX_FILENAME_LEN   256
+/** size of the decoded chunks passed to the FileData callback */
+#define MIME_CHUNK_SIZE         4096
+
+/* content transfer encodings */
+#define MIME_ENC_NONE           0
+#define MIME_ENC_BASE64         1
+#define MIME_ENC_QP             2
+
+/* anomalies seen in the message */
+#define MIME_ANOM_INVALID_BASE64    0x01
+#define MIME_ANOM_INVALID_QP        0x02
+#define MIME_ANOM_LONG_HEADER       0x04
+#define MIME_ANOM_LONG_BOUNDARY     0x08
+#define MIME_ANOM_DEPTH_EXCEEDED    0x10
+#define MIME_ANOM_LONG_FILENAME     0x20
+
+/** file callbacks. A negative return value of FileOpen or FileData
+ *  stops the decoding of the current part. */
+typedef struct MimeDecCallbacks_ {
+    int (*FileOpen)(const uint8_t *name, uint16_t name_len, void *data);
+    int (*FileData)(const uint8_t *chunk, uint32_t len, void *data);
+    int (*FileClose)(int truncated, void *data);
+} MimeDecCallbacks;
+
+typedef struct MimeDecParseState_ {
+    /** MIME_STATE_* */
+    uint8_t state;
+    /** MIME_ENC_* of the current part */
+    uint8_t encoding;
+    /** file callbacks are open for the current part */
+    uint8_t in_file;
+    /** CRLF of the previous line, only output if it's not followed by a
+     *  boundary */
+    uint8_t crlf_pending;
+    /** MIME_ANOM_* */
+    uint32_t anomalies;
+
+    /** boundaries of the enclosing multipart bodies */
+    uint8_t depth;
+    uint8_t boundary_len[MIME_MAX_DEPTH];
+    uint8_t boundary[MIME_MAX_DEPTH][MIME_MAX_BOUNDARY_LEN];
+
+    /** header being collected, unfolded */
+    uint16_t hdr_len;
+    uint8_t hdr[MIME_MAX_HEADER_LEN];
+
+    /** boundary and file name from the headers of the current part */
+    uint8_t part_boundary_len;
+    uint8_t part_boundary[MIME_MAX_BOUNDARY_LEN];
+    uint16_t filename_len;
+    uint8_t filename[MIME_MAX_FILENAME_LEN];
+
+    /** incomplete base64 quantum */
+    uint8_t b64_len;
+    uint8_t b64[4];
+
+    /** decoded data not yet passed to FileData */
+    uint32_t out_len;
+    uint8_t out[MIME_CHUNK_SIZE];
+
+    const MimeDecCallbacks *cb;
+    void *data;
+} MimeDecParseState;
+
+MimeDecParseState *MimeDecInitParser(const MimeDecCallbacks *cb, void *data);
+void MimeDecDeInitParser(MimeDecParseState *state);
+int MimeDecParseLine(MimeDecParseState *state, const uint8_t *line,
+        uint32_t len);
+int MimeDecParseComplete(MimeDecParseState *state);
+
+void MimeDecRegisterTests(void);
+
+#endif /* __UTIL_DECODE_MIME_H__ */
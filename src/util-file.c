@@ -100,6 +100,7 @@ static int FileAppendFileDataFilePtr(File *ff, FileData *ffd)
         ff->chunks_tail->next = ffd;
         ff->chunks_tail = ffd;
     }
+    ff->chunks_memuse += sizeof(FileData) + ffd->len;
 
 #ifdef DEBUG
     ff->chunks_cnt++;
@@ -158,6 +159,7 @@ static void FilePruneFile(File *file)
             file->chunks_head = fd->next;
             if (file->chunks_tail == fd)
                 file->chunks_tail = fd->next;
+            file->chunks_memuse -= sizeof(FileData) + fd->len;
 
             FileDataFree(fd);
 
@@ -184,6 +186,28 @@ void FilePrune(FileContainer *ffc)
     }
 }
 
+/**
+ *  \brief get the memory held by the files in a container and their
+ *         chunks that are not pruned yet
+ *
+ *  \param ffc the container
+ *
+ *  \retval memuse in bytes
+ */
+uint32_t FileContainerGetMemuse(const FileContainer *ffc)
+{
+    uint32_t memuse = 0;
+    File *file;
+
+    if (ffc == NULL)
+        return 0;
+
+    for (file = ffc->head; file != NULL; file = file->next) {
+        memuse += sizeof(File) + file->name_len + file->chunks_memuse;
+    }
+    return memuse;
+}
+
 /**
  *  \brief allocate a FileContainer
  *
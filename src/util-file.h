@@ -69,6 +69,7 @@ typedef struct File_ {
     char *magic;
     FileData *chunks_head;
     FileData *chunks_tail;
+    uint32_t chunks_memuse;         /**< memory held by the chunks list */
     struct File_ *next;
 #ifdef HAVE_NSS
     HASHContext *md5_ctx;
@@ -92,6 +93,8 @@ void FileContainerRecycle(FileContainer *);
 
 void FileContainerAdd(FileContainer *, File *);
 
+uint32_t FileContainerGetMemuse(const FileContainer *);
+
 /**
  *  \brief Open a new File
  *
@@ -0,0 +1,452 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Streaming JSON encoder.
+ *
+ * Objects, arrays and values are serialized in the order they are added,
+ * directly into a (per thread) MemBuffer. No tree is built and nothing
+ * is allocated. The output matches what jansson produces with
+ * JSON_COMPACT|JSON_ENSURE_ASCII|JSON_ESCAPE_SLASH|JSON_PRESERVE_ORDER.
+ * Bytes that are not valid UTF-8 are escaped as if they were Latin-1.
+ *
+ * If the buffer runs out of space the builder is put in error state and
+ * all further calls are ignored.
+ */
+
+#include "suricata-common.h"
+#include "util-buffer.h"
+#include "util-json-builder.h"
+#include "util-unittest.h"
+
+static const char json_hex[] = "0123456789ABCDEF";
+
+static void JsonBuilderWrite(JsonBuilder *jb, const char *data, uint32_t len)
+{
+    MemBuffer *b = jb->buffer;
+
+    if (unlikely(jb->error))
+        return;
+
+    /* keep room for the terminating NUL */
+    if (unlikely(len >= b->size - b->offset)) {
+        jb->error = 1;
+        return;
+    }
+
+    memcpy(b->buffer + b->offset, data, len);
+    b->offset += len;
+    b->buffer[b->offset] = '\0';
+}
+
+/** \brief decode one UTF-8 sequence
+ *  \retval len length of the sequence, 0 if it's invalid */
+static uint32_t JsonBuilderUtf8Decode(const uint8_t *s, uint32_t len, uint32_t *cp)
+{
+    uint32_t n, u, i;
+
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        n = 2;
+        u = s[0] & 0x1F;
+    } else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        n = 3;
+        u = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        n = 4;
+        u = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (n > len)
+        return 0;
+
+    for (i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+        u = (u << 6) | (s[i] & 0x3F);
+    }
+
+    /* overlong, surrogate or out of range */
+    if ((n == 3 && u < 0x800) || (n == 4 && u < 0x10000) ||
+            (u >= 0xD800 && u <= 0xDFFF) || u > 0x10FFFF)
+        return 0;
+
+    *cp = u;
+    return n;
+}
+
+static void JsonBuilderWriteEscapedU16(JsonBuilder *jb, uint32_t u)
+{
+    char seq[6] = { '\\', 'u',
+        json_hex[(u >> 12) & 0xF], json_hex[(u >> 8) & 0xF],
+        json_hex[(u >> 4) & 0xF], json_hex[u & 0xF] };
+    JsonBuilderWrite(jb, seq, sizeof(seq));
+}
+
+/** \brief write a quoted and escaped string */
+static void JsonBuilderWriteString(JsonBuilder *jb, const uint8_t *s, uint32_t len)
+{
+    uint32_t start = 0;
+    uint32_t i = 0;
+
+    JsonBuilderWrite(jb, "\"", 1);
+
+    while (i < len) {
+        uint8_t c = s[i];
+
+        if (c >= 0x20 && c <= 0x7F && c != '"' && c != '\\' && c != '/') {
+            i++;
+            continue;
+        }
+
+        if (i > start)
+            JsonBuilderWrite(jb, (const char *)s + start, i - start);
+
+        uint32_t adv = 1;
+        switch (c) {
+            case '"':
+                JsonBuilderWrite(jb, "\\\"", 2);
+                break;
+            case '\\':
+                JsonBuilderWrite(jb, "\\\\", 2);
+                break;
+            case '/':
+                JsonBuilderWrite(jb, "\\/", 2);
+                break;
+            case '\b':
+                JsonBuilderWrite(jb, "\\b", 2);
+                break;
+            case '\f':
+                JsonBuilderWrite(jb, "\\f", 2);
+                break;
+            case '\n':
+                JsonBuilderWrite(jb, "\\n", 2);
+                break;
+            case '\r':
+                JsonBuilderWrite(jb, "\\r", 2);
+                break;
+            case '\t':
+                JsonBuilderWrite(jb, "\\t", 2);
+                break;
+            default:
+                if (c < 0x20) {
+                    JsonBuilderWriteEscapedU16(jb, c);
+                } else {
+                    uint32_t cp = 0;
+                    adv = JsonBuilderUtf8Decode(s + i, len - i, &cp);
+                    if (adv == 0) {
+                        /* not UTF-8, escape the byte itself */
+                        adv = 1;
+                        cp = c;
+                    }
+
+                    if (cp < 0x10000) {
+                        JsonBuilderWriteEscapedU16(jb, cp);
+                    } else {
+                        cp -= 0x10000;
+                        JsonBuilderWriteEscapedU16(jb, 0xD800 | (cp >> 10));
+                        JsonBuilderWriteEscapedU16(jb, 0xDC00 | (cp & 0x3FF));
+                    }
+                }
+                break;
+        }
+
+        i += adv;
+        start = i;
+    }
+
+    if (i > start)
+        JsonBuilderWrite(jb, (const char *)s + start, i - start);
+
+    JsonBuilderWrite(jb, "\"", 1);
+}
+
+/** \brief write the separator and, inside objects, the key */
+static void JsonBuilderMember(JsonBuilder *jb, const char *key)
+{
+    uint32_t bit = 1U << jb->depth;
+
+    if (jb->first & bit)
+        jb->first &= ~bit;
+    else
+        JsonBuilderWrite(jb, ",", 1);
+
+    if (key != NULL) {
+        JsonBuilderWriteString(jb, (const uint8_t *)key, strlen(key));
+        JsonBuilderWrite(jb, ":", 1);
+    }
+}
+
+static void JsonBuilderOpen(JsonBuilder *jb, const char *key, const char *c)
+{
+    if (unlikely(jb->depth >= JSON_BUILDER_MAX_DEPTH)) {
+        jb->error = 1;
+        return;
+    }
+
+    JsonBuilderMember(jb, key);
+    JsonBuilderWrite(jb, c, 1);
+
+    jb->depth++;
+    jb->first |= (1U << jb->depth);
+}
+
+static void JsonBuilderClose(JsonBuilder *jb, const char *c)
+{
+    if (unlikely(jb->depth == 0)) {
+        jb->error = 1;
+        return;
+    }
+
+    JsonBuilderWrite(jb, c, 1);
+    jb->first &= ~(1U << jb->depth);
+    jb->depth--;
+}
+
+/**
+ *  \brief Start a new record in buffer
+ *
+ *  Resets the buffer. The record is started with
+ *  JsonBuilderOpenObject(jb, NULL).
+ */
+void JsonBuilderInit(JsonBuilder *jb, MemBuffer *buffer)
+{
+    MemBufferReset(buffer);
+
+    jb->buffer = buffer;
+    jb->depth = 0;
+    jb->first = 1;
+    jb->error = 0;
+}
+
+/** \brief open an object, key is NULL for the top level object and
+ *         for objects in arrays */
+void JsonBuilderOpenObject(JsonBuilder *jb, const char *key)
+{
+    JsonBuilderOpen(jb, key, "{");
+}
+
+void JsonBuilderCloseObject(JsonBuilder *jb)
+{
+    JsonBuilderClose(jb, "}");
+}
+
+/** \brief open an array, key is NULL for arrays in arrays */
+void JsonBuilderOpenArray(JsonBuilder *jb, const char *key)
+{
+    JsonBuilderOpen(jb, key, "[");
+}
+
+void JsonBuilderCloseArray(JsonBuilder *jb)
+{
+    JsonBuilderClose(jb, "]");
+}
+
+/**
+ *  \brief add a string, key is NULL for array elements
+ *
+ *  Like json_string() a NULL val doesn't add anything.
+ */
+void JsonBuilderSetString(JsonBuilder *jb, const char *key, const char *val)
+{
+    if (val == NULL)
+        return;
+
+    JsonBuilderMember(jb, key);
+    JsonBuilderWriteString(jb, (const uint8_t *)val, strlen(val));
+}
+
+/** \brief add a string that is not NUL terminated, f.e. straight
+ *         from a packet or bstr */
+void JsonBuilderSetStringN(JsonBuilder *jb, const char *key,
+        const uint8_t *val, uint32_t val_len)
+{
+    if (val == NULL)
+        return;
+
+    JsonBuilderMember(jb, key);
+    JsonBuilderWriteString(jb, val, val_len);
+}
+
+void JsonBuilderSetInt(JsonBuilder *jb, const char *key, int64_t val)
+{
+    char str[24];
+    int len = snprintf(str, sizeof(str), "%"PRId64, val);
+
+    JsonBuilderMember(jb, key);
+    JsonBuilderWrite(jb, str, (uint32_t)len);
+}
+
+void JsonBuilderSetBool(JsonBuilder *jb, const char *key, int val)
+{
+    JsonBuilderMember(jb, key);
+    if (val)
+        JsonBuilderWrite(jb, "true", 4);
+    else
+        JsonBuilderWrite(jb, "false", 5);
+}
+
+/** \brief append data as is, f.e. the record separator after the
+ *         top level object */
+void JsonBuilderAppendRaw(JsonBuilder *jb, const char *data, uint32_t len)
+{
+    JsonBuilderWrite(jb, data, len);
+}
+
+/**
+ *  \brief save the current position
+ *
+ *  Used to build several records that share a common part, f.e. the
+ *  header, without rebuilding it.
+ */
+void JsonBuilderGetMark(const JsonBuilder *jb, JsonBuilderMark *mark)
+{
+    mark->offset = jb->buffer->offset;
+    mark->depth = jb->depth;
+    mark->first = jb->first;
+}
+
+/** \brief go back to a position saved with JsonBuilderGetMark() */
+void JsonBuilderRestoreMark(JsonBuilder *jb, const JsonBuilderMark *mark)
+{
+    jb->buffer->offset = mark->offset;
+    jb->buffer->buffer[mark->offset] = '\0';
+    jb->depth = mark->depth;
+    jb->first = mark->first;
+    jb->error = 0;
+}
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+static int JsonBuilderTest01(void)
+{
+    int result = 0;
+    JsonBuilder jb;
+    MemBuffer *buffer = MemBufferCreateNew(256);
+    if (buffer == NULL)
+        return 0;
+
+    JsonBuilderInit(&jb, buffer);
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderSetString(&jb, "a", "b");
+    JsonBuilderSetString(&jb, "skipped", NULL);
+    JsonBuilderSetInt(&jb, "int", -12);
+    JsonBuilderOpenObject(&jb, "obj");
+    JsonBuilderSetBool(&jb, "t", 1);
+    JsonBuilderSetBool(&jb, "f", 0);
+    JsonBuilderCloseObject(&jb);
+    JsonBuilderOpenArray(&jb, "arr");
+    JsonBuilderSetInt(&jb, NULL, 1);
+    JsonBuilderSetInt(&jb, NULL, 2);
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderCloseObject(&jb);
+    JsonBuilderCloseArray(&jb);
+    JsonBuilderCloseObject(&jb);
+
+    const char *expect = "{\"a\":\"b\",\"int\":-12,\"obj\":{\"t\":true,"
+        "\"f\":false},\"arr\":[1,2,{}]}";
+    if (jb.error || jb.depth != 0 || strcmp((char *)buffer->buffer, expect) != 0) {
+        printf("got \"%s\": ", buffer->buffer);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MemBufferFree(buffer);
+    return result;
+}
+
+/** \test escaping the way jansson does it */
+static int JsonBuilderTest02(void)
+{
+    int result = 0;
+    JsonBuilder jb;
+    MemBuffer *buffer = MemBufferCreateNew(256);
+    if (buffer == NULL)
+        return 0;
+
+    /* quote, backslash, slash, control chars, 2 and 4 byte UTF-8, an
+     * invalid byte and a NUL */
+    const uint8_t str[] = "q\"b\\s/\n\t\x01\xc3\xa9\xf0\x9f\x98\x80\xff" "a\0z";
+
+    JsonBuilderInit(&jb, buffer);
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderSetStringN(&jb, "k", str, sizeof(str) - 1);
+    JsonBuilderCloseObject(&jb);
+
+    const char *expect = "{\"k\":\"q\\\"b\\\\s\\/\\n\\t\\u0001\\u00E9"
+        "\\uD83D\\uDE00\\u00FFa\\u0000z\"}";
+    if (jb.error || strcmp((char *)buffer->buffer, expect) != 0) {
+        printf("got \"%s\" expected \"%s\": ", buffer->buffer, expect);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MemBufferFree(buffer);
+    return result;
+}
+
+/** \test marks and running out of space */
+static int JsonBuilderTest03(void)
+{
+    int result = 0;
+    JsonBuilder jb;
+    JsonBuilderMark mark;
+    MemBuffer *buffer = MemBufferCreateNew(32);
+    if (buffer == NULL)
+        return 0;
+
+    JsonBuilderInit(&jb, buffer);
+    JsonBuilderOpenObject(&jb, NULL);
+    JsonBuilderSetString(&jb, "a", "b");
+    JsonBuilderGetMark(&jb, &mark);
+
+    JsonBuilderSetString(&jb, "long", "0123456789012345678901234567890");
+    JsonBuilderCloseObject(&jb);
+    if (!jb.error)
+        goto end;
+
+    JsonBuilderRestoreMark(&jb, &mark);
+    JsonBuilderSetInt(&jb, "c", 1);
+    JsonBuilderCloseObject(&jb);
+    if (jb.error || strcmp((char *)buffer->buffer, "{\"a\":\"b\",\"c\":1}") != 0) {
+        printf("got \"%s\": ", buffer->buffer);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MemBufferFree(buffer);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void JsonBuilderRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("JsonBuilderTest01", JsonBuilderTest01, 1);
+    UtRegisterTest("JsonBuilderTest02", JsonBuilderTest02, 1);
+    UtRegisterTest("JsonBuilderTest03", JsonBuilderTest03, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Streaming JSON encoder writing straight into a MemBuffer.
+ */
+
+#ifndef __UTIL_JSON_BUILDER_H__
+#define __UTIL_JSON_BUILDER_H__
+
+#include "util-buffer.h"
+
+/** max nesting of objects and arrays */
+#define JSON_BUILDER_MAX_DEPTH 31
+
+typedef struct JsonBuilder_ {
+    MemBuffer *buffer;
+    /** current nesting level, 0 is outside of the top level object */
+    uint32_t depth;
+    /** bit per level: set while nothing was added at that level yet */
+    uint32_t first;
+    /** buffer was too small or nesting too deep, the output is
+     *  incomplete and must not be used */
+    int error;
+} JsonBuilder;
+
+/** saved builder position, see JsonBuilderGetMark() */
+typedef struct JsonBuilderMark_ {
+    uint32_t offset;
+    uint32_t depth;
+    uint32_t first;
+} JsonBuilderMark;
+
+void JsonBuilderInit(JsonBuilder *jb, MemBuffer *buffer);
+
+void JsonBuilderOpenObject(JsonBuilder *jb, const char *key);
+void JsonBuilderCloseObject(JsonBuilder *jb);
+void JsonBuilderOpenArray(JsonBuilder *jb, const char *key);
+void JsonBuilderCloseArray(JsonBuilder *jb);
+
+void JsonBuilderSetString(JsonBuilder *jb, const char *key, const char *val);
+void JsonBuilderSetStringN(JsonBuilder *jb, const char *key,
+        const uint8_t *val, uint32_t val_len);
+void JsonBuilderSetInt(JsonBuilder *jb, const char *key, int64_t val);
+void JsonBuilderSetBool(JsonBuilder *jb, const char *key, int val);
+void JsonBuilderAppendRaw(JsonBuilder *jb, const char *data, uint32_t len);
+
+void JsonBuilderGetMark(const JsonBuilder *jb, JsonBuilderMark *mark);
+void JsonBuilderRestoreMark(JsonBuilder *jb, const JsonBuilderMark *mark);
+
+void JsonBuilderRegisterTests(void);
+
+#endif /* __UTIL_JSON_BUILDER_H__ */
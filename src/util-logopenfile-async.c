@@ -0,0 +1,666 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Asynchronous LogFileCtx output.
+ *
+ * Every thread logging to an async LogFileCtx gets its own byte ring.
+ * A record is copied into the ring of the calling thread without taking
+ * any lock. The "LogFileWriter" management thread wakes up every flush
+ * interval (or earlier when a ring is filling up), collects the pending
+ * data of all rings and writes it out with a single writev() call per
+ * batch of rings. Records that do not fit in the ring are dropped and
+ * counted, the logging threads never block on the file.
+ */
+
+#include "suricata-common.h"
+#include "threads.h"
+#include "threadvars.h"
+#include "tm-threads.h"
+#include "conf.h"
+#include "counters.h"
+#include "util-atomic.h"
+#include "util-misc.h"
+#include "util-byte.h"
+#include "util-signal.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#include "util-logopenfile.h"
+#include "util-logopenfile-async.h"
+#include "util-logopenfile-compress.h"
+
+#include <sys/uio.h>
+
+/** default size of the per thread ring */
+#define LOGFILE_ASYNC_DEFAULT_BUFFER_SIZE   (1024 * 1024)
+/** default writer thread wake up interval in msec */
+#define LOGFILE_ASYNC_DEFAULT_FLUSH_INTERVAL 100
+
+/** max number of iovecs handed to a single writev() call. Each ring
+ *  needs at most 2: one up to the end of the buffer, one for the
+ *  wrapped part. */
+#define LOGFILE_ASYNC_MAX_IOV               64
+
+/** per thread ring. head is only updated by the logging thread that
+ *  owns the ring, tail only by the thread holding the rings_lock. */
+typedef struct LogFileRing_ {
+    uint8_t *buf;
+    uint32_t size;
+    SC_ATOMIC_DECLARE(uint64_t, head);  /**< total bytes produced */
+    SC_ATOMIC_DECLARE(uint64_t, tail);  /**< total bytes written out */
+    struct LogFileRing_ *next;
+} LogFileRing;
+
+typedef struct LogFileAsyncCtx_ {
+    LogFileCtx *file_ctx;
+
+    /** lookup of the ring of the calling thread */
+    pthread_key_t ring_key;
+
+    uint32_t ring_size;
+    uint32_t flush_interval;
+
+    /** protects the ring list and serializes the draining */
+    SCMutex rings_lock;
+    LogFileRing *rings;
+
+    SC_ATOMIC_DECLARE(uint64_t, drops);
+
+    struct LogFileAsyncCtx_ *next;
+} LogFileAsyncCtx;
+
+/** list of all async ctxs, walked by the writer thread */
+static LogFileAsyncCtx *async_list = NULL;
+static SCMutex async_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** shortest flush interval of all async ctxs in msec */
+static uint32_t writer_flush_interval = LOGFILE_ASYNC_DEFAULT_FLUSH_INTERVAL;
+/** set while the writer thread is running. If it's not, the logging
+ *  threads drain their rings themselves. */
+static int writer_running = 0;
+
+static SCCtrlCondT writer_ctrl_cond;
+static SCCtrlMutex writer_ctrl_mutex;
+
+typedef struct LogFileWriterThreadData_ {
+    uint16_t counter_queue_depth;
+    uint16_t counter_drops;
+    uint16_t counter_writes;
+} LogFileWriterThreadData;
+
+static void LogFileWriterWakeup(void)
+{
+    if (writer_running)
+        SCCtrlCondSignal(&writer_ctrl_cond);
+}
+
+static LogFileRing *LogFileAsyncRingNew(LogFileAsyncCtx *actx)
+{
+    LogFileRing *ring = SCMalloc(sizeof(LogFileRing));
+    if (unlikely(ring == NULL))
+        return NULL;
+    memset(ring, 0, sizeof(LogFileRing));
+
+    ring->buf = SCMalloc(actx->ring_size);
+    if (unlikely(ring->buf == NULL)) {
+        SCFree(ring);
+        return NULL;
+    }
+    ring->size = actx->ring_size;
+    SC_ATOMIC_INIT(ring->head);
+    SC_ATOMIC_INIT(ring->tail);
+
+    SCMutexLock(&actx->rings_lock);
+    ring->next = actx->rings;
+    actx->rings = ring;
+    SCMutexUnlock(&actx->rings_lock);
+
+    pthread_setspecific(actx->ring_key, ring);
+    return ring;
+}
+
+static void LogFileAsyncRingFree(LogFileRing *ring)
+{
+    SC_ATOMIC_DESTROY(ring->head);
+    SC_ATOMIC_DESTROY(ring->tail);
+    SCFree(ring->buf);
+    SCFree(ring);
+}
+
+/** \brief writev() all of iov, dealing with short writes */
+static int LogFileAsyncWritev(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t r = writev(fd, iov, iovcnt);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  \brief write out all pending data of the rings of an async ctx
+ *
+ *  \param writes incremented for each writev batch, may be NULL
+ *
+ *  \retval depth number of bytes that were pending
+ */
+static uint64_t LogFileAsyncFlush(LogFileAsyncCtx *actx, uint64_t *writes)
+{
+    struct iovec iov[LOGFILE_ASYNC_MAX_IOV];
+    LogFileRing *batch[LOGFILE_ASYNC_MAX_IOV / 2];
+    uint64_t heads[LOGFILE_ASYNC_MAX_IOV / 2];
+    LogFileCtx *file_ctx = actx->file_ctx;
+    uint64_t depth = 0;
+
+    SCMutexLock(&actx->rings_lock);
+
+    /* only the draining thread touches the file, so handle the
+     * rotation here */
+    if (file_ctx->rotation_flag) {
+        file_ctx->rotation_flag = 0;
+        SCConfLogReopen(file_ctx);
+    }
+    int fd = file_ctx->fp ? fileno(file_ctx->fp) : -1;
+
+    LogFileRing *ring = actx->rings;
+    while (ring != NULL) {
+        int iovcnt = 0;
+        int nrings = 0;
+        uint64_t batch_len = 0;
+
+        /* rotate between batches, so records are never split over
+         * two files */
+        if (file_ctx->Rotate != NULL && file_ctx->size_limit > 0 &&
+                file_ctx->size_current >= file_ctx->size_limit) {
+            if (file_ctx->Rotate(file_ctx) < 0) {
+                SCLogWarning(SC_ERR_FOPEN, "rotating \"%s\" failed",
+                        file_ctx->filename ? file_ctx->filename : "(null)");
+            }
+            fd = file_ctx->fp ? fileno(file_ctx->fp) : -1;
+        }
+
+        for ( ; ring != NULL && nrings < (LOGFILE_ASYNC_MAX_IOV / 2); ring = ring->next) {
+            uint64_t head = SC_ATOMIC_GET(ring->head);
+            uint64_t tail = SC_ATOMIC_GET(ring->tail);
+            if (head == tail)
+                continue;
+
+            uint64_t len = head - tail;
+            uint32_t start = (uint32_t)(tail % ring->size);
+            uint32_t first = ring->size - start;
+            if (len < first)
+                first = (uint32_t)len;
+
+            iov[iovcnt].iov_base = ring->buf + start;
+            iov[iovcnt].iov_len = first;
+            iovcnt++;
+            if (len > first) {
+                iov[iovcnt].iov_base = ring->buf;
+                iov[iovcnt].iov_len = len - first;
+                iovcnt++;
+            }
+
+            batch[nrings] = ring;
+            heads[nrings] = head;
+            nrings++;
+            depth += len;
+            batch_len += len;
+        }
+
+        if (nrings == 0)
+            break;
+
+        if (file_ctx->compress != NULL) {
+            /* compress here, off the logging threads */
+            int i;
+            for (i = 0; i < iovcnt; i++) {
+                (void) LogFileCompressAppend(file_ctx, iov[i].iov_base,
+                        iov[i].iov_len);
+            }
+            if (writes != NULL)
+                (*writes)++;
+        } else if (fd >= 0) {
+            if (LogFileAsyncWritev(fd, iov, iovcnt) < 0) {
+                SCLogWarning(SC_ERR_FWRITE, "writing to \"%s\" failed: %s",
+                        file_ctx->filename ? file_ctx->filename : "(null)",
+                        strerror(errno));
+            } else {
+                file_ctx->size_current += batch_len;
+            }
+            if (writes != NULL)
+                (*writes)++;
+        }
+
+        /* release the space, also on error so the logging threads
+         * don't get stuck on a full ring */
+        int i;
+        for (i = 0; i < nrings; i++) {
+            SC_ATOMIC_SET(batch[i]->tail, heads[i]);
+        }
+    }
+
+    /* make what was compressed so far readable, also when no new
+     * records come in */
+    LogFileCompressSync(file_ctx, 0);
+
+    SCMutexUnlock(&actx->rings_lock);
+    return depth;
+}
+
+/**
+ *  \brief Write callback for async LogFileCtx's
+ *
+ *  Copies the record into the ring of the calling thread. Doesn't
+ *  need the fp_mutex.
+ *
+ *  \retval 1 record queued
+ *  \retval 0 record dropped
+ */
+static int LogFileAsyncWrite(const char *buffer, int buffer_len, LogFileCtx *file_ctx)
+{
+    LogFileAsyncCtx *actx = file_ctx->async;
+
+    if (unlikely(buffer_len <= 0))
+        return 0;
+
+    LogFileRing *ring = pthread_getspecific(actx->ring_key);
+    if (unlikely(ring == NULL)) {
+        ring = LogFileAsyncRingNew(actx);
+        if (ring == NULL) {
+            (void) SC_ATOMIC_ADD(actx->drops, 1);
+            return 0;
+        }
+    }
+
+    uint64_t head = SC_ATOMIC_GET(ring->head);
+    uint64_t tail = SC_ATOMIC_GET(ring->tail);
+    if ((uint64_t)buffer_len > ring->size - (head - tail)) {
+        if (writer_running) {
+            (void) SC_ATOMIC_ADD(actx->drops, 1);
+            LogFileWriterWakeup();
+            return 0;
+        }
+
+        /* no writer thread, drain ourselves */
+        (void) LogFileAsyncFlush(actx, NULL);
+        tail = SC_ATOMIC_GET(ring->tail);
+        if ((uint64_t)buffer_len > ring->size - (head - tail)) {
+            (void) SC_ATOMIC_ADD(actx->drops, 1);
+            return 0;
+        }
+    }
+
+    uint32_t start = (uint32_t)(head % ring->size);
+    uint32_t first = ring->size - start;
+    if ((uint32_t)buffer_len < first)
+        first = (uint32_t)buffer_len;
+    memcpy(ring->buf + start, buffer, first);
+    if ((uint32_t)buffer_len > first)
+        memcpy(ring->buf, buffer + first, buffer_len - first);
+
+    /* publish the record */
+    SC_ATOMIC_SET(ring->head, head + buffer_len);
+
+    if (head + buffer_len - tail > ring->size / 2)
+        LogFileWriterWakeup();
+
+    return 1;
+}
+
+/**
+ *  \brief Setup async output for a LogFileCtx if configured
+ *
+ *  Reads "async", "async-buffer-size" and "async-flush-interval" from
+ *  the output's config node. The file needs to be opened already.
+ *
+ *  \retval 1 async output enabled
+ *  \retval 0 async output not configured
+ *  \retval -1 error
+ */
+int LogFileAsyncSetup(ConfNode *conf, LogFileCtx *file_ctx)
+{
+    if (conf == NULL || file_ctx == NULL)
+        return 0;
+
+    if (!ConfNodeChildValueIsTrue(conf, "async"))
+        return 0;
+
+    uint32_t ring_size = LOGFILE_ASYNC_DEFAULT_BUFFER_SIZE;
+    const char *size_s = ConfNodeLookupChildValue(conf, "async-buffer-size");
+    if (size_s != NULL) {
+        if (ParseSizeStringU32(size_s, &ring_size) < 0 || ring_size == 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid async-buffer-size "
+                    "setting \"%s\"", size_s);
+            return -1;
+        }
+    }
+
+    uint32_t flush_interval = LOGFILE_ASYNC_DEFAULT_FLUSH_INTERVAL;
+    const char *interval_s = ConfNodeLookupChildValue(conf, "async-flush-interval");
+    if (interval_s != NULL) {
+        if (ByteExtractStringUint32(&flush_interval, 10, 0, interval_s) <= 0 ||
+                flush_interval == 0) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid async-flush-interval "
+                    "setting \"%s\"", interval_s);
+            return -1;
+        }
+    }
+
+    LogFileAsyncCtx *actx = SCMalloc(sizeof(LogFileAsyncCtx));
+    if (unlikely(actx == NULL))
+        return -1;
+    memset(actx, 0, sizeof(LogFileAsyncCtx));
+
+    if (pthread_key_create(&actx->ring_key, NULL) != 0) {
+        SCFree(actx);
+        return -1;
+    }
+    SCMutexInit(&actx->rings_lock, NULL);
+    SC_ATOMIC_INIT(actx->drops);
+    actx->ring_size = ring_size;
+    actx->flush_interval = flush_interval;
+    actx->file_ctx = file_ctx;
+
+    file_ctx->async = actx;
+    file_ctx->Write = LogFileAsyncWrite;
+
+    SCMutexLock(&async_list_lock);
+    actx->next = async_list;
+    async_list = actx;
+    if (flush_interval < writer_flush_interval)
+        writer_flush_interval = flush_interval;
+    SCMutexUnlock(&async_list_lock);
+
+    SCLogInfo("async output for \"%s\": %"PRIu32" bytes per thread, "
+            "flushed every %"PRIu32"ms", file_ctx->filename ? file_ctx->filename :
+            "(null)", ring_size, flush_interval);
+    return 1;
+}
+
+/**
+ *  \brief Write out whatever is pending and free the async part of a
+ *         LogFileCtx. Called before the file is closed.
+ */
+void LogFileAsyncFree(LogFileCtx *file_ctx)
+{
+    LogFileAsyncCtx *actx = file_ctx->async;
+    if (actx == NULL)
+        return;
+
+    /* unlink, after this the writer thread won't touch it anymore */
+    SCMutexLock(&async_list_lock);
+    LogFileAsyncCtx **pactx = &async_list;
+    while (*pactx != NULL) {
+        if (*pactx == actx) {
+            *pactx = actx->next;
+            break;
+        }
+        pactx = &(*pactx)->next;
+    }
+    SCMutexUnlock(&async_list_lock);
+
+    (void) LogFileAsyncFlush(actx, NULL);
+
+    uint64_t drops = SC_ATOMIC_GET(actx->drops);
+    if (drops > 0) {
+        SCLogInfo("async output for \"%s\" dropped %"PRIu64" records",
+                file_ctx->filename ? file_ctx->filename : "(null)", drops);
+    }
+
+    LogFileRing *ring = actx->rings;
+    while (ring != NULL) {
+        LogFileRing *next = ring->next;
+        LogFileAsyncRingFree(ring);
+        ring = next;
+    }
+
+    pthread_key_delete(actx->ring_key);
+    SCMutexDestroy(&actx->rings_lock);
+    SC_ATOMIC_DESTROY(actx->drops);
+    SCFree(actx);
+
+    file_ctx->async = NULL;
+}
+
+/** \brief flush all async ctxs, updating the writer counters if tv is set */
+static void LogFileWriterFlushAll(ThreadVars *tv, LogFileWriterThreadData *td)
+{
+    uint64_t depth = 0;
+    uint64_t drops = 0;
+    uint64_t writes = 0;
+
+    SCMutexLock(&async_list_lock);
+    LogFileAsyncCtx *actx = async_list;
+    for ( ; actx != NULL; actx = actx->next) {
+        depth += LogFileAsyncFlush(actx, &writes);
+        drops += SC_ATOMIC_GET(actx->drops);
+    }
+    SCMutexUnlock(&async_list_lock);
+
+    if (tv != NULL && td != NULL) {
+        SCPerfCounterSetUI64(td->counter_queue_depth, tv->sc_perf_pca, depth);
+        SCPerfCounterSetUI64(td->counter_drops, tv->sc_perf_pca, drops);
+        SCPerfCounterAddUI64(td->counter_writes, tv->sc_perf_pca, writes);
+    }
+}
+
+static TmEcode LogFileWriterThreadInit(ThreadVars *t, void *initdata, void **data)
+{
+    LogFileWriterThreadData *td = SCCalloc(1, sizeof(LogFileWriterThreadData));
+    if (td == NULL)
+        return TM_ECODE_FAILED;
+
+    td->counter_queue_depth = SCPerfTVRegisterCounter("logfile.queue_depth", t,
+            SC_PERF_TYPE_UINT64, "NULL");
+    td->counter_drops = SCPerfTVRegisterCounter("logfile.drops", t,
+            SC_PERF_TYPE_UINT64, "NULL");
+    td->counter_writes = SCPerfTVRegisterCounter("logfile.writes", t,
+            SC_PERF_TYPE_UINT64, "NULL");
+
+    *data = td;
+    return TM_ECODE_OK;
+}
+
+static TmEcode LogFileWriterThreadDeinit(ThreadVars *t, void *data)
+{
+    if (data != NULL)
+        SCFree(data);
+    return TM_ECODE_OK;
+}
+
+/** \brief writer thread: drain the rings every flush interval */
+static TmEcode LogFileWriter(ThreadVars *th_v, void *thread_data)
+{
+    /* block usr2. usr2 to be handled by the main thread only */
+    UtilSignalBlock(SIGUSR2);
+
+    LogFileWriterThreadData *td = (LogFileWriterThreadData *)thread_data;
+    struct timeval tv;
+    struct timespec cond_time;
+
+    while (1)
+    {
+        if (TmThreadsCheckFlag(th_v, THV_PAUSE)) {
+            TmThreadsSetFlag(th_v, THV_PAUSED);
+            TmThreadTestThreadUnPaused(th_v);
+            TmThreadsUnsetFlag(th_v, THV_PAUSED);
+        }
+
+        LogFileWriterFlushAll(th_v, td);
+
+        if (TmThreadsCheckFlag(th_v, THV_KILL)) {
+            /* logging threads are gone by now, write out the rest */
+            writer_running = 0;
+            LogFileWriterFlushAll(th_v, td);
+            SCPerfSyncCounters(th_v);
+            break;
+        }
+
+        gettimeofday(&tv, NULL);
+        uint64_t nsec = (uint64_t)tv.tv_usec * 1000 +
+            (uint64_t)writer_flush_interval * 1000000;
+        cond_time.tv_sec = tv.tv_sec + (nsec / 1000000000);
+        cond_time.tv_nsec = nsec % 1000000000;
+
+        SCCtrlMutexLock(&writer_ctrl_mutex);
+        SCCtrlCondTimedwait(&writer_ctrl_cond, &writer_ctrl_mutex, &cond_time);
+        SCCtrlMutexUnlock(&writer_ctrl_mutex);
+
+        SCPerfSyncCountersIfSignalled(th_v);
+    }
+
+    return TM_ECODE_OK;
+}
+
+void TmModuleLogFileWriterRegister(void)
+{
+    tmm_modules[TMM_LOGFILEWRITER].name = "LogFileWriter";
+    tmm_modules[TMM_LOGFILEWRITER].ThreadInit = LogFileWriterThreadInit;
+    tmm_modules[TMM_LOGFILEWRITER].ThreadDeinit = LogFileWriterThreadDeinit;
+    tmm_modules[TMM_LOGFILEWRITER].Management = LogFileWriter;
+    tmm_modules[TMM_LOGFILEWRITER].RegisterTests = LogFileAsyncRegisterTests;
+    tmm_modules[TMM_LOGFILEWRITER].cap_flags = 0;
+    tmm_modules[TMM_LOGFILEWRITER].flags = TM_FLAG_MANAGEMENT_TM;
+    SCLogDebug("%s registered", tmm_modules[TMM_LOGFILEWRITER].name);
+}
+
+/** \brief spawn the writer thread if any output uses async mode */
+void LogFileWriterThreadSpawn(void)
+{
+    SCMutexLock(&async_list_lock);
+    int needed = (async_list != NULL);
+    SCMutexUnlock(&async_list_lock);
+
+    if (!needed)
+        return;
+
+    SCCtrlCondInit(&writer_ctrl_cond, NULL);
+    SCCtrlMutexInit(&writer_ctrl_mutex, NULL);
+
+    ThreadVars *tv_writer = TmThreadCreateMgmtThreadByName("LogFileWriter",
+            "LogFileWriter", 0);
+    if (tv_writer == NULL) {
+        SCLogError(SC_ERR_THREAD_CREATE, "creating the log file writer thread failed");
+        exit(EXIT_FAILURE);
+    }
+    TmThreadSetCPU(tv_writer, MANAGEMENT_CPU_SET);
+
+    writer_running = 1;
+    if (TmThreadSpawn(tv_writer) != TM_ECODE_OK) {
+        SCLogError(SC_ERR_THREAD_SPAWN, "spawning the log file writer thread failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+/**
+ *  \test records are queued per thread, dropped when the ring is full
+ *        and written out in order by the flush.
+ */
+static int LogFileAsyncTest01(void)
+{
+    int result = 0;
+    char out[64];
+    LogFileCtx *file_ctx = NULL;
+    ConfNode *conf = NULL;
+
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    file_ctx->fp = tmpfile();
+    if (file_ctx->fp == NULL)
+        goto end;
+
+    conf = ConfNodeNew();
+    if (conf == NULL)
+        goto end;
+    ConfNode *node = ConfNodeNew();
+    node->name = SCStrdup("async");
+    node->val = SCStrdup("yes");
+    TAILQ_INSERT_TAIL(&conf->head, node, next);
+    node = ConfNodeNew();
+    node->name = SCStrdup("async-buffer-size");
+    node->val = SCStrdup("16");
+    TAILQ_INSERT_TAIL(&conf->head, node, next);
+
+    if (LogFileAsyncSetup(conf, file_ctx) != 1)
+        goto end;
+
+    /* the writer thread isn't running in unittest mode, so a full ring
+     * is drained by the writing thread itself */
+    if (file_ctx->Write("abcdef\n", 7, file_ctx) != 1)
+        goto end;
+    if (file_ctx->Write("ghijkl\n", 7, file_ctx) != 1)
+        goto end;
+    /* larger than the ring */
+    if (file_ctx->Write("0123456789abcdefgh\n", 19, file_ctx) != 0)
+        goto end;
+    if (SC_ATOMIC_GET(file_ctx->async->drops) != 1)
+        goto end;
+    if (file_ctx->Write("mnopqr\n", 7, file_ctx) != 1)
+        goto end;
+
+    /* last record is wrapped around the end of the ring */
+    if (LogFileAsyncFlush(file_ctx->async, NULL) != 7)
+        goto end;
+
+    rewind(file_ctx->fp);
+    memset(out, 0, sizeof(out));
+    if (fread(out, 1, sizeof(out) - 1, file_ctx->fp) != 21)
+        goto end;
+    if (strcmp(out, "abcdef\nghijkl\nmnopqr\n") != 0) {
+        printf("unexpected output \"%s\": ", out);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (conf != NULL)
+        ConfNodeFree(conf);
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void LogFileAsyncRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("LogFileAsyncTest01", LogFileAsyncTest01, 1);
+#endif /* UNITTESTS */
+}
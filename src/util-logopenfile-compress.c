@@ -0,0 +1,647 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Compressed LogFileCtx output.
+ *
+ * Records are fed into a gzip (zlib) or lz4 frame stream per file. The
+ * stream is sync flushed at most once per LOGFILE_COMPRESS_SYNC_INTERVAL
+ * so the file can be followed while it's written, and finished before
+ * the file is closed or reopened for rotation. A stream is only started
+ * by the first record, so an unused file stays empty.
+ *
+ * Together with async output the compression happens in the writer
+ * thread instead of the logging threads, which also does the sync
+ * flushes. Without it, the flow manager calls LogFileCompressSyncAll()
+ * so the files are flushed when no new records come in.
+ */
+
+#include "suricata-common.h"
+#include "conf.h"
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#include "util-logopenfile.h"
+#include "util-logopenfile-compress.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+/** min seconds between two sync flushes of a stream */
+#define LOGFILE_COMPRESS_SYNC_INTERVAL  1
+
+/** input is handed to the lz4 compressor in chunks of at most this size,
+ *  which bounds the size of the output buffer */
+#define LOGFILE_COMPRESS_LZ4_CHUNK      65536
+
+#define LOGFILE_COMPRESS_GZIP_OUT_SIZE  65536
+
+enum {
+    LOGFILE_COMPRESS_GZIP = 1,
+    LOGFILE_COMPRESS_LZ4,
+};
+
+typedef struct LogFileCompressCtx_ {
+    int type;
+
+    /** stream was started and needs to be finished */
+    int started;
+    /** data was compressed since the last sync flush */
+    int dirty;
+    time_t last_sync;
+
+    uint8_t *out;
+    size_t out_size;
+
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+
+    /** file this belongs to, for LogFileCompressSyncAll() */
+    LogFileCtx *file_ctx;
+    TAILQ_ENTRY(LogFileCompressCtx_) next;
+
+#ifdef HAVE_LIBZ
+    z_stream zs;
+#endif
+#ifdef HAVE_LIBLZ4
+    LZ4F_compressionContext_t lz4;
+    LZ4F_preferences_t lz4_prefs;
+#endif
+} LogFileCompressCtx;
+
+/** all compressed files, for LogFileCompressSyncAll() */
+static TAILQ_HEAD(, LogFileCompressCtx_) compress_list =
+    TAILQ_HEAD_INITIALIZER(compress_list);
+static SCMutex compress_list_lock = SCMUTEX_INITIALIZER;
+
+static void LogFileCompressOutput(LogFileCtx *file_ctx, const uint8_t *data,
+        size_t len)
+{
+    if (len == 0)
+        return;
+    if (fwrite(data, len, 1, file_ctx->fp) != 1) {
+        SCLogDebug("writing compressed data to \"%s\" failed",
+                file_ctx->filename ? file_ctx->filename : "(null)");
+    }
+    file_ctx->compress->bytes_out += len;
+}
+
+#ifdef HAVE_LIBZ
+/** \brief run deflate until it has no more output for this flush mode */
+static void LogFileCompressDeflate(LogFileCtx *file_ctx, int flush)
+{
+    LogFileCompressCtx *cctx = file_ctx->compress;
+
+    do {
+        cctx->zs.next_out = cctx->out;
+        cctx->zs.avail_out = cctx->out_size;
+        if (deflate(&cctx->zs, flush) == Z_STREAM_ERROR)
+            return;
+        LogFileCompressOutput(file_ctx, cctx->out,
+                cctx->out_size - cctx->zs.avail_out);
+    } while (cctx->zs.avail_out == 0);
+}
+#endif /* HAVE_LIBZ */
+
+#ifdef HAVE_LIBLZ4
+static void LogFileCompressLz4Result(LogFileCtx *file_ctx, size_t r)
+{
+    if (LZ4F_isError(r)) {
+        SCLogDebug("lz4 compression for \"%s\" failed: %s",
+                file_ctx->filename ? file_ctx->filename : "(null)",
+                LZ4F_getErrorName(r));
+        return;
+    }
+    LogFileCompressOutput(file_ctx, file_ctx->compress->out, r);
+}
+#endif /* HAVE_LIBLZ4 */
+
+/**
+ *  \brief compress a record into the file's stream
+ *
+ *  Doesn't handle rotation, the caller needs to hold whatever
+ *  serializes the writes to the file.
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+int LogFileCompressAppend(LogFileCtx *file_ctx, const char *buffer, size_t len)
+{
+    LogFileCompressCtx *cctx = file_ctx->compress;
+
+    if (cctx == NULL || file_ctx->fp == NULL)
+        return -1;
+    if (len == 0)
+        return 0;
+
+    cctx->bytes_in += len;
+
+    switch (cctx->type) {
+#ifdef HAVE_LIBZ
+        case LOGFILE_COMPRESS_GZIP:
+            cctx->zs.next_in = (Bytef *)buffer;
+            cctx->zs.avail_in = (uInt)len;
+            LogFileCompressDeflate(file_ctx, Z_NO_FLUSH);
+            break;
+#endif
+#ifdef HAVE_LIBLZ4
+        case LOGFILE_COMPRESS_LZ4:
+            if (!cctx->started) {
+                LogFileCompressLz4Result(file_ctx, LZ4F_compressBegin(cctx->lz4,
+                            cctx->out, cctx->out_size, &cctx->lz4_prefs));
+            }
+            while (len > 0) {
+                size_t chunk = len < LOGFILE_COMPRESS_LZ4_CHUNK ?
+                    len : LOGFILE_COMPRESS_LZ4_CHUNK;
+                LogFileCompressLz4Result(file_ctx, LZ4F_compressUpdate(cctx->lz4,
+                            cctx->out, cctx->out_size, buffer, chunk, NULL));
+                buffer += chunk;
+                len -= chunk;
+            }
+            break;
+#endif
+        default:
+            return -1;
+    }
+
+    cctx->started = 1;
+    cctx->dirty = 1;
+
+    LogFileCompressSync(file_ctx, 0);
+    return 0;
+}
+
+/**
+ *  \brief sync flush the stream, so all records compressed so far can
+ *         be decompressed from the file
+ *
+ *  \param force flush even if the last flush was less than
+ *               LOGFILE_COMPRESS_SYNC_INTERVAL ago
+ */
+void LogFileCompressSync(LogFileCtx *file_ctx, int force)
+{
+    LogFileCompressCtx *cctx = file_ctx->compress;
+
+    if (cctx == NULL || !cctx->dirty || file_ctx->fp == NULL)
+        return;
+
+    time_t now = time(NULL);
+    if (!force && now - cctx->last_sync < LOGFILE_COMPRESS_SYNC_INTERVAL)
+        return;
+
+    switch (cctx->type) {
+#ifdef HAVE_LIBZ
+        case LOGFILE_COMPRESS_GZIP:
+            LogFileCompressDeflate(file_ctx, Z_SYNC_FLUSH);
+            break;
+#endif
+#ifdef HAVE_LIBLZ4
+        case LOGFILE_COMPRESS_LZ4:
+            LogFileCompressLz4Result(file_ctx, LZ4F_flush(cctx->lz4,
+                        cctx->out, cctx->out_size, NULL));
+            break;
+#endif
+    }
+    fflush(file_ctx->fp);
+
+    cctx->dirty = 0;
+    cctx->last_sync = now;
+}
+
+/**
+ *  \brief finish the stream, writing out its trailer. Must be called
+ *         before the file is closed. The next record starts a new
+ *         stream.
+ */
+void LogFileCompressFinish(LogFileCtx *file_ctx)
+{
+    LogFileCompressCtx *cctx = file_ctx->compress;
+
+    if (cctx == NULL || !cctx->started || file_ctx->fp == NULL)
+        return;
+
+    switch (cctx->type) {
+#ifdef HAVE_LIBZ
+        case LOGFILE_COMPRESS_GZIP:
+            cctx->zs.next_in = NULL;
+            cctx->zs.avail_in = 0;
+            LogFileCompressDeflate(file_ctx, Z_FINISH);
+            deflateReset(&cctx->zs);
+            break;
+#endif
+#ifdef HAVE_LIBLZ4
+        case LOGFILE_COMPRESS_LZ4:
+            LogFileCompressLz4Result(file_ctx, LZ4F_compressEnd(cctx->lz4,
+                        cctx->out, cctx->out_size, NULL));
+            break;
+#endif
+    }
+    fflush(file_ctx->fp);
+
+    cctx->started = 0;
+    cctx->dirty = 0;
+}
+
+/**
+ *  \brief sync flush the compressed files that didn't get a record for
+ *         LOGFILE_COMPRESS_SYNC_INTERVAL, so their tail is readable on
+ *         an idle link. Files using async output are skipped, their
+ *         writer thread does this.
+ *
+ *  Called periodically by the flow manager.
+ */
+void LogFileCompressSyncAll(void)
+{
+    LogFileCompressCtx *cctx;
+
+    SCMutexLock(&compress_list_lock);
+    TAILQ_FOREACH(cctx, &compress_list, next) {
+        LogFileCtx *file_ctx = cctx->file_ctx;
+
+        if (file_ctx->async != NULL)
+            continue;
+
+        /* a logging thread is writing, it'll do the flush itself */
+        if (SCMutexTrylock(&file_ctx->fp_mutex) != 0)
+            continue;
+        LogFileCompressSync(file_ctx, 0);
+        SCMutexUnlock(&file_ctx->fp_mutex);
+    }
+    SCMutexUnlock(&compress_list_lock);
+}
+
+/**
+ *  \brief Write callback for compressed LogFileCtx's
+ */
+static int LogFileCompressWrite(const char *buffer, int buffer_len, LogFileCtx *file_ctx)
+{
+    /* Check for rotation. */
+    if (file_ctx->rotation_flag) {
+        file_ctx->rotation_flag = 0;
+        SCConfLogReopen(file_ctx);
+    }
+
+    if (buffer_len <= 0 || file_ctx->fp == NULL)
+        return 0;
+
+    return (LogFileCompressAppend(file_ctx, buffer, (size_t)buffer_len) == 0);
+}
+
+/**
+ *  \brief Setup compressed output for a LogFileCtx if configured
+ *
+ *  Reads "compression" ("gzip", "lz4" or "none") and "compression-level"
+ *  from the output's config node. Only regular files can be compressed.
+ *
+ *  \retval 1 compression enabled
+ *  \retval 0 compression not configured
+ *  \retval -1 error
+ */
+int LogFileCompressSetup(ConfNode *conf, LogFileCtx *file_ctx)
+{
+    if (conf == NULL || file_ctx == NULL)
+        return 0;
+
+    const char *type_s = ConfNodeLookupChildValue(conf, "compression");
+    if (type_s == NULL || strcasecmp(type_s, "none") == 0)
+        return 0;
+
+    int type;
+    if (strcasecmp(type_s, "gzip") == 0) {
+#ifndef HAVE_LIBZ
+        SCLogError(SC_ERR_NOT_SUPPORTED, "gzip compression of log files "
+                "requires zlib, which was not available at build time");
+        return -1;
+#endif
+        type = LOGFILE_COMPRESS_GZIP;
+    } else if (strcasecmp(type_s, "lz4") == 0) {
+#ifndef HAVE_LIBLZ4
+        SCLogError(SC_ERR_NOT_SUPPORTED, "lz4 compression of log files "
+                "requires liblz4, which was not available at build time");
+        return -1;
+#endif
+        type = LOGFILE_COMPRESS_LZ4;
+    } else {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid compression "
+                "setting \"%s\": expected \"gzip\", \"lz4\" or \"none\"",
+                type_s);
+        return -1;
+    }
+
+    if (!file_ctx->is_regular) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "compression is only "
+                "supported for regular files");
+        return -1;
+    }
+
+    /* -1 is the library's default */
+    int level = -1;
+    const char *level_s = ConfNodeLookupChildValue(conf, "compression-level");
+    if (level_s != NULL) {
+        uint32_t l;
+        if (ByteExtractStringUint32(&l, 10, 0, level_s) <= 0 || l > 16) {
+            SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid "
+                    "compression-level \"%s\"", level_s);
+            return -1;
+        }
+        level = (int)l;
+    }
+
+    LogFileCompressCtx *cctx = SCMalloc(sizeof(LogFileCompressCtx));
+    if (unlikely(cctx == NULL))
+        return -1;
+    memset(cctx, 0, sizeof(LogFileCompressCtx));
+    cctx->type = type;
+
+    switch (type) {
+#ifdef HAVE_LIBZ
+        case LOGFILE_COMPRESS_GZIP:
+            if (level > 9)
+                level = 9;
+            /* 15 + 16: max window, gzip instead of zlib framing */
+            if (deflateInit2(&cctx->zs, level < 0 ? Z_DEFAULT_COMPRESSION : level,
+                        Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                SCFree(cctx);
+                return -1;
+            }
+            cctx->out_size = LOGFILE_COMPRESS_GZIP_OUT_SIZE;
+            break;
+#endif
+#ifdef HAVE_LIBLZ4
+        case LOGFILE_COMPRESS_LZ4:
+            if (LZ4F_isError(LZ4F_createCompressionContext(&cctx->lz4, LZ4F_VERSION))) {
+                SCFree(cctx);
+                return -1;
+            }
+            cctx->lz4_prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+            cctx->lz4_prefs.compressionLevel = level < 0 ? 0 : level;
+            /* room for the output of a chunk plus the buffered data
+             * flushed with it, also fits the frame header */
+            cctx->out_size = LZ4F_compressBound(LOGFILE_COMPRESS_LZ4_CHUNK,
+                    &cctx->lz4_prefs);
+            break;
+#endif
+    }
+
+    cctx->out = SCMalloc(cctx->out_size);
+    if (unlikely(cctx->out == NULL)) {
+        file_ctx->compress = cctx;
+        LogFileCompressFree(file_ctx);
+        return -1;
+    }
+    cctx->last_sync = time(NULL);
+    cctx->file_ctx = file_ctx;
+
+    file_ctx->compress = cctx;
+    file_ctx->Write = LogFileCompressWrite;
+
+    SCMutexLock(&compress_list_lock);
+    TAILQ_INSERT_TAIL(&compress_list, cctx, next);
+    SCMutexUnlock(&compress_list_lock);
+
+    SCLogInfo("%s compressed output for \"%s\"", type_s,
+            file_ctx->filename ? file_ctx->filename : "(null)");
+    return 1;
+}
+
+/**
+ *  \brief Finish the stream and free the compression part of a
+ *         LogFileCtx. Called before the file is closed.
+ */
+void LogFileCompressFree(LogFileCtx *file_ctx)
+{
+    LogFileCompressCtx *cctx = file_ctx->compress;
+    if (cctx == NULL)
+        return;
+
+    if (cctx->file_ctx != NULL) {
+        SCMutexLock(&compress_list_lock);
+        TAILQ_REMOVE(&compress_list, cctx, next);
+        SCMutexUnlock(&compress_list_lock);
+    }
+
+    if (cctx->out != NULL) {
+        LogFileCompressFinish(file_ctx);
+        if (cctx->bytes_in > 0) {
+            SCLogInfo("compressed output for \"%s\": %"PRIu64" bytes "
+                    "written as %"PRIu64, file_ctx->filename ?
+                    file_ctx->filename : "(null)", cctx->bytes_in,
+                    cctx->bytes_out);
+        }
+        SCFree(cctx->out);
+    }
+
+    switch (cctx->type) {
+#ifdef HAVE_LIBZ
+        case LOGFILE_COMPRESS_GZIP:
+            deflateEnd(&cctx->zs);
+            break;
+#endif
+#ifdef HAVE_LIBLZ4
+        case LOGFILE_COMPRESS_LZ4:
+            LZ4F_freeCompressionContext(cctx->lz4);
+            break;
+#endif
+    }
+
+    SCFree(cctx);
+    file_ctx->compress = NULL;
+}
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+#ifdef HAVE_LIBZ
+/**
+ *  \test gzip: records written through the Write callback around a
+ *        sync flush decompress to the input once the stream is finished.
+ */
+static int LogFileCompressTest01(void)
+{
+    int result = 0;
+    uint8_t in[4096];
+    char out[128];
+    LogFileCtx *file_ctx = NULL;
+    ConfNode *conf = NULL;
+    int zinit = 0;
+    z_stream zs;
+
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    file_ctx->fp = tmpfile();
+    if (file_ctx->fp == NULL)
+        goto end;
+    file_ctx->is_regular = 1;
+
+    conf = ConfNodeNew();
+    if (conf == NULL)
+        goto end;
+    ConfNode *node = ConfNodeNew();
+    node->name = SCStrdup("compression");
+    node->val = SCStrdup("gzip");
+    TAILQ_INSERT_TAIL(&conf->head, node, next);
+
+    if (LogFileCompressSetup(conf, file_ctx) != 1)
+        goto end;
+
+    /* nothing is written before the first record */
+    LogFileCompressFinish(file_ctx);
+    if (ftell(file_ctx->fp) != 0)
+        goto end;
+
+    if (file_ctx->Write("abcdef\n", 7, file_ctx) != 1)
+        goto end;
+    LogFileCompressSync(file_ctx, 1);
+    if (file_ctx->Write("ghijkl\n", 7, file_ctx) != 1)
+        goto end;
+    LogFileCompressFinish(file_ctx);
+
+    rewind(file_ctx->fp);
+    size_t in_len = fread(in, 1, sizeof(in), file_ctx->fp);
+    if (in_len == 0)
+        goto end;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        goto end;
+    zinit = 1;
+    memset(out, 0, sizeof(out));
+    zs.next_in = in;
+    zs.avail_in = in_len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = sizeof(out) - 1;
+    if (inflate(&zs, Z_FINISH) != Z_STREAM_END)
+        goto end;
+    if (strcmp(out, "abcdef\nghijkl\n") != 0) {
+        printf("unexpected output \"%s\": ", out);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (zinit)
+        inflateEnd(&zs);
+    if (conf != NULL)
+        ConfNodeFree(conf);
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    return result;
+}
+
+/**
+ *  \test gzip: a record that isn't followed by others is flushed by
+ *        LogFileCompressSyncAll() once the sync interval has passed.
+ */
+static int LogFileCompressTest02(void)
+{
+    int result = 0;
+    uint8_t in[4096];
+    char out[128];
+    LogFileCtx *file_ctx = NULL;
+    ConfNode *conf = NULL;
+    int zinit = 0;
+    z_stream zs;
+
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    file_ctx->fp = tmpfile();
+    if (file_ctx->fp == NULL)
+        goto end;
+    file_ctx->is_regular = 1;
+
+    conf = ConfNodeNew();
+    if (conf == NULL)
+        goto end;
+    ConfNode *node = ConfNodeNew();
+    node->name = SCStrdup("compression");
+    node->val = SCStrdup("gzip");
+    TAILQ_INSERT_TAIL(&conf->head, node, next);
+
+    if (LogFileCompressSetup(conf, file_ctx) != 1)
+        goto end;
+
+    if (file_ctx->Write("abcdef\n", 7, file_ctx) != 1)
+        goto end;
+
+    /* within the interval: nothing to flush yet */
+    LogFileCompressSyncAll();
+    if (!file_ctx->compress->dirty) {
+        printf("flushed within the sync interval: ");
+        goto end;
+    }
+
+    file_ctx->compress->last_sync -= LOGFILE_COMPRESS_SYNC_INTERVAL;
+    LogFileCompressSyncAll();
+    if (file_ctx->compress->dirty) {
+        printf("not flushed: ");
+        goto end;
+    }
+
+    rewind(file_ctx->fp);
+    size_t in_len = fread(in, 1, sizeof(in), file_ctx->fp);
+    if (in_len == 0)
+        goto end;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        goto end;
+    zinit = 1;
+    memset(out, 0, sizeof(out));
+    zs.next_in = in;
+    zs.avail_in = in_len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = sizeof(out) - 1;
+    if (inflate(&zs, Z_SYNC_FLUSH) != Z_OK)
+        goto end;
+    if (strcmp(out, "abcdef\n") != 0) {
+        printf("unexpected output \"%s\": ", out);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (zinit)
+        inflateEnd(&zs);
+    if (conf != NULL)
+        ConfNodeFree(conf);
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    return result;
+}
+#endif /* HAVE_LIBZ */
+
+#endif /* UNITTESTS */
+
+void LogFileCompressRegisterTests(void)
+{
+#ifdef UNITTESTS
+#ifdef HAVE_LIBZ
+    UtRegisterTest("LogFileCompressTest01", LogFileCompressTest01, 1);
+    UtRegisterTest("LogFileCompressTest02", LogFileCompressTest02, 1);
+#endif
+#endif /* UNITTESTS */
+}
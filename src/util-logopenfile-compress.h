@@ -0,0 +1,38 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Compressed LogFileCtx output: gzip or lz4 frame streams.
+ */
+
+#ifndef __UTIL_LOGOPENFILE_COMPRESS_H__
+#define __UTIL_LOGOPENFILE_COMPRESS_H__
+
+#include "util-logopenfile.h"
+
+int LogFileCompressSetup(ConfNode *conf, LogFileCtx *file_ctx);
+int LogFileCompressAppend(LogFileCtx *file_ctx, const char *buffer, size_t len);
+void LogFileCompressSync(LogFileCtx *file_ctx, int force);
+void LogFileCompressFinish(LogFileCtx *file_ctx);
+void LogFileCompressSyncAll(void);
+void LogFileCompressFree(LogFileCtx *file_ctx);
+
+void LogFileCompressRegisterTests(void);
+
+#endif /* __UTIL_LOGOPENFILE_COMPRESS_H__ */
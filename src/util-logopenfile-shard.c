@@ -0,0 +1,462 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sharded LogFileCtx output.
+ *
+ * With "shards: thread" each thread that logs gets its own file
+ * <filename>.<n>, opened on its first record, so no two threads ever
+ * write to the same file. With "shards: <N>" the N files are opened
+ * at startup and the caller picks one by hash, e.g. of the flow, so
+ * that all records of a flow end up in the same file.
+ *
+ * Rotation is requested on the parent LogFileCtx. It's passed on to
+ * the shards through a generation counter, so every shard reopens its
+ * file once, on its next record.
+ */
+
+#include "suricata-common.h"
+#include "threads.h"
+#include "conf.h"
+#include "output.h"
+#include "util-atomic.h"
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-hash-lookup3.h"
+#include "util-unittest.h"
+
+#include "util-logopenfile.h"
+#include "util-logopenfile-async.h"
+#include "util-logopenfile-compress.h"
+#include "util-logopenfile-shard.h"
+
+/** upper limit for "shards: <N>" */
+#define LOGFILE_SHARD_MAX   1024
+
+enum {
+    LOGFILE_SHARD_BY_THREAD,
+    LOGFILE_SHARD_BY_HASH,
+};
+
+typedef struct LogFileShard_ {
+    LogFileCtx *file_ctx;
+    /** last rotation generation passed on to file_ctx */
+    uint32_t rotation_gen;
+    struct LogFileShard_ *next;
+} LogFileShard;
+
+typedef struct LogFileShardCtx_ {
+    int mode;
+
+    /** output config, used to set up async output for the shards */
+    ConfNode *conf;
+    const char *append;
+
+    /** BY_THREAD: lookup of the shard of the calling thread */
+    pthread_key_t shard_key;
+
+    /** protects the shard list and shard_cnt */
+    SCMutex shards_lock;
+    LogFileShard *shards;
+    uint32_t shard_cnt;
+
+    /** BY_HASH: shard_cnt shards indexed by hash */
+    LogFileShard **table;
+
+    /** incremented for each rotation request on the parent */
+    SC_ATOMIC_DECLARE(uint32_t, rotation_gen);
+} LogFileShardCtx;
+
+/** stored as the thread's shard if opening its file failed, so we
+ *  don't retry (and log an error) for each record */
+static LogFileShard shard_failed;
+
+/**
+ *  \brief open shard number idx of a sharded LogFileCtx
+ *
+ *  \retval shard or NULL on error
+ */
+static LogFileShard *LogFileShardOpen(LogFileShardCtx *sctx,
+        const LogFileCtx *parent, uint32_t idx)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s.%"PRIu32, parent->filename, idx);
+
+    LogFileShard *shard = SCMalloc(sizeof(LogFileShard));
+    if (unlikely(shard == NULL))
+        return NULL;
+    memset(shard, 0, sizeof(LogFileShard));
+
+    shard->file_ctx = LogFileNewCtx();
+    if (unlikely(shard->file_ctx == NULL)) {
+        SCFree(shard);
+        return NULL;
+    }
+
+    if (LogFileOpenRegular(shard->file_ctx, path, sctx->append) < 0 ||
+            LogFileCompressSetup(sctx->conf, shard->file_ctx) < 0 ||
+            LogFileAsyncSetup(sctx->conf, shard->file_ctx) < 0) {
+        LogFileFreeCtx(shard->file_ctx);
+        SCFree(shard);
+        return NULL;
+    }
+    shard->rotation_gen = SC_ATOMIC_GET(sctx->rotation_gen);
+
+    SCMutexLock(&sctx->shards_lock);
+    shard->next = sctx->shards;
+    sctx->shards = shard;
+    SCMutexUnlock(&sctx->shards_lock);
+
+    SCLogInfo("opened log file shard \"%s\"", path);
+    return shard;
+}
+
+/** \brief open the file of a new BY_THREAD shard for the calling thread */
+static LogFileShard *LogFileShardOpenForThread(LogFileShardCtx *sctx,
+        const LogFileCtx *parent)
+{
+    SCMutexLock(&sctx->shards_lock);
+    uint32_t idx = sctx->shard_cnt++;
+    SCMutexUnlock(&sctx->shards_lock);
+
+    LogFileShard *shard = LogFileShardOpen(sctx, parent, idx);
+    pthread_setspecific(sctx->shard_key,
+            shard != NULL ? shard : &shard_failed);
+    return shard;
+}
+
+/**
+ *  \brief get the LogFileCtx a record should be written to
+ *
+ *  \param file_ctx the output's LogFileCtx
+ *  \param hash used to select the shard with "shards: <N>", records
+ *              with the same hash go to the same file
+ *
+ *  \retval file_ctx of the shard, file_ctx itself if the output isn't
+ *          sharded, NULL if the shard couldn't be opened
+ */
+LogFileCtx *LogFileShardGet(LogFileCtx *file_ctx, uint32_t hash)
+{
+    LogFileShardCtx *sctx = file_ctx->shard;
+    if (sctx == NULL)
+        return file_ctx;
+
+    /* the rotation flag is registered for the parent, pass it on to
+     * all shards. Several threads may see it set at the same time, only
+     * the one that clears it bumps the generation. */
+    if (unlikely(file_ctx->rotation_flag)) {
+        if (SCAtomicCompareAndSwap(&file_ctx->rotation_flag, 1, 0))
+            (void) SC_ATOMIC_ADD(sctx->rotation_gen, 1);
+    }
+
+    LogFileShard *shard;
+    if (sctx->mode == LOGFILE_SHARD_BY_HASH) {
+        shard = sctx->table[hash % sctx->shard_cnt];
+    } else {
+        shard = pthread_getspecific(sctx->shard_key);
+        if (unlikely(shard == NULL)) {
+            shard = LogFileShardOpenForThread(sctx, file_ctx);
+            if (shard == NULL)
+                return NULL;
+        } else if (unlikely(shard == &shard_failed)) {
+            return NULL;
+        }
+    }
+
+    uint32_t gen = SC_ATOMIC_GET(sctx->rotation_gen);
+    if (unlikely(shard->rotation_gen != gen)) {
+        shard->rotation_gen = gen;
+        shard->file_ctx->rotation_flag = 1;
+    }
+    return shard->file_ctx;
+}
+
+/**
+ *  \brief shard hash of a pointer, e.g. of the flow a record belongs to,
+ *         so all records of the flow go to the same file
+ */
+uint32_t LogFileShardHashPtr(const void *ptr)
+{
+    uintptr_t addr = (uintptr_t)ptr;
+    return hashword((const uint32_t *)&addr, sizeof(addr) / sizeof(uint32_t), 0);
+}
+
+/**
+ *  \brief Setup sharded output for a LogFileCtx if configured
+ *
+ *  Reads "shards" from the output's config node: "thread" for a file
+ *  per logging thread, or the number of files to hash records over.
+ *  The LogFileCtx needs to be opened as a regular file already. Its
+ *  own file isn't used after this and is removed if it's still empty.
+ *  Compression and async output are set up for each shard instead.
+ *
+ *  \retval 1 sharded output enabled
+ *  \retval 0 sharded output not configured
+ *  \retval -1 error
+ */
+int LogFileShardSetup(ConfNode *conf, LogFileCtx *file_ctx)
+{
+    if (conf == NULL || file_ctx == NULL)
+        return 0;
+
+    const char *shards_s = ConfNodeLookupChildValue(conf, "shards");
+    if (shards_s == NULL)
+        return 0;
+
+    if (!file_ctx->is_regular || file_ctx->filename == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "\"shards\" is only supported "
+                "for regular files");
+        return -1;
+    }
+
+    int mode = LOGFILE_SHARD_BY_THREAD;
+    uint32_t shard_cnt = 0;
+    if (strcasecmp(shards_s, "thread") != 0) {
+        if (ByteExtractStringUint32(&shard_cnt, 10, 0, shards_s) <= 0 ||
+                shard_cnt == 0 || shard_cnt > LOGFILE_SHARD_MAX) {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "invalid shards setting "
+                    "\"%s\": expected \"thread\" or a number from 1 to %d",
+                    shards_s, LOGFILE_SHARD_MAX);
+            return -1;
+        }
+        mode = LOGFILE_SHARD_BY_HASH;
+    }
+
+    const char *append = ConfNodeLookupChildValue(conf, "append");
+    if (append == NULL)
+        append = DEFAULT_LOG_MODE_APPEND;
+
+    LogFileShardCtx *sctx = SCMalloc(sizeof(LogFileShardCtx));
+    if (unlikely(sctx == NULL))
+        return -1;
+    memset(sctx, 0, sizeof(LogFileShardCtx));
+
+    if (pthread_key_create(&sctx->shard_key, NULL) != 0) {
+        SCFree(sctx);
+        return -1;
+    }
+    SCMutexInit(&sctx->shards_lock, NULL);
+    SC_ATOMIC_INIT(sctx->rotation_gen);
+    sctx->mode = mode;
+    sctx->conf = conf;
+    sctx->append = append;
+    file_ctx->shard = sctx;
+
+    if (mode == LOGFILE_SHARD_BY_HASH) {
+        sctx->table = SCMalloc(shard_cnt * sizeof(LogFileShard *));
+        if (unlikely(sctx->table == NULL)) {
+            LogFileShardFree(file_ctx);
+            return -1;
+        }
+
+        uint32_t i;
+        for (i = 0; i < shard_cnt; i++) {
+            sctx->table[i] = LogFileShardOpen(sctx, file_ctx, i);
+            if (sctx->table[i] == NULL) {
+                LogFileShardFree(file_ctx);
+                return -1;
+            }
+        }
+        sctx->shard_cnt = shard_cnt;
+    }
+
+    /* nothing was compressed yet, so this doesn't write anything */
+    LogFileCompressFree(file_ctx);
+    if (file_ctx->fp != NULL) {
+        long pos = ftell(file_ctx->fp);
+        fclose(file_ctx->fp);
+        file_ctx->fp = NULL;
+        if (pos == 0)
+            (void) unlink(file_ctx->filename);
+    }
+
+    if (mode == LOGFILE_SHARD_BY_HASH) {
+        SCLogInfo("output \"%s\" sharded over %"PRIu32" files",
+                file_ctx->filename, shard_cnt);
+    } else {
+        SCLogInfo("output \"%s\" sharded per thread", file_ctx->filename);
+    }
+    return 1;
+}
+
+/** \brief close the shards and free the sharding part of a LogFileCtx */
+void LogFileShardFree(LogFileCtx *file_ctx)
+{
+    LogFileShardCtx *sctx = file_ctx->shard;
+    if (sctx == NULL)
+        return;
+
+    LogFileShard *shard = sctx->shards;
+    while (shard != NULL) {
+        LogFileShard *next = shard->next;
+        LogFileFreeCtx(shard->file_ctx);
+        SCFree(shard);
+        shard = next;
+    }
+
+    if (sctx->table != NULL)
+        SCFree(sctx->table);
+
+    pthread_key_delete(sctx->shard_key);
+    SCMutexDestroy(&sctx->shards_lock);
+    SC_ATOMIC_DESTROY(sctx->rotation_gen);
+    SCFree(sctx);
+
+    file_ctx->shard = NULL;
+}
+
+/*------------------------------Unittests-------------------------------------*/
+
+#ifdef UNITTESTS
+
+static ConfNode *LogFileShardTestConf(const char *shards)
+{
+    ConfNode *conf = ConfNodeNew();
+    if (conf == NULL)
+        return NULL;
+    ConfNode *node = ConfNodeNew();
+    if (node == NULL) {
+        ConfNodeFree(conf);
+        return NULL;
+    }
+    node->name = SCStrdup("shards");
+    node->val = SCStrdup(shards);
+    TAILQ_INSERT_TAIL(&conf->head, node, next);
+    return conf;
+}
+
+/**
+ *  \test "shards: 2": records are spread by hash, the unused parent
+ *        file is removed and rotation reaches every shard.
+ */
+static int LogFileShardTest01(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/suricata-shard-XXXXXX";
+    char path[PATH_MAX];
+    LogFileCtx *file_ctx = NULL;
+    ConfNode *conf = NULL;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    snprintf(path, sizeof(path), "%s/eve.json", dir);
+
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    if (LogFileOpenRegular(file_ctx, path, "no") < 0)
+        goto end;
+    conf = LogFileShardTestConf("2");
+    if (conf == NULL)
+        goto end;
+
+    if (LogFileShardSetup(conf, file_ctx) != 1)
+        goto end;
+    if (file_ctx->fp != NULL || access(path, F_OK) == 0)
+        goto end;
+
+    LogFileCtx *s0 = LogFileShardGet(file_ctx, 0);
+    LogFileCtx *s1 = LogFileShardGet(file_ctx, 1);
+    if (s0 == NULL || s1 == NULL || s0 == s1)
+        goto end;
+    if (LogFileShardGet(file_ctx, 2) != s0)
+        goto end;
+    snprintf(path, sizeof(path), "%s/eve.json.1", dir);
+    if (strcmp(s1->filename, path) != 0)
+        goto end;
+
+    file_ctx->rotation_flag = 1;
+    if (LogFileShardGet(file_ctx, 0) != s0 || !s0->rotation_flag)
+        goto end;
+    if (file_ctx->rotation_flag || s1->rotation_flag)
+        goto end;
+    if (LogFileShardGet(file_ctx, 1) != s1 || !s1->rotation_flag)
+        goto end;
+
+    result = 1;
+end:
+    if (conf != NULL)
+        ConfNodeFree(conf);
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    snprintf(path, sizeof(path), "%s/eve.json.0", dir);
+    (void) unlink(path);
+    snprintf(path, sizeof(path), "%s/eve.json.1", dir);
+    (void) unlink(path);
+    (void) rmdir(dir);
+    return result;
+}
+
+/**
+ *  \test "shards: thread": a thread keeps getting the shard that was
+ *        opened for it on its first record.
+ */
+static int LogFileShardTest02(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/suricata-shard-XXXXXX";
+    char path[PATH_MAX];
+    LogFileCtx *file_ctx = NULL;
+    ConfNode *conf = NULL;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    snprintf(path, sizeof(path), "%s/eve.json", dir);
+
+    file_ctx = LogFileNewCtx();
+    if (file_ctx == NULL)
+        goto end;
+    if (LogFileOpenRegular(file_ctx, path, "no") < 0)
+        goto end;
+    conf = LogFileShardTestConf("thread");
+    if (conf == NULL)
+        goto end;
+
+    if (LogFileShardSetup(conf, file_ctx) != 1)
+        goto end;
+
+    LogFileCtx *s = LogFileShardGet(file_ctx, 0);
+    if (s == NULL || LogFileShardGet(file_ctx, 1) != s)
+        goto end;
+    snprintf(path, sizeof(path), "%s/eve.json.0", dir);
+    if (strcmp(s->filename, path) != 0 || access(path, F_OK) != 0)
+        goto end;
+
+    result = 1;
+end:
+    if (conf != NULL)
+        ConfNodeFree(conf);
+    if (file_ctx != NULL)
+        LogFileFreeCtx(file_ctx);
+    snprintf(path, sizeof(path), "%s/eve.json.0", dir);
+    (void) unlink(path);
+    (void) rmdir(dir);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void LogFileShardRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("LogFileShardTest01", LogFileShardTest01, 1);
+    UtRegisterTest("LogFileShardTest02", LogFileShardTest02, 1);
+#endif /* UNITTESTS */
+}
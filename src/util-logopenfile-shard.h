@@ -0,0 +1,37 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sharded LogFileCtx output: records are spread over several files,
+ * either one per logging thread or a fixed number selected by hash.
+ */
+
+#ifndef __UTIL_LOGOPENFILE_SHARD_H__
+#define __UTIL_LOGOPENFILE_SHARD_H__
+
+#include "util-logopenfile.h"
+
+int LogFileShardSetup(ConfNode *conf, LogFileCtx *file_ctx);
+LogFileCtx *LogFileShardGet(LogFileCtx *file_ctx, uint32_t hash);
+uint32_t LogFileShardHashPtr(const void *ptr);
+void LogFileShardFree(LogFileCtx *file_ctx);
+
+void LogFileShardRegisterTests(void);
+
+#endif /* __UTIL_LOGOPENFILE_SHARD_H__ */
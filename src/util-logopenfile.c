@@ -33,6 +33,9 @@
 #include "output.h"          /* DEFAULT_LOG_* */
 #include "util-logopenfile.h"
 #include "util-logopenfile-tile.h"
+#include "util-logopenfile-async.h"
+#include "util-logopenfile-shard.h"
+#include "util-logopenfile-compress.h"
 
 /** \brief connect to the indicated local stream socket, logging any errors
  *  \param path filesystem path to connect to
@@ -138,6 +141,29 @@ static PcieFile *SCLogOpenPcieFp(LogFileCtx *log_ctx, const char *path,
 #endif
 }
 
+/** \brief open a regular file for a LogFileCtx
+ *  \param log_ctx Log file context allocated by caller
+ *  \param path filesystem path to open
+ *  \param append_setting open file with O_APPEND: "yes" or "no"
+ *  \retval 0 on success
+ *  \retval -1 on error
+ */
+int LogFileOpenRegular(LogFileCtx *log_ctx, const char *path,
+                       const char *append_setting)
+{
+    log_ctx->fp = SCLogOpenFileFp(path, append_setting);
+    if (log_ctx->fp == NULL)
+        return -1; // Error already logged by Open...Fp routine
+    log_ctx->is_regular = 1;
+    log_ctx->filename = SCStrdup(path);
+    if (unlikely(log_ctx->filename == NULL)) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Failed to allocate memory for "
+            "filename");
+        return -1;
+    }
+    return 0;
+}
+
 /** \brief open a generic output "log file", which may be a regular file or a socket
  *  \param conf ConfNode structure for the output section in question
  *  \param log_ctx Log file context allocated by caller
@@ -201,16 +227,8 @@ SCConfLogOpenGeneric(ConfNode *conf,
             return -1; // Error already logged by Open...Fp routine
     } else if (strcasecmp(filetype, DEFAULT_LOG_FILETYPE) == 0 ||
                strcasecmp(filetype, "file") == 0) {
-        log_ctx->fp = SCLogOpenFileFp(log_path, append);
-        if (log_ctx->fp == NULL)
-            return -1; // Error already logged by Open...Fp routine
-        log_ctx->is_regular = 1;
-        log_ctx->filename = SCStrdup(log_path);
-        if (unlikely(log_ctx->filename == NULL)) {
-            SCLogError(SC_ERR_MEM_ALLOC, "Failed to allocate memory for "
-                "filename");
+        if (LogFileOpenRegular(log_ctx, log_path, append) < 0)
             return -1;
-        }
     } else if (strcasecmp(filetype, "pcie") == 0) {
         log_ctx->pcie_fp = SCLogOpenPcieFp(log_ctx, log_path, append);
         if (log_ctx->pcie_fp == NULL)
@@ -223,6 +241,9 @@ SCConfLogOpenGeneric(ConfNode *conf,
                    conf->name);
     }
 
+    if (LogFileCompressSetup(conf, log_ctx) < 0)
+        return -1;
+
     SCLogInfo("%s output device (%s) initialized: %s", conf->name, filetype,
               filename);
 
@@ -249,6 +270,9 @@ int SCConfLogReopen(LogFileCtx *log_ctx)
         return -1;
     }
 
+    /* end the compressed stream, the new file gets a new one */
+    LogFileCompressFinish(log_ctx);
+
     fclose(log_ctx->fp);
 
     /* Reopen the file.  In this case do not append like may have been
@@ -292,6 +316,11 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
         SCReturnInt(0);
     }
 
+    /* write out what is still queued before closing the file */
+    LogFileAsyncFree(lf_ctx);
+    LogFileShardFree(lf_ctx);
+    LogFileCompressFree(lf_ctx);
+
     if (lf_ctx->fp != NULL) {
         SCMutexLock(&lf_ctx->fp_mutex);
         lf_ctx->Close(lf_ctx);
@@ -40,6 +40,9 @@ typedef struct LogFileCtx_ {
 
     int (*Write)(const char *buffer, int buffer_len, struct LogFileCtx_ *fp);
     void (*Close)(struct LogFileCtx_ *fp);
+    /** Size based rotation, called by the async writer between batches
+     *  once size_current reaches size_limit. NULL if not supported. */
+    int (*Rotate)(struct LogFileCtx_ *fp);
 
     /** It will be locked if the log/alert
      * record cannot be written to the file in one call */
@@ -59,6 +62,8 @@ typedef struct LogFileCtx_ {
 
     /* Alerts on the module (not on the file) */
     uint64_t alerts;
+    /* Alerts the module couldn't hand to the async writer */
+    uint64_t alerts_dropped;
     /* flag to avoid multiple threads printing the same stats */
     uint8_t flags;
 
@@ -68,6 +73,15 @@ typedef struct LogFileCtx_ {
 
     /* Flag set when file rotation notification is received. */
     int rotation_flag;
+
+    /** async output state, NULL if records are written directly */
+    struct LogFileAsyncCtx_ *async;
+
+    /** sharded output state, NULL if all records go to this file */
+    struct LogFileShardCtx_ *shard;
+
+    /** compression state, NULL if records are written uncompressed */
+    struct LogFileCompressCtx_ *compress;
 } LogFileCtx;
 
 /* flags for LogFileCtx */
@@ -79,5 +93,6 @@ int LogFileFreeCtx(LogFileCtx *);
 
 int SCConfLogOpenGeneric(ConfNode *conf, LogFileCtx *, const char *);
 int SCConfLogReopen(LogFileCtx *);
+int LogFileOpenRegular(LogFileCtx *, const char *, const char *);
 
 #endif /* __UTIL_LOGOPENFILE_H__ */